@@ -0,0 +1,538 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "image_gen.h"
+
+// Escalas que se miden si no se pasa --files
+#define BENCH_DEFAULT_SCALES "1000,10000,100000"
+
+#define BENCH_MAX_SCALES 16
+#define BENCH_MAX_BLOCK_SIZES 3
+
+// Clústeres de datos de un volumen FAT16 como máximo: cada fichero no vacío ocupa al menos uno
+#define BENCH_FAT16_MAX_CLUSTERS 65524
+
+// Lo que --cat escribe antes del contenido del fichero
+#define BENCH_CAT_HEADER "---- Cat Command ----\n\n"
+
+// Bytes que se comparan de cada vez al comprobar la salida de --cat, múltiplo de 512
+#define BENCH_CHECK_CHUNK (1024 * 1024)
+
+// Una medida: un comando sobre una imagen, en frío o en caliente
+typedef struct {
+    const ImageGenConfig *config;
+    const ImageGenResult *image;
+    const char *command;
+    const char *mode;
+    int run;
+    double wall_ms;
+    double user_ms;
+    double sys_ms;
+    int exit_status;
+} BenchRow;
+
+typedef struct {
+    const char *fsutils;
+    const char *out_dir;
+    int runs;
+    int keep;
+    FILE *csv;
+    FILE *json;
+    int json_rows;
+    const char *cold_method;    // How the page cache is dropped before a cold run
+} Bench;
+
+static void bench_usage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --fs ext2|fat16|all      File systems to measure (all)\n"
+        "  --files N[,N...]         Number of files of each image (" BENCH_DEFAULT_SCALES ")\n"
+        "  --dirs N                 Directories per image, the root included (files / 10)\n"
+        "  --depth N                Maximum depth of the tree (4)\n"
+        "  --fanout N               Subdirectories per directory (8)\n"
+        "  --min-size N             Smallest file in bytes (0)\n"
+        "  --max-size N             Largest file in bytes (4096)\n"
+        "  --frag P                 Probability of a gap after each block, 0..1 (0)\n"
+        "  --block-size N|all       EXT2 block size: 1024, 2048, 4096 (1024)\n"
+        "  --volume-size N[K|M|G|T] Minimum EXT2 volume size, the files go to its end (0)\n"
+        "  --seed N                 Seed of the generator (1)\n"
+        "  --runs N                 Runs of each command and mode (3)\n"
+        "  --fsutils PATH           Binary to measure (../fsutils)\n"
+        "  --out-dir DIR            Where the images are written (/tmp)\n"
+        "  --keep                   Keep the images after measuring them\n"
+        "  --csv FILE               Write the results as CSV\n"
+        "  --json FILE              Write the results as JSON\n"
+        "  --generate IMAGE         Only write one image with the options above\n",
+        program);
+}
+
+static double bench_ms(const struct timeval *time) {
+    return time->tv_sec * 1000.0 + time->tv_usec / 1000.0;
+}
+
+/**
+ * @brief Drops the pages of the image from the page cache.
+ *
+ * Dropping every cache needs root; otherwise the pages of the image are released
+ * with posix_fadvise, which is enough because nothing else of the image is cached.
+ *
+ * @return Name of the method used.
+*/
+static const char *bench_drop_cache(const char *path) {
+    const char *method = "fadvise";
+
+    sync();
+    int proc = open("/proc/sys/vm/drop_caches", O_WRONLY);
+    if (proc != -1) {
+        if (write(proc, "3", 1) == 1) method = "drop_caches";
+        close(proc);
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd != -1) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    } else if (strcmp(method, "drop_caches") != 0) {
+        method = "none";
+    }
+
+    // The sidecar index is part of what --cat reads
+    char sidecar[IMAGE_GEN_PATH_MAX + 16];
+    snprintf(sidecar, sizeof(sidecar), "%s.fsidx", path);
+    fd = open(sidecar, O_RDONLY);
+    if (fd != -1) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+    return method;
+}
+
+/**
+ * @brief Runs fsutils once with its output discarded and measures it.
+ *
+ * @return 0 if the process could be run, -1 otherwise.
+*/
+static int bench_run(const Bench *bench, char *const argv[], BenchRow *row) {
+    struct timespec start, end;
+    struct rusage usage;
+    int status;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("Error creating the process");
+        return -1;
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null != -1) {
+            dup2(null, STDOUT_FILENO);
+            close(null);
+        }
+        execv(bench->fsutils, argv);
+        perror("Error running fsutils");
+        _exit(127);
+    }
+
+    while (wait4(pid, &status, 0, &usage) == -1) {
+        if (errno != EINTR) {
+            perror("Error waiting for fsutils");
+            return -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    row->wall_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    row->user_ms = bench_ms(&usage.ru_utime);
+    row->sys_ms = bench_ms(&usage.ru_stime);
+    row->exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return 0;
+}
+
+// Lee hasta llenar el buffer o hasta el final de la salida
+static size_t bench_read_full(int fd, uint8_t *buffer, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = read(fd, buffer + done, length - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    return done;
+}
+
+/**
+ * @brief Checks that --cat writes the contents the generator wrote in the last file.
+ *
+ * The output is compared as it arrives, so a file of several GiB does not need that
+ * much memory. A wrong byte means some offset of the reader was cut.
+ *
+ * @return 0 if the output matches, -1 otherwise.
+*/
+static int bench_check_cat(const Bench *bench, const ImageGenConfig *config, const ImageGenResult *image, const char *path) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        perror("Error creating a pipe");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("Error creating the process");
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        execl(bench->fsutils, "fsutils", "--cat", path, image->cat_name, (char *)NULL);
+        perror("Error running fsutils");
+        _exit(127);
+    }
+    close(pipe_fds[1]);
+
+    uint8_t *output = malloc(BENCH_CHECK_CHUNK);
+    uint8_t *expected = malloc(BENCH_CHECK_CHUNK);
+    char header[sizeof(BENCH_CAT_HEADER) - 1];
+    uint64_t offset = 0;
+    int result = 0;
+
+    if (output == NULL || expected == NULL) {
+        fprintf(stderr, "Out of memory checking --cat\n");
+        result = -1;
+    } else if (bench_read_full(pipe_fds[0], (uint8_t *)header, sizeof(header)) != sizeof(header) ||
+               memcmp(header, BENCH_CAT_HEADER, sizeof(header)) != 0) {
+        fprintf(stderr, "--cat %s did not print the file\n", image->cat_name);
+        result = -1;
+    }
+
+    while (result == 0) {
+        size_t length = bench_read_full(pipe_fds[0], output, BENCH_CHECK_CHUNK);
+        uint64_t left = image->cat_size - offset;
+        size_t wanted = left < BENCH_CHECK_CHUNK ? left : BENCH_CHECK_CHUNK;
+
+        image_gen_contents(config, image->cat_file, offset, expected, wanted);
+        if (length != wanted || memcmp(output, expected, length) != 0) {
+            size_t at = 0;
+            while (at < length && at < wanted && output[at] == expected[at]) at++;
+            fprintf(stderr, "--cat %s differs from the generated file at byte %llu of %llu\n", image->cat_name,
+                    (unsigned long long)(offset + at), (unsigned long long)image->cat_size);
+            result = -1;
+        }
+        offset += length;
+        if (length < BENCH_CHECK_CHUNK) break;
+    }
+
+    // Whatever is left is drained so the child can exit
+    while (result != 0 && output != NULL && bench_read_full(pipe_fds[0], output, BENCH_CHECK_CHUNK) > 0) {
+    }
+    close(pipe_fds[0]);
+    free(output);
+    free(expected);
+
+    int status;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+    }
+    return result;
+}
+
+static const char *bench_fs_name(int fs) {
+    return fs == IMAGE_GEN_EXT2 ? "ext2" : "fat16";
+}
+
+static void bench_emit(Bench *bench, const BenchRow *row) {
+    const ImageGenConfig *config = row->config;
+    uint32_t block_size = config->fs == IMAGE_GEN_EXT2 ? config->block_size : 0;
+
+    if (bench->csv != NULL) {
+        fprintf(bench->csv, "%s,%u,%u,%u,%u,%u,%.3f,%llu,%s,%s,%d,%.3f,%.3f,%.3f,%d\n",
+                bench_fs_name(config->fs), block_size, row->image->files, row->image->dirs, config->depth, config->fanout,
+                config->fragmentation, (unsigned long long)row->image->image_bytes, row->command, row->mode, row->run,
+                row->wall_ms, row->user_ms, row->sys_ms, row->exit_status);
+        fflush(bench->csv);
+    }
+    if (bench->json != NULL) {
+        fprintf(bench->json, "%s\n    {\"fs\": \"%s\", \"block_size\": %u, \"files\": %u, \"dirs\": %u, \"depth\": %u, "
+                "\"fanout\": %u, \"frag\": %.3f, \"image_bytes\": %llu, \"command\": \"%s\", \"mode\": \"%s\", "
+                "\"run\": %d, \"wall_ms\": %.3f, \"user_ms\": %.3f, \"sys_ms\": %.3f, \"exit_status\": %d}",
+                bench->json_rows++ ? "," : "", bench_fs_name(config->fs), block_size, row->image->files, row->image->dirs,
+                config->depth, config->fanout, config->fragmentation, (unsigned long long)row->image->image_bytes,
+                row->command, row->mode, row->run, row->wall_ms, row->user_ms, row->sys_ms, row->exit_status);
+    }
+
+    printf("%-5s %5u %8u %-12s %-4s %2d %10.3f ms  user %9.3f  sys %9.3f%s\n",
+           bench_fs_name(config->fs), block_size, row->image->files, row->command, row->mode, row->run,
+           row->wall_ms, row->user_ms, row->sys_ms, row->exit_status ? "  FAILED" : "");
+    fflush(stdout);
+}
+
+/**
+ * @brief Generates one image and times every command on it, cold and warm.
+ *
+ * The warm runs follow a run that is not recorded, so the image is in the page cache.
+ * --cat looks for the last file created, first by walking the tree and then with the
+ * index written by --build-index.
+*/
+static int bench_image(Bench *bench, const ImageGenConfig *config) {
+    char path[IMAGE_GEN_PATH_MAX];
+    char sidecar[IMAGE_GEN_PATH_MAX + 16];
+    ImageGenResult image;
+    struct timespec start, end;
+
+    snprintf(path, sizeof(path), "%s/fsbench-%s-%u-%u.img", bench->out_dir, bench_fs_name(config->fs),
+             config->fs == IMAGE_GEN_EXT2 ? config->block_size : 512, config->files);
+    snprintf(sidecar, sizeof(sidecar), "%s.fsidx", path);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (image_gen_write(config, path, &image) != 0) {
+        unlink(path);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    unlink(sidecar); // An index from an older image would be stale anyway
+    fprintf(stderr, "Generated %s: %u files, %u directories, %llu bytes in %.1f s\n", path, image.files, image.dirs,
+            (unsigned long long)image.image_bytes, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    if (image.files > 0 && bench_check_cat(bench, config, &image, path) != 0) {
+        if (!bench->keep) unlink(path);
+        return -1;
+    }
+
+    const char *name = image.files > 0 ? image.cat_name : "missing";
+    struct {
+        const char *label;
+        char *argv[5];
+    } commands[] = {
+        { "info",        { "fsutils", "--info", path, NULL, NULL } },
+        { "tree",        { "fsutils", "--tree", path, NULL, NULL } },
+        { "cat",         { "fsutils", "--cat", path, (char *)name, NULL } },
+        { "build-index", { "fsutils", "--build-index", path, NULL, NULL } },
+        { "cat-index",   { "fsutils", "--cat", path, (char *)name, NULL } },
+    };
+
+    int result = 0;
+    for (size_t c = 0; c < sizeof(commands) / sizeof(commands[0]); c++) {
+        BenchRow row = { config, &image, commands[c].label, NULL, 0, 0, 0, 0, 0 };
+
+        for (int run = 1; run <= bench->runs; run++) {
+            row.mode = "cold";
+            row.run = run;
+            bench->cold_method = bench_drop_cache(path);
+            if (bench_run(bench, commands[c].argv, &row) != 0) return -1;
+            bench_emit(bench, &row);
+            result |= row.exit_status;
+        }
+
+        row.mode = "warm";
+        if (bench_run(bench, commands[c].argv, &row) != 0) return -1;
+        for (int run = 1; run <= bench->runs; run++) {
+            row.run = run;
+            if (bench_run(bench, commands[c].argv, &row) != 0) return -1;
+            bench_emit(bench, &row);
+            result |= row.exit_status;
+        }
+    }
+
+    if (!bench->keep) {
+        unlink(path);
+        unlink(sidecar);
+    }
+    return result != 0 ? -1 : 0;
+}
+
+// Tamaño con un sufijo opcional K, M, G o T (potencias de 1024)
+static int bench_parse_size(const char *text, uint64_t *size) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    int shift = 0;
+
+    if (end == text) return -1;
+    switch (*end) {
+        case 'K': case 'k': shift = 10; end++; break;
+        case 'M': case 'm': shift = 20; end++; break;
+        case 'G': case 'g': shift = 30; end++; break;
+        case 'T': case 't': shift = 40; end++; break;
+    }
+    if (*end != '\0' || value > (UINT64_MAX >> shift)) return -1;
+    *size = (uint64_t)value << shift;
+    return 0;
+}
+
+static int bench_parse_list(const char *text, uint32_t *values, int max) {
+    int count = 0;
+    char *end;
+
+    while (*text != '\0' && count < max) {
+        unsigned long value = strtoul(text, &end, 10);
+        if (end == text || value > 9999999) return -1;
+        values[count++] = value;
+        text = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') return -1;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    ImageGenConfig config;
+    Bench bench;
+    uint32_t scales[BENCH_MAX_SCALES];
+    uint32_t block_sizes[BENCH_MAX_BLOCK_SIZES] = { 1024 };
+    int scale_count = bench_parse_list(BENCH_DEFAULT_SCALES, scales, BENCH_MAX_SCALES);
+    int block_size_count = 1;
+    int fs_mask = 3;
+    long dirs = -1;
+    const char *csv_path = NULL, *json_path = NULL, *generate = NULL;
+
+    image_gen_defaults(&config);
+    memset(&bench, 0, sizeof(bench));
+    bench.fsutils = "../fsutils";
+    bench.out_dir = "/tmp";
+    bench.runs = 3;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        int takes_value = strcmp(argv[i], "--keep") != 0 && strcmp(argv[i], "--help") != 0;
+
+        if (takes_value && value == NULL) {
+            bench_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (!strcmp(argv[i], "--fs")) {
+            fs_mask = !strcmp(value, "ext2") ? 1 : !strcmp(value, "fat16") ? 2 : !strcmp(value, "all") ? 3 : 0;
+        } else if (!strcmp(argv[i], "--files")) {
+            scale_count = bench_parse_list(value, scales, BENCH_MAX_SCALES);
+        } else if (!strcmp(argv[i], "--dirs")) {
+            dirs = atol(value);
+        } else if (!strcmp(argv[i], "--depth")) {
+            config.depth = atoi(value);
+        } else if (!strcmp(argv[i], "--fanout")) {
+            config.fanout = atoi(value);
+        } else if (!strcmp(argv[i], "--min-size")) {
+            config.min_size = strtoull(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--max-size")) {
+            config.max_size = strtoull(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--frag")) {
+            config.fragmentation = atof(value);
+        } else if (!strcmp(argv[i], "--block-size")) {
+            if (!strcmp(value, "all")) {
+                block_sizes[0] = 1024;
+                block_sizes[1] = 2048;
+                block_sizes[2] = 4096;
+                block_size_count = 3;
+            } else {
+                block_sizes[0] = atoi(value);
+                block_size_count = 1;
+            }
+        } else if (!strcmp(argv[i], "--volume-size")) {
+            if (bench_parse_size(value, &config.volume_bytes) != 0) {
+                printf("Invalid volume size\n");
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[i], "--seed")) {
+            config.seed = strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--runs")) {
+            bench.runs = atoi(value);
+        } else if (!strcmp(argv[i], "--fsutils")) {
+            bench.fsutils = value;
+        } else if (!strcmp(argv[i], "--out-dir")) {
+            bench.out_dir = value;
+        } else if (!strcmp(argv[i], "--csv")) {
+            csv_path = value;
+        } else if (!strcmp(argv[i], "--json")) {
+            json_path = value;
+        } else if (!strcmp(argv[i], "--generate")) {
+            generate = value;
+        } else if (!strcmp(argv[i], "--keep")) {
+            bench.keep = 1;
+        } else {
+            bench_usage(argv[0]);
+            return !strcmp(argv[i], "--help") ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        i += takes_value;
+    }
+
+    if (fs_mask == 0 || scale_count <= 0 || bench.runs < 1 || config.fanout < 1 ||
+        config.min_size > config.max_size || config.fragmentation < 0 || config.fragmentation > 1) {
+        printf("Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    if (generate != NULL) {
+        ImageGenResult image;
+        config.fs = fs_mask == 2 ? IMAGE_GEN_FAT16 : IMAGE_GEN_EXT2;
+        config.block_size = block_sizes[0];
+        config.files = scales[0];
+        config.dirs = dirs >= 0 ? dirs : (config.files / 10 ? config.files / 10 : 1);
+        if (image_gen_write(&config, generate, &image) != 0) {
+            return EXIT_FAILURE;
+        }
+        printf("%s: %u files, %u directories, %llu bytes, last file %s\n", generate, image.files, image.dirs,
+               (unsigned long long)image.image_bytes, image.cat_path);
+        return EXIT_SUCCESS;
+    }
+
+    if (access(bench.fsutils, X_OK) != 0) {
+        fprintf(stderr, "Cannot run %s, build it with make first\n", bench.fsutils);
+        return EXIT_FAILURE;
+    }
+    if (csv_path != NULL && (bench.csv = fopen(csv_path, "w")) == NULL) {
+        perror("Error creating the CSV file");
+        return EXIT_FAILURE;
+    }
+    if (json_path != NULL && (bench.json = fopen(json_path, "w")) == NULL) {
+        perror("Error creating the JSON file");
+        if (bench.csv != NULL) fclose(bench.csv);
+        return EXIT_FAILURE;
+    }
+
+    if (bench.csv != NULL) {
+        fprintf(bench.csv, "fs,block_size,files,dirs,depth,fanout,frag,image_bytes,command,mode,run,wall_ms,user_ms,sys_ms,exit_status\n");
+    }
+    if (bench.json != NULL) {
+        fprintf(bench.json, "{\n  \"fsutils\": \"%s\",\n  \"runs\": %d,\n  \"seed\": %u,\n  \"results\": [", bench.fsutils, bench.runs, config.seed);
+    }
+
+    int failed = 0;
+    for (int s = 0; s < scale_count; s++) {
+        for (int fs = IMAGE_GEN_EXT2; fs <= IMAGE_GEN_FAT16; fs++) {
+            if (!(fs_mask & fs)) continue;
+
+            for (int b = 0; b < (fs == IMAGE_GEN_EXT2 ? block_size_count : 1); b++) {
+                if (fs == IMAGE_GEN_FAT16 && config.max_size > 0 && scales[s] >= BENCH_FAT16_MAX_CLUSTERS) {
+                    fprintf(stderr, "Skipping FAT16 with %u files: a FAT16 volume has at most %u clusters\n",
+                            scales[s], BENCH_FAT16_MAX_CLUSTERS);
+                    continue;
+                }
+
+                ImageGenConfig image_config = config;
+                image_config.fs = fs;
+                image_config.block_size = block_sizes[b];
+                image_config.files = scales[s];
+                image_config.dirs = dirs >= 0 ? dirs : (scales[s] / 10 ? scales[s] / 10 : 1);
+                if (bench_image(&bench, &image_config) != 0) failed = 1;
+            }
+        }
+    }
+
+    if (bench.json != NULL) {
+        fprintf(bench.json, "\n  ],\n  \"cold_method\": \"%s\"\n}\n", bench.cold_method ? bench.cold_method : "none");
+        fclose(bench.json);
+    }
+    if (bench.csv != NULL) {
+        fclose(bench.csv);
+    }
+    fprintf(stderr, "Cold runs dropped the page cache with %s\n", bench.cold_method ? bench.cold_method : "none");
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
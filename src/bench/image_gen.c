@@ -0,0 +1,1109 @@
+#include "image_gen.h"
+#include "../ext2/ext2_reader.h"
+#include "../fat16/fat16_reader.h"
+
+#include <errno.h>
+
+// Marca de tiempo fija para que dos imágenes con la misma configuración sean idénticas
+#define IMAGE_GEN_TIMESTAMP 1700000000u
+
+// Huecos que deja la fragmentación entre dos bloques de un fichero: de 1 a IMAGE_GEN_MAX_GAP
+#define IMAGE_GEN_MAX_GAP 4
+
+// Directorio del plan, los hijos de cada directorio son consecutivos (se crean en anchura)
+typedef struct {
+    uint32_t parent;
+    uint32_t depth;
+    uint32_t first_child;
+    uint32_t child_count;
+    uint32_t file_count;    // Files assigned to the directory
+    uint32_t slot;          // Position in the round robin, valid when file_count > 0
+    uint32_t id;            // Inode (EXT2) or first cluster (FAT16)
+} GenDir;
+
+// Árbol que se va a escribir, común a los dos sistemas de ficheros
+typedef struct {
+    const ImageGenConfig *config;
+    GenDir *dirs;
+    uint32_t dir_count;
+    uint64_t *sizes;        // Size of every file
+    uint32_t file_count;
+    uint32_t *eligible;     // Directories that receive files, round robin
+    uint32_t eligible_count;
+    uint32_t rng;
+} GenPlan;
+
+static uint32_t gen_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/**
+ * @brief Fills a configuration with the defaults: 1000 files in 100 directories, EXT2 with 1K blocks.
+ *
+ * @param config Configuration to fill.
+ *
+ * @return void
+*/
+void image_gen_defaults(ImageGenConfig *config) {
+    memset(config, 0, sizeof(ImageGenConfig));
+    config->fs = IMAGE_GEN_EXT2;
+    config->files = 1000;
+    config->dirs = 100;
+    config->depth = 4;
+    config->fanout = 8;
+    config->min_size = 0;
+    config->max_size = 4096;
+    config->fragmentation = 0.0;
+    config->block_size = 1024;
+    config->seed = 1;
+}
+
+/**
+ * @brief Builds the directory tree breadth first and draws the size of every file.
+ *
+ * @param root_capacity Entries that fit in the root directory, 0 when it can grow.
+ *
+ * @return 0 on success, -1 on error.
+*/
+static int gen_plan(GenPlan *plan, const ImageGenConfig *config, uint32_t root_capacity) {
+    memset(plan, 0, sizeof(GenPlan));
+    plan->config = config;
+    plan->rng = config->seed ? config->seed : 1;
+
+    uint32_t wanted = config->dirs ? config->dirs : 1;
+    plan->dirs = calloc(wanted, sizeof(GenDir));
+    plan->sizes = malloc((config->files ? config->files : 1) * sizeof(uint64_t));
+    plan->eligible = malloc(wanted * sizeof(uint32_t));
+    if (plan->dirs == NULL || plan->sizes == NULL || plan->eligible == NULL) {
+        fprintf(stderr, "Out of memory planning the image\n");
+        return -1;
+    }
+
+    // Every directory gets up to fanout subdirectories, level by level
+    plan->dir_count = 1;
+    for (uint32_t parent = 0; parent < plan->dir_count && plan->dir_count < wanted; parent++) {
+        if (plan->dirs[parent].depth >= config->depth) break; // BFS order: the rest are deeper
+        plan->dirs[parent].first_child = plan->dir_count;
+        for (uint32_t c = 0; c < config->fanout && plan->dir_count < wanted; c++) {
+            GenDir *child = &plan->dirs[plan->dir_count++];
+            child->parent = parent;
+            child->depth = plan->dirs[parent].depth + 1;
+            plan->dirs[parent].child_count++;
+        }
+    }
+
+    // The FAT16 root directory has a fixed size: it only gets files if they all fit
+    uint32_t files_per_dir = (config->files + plan->dir_count - 1) / plan->dir_count;
+    int root_gets_files = root_capacity == 0 || plan->dirs[0].child_count + files_per_dir <= root_capacity;
+    if (root_capacity != 0 && plan->dirs[0].child_count > root_capacity) {
+        fprintf(stderr, "The root directory cannot hold %u subdirectories\n", plan->dirs[0].child_count);
+        return -1;
+    }
+    for (uint32_t d = root_gets_files ? 0 : 1; d < plan->dir_count; d++) {
+        plan->dirs[d].slot = plan->eligible_count;
+        plan->eligible[plan->eligible_count++] = d;
+    }
+    if (plan->eligible_count == 0 && config->files > 0) {
+        fprintf(stderr, "The root directory cannot hold %u files, add directories\n", config->files);
+        return -1;
+    }
+
+    plan->file_count = config->files;
+    uint64_t span = config->max_size > config->min_size ? config->max_size - config->min_size + 1 : 1;
+    for (uint32_t i = 0; i < plan->file_count; i++) {
+        uint64_t draw = ((uint64_t)gen_random(&plan->rng) << 32) | gen_random(&plan->rng);
+        plan->sizes[i] = config->min_size + draw % span;
+        plan->dirs[plan->eligible[i % plan->eligible_count]].file_count++;
+    }
+
+    return 0;
+}
+
+static void gen_plan_free(GenPlan *plan) {
+    free(plan->dirs);
+    free(plan->sizes);
+    free(plan->eligible);
+}
+
+// Fichero número k de un directorio, según el reparto round robin
+static uint32_t gen_file_of(const GenPlan *plan, uint32_t dir, uint32_t k) {
+    return plan->dirs[dir].slot + k * plan->eligible_count;
+}
+
+/**
+ * @brief Fills the summary: sizes, counts and the name and path of the last file.
+*/
+static void gen_fill_result(const GenPlan *plan, uint64_t image_bytes, ImageGenResult *result) {
+    if (result == NULL) return;
+
+    memset(result, 0, sizeof(ImageGenResult));
+    result->image_bytes = image_bytes;
+    result->files = plan->file_count;
+    result->dirs = plan->dir_count;
+    for (uint32_t i = 0; i < plan->file_count; i++) {
+        result->data_bytes += plan->sizes[i];
+    }
+    if (plan->file_count == 0) return;
+
+    uint32_t last = plan->file_count - 1;
+    snprintf(result->cat_name, sizeof(result->cat_name), "f%07u.dat", last);
+    result->cat_file = last;
+    result->cat_size = plan->sizes[last];
+
+    // The directories of the path, from the root down
+    uint32_t dir = plan->eligible[last % plan->eligible_count];
+    uint32_t depth = plan->dirs[dir].depth;
+    uint32_t *chain = malloc((depth ? depth : 1) * sizeof(uint32_t));
+    if (chain == NULL) return;
+    for (uint32_t level = depth; level > 0; level--, dir = plan->dirs[dir].parent) {
+        chain[level - 1] = dir;
+    }
+
+    size_t length = 0;
+    for (uint32_t level = 0; level < depth && length + 10 < sizeof(result->cat_path); level++) {
+        length += snprintf(result->cat_path + length, sizeof(result->cat_path) - length, "/d%07u", chain[level]);
+    }
+    snprintf(result->cat_path + length, sizeof(result->cat_path) - length, "/f%07u.dat", last);
+    free(chain);
+}
+
+/**
+ * @brief Fills part of a file with bytes that only depend on the file and the offset.
+ *
+ * The contents are generated in 512 byte chunks, so the same file has the same bytes
+ * whatever the block or cluster size of the image.
+ *
+ * @param offset Offset of the buffer in the file, a multiple of 512.
+*/
+static void gen_fill_contents(uint8_t *buffer, size_t length, uint32_t file, uint64_t offset, uint32_t seed) {
+    for (size_t chunk = 0; chunk < length; chunk += 512) {
+        uint64_t sector = (offset + chunk) / 512;
+        uint32_t state = (file * 2654435761u) ^ (uint32_t)(sector * 40503u) ^ (uint32_t)(sector >> 32) ^ seed ^ 0x9e3779b9u;
+        size_t end = length - chunk < 512 ? length : chunk + 512;
+        if (state == 0) state = 1;
+
+        size_t i = chunk;
+        for (; i + 4 <= end; i += 4) {
+            uint32_t value = gen_random(&state);
+            memcpy(buffer + i, &value, 4);
+        }
+        for (; i < end; i++) {
+            buffer[i] = gen_random(&state);
+        }
+    }
+}
+
+/**
+ * @brief Returns the contents the generator wrote in part of a file.
+ *
+ * @param config Configuration the image was generated with.
+ * @param file Number of the file, as in its name.
+ * @param offset Offset in the file, a multiple of 512.
+ * @param buffer Where the contents are stored.
+ * @param length Number of bytes.
+ *
+ * @return void
+*/
+void image_gen_contents(const ImageGenConfig *config, uint32_t file, uint64_t offset, void *buffer, size_t length) {
+    gen_fill_contents(buffer, length, file, offset, config->seed);
+}
+
+static int gen_pwrite(int fd, const void *buffer, size_t length, uint64_t offset) {
+    const uint8_t *data = buffer;
+    while (length > 0) {
+        ssize_t n = pwrite(fd, data, length, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Error writing image");
+            return -1;
+        }
+        data += n;
+        length -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                       //
+// EXT2                                                                                                                  //
+//                                                                                                                       //
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define GEN_EXT2_INODE_SIZE 128
+#define GEN_EXT2_FIRST_INODE 11
+#define GEN_EXT2_FEATURE_INCOMPAT_FILETYPE 0x0002
+#define GEN_EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define GEN_EXT2_FEATURE_RO_COMPAT_LARGE_FILE 0x0002
+
+typedef struct {
+    GenPlan *plan;
+    int fd;
+    uint32_t block_size;
+    uint32_t first_data_block;
+    uint32_t blocks_per_group;
+    uint32_t inodes_per_group;
+    uint32_t group_count;
+    uint32_t gdt_blocks;
+    uint32_t inode_table_blocks;
+    uint64_t total_blocks;
+    uint8_t *block_bitmap;  // One bit per block of the image
+    uint64_t cursor;        // Next block the allocator looks at, the first block of the data groups at the start
+    Ext2Inode *inodes;      // Every inode of the image, inode n at n - 1
+    uint32_t inode_count;   // Inodes in use
+    uint8_t *block;         // Scratch block
+    int large_files;
+} Ext2Gen;
+
+static uint32_t gen_ext2_dir_inode(uint32_t dir) {
+    return dir == 0 ? EXT2_ROOT_INODE : GEN_EXT2_FIRST_INODE + dir;
+}
+
+static uint32_t gen_ext2_file_inode(const GenPlan *plan, uint32_t file) {
+    return GEN_EXT2_FIRST_INODE + plan->dir_count + file;
+}
+
+static uint32_t gen_ext2_entry_length(size_t name_len) {
+    return (8 + name_len + 3) & ~3u;
+}
+
+static uint64_t gen_ext2_group_start(const Ext2Gen *gen, uint32_t group) {
+    return gen->first_data_block + (uint64_t)group * gen->blocks_per_group;
+}
+
+// Con sparse_super solo los grupos 0, 1 y las potencias de 3, 5 y 7 guardan copia del superbloque
+static int gen_ext2_has_backup(uint32_t group) {
+    if (group <= 1) return 1;
+    for (uint32_t base = 3; base <= 7; base += 2) {
+        uint64_t power = base;
+        while (power < group) power *= base;
+        if (power == group) return 1;
+    }
+    return 0;
+}
+
+// Primer bloque del grupo después de la copia del superbloque y de los descriptores, si la tiene
+static uint64_t gen_ext2_group_metadata(const Ext2Gen *gen, uint32_t group) {
+    return gen_ext2_group_start(gen, group) + (gen_ext2_has_backup(group) ? 1 + gen->gdt_blocks : 0);
+}
+
+static uint64_t gen_ext2_indirect_blocks(uint64_t blocks, uint64_t per_block) {
+    if (blocks <= EXT2_NDIR_BLOCKS) return 0;
+    blocks -= EXT2_NDIR_BLOCKS;
+    uint64_t count = 1;                                             // Single indirect
+    if (blocks > per_block) {
+        blocks -= per_block;
+        count += 1 + (blocks + per_block - 1) / per_block;          // Double indirect
+        if (blocks > per_block * per_block) {
+            blocks -= per_block * per_block;
+            count += 1 + (blocks + per_block * per_block - 1) / (per_block * per_block) +
+                     (blocks + per_block - 1) / per_block;          // Triple indirect
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Bytes of directory entries of a directory: '.', '..', lost+found in the root, subdirectories and files.
+*/
+static uint64_t gen_ext2_directory_blocks(const GenPlan *plan, uint32_t dir, uint32_t block_size) {
+    const GenDir *d = &plan->dirs[dir];
+    uint64_t used = 0, blocks = 1;
+    uint32_t lengths[3] = { gen_ext2_entry_length(1), gen_ext2_entry_length(2), gen_ext2_entry_length(10) };
+    uint32_t count = dir == 0 ? 3 : 2;
+
+    for (uint64_t i = 0; i < count + d->child_count + d->file_count; i++) {
+        uint32_t length = i < count ? lengths[i] : i < count + d->child_count ? gen_ext2_entry_length(8) : gen_ext2_entry_length(12);
+        if (used + length > block_size) {
+            blocks++;
+            used = 0;
+        }
+        used += length;
+    }
+    return blocks;
+}
+
+/**
+ * @brief Chooses the number of groups and inodes per group so that everything fits.
+ *
+ * A volume larger than what the files need keeps its files in the last groups, so
+ * their blocks get the highest block numbers of the volume.
+*/
+static int gen_ext2_layout(Ext2Gen *gen) {
+    const ImageGenConfig *config = gen->plan->config;
+    uint32_t block_size = gen->block_size;
+    uint64_t per_block = block_size / sizeof(uint32_t);
+    uint64_t needed = 1; // lost+found
+
+    for (uint32_t i = 0; i < gen->plan->file_count; i++) {
+        uint64_t blocks = (gen->plan->sizes[i] + block_size - 1) / block_size;
+        needed += blocks + gen_ext2_indirect_blocks(blocks, per_block);
+        if (gen->plan->sizes[i] > 0x7FFFFFFFu) gen->large_files = 1;
+    }
+    for (uint32_t d = 0; d < gen->plan->dir_count; d++) {
+        uint64_t blocks = gen_ext2_directory_blocks(gen->plan, d, block_size);
+        needed += blocks + gen_ext2_indirect_blocks(blocks, per_block);
+    }
+    needed = needed + (uint64_t)(needed * config->fragmentation * (IMAGE_GEN_MAX_GAP + 1) / 2) + 64;
+
+    uint64_t inodes_needed = GEN_EXT2_FIRST_INODE + gen->plan->dir_count + gen->plan->file_count;
+    uint32_t inodes_per_block = block_size / GEN_EXT2_INODE_SIZE;
+
+    gen->first_data_block = block_size == 1024 ? 1 : 0;
+    gen->blocks_per_group = block_size * 8;
+
+    uint64_t first_groups = 1;
+    if (config->volume_bytes / block_size > gen->first_data_block) {
+        first_groups = (config->volume_bytes / block_size - gen->first_data_block + gen->blocks_per_group - 1) / gen->blocks_per_group;
+    }
+    for (uint64_t groups = first_groups; groups < (1u << 20); groups++) {
+        uint64_t ipg = (inodes_needed + groups - 1) / groups;
+        if (ipg < 16) ipg = 16;
+        uint32_t multiple = inodes_per_block > 8 ? inodes_per_block : 8;
+        ipg = (ipg + multiple - 1) / multiple * multiple;
+        if (ipg > (uint64_t)block_size * 8) continue; // The inode bitmap is one block
+
+        uint64_t gdt_blocks = (groups * sizeof(Ext2GroupDesc) + block_size - 1) / block_size;
+        uint64_t inode_table_blocks = ipg / inodes_per_block;
+        uint64_t overhead = 1 + gdt_blocks + 2 + inode_table_blocks;
+        if (overhead + 1 >= gen->blocks_per_group) continue;
+        if (groups * (gen->blocks_per_group - overhead) < needed) continue;
+
+        uint64_t total_blocks = gen->first_data_block + groups * gen->blocks_per_group;
+        if (total_blocks > UINT32_MAX) break;
+
+        gen->group_count = groups;
+        gen->inodes_per_group = ipg;
+        gen->gdt_blocks = gdt_blocks;
+        gen->inode_table_blocks = inode_table_blocks;
+        gen->total_blocks = total_blocks;
+
+        // The data starts in the first of the last groups that can hold it
+        uint64_t data_groups = (needed + gen->blocks_per_group - overhead - 1) / (gen->blocks_per_group - overhead);
+        gen->cursor = gen_ext2_group_start(gen, groups - (data_groups < groups ? data_groups : groups));
+        return 0;
+    }
+
+    fprintf(stderr, "The file system does not fit in an EXT2 image with %u byte blocks\n", block_size);
+    return -1;
+}
+
+static void gen_bit_set(uint8_t *bitmap, uint64_t bit) {
+    bitmap[bit / 8] |= 1u << (bit % 8);
+}
+
+static int gen_bit_test(const uint8_t *bitmap, uint64_t bit) {
+    return (bitmap[bit / 8] >> (bit % 8)) & 1;
+}
+
+/**
+ * @brief Takes the next free block; with the fragmentation probability, leaves a gap after it.
+*/
+static int gen_ext2_alloc(Ext2Gen *gen, uint32_t *block) {
+    while (gen->cursor < gen->total_blocks && gen_bit_test(gen->block_bitmap, gen->cursor)) {
+        gen->cursor++;
+    }
+    if (gen->cursor >= gen->total_blocks) {
+        fprintf(stderr, "The EXT2 image ran out of blocks\n");
+        return -1;
+    }
+
+    *block = gen->cursor;
+    gen_bit_set(gen->block_bitmap, gen->cursor);
+    gen->cursor++;
+
+    double draw = gen_random(&gen->plan->rng) / 4294967296.0;
+    if (draw < gen->plan->config->fragmentation) {
+        gen->cursor += 1 + gen_random(&gen->plan->rng) % IMAGE_GEN_MAX_GAP;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes an indirect block that points to count blocks (or subtrees for depth > 1).
+*/
+static int gen_ext2_write_indirect(Ext2Gen *gen, const uint32_t *blocks, uint64_t count, int depth, uint32_t *result, uint64_t *metadata) {
+    uint64_t per_block = gen->block_size / sizeof(uint32_t);
+    uint64_t span = 1;
+    for (int i = 1; i < depth; i++) span *= per_block;
+
+    uint32_t *pointers = calloc(per_block, sizeof(uint32_t));
+    if (pointers == NULL || gen_ext2_alloc(gen, result) != 0) {
+        free(pointers);
+        return -1;
+    }
+    (*metadata)++;
+
+    for (uint64_t i = 0; i * span < count; i++) {
+        uint64_t chunk = count - i * span < span ? count - i * span : span;
+        if (depth == 1) {
+            pointers[i] = blocks[i];
+        } else if (gen_ext2_write_indirect(gen, blocks + i * span, chunk, depth - 1, &pointers[i], metadata) != 0) {
+            free(pointers);
+            return -1;
+        }
+    }
+
+    int written = gen_pwrite(gen->fd, pointers, gen->block_size, (uint64_t)*result * gen->block_size);
+    free(pointers);
+    return written;
+}
+
+/**
+ * @brief Allocates the blocks of an inode and fills its block map. The data is written by the caller.
+ *
+ * @param blocks Array where the data blocks are stored, one per logical block.
+*/
+static int gen_ext2_map(Ext2Gen *gen, Ext2Inode *inode, uint32_t *blocks, uint64_t count) {
+    uint64_t per_block = gen->block_size / sizeof(uint32_t);
+    uint64_t metadata = 0;
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (gen_ext2_alloc(gen, &blocks[i]) != 0) return -1;
+    }
+
+    for (uint64_t i = 0; i < count && i < EXT2_NDIR_BLOCKS; i++) {
+        inode->block[i] = blocks[i];
+    }
+
+    uint64_t done = EXT2_NDIR_BLOCKS;
+    uint64_t spans[3] = { per_block, per_block * per_block, per_block * per_block * per_block };
+    for (int level = 0; level < 3 && done < count; level++) {
+        uint64_t chunk = count - done < spans[level] ? count - done : spans[level];
+        if (gen_ext2_write_indirect(gen, blocks + done, chunk, level + 1, &inode->block[EXT2_IND_BLOCK + level], &metadata) != 0) {
+            return -1;
+        }
+        done += chunk;
+    }
+
+    inode->blocks = (uint32_t)((count + metadata) * (gen->block_size / 512));
+    return 0;
+}
+
+static void gen_ext2_inode_init(Ext2Inode *inode, uint16_t mode, uint64_t size, uint16_t links) {
+    memset(inode, 0, sizeof(Ext2Inode));
+    inode->mode = mode;
+    inode->size = (uint32_t)size;
+    inode->dir_acl = (uint32_t)(size >> 32);
+    inode->atime = inode->ctime = inode->mtime = IMAGE_GEN_TIMESTAMP;
+    inode->links_count = links;
+}
+
+/**
+ * @brief Appends an entry to a directory being packed in blocks.
+*/
+static void gen_ext2_add_entry(uint8_t *data, uint32_t block_size, uint64_t *used, uint64_t *last, uint32_t inode, const char *name, uint8_t type) {
+    size_t name_len = strlen(name);
+    uint32_t length = gen_ext2_entry_length(name_len);
+
+    // An entry never crosses a block: the previous one grows up to the end of its block
+    uint64_t in_block = *used % block_size;
+    if (in_block + length > block_size) {
+        Ext2DirectoryEntry *previous = (Ext2DirectoryEntry *)(data + *last);
+        previous->rec_len += block_size - in_block;
+        *used += block_size - in_block;
+    }
+
+    Ext2DirectoryEntry *entry = (Ext2DirectoryEntry *)(data + *used);
+    entry->inode = inode;
+    entry->rec_len = length;
+    entry->name_len = name_len;
+    entry->file_type = type;
+    memcpy(entry->name, name, name_len);
+    *last = *used;
+    *used += length;
+}
+
+/**
+ * @brief Writes a directory: its entries, then its blocks and its inode.
+*/
+static int gen_ext2_write_directory(Ext2Gen *gen, uint32_t dir) {
+    GenPlan *plan = gen->plan;
+    const GenDir *d = &plan->dirs[dir];
+    uint32_t block_size = gen->block_size;
+    uint64_t block_count = gen_ext2_directory_blocks(plan, dir, block_size);
+    uint8_t *data = calloc(block_count, block_size);
+    uint32_t *blocks = malloc(block_count * sizeof(uint32_t));
+    char name[32];
+    uint64_t used = 0, last = 0;
+    int result = -1;
+
+    if (data == NULL || blocks == NULL) {
+        fprintf(stderr, "Out of memory writing a directory\n");
+        goto out;
+    }
+
+    uint32_t self = gen_ext2_dir_inode(dir);
+    gen_ext2_add_entry(data, block_size, &used, &last, self, ".", 2);
+    gen_ext2_add_entry(data, block_size, &used, &last, gen_ext2_dir_inode(dir == 0 ? 0 : d->parent), "..", 2);
+    if (dir == 0) {
+        gen_ext2_add_entry(data, block_size, &used, &last, GEN_EXT2_FIRST_INODE, "lost+found", 2);
+    }
+    for (uint32_t c = 0; c < d->child_count; c++) {
+        snprintf(name, sizeof(name), "d%07u", d->first_child + c);
+        gen_ext2_add_entry(data, block_size, &used, &last, gen_ext2_dir_inode(d->first_child + c), name, 2);
+    }
+    for (uint32_t k = 0; k < d->file_count; k++) {
+        uint32_t file = gen_file_of(plan, dir, k);
+        snprintf(name, sizeof(name), "f%07u.dat", file);
+        gen_ext2_add_entry(data, block_size, &used, &last, gen_ext2_file_inode(plan, file), name, 1);
+    }
+    // The last entry reaches the end of the last block
+    ((Ext2DirectoryEntry *)(data + last))->rec_len += block_count * block_size - used;
+
+    Ext2Inode *inode = &gen->inodes[self - 1];
+    gen_ext2_inode_init(inode, 0x41ED, block_count * block_size, 2 + d->child_count + (dir == 0));
+    if (gen_ext2_map(gen, inode, blocks, block_count) != 0) goto out;
+
+    for (uint64_t i = 0; i < block_count; i++) {
+        if (gen_pwrite(gen->fd, data + i * block_size, block_size, (uint64_t)blocks[i] * block_size) != 0) goto out;
+    }
+    result = 0;
+
+out:
+    free(data);
+    free(blocks);
+    return result;
+}
+
+/**
+ * @brief Writes a regular file: allocates its blocks, writes its contents and fills its inode.
+*/
+static int gen_ext2_write_file(Ext2Gen *gen, uint32_t file) {
+    uint32_t block_size = gen->block_size;
+    uint64_t size = gen->plan->sizes[file];
+    uint64_t block_count = (size + block_size - 1) / block_size;
+    uint32_t *blocks = malloc((block_count ? block_count : 1) * sizeof(uint32_t));
+    uint32_t ino = gen_ext2_file_inode(gen->plan, file);
+    Ext2Inode *inode = &gen->inodes[ino - 1];
+
+    if (blocks == NULL) {
+        fprintf(stderr, "Out of memory writing a file\n");
+        return -1;
+    }
+
+    gen_ext2_inode_init(inode, 0x81A4, size, 1);
+    if (gen_ext2_map(gen, inode, blocks, block_count) != 0) {
+        free(blocks);
+        return -1;
+    }
+
+    for (uint64_t i = 0; i < block_count; i++) {
+        size_t length = i + 1 < block_count || size % block_size == 0 ? block_size : size % block_size;
+        memset(gen->block, 0, block_size);
+        gen_fill_contents(gen->block, length, file, i * block_size, gen->plan->config->seed);
+        if (gen_pwrite(gen->fd, gen->block, block_size, (uint64_t)blocks[i] * block_size) != 0) {
+            free(blocks);
+            return -1;
+        }
+    }
+
+    free(blocks);
+    return 0;
+}
+
+/**
+ * @brief Writes the superblock copies, the group descriptors, the bitmaps and the inode tables.
+*/
+static int gen_ext2_write_metadata(Ext2Gen *gen) {
+    uint32_t block_size = gen->block_size;
+    Ext2GroupDesc *groups = calloc(gen->group_count, sizeof(Ext2GroupDesc));
+    uint8_t *gdt = calloc(gen->gdt_blocks, block_size);
+    uint8_t *bitmap = malloc(block_size);
+    uint64_t free_blocks = 0, free_inodes = 0;
+    int result = -1;
+
+    if (groups == NULL || gdt == NULL || bitmap == NULL) {
+        fprintf(stderr, "Out of memory writing the metadata\n");
+        goto out;
+    }
+
+    for (uint32_t g = 0; g < gen->group_count; g++) {
+        uint64_t start = gen_ext2_group_start(gen, g);
+        groups[g].block_bitmap = gen_ext2_group_metadata(gen, g);
+        groups[g].inode_bitmap = groups[g].block_bitmap + 1;
+        groups[g].inode_table = groups[g].inode_bitmap + 1;
+
+        // Block bitmap of the group; with blocks of 2K or more a group starts at a whole byte
+        if (start % 8 == 0) {
+            memcpy(bitmap, gen->block_bitmap + start / 8, block_size);
+            groups[g].free_blocks_count = gen->blocks_per_group;
+            for (uint32_t i = 0; i < block_size; i++) {
+                groups[g].free_blocks_count -= __builtin_popcount(bitmap[i]);
+            }
+        } else {
+            memset(bitmap, 0, block_size);
+            for (uint32_t b = 0; b < gen->blocks_per_group; b++) {
+                if (gen_bit_test(gen->block_bitmap, start + b)) {
+                    gen_bit_set(bitmap, b);
+                } else {
+                    groups[g].free_blocks_count++;
+                }
+            }
+        }
+        if (gen_pwrite(gen->fd, bitmap, block_size, (uint64_t)groups[g].block_bitmap * block_size) != 0) goto out;
+
+        // Inode bitmap: the inodes are used in order; the bits after the last inode of the group are padding
+        memset(bitmap, 0, block_size);
+        for (uint32_t i = 0; i < gen->inodes_per_group; i++) {
+            uint64_t ino = (uint64_t)g * gen->inodes_per_group + i + 1;
+            if (ino <= gen->inode_count) {
+                gen_bit_set(bitmap, i);
+                if ((gen->inodes[ino - 1].mode & 0xF000) == 0x4000) groups[g].used_dirs_count++;
+            } else {
+                groups[g].free_inodes_count++;
+            }
+        }
+        memset(bitmap + gen->inodes_per_group / 8, 0xFF, block_size - gen->inodes_per_group / 8);
+        if (gen_pwrite(gen->fd, bitmap, block_size, (uint64_t)groups[g].inode_bitmap * block_size) != 0) goto out;
+
+        // Inode table of the group; the tables without inodes in use stay as holes
+        Ext2Inode *table = &gen->inodes[(uint64_t)g * gen->inodes_per_group];
+        if ((uint64_t)g * gen->inodes_per_group < gen->inode_count &&
+            gen_pwrite(gen->fd, table, (size_t)gen->inodes_per_group * GEN_EXT2_INODE_SIZE, (uint64_t)groups[g].inode_table * block_size) != 0) goto out;
+
+        free_blocks += groups[g].free_blocks_count;
+        free_inodes += groups[g].free_inodes_count;
+    }
+    memcpy(gdt, groups, gen->group_count * sizeof(Ext2GroupDesc));
+
+    // The superblock
+    uint8_t raw[EXT2_SUPERBLOCK_SIZE];
+    Ext2Superblock superblock;
+    memset(&superblock, 0, sizeof(superblock));
+    superblock.total_inodes = gen->group_count * gen->inodes_per_group;
+    superblock.total_blocks = gen->total_blocks;
+    superblock.free_blocks = free_blocks;
+    superblock.free_inodes = free_inodes;
+    superblock.first_data_block = gen->first_data_block;
+    superblock.log_block_size = block_size == 1024 ? 0 : block_size == 2048 ? 1 : 2;
+    superblock.log_frag_size = superblock.log_block_size;
+    superblock.blocks_per_group = gen->blocks_per_group;
+    superblock.frags_per_group = gen->blocks_per_group;
+    superblock.inodes_per_group = gen->inodes_per_group;
+    superblock.last_written_time = IMAGE_GEN_TIMESTAMP;
+    superblock.max_mnt_count = 0xFFFF;
+    superblock.magic = EXT2_MAGIC;
+    superblock.state = 1;
+    superblock.errors = 1;
+    superblock.last_check = IMAGE_GEN_TIMESTAMP;
+    superblock.rev_level = 1;
+    superblock.first_non_reserved_inode = GEN_EXT2_FIRST_INODE;
+    superblock.inode_size = GEN_EXT2_INODE_SIZE;
+    superblock.feature_required = GEN_EXT2_FEATURE_INCOMPAT_FILETYPE;
+    superblock.feature_ro_compat = GEN_EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER | (gen->large_files ? GEN_EXT2_FEATURE_RO_COMPAT_LARGE_FILE : 0);
+    for (int i = 0; i < 16; i++) superblock.uuid[i] = (uint8_t)(gen->plan->config->seed * 31 + i * 17);
+    memcpy(superblock.volume_name, "fsbench", 7);
+
+    // Copies of the superblock and of the descriptors, only in the groups sparse_super keeps
+    for (uint32_t g = 0; g < gen->group_count; g++) {
+        if (!gen_ext2_has_backup(g)) continue;
+        uint64_t start = gen_ext2_group_start(gen, g);
+        superblock.block_group_number = g;
+
+        memset(raw, 0, sizeof(raw));
+        memcpy(raw, &superblock, sizeof(superblock));
+
+        uint64_t offset = g == 0 ? EXT2_SUPERBLOCK_OFFSET : start * block_size;
+        if (gen_pwrite(gen->fd, raw, sizeof(raw), offset) != 0) goto out;
+        if (gen_pwrite(gen->fd, gdt, (size_t)gen->gdt_blocks * block_size, (start + 1) * block_size) != 0) goto out;
+    }
+    result = 0;
+
+out:
+    free(groups);
+    free(gdt);
+    free(bitmap);
+    return result;
+}
+
+static int gen_ext2(GenPlan *plan, int fd, uint64_t *image_bytes) {
+    Ext2Gen gen;
+    int result = -1;
+
+    memset(&gen, 0, sizeof(gen));
+    gen.plan = plan;
+    gen.fd = fd;
+    gen.block_size = plan->config->block_size;
+    if (gen.block_size != 1024 && gen.block_size != 2048 && gen.block_size != 4096) {
+        fprintf(stderr, "Invalid EXT2 block size %u\n", gen.block_size);
+        return -1;
+    }
+    if (gen_ext2_layout(&gen) != 0) {
+        return -1;
+    }
+
+    uint64_t inode_slots = (uint64_t)gen.group_count * gen.inodes_per_group;
+    gen.block_bitmap = calloc((gen.total_blocks + 7) / 8, 1);
+    gen.inodes = calloc(inode_slots, sizeof(Ext2Inode));
+    gen.block = malloc(gen.block_size);
+    if (gen.block_bitmap == NULL || gen.inodes == NULL || gen.block == NULL) {
+        fprintf(stderr, "Out of memory generating the image\n");
+        goto out;
+    }
+    gen.inode_count = GEN_EXT2_FIRST_INODE + plan->dir_count + plan->file_count - 1;
+
+    // Metadata blocks: boot block, superblock and descriptor copies, bitmaps and inode tables
+    for (uint64_t b = 0; b < gen.first_data_block; b++) gen_bit_set(gen.block_bitmap, b);
+    for (uint32_t g = 0; g < gen.group_count; g++) {
+        uint64_t start = gen_ext2_group_start(&gen, g);
+        uint64_t end = gen_ext2_group_metadata(&gen, g) + 2 + gen.inode_table_blocks;
+        for (uint64_t b = start; b < end; b++) {
+            gen_bit_set(gen.block_bitmap, b);
+        }
+    }
+
+    if (ftruncate(fd, gen.total_blocks * gen.block_size) != 0) {
+        perror("Error sizing the image");
+        goto out;
+    }
+
+    // Each directory is followed by its files, the way a file system filled in order looks
+    for (uint32_t d = 0; d < plan->dir_count; d++) {
+        if (gen_ext2_write_directory(&gen, d) != 0) goto out;
+
+        if (d == 0) {
+            uint32_t lost_found_block;
+            Ext2Inode *lost_found = &gen.inodes[GEN_EXT2_FIRST_INODE - 1];
+            Ext2DirectoryEntry *entry;
+
+            gen_ext2_inode_init(lost_found, 0x41C0, gen.block_size, 2);
+            if (gen_ext2_map(&gen, lost_found, &lost_found_block, 1) != 0) goto out;
+            memset(gen.block, 0, gen.block_size);
+            entry = (Ext2DirectoryEntry *)gen.block;
+            entry->inode = GEN_EXT2_FIRST_INODE;
+            entry->rec_len = 12;
+            entry->name_len = 1;
+            entry->file_type = 2;
+            entry->name[0] = '.';
+            entry = (Ext2DirectoryEntry *)(gen.block + 12);
+            entry->inode = EXT2_ROOT_INODE;
+            entry->rec_len = gen.block_size - 12;
+            entry->name_len = 2;
+            entry->file_type = 2;
+            memcpy(entry->name, "..", 2);
+            if (gen_pwrite(fd, gen.block, gen.block_size, (uint64_t)lost_found_block * gen.block_size) != 0) goto out;
+        }
+
+        for (uint32_t k = 0; k < plan->dirs[d].file_count; k++) {
+            if (gen_ext2_write_file(&gen, gen_file_of(plan, d, k)) != 0) goto out;
+        }
+    }
+
+    if (gen_ext2_write_metadata(&gen) != 0) goto out;
+    *image_bytes = gen.total_blocks * gen.block_size;
+    result = 0;
+
+out:
+    free(gen.block_bitmap);
+    free(gen.inodes);
+    free(gen.block);
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                       //
+// FAT16                                                                                                                 //
+//                                                                                                                       //
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define GEN_FAT16_SECTOR_SIZE 512
+#define GEN_FAT16_ROOT_ENTRIES 512
+#define GEN_FAT16_MIN_CLUSTERS 4085
+#define GEN_FAT16_MAX_CLUSTERS 65524
+
+typedef struct {
+    GenPlan *plan;
+    int fd;
+    uint32_t sectors_per_cluster;
+    uint32_t cluster_size;
+    uint32_t cluster_count;
+    uint32_t fat_sectors;
+    uint64_t first_data_sector;
+    uint16_t *fat;
+    uint16_t *file_clusters; // First cluster of every file
+    uint32_t cursor;        // Next cluster the allocator looks at
+    uint8_t *cluster;       // Scratch cluster
+} Fat16Gen;
+
+static uint64_t gen_fat16_directory_clusters(const GenPlan *plan, uint32_t dir, uint32_t cluster_size) {
+    const GenDir *d = &plan->dirs[dir];
+    uint64_t bytes = (2 + (uint64_t)d->child_count + d->file_count) * sizeof(DirEntry);
+    return (bytes + cluster_size - 1) / cluster_size;
+}
+
+/**
+ * @brief Chooses the cluster size: the smallest one with which everything fits in a FAT16.
+*/
+static int gen_fat16_layout(Fat16Gen *gen) {
+    const GenPlan *plan = gen->plan;
+
+    for (uint32_t spc = 1; spc <= 64; spc *= 2) {
+        uint32_t cluster_size = spc * GEN_FAT16_SECTOR_SIZE;
+        uint64_t needed = 0;
+
+        for (uint32_t i = 0; i < plan->file_count; i++) {
+            needed += (plan->sizes[i] + cluster_size - 1) / cluster_size;
+        }
+        for (uint32_t d = 1; d < plan->dir_count; d++) {
+            needed += gen_fat16_directory_clusters(plan, d, cluster_size);
+        }
+        needed = needed + (uint64_t)(needed * plan->config->fragmentation * (IMAGE_GEN_MAX_GAP + 1) / 2) + 16;
+        if (needed > GEN_FAT16_MAX_CLUSTERS) continue;
+
+        gen->sectors_per_cluster = spc;
+        gen->cluster_size = cluster_size;
+        gen->cluster_count = needed < GEN_FAT16_MIN_CLUSTERS + 16 ? GEN_FAT16_MIN_CLUSTERS + 16 : needed;
+        gen->fat_sectors = ((uint64_t)(gen->cluster_count + 2) * 2 + GEN_FAT16_SECTOR_SIZE - 1) / GEN_FAT16_SECTOR_SIZE;
+        uint32_t root_sectors = GEN_FAT16_ROOT_ENTRIES * sizeof(DirEntry) / GEN_FAT16_SECTOR_SIZE;
+        gen->first_data_sector = 1 + 2 * gen->fat_sectors + root_sectors;
+        return 0;
+    }
+
+    fprintf(stderr, "The file system does not fit in a FAT16 volume\n");
+    return -1;
+}
+
+static uint64_t gen_fat16_cluster_offset(const Fat16Gen *gen, uint32_t cluster) {
+    return (gen->first_data_sector + (uint64_t)(cluster - 2) * gen->sectors_per_cluster) * GEN_FAT16_SECTOR_SIZE;
+}
+
+/**
+ * @brief Allocates a chain of clusters, with gaps when the volume is fragmented.
+ *
+ * @return First cluster of the chain, 0 for an empty chain.
+*/
+static int gen_fat16_alloc_chain(Fat16Gen *gen, uint64_t count, uint16_t *first) {
+    uint16_t previous = 0;
+
+    *first = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        while (gen->cursor < gen->cluster_count + 2 && gen->fat[gen->cursor] != 0) gen->cursor++;
+        if (gen->cursor >= gen->cluster_count + 2) {
+            fprintf(stderr, "The FAT16 image ran out of clusters\n");
+            return -1;
+        }
+
+        uint16_t cluster = gen->cursor++;
+        gen->fat[cluster] = 0xFFFF;
+        if (previous != 0) gen->fat[previous] = cluster;
+        else *first = cluster;
+        previous = cluster;
+
+        double draw = gen_random(&gen->plan->rng) / 4294967296.0;
+        if (draw < gen->plan->config->fragmentation) {
+            gen->cursor += 1 + gen_random(&gen->plan->rng) % IMAGE_GEN_MAX_GAP;
+        }
+    }
+    return 0;
+}
+
+static void gen_fat16_entry(DirEntry *entry, const char name[11], uint8_t attributes, uint16_t cluster, uint32_t size) {
+    memset(entry, 0, sizeof(DirEntry));
+    memcpy(entry->filename, name, 11);
+    entry->attributes = attributes;
+    entry->startCluster = cluster;
+    entry->fileSize = size;
+    entry->writeDate = ((2023 - 1980) << 9) | (11 << 5) | 14;
+    entry->createDate = entry->accessDate = entry->writeDate;
+}
+
+/**
+ * @brief Writes the entries of a directory in its clusters (or in the root directory region).
+*/
+static int gen_fat16_write_directory(Fat16Gen *gen, uint32_t dir) {
+    GenPlan *plan = gen->plan;
+    const GenDir *d = &plan->dirs[dir];
+    uint64_t capacity = dir == 0 ? GEN_FAT16_ROOT_ENTRIES : gen_fat16_directory_clusters(plan, dir, gen->cluster_size) * gen->cluster_size / sizeof(DirEntry);
+    DirEntry *entries = calloc(capacity, sizeof(DirEntry));
+    char name[16];
+    size_t count = 0;
+
+    if (entries == NULL) {
+        fprintf(stderr, "Out of memory writing a directory\n");
+        return -1;
+    }
+
+    if (dir != 0) {
+        gen_fat16_entry(&entries[count++], ".          ", ATTR_DIRECTORY, d->id, 0);
+        gen_fat16_entry(&entries[count++], "..         ", ATTR_DIRECTORY, d->parent == 0 ? 0 : plan->dirs[d->parent].id, 0);
+    }
+    for (uint32_t c = 0; c < d->child_count; c++) {
+        snprintf(name, sizeof(name), "D%07u   ", d->first_child + c);
+        gen_fat16_entry(&entries[count++], name, ATTR_DIRECTORY, plan->dirs[d->first_child + c].id, 0);
+    }
+    for (uint32_t k = 0; k < d->file_count; k++) {
+        uint32_t file = gen_file_of(plan, dir, k);
+        snprintf(name, sizeof(name), "F%07uDAT", file);
+        gen_fat16_entry(&entries[count++], name, ATTR_ARCHIVE, gen->file_clusters[file], plan->sizes[file]);
+    }
+
+    int result = 0;
+    if (dir == 0) {
+        result = gen_pwrite(gen->fd, entries, GEN_FAT16_ROOT_ENTRIES * sizeof(DirEntry), (1 + 2 * (uint64_t)gen->fat_sectors) * GEN_FAT16_SECTOR_SIZE);
+    } else {
+        uint64_t written = 0;
+        for (uint16_t cluster = d->id; cluster >= 2 && cluster < FAT16_BAD_CLUSTER; cluster = gen->fat[cluster]) {
+            result = gen_pwrite(gen->fd, (uint8_t *)entries + written, gen->cluster_size, gen_fat16_cluster_offset(gen, cluster));
+            if (result != 0) break;
+            written += gen->cluster_size;
+        }
+    }
+
+    free(entries);
+    return result;
+}
+
+static int gen_fat16(GenPlan *plan, int fd, uint64_t *image_bytes) {
+    Fat16Gen gen;
+    int result = -1;
+
+    memset(&gen, 0, sizeof(gen));
+    gen.plan = plan;
+    gen.fd = fd;
+    if (gen_fat16_layout(&gen) != 0) {
+        return -1;
+    }
+
+    gen.fat = calloc(gen.cluster_count + 2, sizeof(uint16_t));
+    gen.cluster = malloc(gen.cluster_size);
+    gen.file_clusters = calloc(plan->file_count ? plan->file_count : 1, sizeof(uint16_t));
+    if (gen.fat == NULL || gen.cluster == NULL || gen.file_clusters == NULL) {
+        fprintf(stderr, "Out of memory generating the image\n");
+        goto out;
+    }
+    gen.fat[0] = 0xFFF8;
+    gen.fat[1] = 0xFFFF;
+    gen.cursor = 2;
+
+    uint64_t total_sectors = gen.first_data_sector + (uint64_t)gen.cluster_count * gen.sectors_per_cluster;
+    if (ftruncate(fd, total_sectors * GEN_FAT16_SECTOR_SIZE) != 0) {
+        perror("Error sizing the image");
+        goto out;
+    }
+
+    // Each directory is allocated before its files; the entries are written once every cluster is known
+    for (uint32_t d = 0; d < plan->dir_count; d++) {
+        if (d != 0) {
+            uint16_t first;
+            if (gen_fat16_alloc_chain(&gen, gen_fat16_directory_clusters(plan, d, gen.cluster_size), &first) != 0) goto out;
+            plan->dirs[d].id = first;
+        }
+
+        for (uint32_t k = 0; k < plan->dirs[d].file_count; k++) {
+            uint32_t file = gen_file_of(plan, d, k);
+            uint64_t size = plan->sizes[file];
+            uint16_t first;
+            if (gen_fat16_alloc_chain(&gen, (size + gen.cluster_size - 1) / gen.cluster_size, &first) != 0) goto out;
+            gen.file_clusters[file] = first;
+
+            uint64_t block = 0;
+            for (uint16_t cluster = first; cluster >= 2 && cluster < FAT16_BAD_CLUSTER; cluster = gen.fat[cluster], block++) {
+                uint64_t remaining = size - block * gen.cluster_size;
+                size_t length = remaining < gen.cluster_size ? remaining : gen.cluster_size;
+                memset(gen.cluster, 0, gen.cluster_size);
+                gen_fill_contents(gen.cluster, length, file, block * gen.cluster_size, plan->config->seed);
+                if (gen_pwrite(fd, gen.cluster, gen.cluster_size, gen_fat16_cluster_offset(&gen, cluster)) != 0) goto out;
+            }
+        }
+    }
+
+    for (uint32_t d = 0; d < plan->dir_count; d++) {
+        if (gen_fat16_write_directory(&gen, d) != 0) goto out;
+    }
+
+    // Boot sector and both copies of the FAT
+    BootSector boot;
+    memset(&boot, 0, sizeof(boot));
+    memcpy(boot.jmp, "\xEB\x3C\x90", 3);
+    memcpy(boot.oem, "FSBENCH ", 8);
+    boot.sector_size = GEN_FAT16_SECTOR_SIZE;
+    boot.sectors_per_cluster = gen.sectors_per_cluster;
+    boot.reserved_sectors = 1;
+    boot.number_of_fats = 2;
+    boot.root_dir_entries = GEN_FAT16_ROOT_ENTRIES;
+    boot.total_sectors_16 = total_sectors < 65536 ? total_sectors : 0;
+    boot.total_sectors_32 = total_sectors < 65536 ? 0 : total_sectors;
+    boot.media_descriptor = 0xF8;
+    boot.fat_size_16 = gen.fat_sectors;
+    boot.sectors_per_track = 32;
+    boot.number_of_heads = 64;
+    boot.drive_number = 0x80;
+    boot.boot_signature = 0x29;
+    boot.volume_id = 0x46530000u ^ plan->config->seed;
+    memcpy(boot.volume_label, "FSBENCH    ", 11);
+    memcpy(boot.fs_type, "FAT16   ", 8);
+    boot.boot_sector_signature = 0xAA55;
+    if (gen_pwrite(fd, &boot, sizeof(boot), 0) != 0) goto out;
+
+    for (int copy = 0; copy < 2; copy++) {
+        uint64_t offset = (1 + (uint64_t)copy * gen.fat_sectors) * GEN_FAT16_SECTOR_SIZE;
+        if (gen_pwrite(fd, gen.fat, (gen.cluster_count + 2) * sizeof(uint16_t), offset) != 0) goto out;
+    }
+
+    *image_bytes = total_sectors * GEN_FAT16_SECTOR_SIZE;
+    result = 0;
+
+out:
+    free(gen.fat);
+    free(gen.cluster);
+    free(gen.file_clusters);
+    return result;
+}
+
+/**
+ * @brief Writes a synthetic EXT2 or FAT16 image.
+ *
+ * The image is built in-process, without external tools, and only the blocks in
+ * use are written so large images stay sparse.
+ *
+ * @param config Shape of the file system.
+ * @param path Path of the image file, created or truncated.
+ * @param result Summary of what was written, can be NULL.
+ *
+ * @return 0 on success, -1 on error (a message is printed to stderr).
+*/
+int image_gen_write(const ImageGenConfig *config, const char *path, ImageGenResult *result) {
+    GenPlan plan;
+    uint64_t image_bytes = 0;
+
+    if (config->fs != IMAGE_GEN_EXT2 && config->fs != IMAGE_GEN_FAT16) {
+        fprintf(stderr, "Unknown file system to generate\n");
+        return -1;
+    }
+    if (config->fs == IMAGE_GEN_FAT16 && config->max_size > UINT32_MAX) {
+        fprintf(stderr, "FAT16 files are smaller than 4 GiB\n");
+        return -1;
+    }
+    if (config->files > 9999999 || config->dirs > 9999999) {
+        fprintf(stderr, "At most 9999999 files and directories\n");
+        return -1;
+    }
+    if (gen_plan(&plan, config, config->fs == IMAGE_GEN_FAT16 ? GEN_FAT16_ROOT_ENTRIES : 0) != 0) {
+        gen_plan_free(&plan);
+        return -1;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("Error creating the image");
+        gen_plan_free(&plan);
+        return -1;
+    }
+
+    int status = config->fs == IMAGE_GEN_EXT2 ? gen_ext2(&plan, fd, &image_bytes) : gen_fat16(&plan, fd, &image_bytes);
+    if (close(fd) != 0 && status == 0) {
+        perror("Error closing the image");
+        status = -1;
+    }
+    if (status == 0) {
+        gen_fill_result(&plan, image_bytes, result);
+    }
+
+    gen_plan_free(&plan);
+    return status;
+}
@@ -0,0 +1,84 @@
+#ifndef _IMAGE_GEN_H
+#define _IMAGE_GEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define IMAGE_GEN_EXT2 1
+#define IMAGE_GEN_FAT16 2
+
+// Longitud máxima de los caminos que devuelve el generador
+#define IMAGE_GEN_PATH_MAX 1024
+
+/**
+ * @brief Shape of a synthetic file system.
+ *
+ * Directories are created breadth first: every directory gets up to fanout
+ * subdirectories until dirs directories exist or depth is reached. Files are
+ * then spread round robin over the directories.
+ */
+typedef struct {
+    int fs;                 // IMAGE_GEN_EXT2 or IMAGE_GEN_FAT16
+    uint32_t files;         // Number of regular files
+    uint32_t dirs;          // Number of directories, the root included
+    uint32_t depth;         // Maximum depth of a directory, the root is 0
+    uint32_t fanout;        // Maximum number of subdirectories of a directory
+    uint64_t min_size;      // Sizes of the files, uniform in [min_size, max_size]
+    uint64_t max_size;
+    double fragmentation;   // Probability that the next block of a file is not contiguous, 0..1
+    uint32_t block_size;    // EXT2 block size: 1024, 2048 or 4096
+    uint64_t volume_bytes;  // Minimum size of an EXT2 volume, 0 for what the files need; the files go to its end
+    uint32_t seed;          // Seed of the sizes, the gaps and the contents
+} ImageGenConfig;
+
+/**
+ * @brief What was written, for the benchmark.
+ */
+typedef struct {
+    uint64_t image_bytes;   // Size of the image file (sparse where nothing was written)
+    uint64_t data_bytes;    // Bytes of file contents
+    uint32_t files;         // Files and directories actually created
+    uint32_t dirs;
+    char cat_name[64];      // Bare name of the last file, the worst case of a --cat walk
+    char cat_path[IMAGE_GEN_PATH_MAX]; // Full path of the same file
+    uint32_t cat_file;      // Number of the same file, for image_gen_contents
+    uint64_t cat_size;
+} ImageGenResult;
+
+/**
+ * @brief Fills a configuration with the defaults: 1000 files in 100 directories, EXT2 with 1K blocks.
+ *
+ * @param config Configuration to fill.
+ *
+ * @return void
+*/
+void image_gen_defaults(ImageGenConfig *config);
+
+/**
+ * @brief Writes a synthetic EXT2 or FAT16 image.
+ *
+ * The image is built in-process, without external tools, and only the blocks in
+ * use are written so large images stay sparse.
+ *
+ * @param config Shape of the file system.
+ * @param path Path of the image file, created or truncated.
+ * @param result Summary of what was written, can be NULL.
+ *
+ * @return 0 on success, -1 on error (a message is printed to stderr).
+*/
+int image_gen_write(const ImageGenConfig *config, const char *path, ImageGenResult *result);
+
+/**
+ * @brief Returns the contents the generator wrote in part of a file.
+ *
+ * @param config Configuration the image was generated with.
+ * @param file Number of the file, as in its name.
+ * @param offset Offset in the file, a multiple of 512.
+ * @param buffer Where the contents are stored.
+ * @param length Number of bytes.
+ *
+ * @return void
+*/
+void image_gen_contents(const ImageGenConfig *config, uint32_t file, uint64_t offset, void *buffer, size_t length);
+
+#endif // !_IMAGE_GEN_H
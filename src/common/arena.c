@@ -0,0 +1,93 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Alineación de todas las reservas, la de cualquier tipo básico
+#define ARENA_ALIGN (sizeof(max_align_t))
+
+struct ArenaChunk {
+    ArenaChunk *next;
+    size_t size;            // Usable bytes of data
+    size_t used;
+    max_align_t data[];
+};
+
+static ArenaChunk *arena_new_chunk(Arena *arena, size_t size) {
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + size);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->reserved += size;
+    return chunk;
+}
+
+/**
+ * @brief Allocates memory from an arena, aligned for any type.
+ *
+ * @param arena Arena to allocate from. A zeroed Arena is an empty arena.
+ * @param size Number of bytes.
+ *
+ * @return Pointer to the memory, valid until the next arena_reset, NULL if out of memory.
+*/
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    ArenaChunk *chunk = arena->chunks;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        chunk = arena_new_chunk(arena, size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+        if (chunk == NULL) {
+            return NULL;
+        }
+    }
+
+    void *memory = (uint8_t *)chunk->data + chunk->used;
+    chunk->used += size;
+    return memory;
+}
+
+/**
+ * @brief Releases every allocation of an arena.
+ *
+ * The memory is kept in a single chunk as large as everything the arena held,
+ * so an arena that is filled and reset again and again stops calling malloc.
+ *
+ * @param arena Arena to reset.
+ *
+ * @return void
+*/
+void arena_reset(Arena *arena) {
+    if (arena->chunks == NULL) {
+        return;
+    }
+
+    // Varios bloques se juntan en uno solo con el tamaño de todos
+    if (arena->chunks->next != NULL) {
+        size_t total = arena->reserved;
+        arena_free(arena);
+        if (arena_new_chunk(arena, total) == NULL) {
+            return; // The next arena_alloc will try again
+        }
+    }
+    arena->chunks->used = 0;
+}
+
+/**
+ * @brief Gives the memory of an arena back to the system.
+ *
+ * @param arena Arena to release. It is left empty and can be used again.
+ *
+ * @return void
+*/
+void arena_free(Arena *arena) {
+    while (arena->chunks != NULL) {
+        ArenaChunk *next = arena->chunks->next;
+        free(arena->chunks);
+        arena->chunks = next;
+    }
+    arena->reserved = 0;
+}
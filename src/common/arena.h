@@ -0,0 +1,50 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+// Tamaño mínimo de cada bloque de memoria que pide la arena
+#define ARENA_CHUNK_SIZE 4096
+
+typedef struct ArenaChunk ArenaChunk;
+
+/**
+ * @brief Bump allocator: allocations are only released all at once, with arena_reset.
+ */
+typedef struct {
+    ArenaChunk *chunks;     // Most recent chunk first
+    size_t reserved;        // Bytes held by the chunks
+} Arena;
+
+/**
+ * @brief Allocates memory from an arena, aligned for any type.
+ *
+ * @param arena Arena to allocate from. A zeroed Arena is an empty arena.
+ * @param size Number of bytes.
+ *
+ * @return Pointer to the memory, valid until the next arena_reset, NULL if out of memory.
+*/
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * @brief Releases every allocation of an arena.
+ *
+ * The memory is kept in a single chunk as large as everything the arena held,
+ * so an arena that is filled and reset again and again stops calling malloc.
+ *
+ * @param arena Arena to reset.
+ *
+ * @return void
+*/
+void arena_reset(Arena *arena);
+
+/**
+ * @brief Gives the memory of an arena back to the system.
+ *
+ * @param arena Arena to release. It is left empty and can be used again.
+ *
+ * @return void
+*/
+void arena_free(Arena *arena);
+
+#endif // !_ARENA_H
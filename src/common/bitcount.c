@@ -0,0 +1,168 @@
+#include "bitcount.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITCOUNT_X86 1
+#endif
+
+typedef uint64_t (*BitcountOnes)(const uint8_t *data, size_t length);
+typedef uint64_t (*BitcountZeroWords)(const uint16_t *words, size_t count);
+
+static uint64_t bitcount_ones_scalar(const uint8_t *data, size_t length) {
+    uint64_t count = 0;
+    size_t i = 0;
+
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        count += __builtin_popcountll(word);
+    }
+    for (; i < length; i++) {
+        count += __builtin_popcount(data[i]);
+    }
+    return count;
+}
+
+static uint64_t bitcount_zero_words_scalar(const uint16_t *words, size_t count) {
+    uint64_t zeros = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        zeros += words[i] == 0;
+    }
+    return zeros;
+}
+
+#ifdef BITCOUNT_X86
+
+// Igual que la versión escalar pero con la instrucción popcnt en lugar de la rutina de libgcc
+__attribute__((target("popcnt")))
+static uint64_t bitcount_ones_popcnt(const uint8_t *data, size_t length) {
+    uint64_t count = 0;
+    size_t i = 0;
+
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        count += __builtin_popcountll(word);
+    }
+    return count + bitcount_ones_scalar(data + i, length - i);
+}
+
+// Cuenta los bits de cada byte con una tabla de 16 entradas por nibble y los suma con vpsadbw
+__attribute__((target("avx2")))
+static uint64_t bitcount_ones_avx2(const uint8_t *data, size_t length) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i low = _mm256_shuffle_epi8(table, _mm256_and_si256(bytes, low_mask));
+        __m256i high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), low_mask));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256()));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + bitcount_ones_popcnt(data + i, length - i);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t bitcount_ones_avx512(const uint8_t *data, size_t length) {
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+
+    for (; i + 64 <= length; i += 64) {
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_loadu_si512((const void *)(data + i))));
+    }
+    return _mm512_reduce_add_epi64(total) + bitcount_ones_popcnt(data + i, length - i);
+}
+
+// Compara 16 palabras con cero de golpe; cada palabra igual pone dos bits en la máscara
+__attribute__((target("avx2,popcnt")))
+static uint64_t bitcount_zero_words_avx2(const uint16_t *words, size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t zeros = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256i equal = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(words + i)), zero);
+        zeros += __builtin_popcount((unsigned)_mm256_movemask_epi8(equal)) / 2;
+    }
+    return zeros + bitcount_zero_words_scalar(words + i, count - i);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static uint64_t bitcount_zero_words_avx512(const uint16_t *words, size_t count) {
+    const __m512i zero = _mm512_setzero_si512();
+    uint64_t zeros = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= count; i += 32) {
+        zeros += __builtin_popcount(_mm512_cmpeq_epi16_mask(_mm512_loadu_si512((const void *)(words + i)), zero));
+    }
+    return zeros + bitcount_zero_words_scalar(words + i, count - i);
+}
+
+#endif // BITCOUNT_X86
+
+static BitcountOnes ones_function = NULL;
+static BitcountZeroWords zero_words_function = NULL;
+
+// Elige las versiones según las extensiones del procesador; varios hilos eligen lo mismo
+static void bitcount_select(void) {
+    ones_function = bitcount_ones_scalar;
+    zero_words_function = bitcount_zero_words_scalar;
+
+#ifdef BITCOUNT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")) {
+        ones_function = bitcount_ones_avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        ones_function = bitcount_ones_avx2;
+    } else if (__builtin_cpu_supports("popcnt")) {
+        ones_function = bitcount_ones_popcnt;
+    }
+
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("popcnt")) {
+        zero_words_function = bitcount_zero_words_avx512;
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        zero_words_function = bitcount_zero_words_avx2;
+    }
+#endif
+}
+
+/**
+ * @brief Counts the bits set in a buffer.
+ *
+ * Uses AVX-512 (VPOPCNTDQ) or AVX2 when the processor has them, chosen once at the
+ * first call, and the popcnt instruction otherwise.
+ *
+ * @param data Buffer to count.
+ * @param length Number of bytes of the buffer.
+ *
+ * @return Number of bits set.
+*/
+uint64_t bitcount_ones(const void *data, size_t length) {
+    if (ones_function == NULL) bitcount_select();
+    return ones_function(data, length);
+}
+
+/**
+ * @brief Counts the 16 bit words that are zero (free clusters of a FAT16).
+ *
+ * Uses AVX-512 (BW) or AVX2 when the processor has them, like bitcount_ones.
+ *
+ * @param words Words to check.
+ * @param count Number of words.
+ *
+ * @return Number of words equal to zero.
+*/
+uint64_t bitcount_zero_words(const uint16_t *words, size_t count) {
+    if (zero_words_function == NULL) bitcount_select();
+    return zero_words_function(words, count);
+}
@@ -0,0 +1,32 @@
+#ifndef _BITCOUNT_H
+#define _BITCOUNT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Counts the bits set in a buffer.
+ *
+ * Uses AVX-512 (VPOPCNTDQ) or AVX2 when the processor has them, chosen once at the
+ * first call, and the popcnt instruction otherwise.
+ *
+ * @param data Buffer to count.
+ * @param length Number of bytes of the buffer.
+ *
+ * @return Number of bits set.
+*/
+uint64_t bitcount_ones(const void *data, size_t length);
+
+/**
+ * @brief Counts the 16 bit words that are zero (free clusters of a FAT16).
+ *
+ * Uses AVX-512 (BW) or AVX2 when the processor has them, like bitcount_ones.
+ *
+ * @param words Words to check.
+ * @param count Number of words.
+ *
+ * @return Number of words equal to zero.
+*/
+uint64_t bitcount_zero_words(const uint16_t *words, size_t count);
+
+#endif // !_BITCOUNT_H
@@ -1,35 +1,221 @@
 #include "cat.h"
+#include "path_index.h"
+#include "stats.h"
 #include "../ext2/ext2_reader.h"
 #include "../fat16/fat16_reader.h"
-#include "tree.h"
+#include "report.h"
+
+// Fitxer buscat per camí complet quan no hi ha índex
+typedef struct {
+    const char *path;
+    uint32_t key;
+    uint64_t size;
+} CatPathSearch;
+
+static int cat_match_path(const FsWalkEntry *entry, void *context) {
+    CatPathSearch *search = context;
+
+    if (entry->is_directory || strcmp(entry->path, search->path) != 0) {
+        return 0;
+    }
+    search->key = entry->key;
+    search->size = entry->size;
+    return 1;
+}
+
+/*
+    * @brief Displays the contents of a file.
+    * @param volume Volume of the EXT2 file system.
+    * @param inode Inode of the file to display.
+ */
+static void cat_ext2_file(Ext2Volume *volume, Ext2Inode *inode) {
+    uint32_t block_size = volume->block_size;
+    uint64_t size = ext2_inode_size(inode);
+
+    // Obtenim els trams de blocs contigus del fitxer, incloent els blocs indirectes
+    Ext2Extent *extents;
+    size_t extent_count;
+    if (ext2_build_extents(volume, inode, &extents, &extent_count) != 0) {
+        perror("Error mapping file blocks");
+        return;
+    }
+
+    // Buidem stdout abans d'escriure directament al descriptor per no desordenar la sortida
+    StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+    fflush(stdout);
+
+    for (size_t i = 0; i < extent_count; i++) {
+        // L'últim tram es retalla a la mida real del fitxer
+        uint64_t start = (uint64_t)extents[i].logical * block_size;
+        uint64_t length = (uint64_t)extents[i].length * block_size;
+        if (start + length > size) length = size - start;
+
+        // Els trams es copien de la imatge a la sortida sense passar per stdio, els forats s'escriuen com a zeros
+        int result = extents[i].physical == 0
+            ? output_zeros(STDOUT_FILENO, length)
+            : output_image_range(volume->image, (uint64_t)extents[i].physical * block_size, length, STDOUT_FILENO);
+        if (result != 0) {
+            perror("Error writing file contents");
+            break;  // Si la còpia falla, mostrem un missatge d'error i parem
+        }
+    }
+    stats_phase(previous);
+
+    free(extents);
+}
+
+/**
+ * @brief Writes the contents of a FAT16 file to stdout following its cluster chain.
+ * 
+ * @param volume Volume of the file system.
+ * @param start_cluster First cluster of the file.
+ * @param file_size Size of the file in bytes.
+ * 
+ * @return void
+*/
+static void cat_fat16_file(Fat16Volume *volume, uint16_t start_cluster, uint32_t file_size) {
+    const BootSector bpb = volume->boot_sector;
+    uint64_t cluster_size = (uint64_t)bpb.sectors_per_cluster * bpb.sector_size;
+    uint64_t bytes_read = 0;
+
+    Fat16Extent *extents;
+    size_t extent_count;
+    if (fat16_chain_extents(&volume->fat, start_cluster, &extents, &extent_count) != 0) {
+        perror("Error following cluster chain");
+        return;
+    }
+
+    // Flush what stdio holds before writing straight to the descriptor
+    StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+    fflush(stdout);
+
+    // Each run of consecutive clusters is sent to stdout with a single copy, without going through stdio
+    for (size_t e = 0; e < extent_count && bytes_read < file_size; e++) {
+        uint32_t first_sector_of_extent = calculate_first_sector_of_cluster(extents[e].start_cluster, bpb);
+        uint64_t bytes_to_read = extents[e].length * cluster_size;
+        bytes_to_read = bytes_read + bytes_to_read > file_size ? file_size - bytes_read : bytes_to_read;
+
+        if (output_image_range(volume->image, (uint64_t)first_sector_of_extent * bpb.sector_size, bytes_to_read, STDOUT_FILENO) != 0) {
+            perror("Error writing file contents");
+            break;
+        }
+
+        bytes_read += bytes_to_read;
+    }
+    stats_phase(previous);
+
+    free(extents);
+}
+
+/**
+ * @brief Looks a file up in the sidecar index of the image.
+ * 
+ * @return 1 if found, 0 if the index says it does not exist, -1 if there is no usable index.
+*/
+static int cat_lookup_index(Image *image, uint32_t fs_type, uint32_t fs_stamp, const char *fileName, uint32_t *key, uint64_t *size) {
+    PathIndex index;
+
+    if (path_index_open(&index, image, fs_type, fs_stamp) != 0) {
+        return -1;
+    }
+    int found = path_index_lookup(&index, fileName, key, size);
+    stats_cache(STATS_CACHE_PATH_INDEX, found);
+    path_index_close(&index);
+    return found;
+}
 
 /**
  * @brief Displays the contents of a file using the cat command.
  * 
- * @param fd File descriptor of the file system.
- * @param fileName Name of the file to display.
+ * The file is found through the sidecar index when it is up to date. Otherwise a name
+ * is searched in every directory, while a full path (starting with '/') is resolved one
+ * component at a time, through the hashed index of the EXT2 directories that have one.
+ * 
+ * @param image Image of the file system.
+ * @param fileName Name or full path of the file to display.
  * 
  * @return void
 */
-void cat_command(int fd, char* fileName) {
+void cat_command(Image *image, char* fileName) {
     printf("---- Cat Command ----\n\n");
 
+    uint32_t key;
+    uint64_t size;
+    int found;
+
     //Check if the file system is ext2 or fat16
-    if (is_ext2(fd)) {
-        Ext2Superblock superblock;
-        if (read_ext2_superblock(fd, &superblock) != 0) {
-            perror("Error reading superblock");
-            close(fd);
-            exit(-1);
-        }
-        if (!cat_ext2(fd, 2, &superblock, fileName, 2, 2)) {
+    if (is_ext2(image)) {
+        Ext2Volume volume;
+        if (ext2_open_volume(image, &volume) != 0) {
+            perror("Error opening EXT2 volume");
+            return;
+        }
+
+        found = cat_lookup_index(image, PATH_INDEX_FS_EXT2, volume.superblock.last_written_time, fileName, &key, &size);
+        if (found == -1 && fileName[0] == '/') {
+            // El camí es resol component a component, amb l'htree als directoris indexats
+            Ext2Inode inode;
+            int looked = ext2_lookup_path(&volume, fileName, &key, &inode);
+            if (looked == -1) {
+                perror("Error resolving path");
+                found = -2; // Ja s'ha informat de l'error, no és que el fitxer no hi sigui
+            } else {
+                found = looked == 1 && (inode.mode & 0xF000) != 0x4000;
+            }
+        }
+
+        if (found == -1) {
+            found = ext2_find_file(&volume, fileName, &key);
+            if (found == -1) {
+                perror("Error walking directories");
+            }
+            report_walk_error(volume.walk_error);
+        }
+        if (found == 1) {
+            Ext2Inode inode;
+            if (read_ext2_inode(&volume, key, &inode) == 0) {
+                cat_ext2_file(&volume, &inode);
+            } else {
+                perror("Error reading inode");
+            }
+        } else if (found == 0) {
             printf("File not found.\n");
         }
-    } else if (is_fat16(fd)) {
-        BootSector bootSector;
-        read_boot_sector(fd, &bootSector);
+        ext2_close_volume(&volume);
+    } else if (is_fat16(image)) {
+        Fat16Volume volume;
+        if (fat16_open_volume(image, &volume) != 0) {
+            perror("Error loading FAT");
+            return;
+        }
+        report_fat16_copies(&volume);
+
+        found = cat_lookup_index(image, PATH_INDEX_FS_FAT16, volume.boot_sector.volume_id, fileName, &key, &size);
+        if (found == -1 && fileName[0] == '/') {
+            CatPathSearch search = { fileName, 0, 0 };
+            found = fat16_walk(&volume, cat_match_path, &search) == 1;
+            key = search.key;
+            size = search.size;
+            report_walk_error(volume.walk_error);
+        }
 
-        fat16_recursion_tree(fd, bootSector, 0, fileName);
+        if (found == -1) {
+            uint16_t start_cluster;
+            uint32_t file_size;
+            found = fat16_find_file(&volume, fileName, &start_cluster, &file_size);
+            if (found == -1) {
+                perror("Error walking directories");
+            }
+            report_walk_error(volume.walk_error);
+            key = start_cluster;
+            size = file_size;
+        }
+        if (found == 1) {
+            cat_fat16_file(&volume, key, size);
+        } else if (found == 0) {
+            printf("File not found.\n");
+        }
+        fat16_close_volume(&volume);
     } else {
         printf("Invalid file system.\n");
     }
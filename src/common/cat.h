@@ -1,14 +1,20 @@
 #ifndef _CAT_H
 #define _CAT_H
 
+#include "image.h"
+
 /**
  * @brief Displays the contents of a file using the cat command.
  * 
- * @param fd File descriptor of the file system.
- * @param fileName Name of the file to display.
+ * The file is found through the sidecar index when it is up to date. Otherwise a name
+ * is searched in every directory, while a full path (starting with '/') is resolved one
+ * component at a time, through the hashed index of the EXT2 directories that have one.
+ * 
+ * @param image Image of the file system.
+ * @param fileName Name or full path of the file to display.
  * 
  * @return void
 */
-void cat_command(int fd, char* fileName);
+void cat_command(Image *image, char* fileName);
 
 #endif // !_CAT_H
\ No newline at end of file
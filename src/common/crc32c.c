@@ -0,0 +1,158 @@
+#include "crc32c.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32C_X86 1
+#endif
+
+// Polinomio de Castagnoli en orden reflejado
+#define CRC32C_POLY 0x82F63B78u
+
+typedef uint32_t (*Crc32cUpdate)(uint32_t crc, const uint8_t *data, size_t length);
+
+static uint32_t table[8][256];
+static uint32_t powers[67];         // x^(2^k) mod P: shifting by 8 * length bits needs k up to 66
+static Crc32cUpdate update_function = NULL;
+
+static uint32_t crc32c_scalar(uint32_t crc, const uint8_t *data, size_t length) {
+    // Ocho bytes por vuelta con una tabla por posición
+    for (; length >= 8; data += 8, length -= 8) {
+        uint32_t low, high;
+        memcpy(&low, data, 4);
+        memcpy(&high, data + 4, 4);
+        low ^= crc;
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+              table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+    }
+    for (; length > 0; data++, length--) {
+        crc = table[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CRC32C_X86
+
+// La instrucción crc32 usa el mismo polinomio; sin inversiones, igual que la versión escalar
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t length) {
+#if defined(__x86_64__)
+    uint64_t wide = crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = (uint32_t)wide;
+#endif
+    for (; length >= 4; data += 4, length -= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for (; length > 0; data++, length--) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+#endif // CRC32C_X86
+
+// Producto de dos polinomios módulo P, en orden reflejado
+static uint32_t crc32c_multiply(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+
+    for (uint32_t bit = 1u << 31; bit != 0; bit >>= 1) {
+        if (a & bit) product ^= b;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+// Tablas y versión según las extensiones del procesador; varios hilos calculan lo mismo
+static void crc32c_select(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            table[k][i] = table[0][table[k - 1][i] & 0xFF] ^ (table[k - 1][i] >> 8);
+        }
+    }
+
+    powers[0] = 1u << 30;       // x^1
+    for (int k = 1; k < 67; k++) {
+        powers[k] = crc32c_multiply(powers[k - 1], powers[k - 1]);
+    }
+
+    Crc32cUpdate selected = crc32c_scalar;
+#ifdef CRC32C_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        selected = crc32c_sse42;
+    }
+#endif
+    __atomic_store_n(&update_function, selected, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Updates a CRC32C (Castagnoli) without the initial and final inversions.
+ *
+ * Uses the crc32 instruction of SSE4.2 when the processor has it, chosen once at the
+ * first call, and a slicing-by-8 table otherwise. Without the inversions the CRC of a
+ * block does not depend on what comes before it, so blocks can be hashed in any order
+ * and joined with crc32c_shift.
+ *
+ * @param crc CRC of the previous bytes, 0 at the start.
+ * @param data Bytes to add.
+ * @param length Number of bytes.
+ *
+ * @return CRC of the previous bytes followed by data.
+*/
+uint32_t crc32c_raw(uint32_t crc, const void *data, size_t length) {
+    Crc32cUpdate update = __atomic_load_n(&update_function, __ATOMIC_ACQUIRE);
+
+    if (update == NULL) {
+        crc32c_select();
+        update = update_function;
+    }
+    return update(crc, data, length);
+}
+
+/**
+ * @brief Appends length zero bytes to a CRC of crc32c_raw.
+ *
+ * Takes O(log length) steps, so it also joins blocks: the CRC of A followed by B is
+ * crc32c_shift(crc(A), length(B)) ^ crc(B).
+ *
+ * @param crc CRC of the previous bytes.
+ * @param length Number of zero bytes.
+ *
+ * @return CRC of the previous bytes followed by the zeros.
+*/
+uint32_t crc32c_shift(uint32_t crc, uint64_t length) {
+    if (__atomic_load_n(&update_function, __ATOMIC_ACQUIRE) == NULL) crc32c_select();
+
+    // length bytes son 8 * length bits: x^(8 * length) con las potencias x^(2^k)
+    for (int k = 3; length != 0; k++, length >>= 1) {
+        if (length & 1) crc = crc32c_multiply(powers[k], crc);
+    }
+    return crc;
+}
+
+/**
+ * @brief Turns the CRC of crc32c_raw of a whole message into the standard CRC32C.
+ *
+ * @param crc CRC of the message.
+ * @param length Number of bytes of the message.
+ *
+ * @return Standard CRC32C, the same as with the initial and final inversions.
+*/
+uint32_t crc32c_finish(uint32_t crc, uint64_t length) {
+    return crc32c_shift(0xFFFFFFFFu, length) ^ crc ^ 0xFFFFFFFFu;
+}
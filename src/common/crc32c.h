@@ -0,0 +1,46 @@
+#ifndef _CRC32C_H
+#define _CRC32C_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Updates a CRC32C (Castagnoli) without the initial and final inversions.
+ *
+ * Uses the crc32 instruction of SSE4.2 when the processor has it, chosen once at the
+ * first call, and a slicing-by-8 table otherwise. Without the inversions the CRC of a
+ * block does not depend on what comes before it, so blocks can be hashed in any order
+ * and joined with crc32c_shift.
+ *
+ * @param crc CRC of the previous bytes, 0 at the start.
+ * @param data Bytes to add.
+ * @param length Number of bytes.
+ *
+ * @return CRC of the previous bytes followed by data.
+*/
+uint32_t crc32c_raw(uint32_t crc, const void *data, size_t length);
+
+/**
+ * @brief Appends length zero bytes to a CRC of crc32c_raw.
+ *
+ * Takes O(log length) steps, so it also joins blocks: the CRC of A followed by B is
+ * crc32c_shift(crc(A), length(B)) ^ crc(B).
+ *
+ * @param crc CRC of the previous bytes.
+ * @param length Number of zero bytes.
+ *
+ * @return CRC of the previous bytes followed by the zeros.
+*/
+uint32_t crc32c_shift(uint32_t crc, uint64_t length);
+
+/**
+ * @brief Turns the CRC of crc32c_raw of a whole message into the standard CRC32C.
+ *
+ * @param crc CRC of the message.
+ * @param length Number of bytes of the message.
+ *
+ * @return Standard CRC32C, the same as with the initial and final inversions.
+*/
+uint32_t crc32c_finish(uint32_t crc, uint64_t length);
+
+#endif // !_CRC32C_H
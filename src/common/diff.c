@@ -0,0 +1,318 @@
+#include "diff.h"
+#include "arena.h"
+#include "owner_map.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Rango de bytes distinto en las dos imágenes
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+} DiffRange;
+
+typedef struct {
+    Image *images[2];
+    uint64_t end;               // Size of the larger image
+
+    pthread_mutex_t lock;       // Protects the list of ranges
+    DiffRange *ranges;
+    size_t range_count;
+    size_t range_capacity;
+    int failed;
+} DiffContext;
+
+typedef struct {
+    DiffContext *diff;
+    uint64_t offset;
+} DiffTask;
+
+// Bytes cambiados de un dueño en cada imagen
+typedef struct {
+    const char *name;
+    uint64_t bytes[2];
+    uint64_t first;             // First changed byte, to print in the order of the image
+} DiffOwner;
+
+typedef struct {
+    DiffOwner *owners;
+    size_t count;
+    size_t capacity;
+    Arena arena;                // Names of the owners
+    const DiffRange *range;     // Range being looked up
+    int side;                   // Image whose map is being searched
+    uint64_t covered;           // Bytes of the range with an owner
+} DiffReport;
+
+static int diff_add_range(DiffRange **ranges, size_t *count, size_t *capacity, uint64_t start, uint64_t end) {
+    if (*count > 0 && (*ranges)[*count - 1].end == start) {
+        (*ranges)[*count - 1].end = end;
+        return 0;
+    }
+    if (*count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        DiffRange *bigger = realloc(*ranges, new_capacity * sizeof(DiffRange));
+        if (bigger == NULL) return -1;
+        *ranges = bigger;
+        *capacity = new_capacity;
+    }
+    (*ranges)[(*count)++] = (DiffRange){ start, end };
+    return 0;
+}
+
+// Compara un trozo de las dos imágenes sector a sector; lo que solo está en una de ellas también cambia
+static void diff_compare_task(ThreadPool *pool, void *arg) {
+    DiffTask *task = arg;
+    DiffContext *diff = task->diff;
+    uint64_t length = diff->end - task->offset < DIFF_CHUNK_SIZE ? diff->end - task->offset : DIFF_CHUNK_SIZE;
+    const uint8_t *views[2];
+    uint8_t *scratch[2] = { NULL, NULL };
+    uint64_t lengths[2];
+    DiffRange *ranges = NULL;
+    size_t count = 0, capacity = 0;
+    int failed = 0;
+    (void)pool;
+
+    for (int side = 0; side < 2; side++) {
+        Image *image = diff->images[side];
+        lengths[side] = task->offset >= image->size ? 0 : image->size - task->offset < length ? image->size - task->offset : length;
+        views[side] = NULL;
+        if (lengths[side] == 0) continue;
+        if (image->data == NULL && (scratch[side] = malloc(lengths[side])) == NULL) {
+            failed = 1;
+            continue;
+        }
+        if ((views[side] = image_view(image, task->offset, lengths[side], scratch[side])) == NULL) failed = 1;
+    }
+
+    for (uint64_t unit = 0; unit < length && !failed; unit += DIFF_UNIT) {
+        uint64_t size = length - unit < DIFF_UNIT ? length - unit : DIFF_UNIT;
+        int changed = unit + size > lengths[0] || unit + size > lengths[1] || memcmp(views[0] + unit, views[1] + unit, size) != 0;
+        if (changed && diff_add_range(&ranges, &count, &capacity, task->offset + unit, task->offset + unit + size) != 0) failed = 1;
+    }
+
+    pthread_mutex_lock(&diff->lock);
+    for (size_t i = 0; i < count && !failed; i++) {
+        failed = diff_add_range(&diff->ranges, &diff->range_count, &diff->range_capacity, ranges[i].start, ranges[i].end) != 0;
+    }
+    diff->failed |= failed;
+    pthread_mutex_unlock(&diff->lock);
+
+    free(ranges);
+    free(scratch[0]);
+    free(scratch[1]);
+}
+
+static int diff_compare_ranges(const void *a, const void *b) {
+    const DiffRange *x = a, *y = b;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+// Compara las dos imágenes con una tarea por trozo y junta los rangos contiguos
+static int diff_compare(DiffContext *diff, int threads) {
+    size_t task_count = (diff->end + DIFF_CHUNK_SIZE - 1) / DIFF_CHUNK_SIZE;
+    DiffTask *tasks = malloc((task_count ? task_count : 1) * sizeof(DiffTask));
+    ThreadPool pool;
+
+    if (tasks == NULL) return -1;
+    for (size_t i = 0; i < task_count; i++) {
+        tasks[i] = (DiffTask){ diff, (uint64_t)i * DIFF_CHUNK_SIZE };
+    }
+    if (threads > 1 && thread_pool_init(&pool, threads) == 0) {
+        for (size_t i = 0; i < task_count; i++) {
+            if (thread_pool_submit(&pool, diff_compare_task, &tasks[i]) != 0) diff_compare_task(&pool, &tasks[i]);
+        }
+        thread_pool_wait(&pool);
+        thread_pool_destroy(&pool);
+    } else {
+        for (size_t i = 0; i < task_count; i++) diff_compare_task(NULL, &tasks[i]);
+    }
+    free(tasks);
+    if (diff->failed) return -1;
+
+    // Los trozos terminan en orden cualquiera; un cambio que cruza dos trozos vuelve a ser un rango
+    if (diff->range_count > 0) qsort(diff->ranges, diff->range_count, sizeof(DiffRange), diff_compare_ranges);
+    size_t merged = 0;
+    for (size_t i = 0; i < diff->range_count; i++) {
+        if (merged > 0 && diff->ranges[merged - 1].end == diff->ranges[i].start) {
+            diff->ranges[merged - 1].end = diff->ranges[i].end;
+        } else {
+            diff->ranges[merged++] = diff->ranges[i];
+        }
+    }
+    diff->range_count = merged;
+    return 0;
+}
+
+static int diff_add_owner(DiffReport *report, const char *name, uint64_t bytes, uint64_t first) {
+    if (report->count == report->capacity) {
+        size_t capacity = report->capacity ? report->capacity * 2 : 64;
+        DiffOwner *bigger = realloc(report->owners, capacity * sizeof(DiffOwner));
+        if (bigger == NULL) return -1;
+        report->owners = bigger;
+        report->capacity = capacity;
+    }
+
+    char *copy = arena_alloc(&report->arena, strlen(name) + 1);
+    if (copy == NULL) return -1;
+    strcpy(copy, name);
+    DiffOwner *owner = &report->owners[report->count++];
+    owner->name = copy;
+    owner->bytes[report->side] = bytes;
+    owner->bytes[!report->side] = 0;
+    owner->first = first;
+    return 0;
+}
+
+// Parte de un rango cambiado que cae en un rango del mapa
+static int diff_owner_found(const OwnerMap *map, const OwnerRange *range, void *context) {
+    DiffReport *report = context;
+    uint64_t start = range->start > report->range->start ? range->start : report->range->start;
+    uint64_t end = range->end < report->range->end ? range->end : report->range->end;
+    char name[4352];
+
+    owner_map_describe(map, range, name, sizeof(name));
+    report->covered += end - start;
+    return diff_add_owner(report, name, end - start, start);
+}
+
+static int diff_compare_names(const void *a, const void *b) {
+    return strcmp(((const DiffOwner *)a)->name, ((const DiffOwner *)b)->name);
+}
+
+static int diff_compare_first(const void *a, const void *b) {
+    const DiffOwner *x = a, *y = b;
+    return x->first < y->first ? -1 : x->first > y->first;
+}
+
+/**
+ * @brief Adds up the changed bytes of every owner in both images and prints them.
+ *
+ * The bytes of a changed range that no range of a map covers are free space of that
+ * image, and the ones past the end of an image count only for the other one. The lines
+ * are sorted by the first changed byte of each owner.
+*/
+static int diff_report(const DiffContext *diff, const OwnerMap *maps[2]) {
+    DiffReport report;
+    int result = 0;
+
+    memset(&report, 0, sizeof(DiffReport));
+    for (size_t i = 0; i < diff->range_count && result == 0; i++) {
+        for (report.side = 0; report.side < 2 && result == 0; report.side++) {
+            // Lo que pasa del final de una imagen no tiene dueño en ella
+            uint64_t size = diff->images[report.side]->size;
+            DiffRange range = { diff->ranges[i].start, diff->ranges[i].end < size ? diff->ranges[i].end : size };
+            if (maps[report.side] == NULL || range.start >= range.end) continue;
+
+            report.range = &range;
+            report.covered = 0;
+            result = owner_map_find(maps[report.side], range.start, range.end, diff_owner_found, &report);
+            if (result == 0 && report.covered < range.end - range.start) {
+                result = diff_add_owner(&report, "free space", range.end - range.start - report.covered, range.start);
+            }
+        }
+    }
+
+    if (result == 0 && report.count > 0) {
+        // Un dueño por nombre, con los bytes de las dos imágenes
+        qsort(report.owners, report.count, sizeof(DiffOwner), diff_compare_names);
+        size_t merged = 0;
+        for (size_t i = 0; i < report.count; i++) {
+            DiffOwner *owner = &report.owners[i];
+            if (merged > 0 && strcmp(report.owners[merged - 1].name, owner->name) == 0) {
+                DiffOwner *previous = &report.owners[merged - 1];
+                previous->bytes[0] += owner->bytes[0];
+                previous->bytes[1] += owner->bytes[1];
+                if (owner->first < previous->first) previous->first = owner->first;
+            } else {
+                report.owners[merged++] = *owner;
+            }
+        }
+        report.count = merged;
+        qsort(report.owners, report.count, sizeof(DiffOwner), diff_compare_first);
+
+        printf("\n%12s %12s  %s\n", "Bytes A", "Bytes B", "Owner");
+        for (size_t i = 0; i < report.count; i++) {
+            printf("%12llu %12llu  %s\n", (unsigned long long)report.owners[i].bytes[0],
+                   (unsigned long long)report.owners[i].bytes[1], report.owners[i].name);
+        }
+    }
+
+    free(report.owners);
+    arena_free(&report.arena);
+    return result;
+}
+
+/**
+ * @brief Compares two images of the same volume and shows which files and structures changed.
+ *
+ * Both images are read once, in chunks of DIFF_CHUNK_SIZE that a thread pool compares
+ * sector by sector. The changed sectors are then looked up in the owner maps of both
+ * images (block maps or cluster chains, and the metadata of the volume), so a file is
+ * reported with the bytes that changed where it lives in each image.
+ *
+ * @param image First image.
+ * @param other_path Path of the second image.
+ * @param threads Number of threads that compare the chunks and read the block maps.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int diff_command(Image *image, const char *other_path, int threads) {
+    printf("---- Diff Command ----\n\n");
+
+    Image other;
+    if (image_open(&other, other_path) == -1) {
+        perror("Error opening file");
+        return -1;
+    }
+
+    DiffContext diff;
+    memset(&diff, 0, sizeof(DiffContext));
+    diff.images[0] = image;
+    diff.images[1] = &other;
+    diff.end = image->size > other.size ? image->size : other.size;
+    pthread_mutex_init(&diff.lock, NULL);
+
+    StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+    int result = diff_compare(&diff, threads);
+    stats_phase(previous);
+
+    if (result != 0) {
+        perror("Error comparing the images");
+    } else if (diff.range_count == 0) {
+        printf("The images are identical (%llu bytes)\n", (unsigned long long)image->size);
+    } else {
+        uint64_t changed = 0;
+        for (size_t i = 0; i < diff.range_count; i++) changed += diff.ranges[i].end - diff.ranges[i].start;
+        if (image->size != other.size) {
+            printf("Sizes: %llu and %llu bytes\n", (unsigned long long)image->size, (unsigned long long)other.size);
+        }
+        printf("%llu bytes changed in %zu ranges\n", (unsigned long long)changed, diff.range_count);
+
+        // Sin mapa de una imagen sus bytes no tienen dueño, pero el resto del informe sigue valiendo
+        OwnerMap maps[2];
+        const OwnerMap *found[2] = { NULL, NULL };
+        for (int side = 0; side < 2; side++) {
+            if (owner_map_build(&maps[side], diff.images[side], threads) == 0) {
+                found[side] = &maps[side];
+            } else {
+                result = -1;
+            }
+        }
+        if (diff_report(&diff, found) != 0) {
+            perror("Error comparing the images");
+            result = -1;
+        }
+        owner_map_free(&maps[0]);
+        owner_map_free(&maps[1]);
+    }
+
+    free(diff.ranges);
+    pthread_mutex_destroy(&diff.lock);
+    image_close(&other);
+    return result;
+}
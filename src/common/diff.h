@@ -0,0 +1,28 @@
+#ifndef _DIFF_H
+#define _DIFF_H
+
+#include "image.h"
+
+// Bytes de cada imagen que compara una tarea
+#define DIFF_CHUNK_SIZE (4 * 1024 * 1024)
+
+// Unidad de los cambios: un sector
+#define DIFF_UNIT 512
+
+/**
+ * @brief Compares two images of the same volume and shows which files and structures changed.
+ *
+ * Both images are read once, in chunks of DIFF_CHUNK_SIZE that a thread pool compares
+ * sector by sector. The changed sectors are then looked up in the owner maps of both
+ * images (block maps or cluster chains, and the metadata of the volume), so a file is
+ * reported with the bytes that changed where it lives in each image.
+ *
+ * @param image First image.
+ * @param other_path Path of the second image.
+ * @param threads Number of threads that compare the chunks and read the block maps.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int diff_command(Image *image, const char *other_path, int threads);
+
+#endif // !_DIFF_H
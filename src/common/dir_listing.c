@@ -0,0 +1,58 @@
+#include "dir_listing.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Appends an entry to a listing.
+ *
+ * @param listing Listing to extend.
+ * @param name Name of the entry, it does not need to be NUL terminated.
+ * @param name_len Length of the name.
+ * @param entry Rest of the fields of the entry; name and child are ignored.
+ *
+ * @return 0 on success, -1 on error (out of memory).
+*/
+int dir_listing_add(DirListing *listing, const char *name, size_t name_len, const DirListingEntry *entry) {
+    if (listing->count == listing->capacity) {
+        size_t capacity = listing->capacity ? listing->capacity * 2 : 16;
+        DirListingEntry *bigger = realloc(listing->entries, capacity * sizeof(DirListingEntry));
+        if (bigger == NULL) {
+            return -1;
+        }
+        listing->entries = bigger;
+        listing->capacity = capacity;
+    }
+
+    char *copy = malloc(name_len + 1);
+    if (copy == NULL) {
+        return -1;
+    }
+    memcpy(copy, name, name_len);
+    copy[name_len] = '\0';
+
+    DirListingEntry *added = &listing->entries[listing->count++];
+    *added = *entry;
+    added->name = copy;
+    added->child = NULL;
+    return 0;
+}
+
+/**
+ * @brief Releases a listing and, recursively, the listings of its subdirectories.
+ *
+ * @param listing Listing to release. The structure itself is not freed.
+ *
+ * @return void
+*/
+void dir_listing_free(DirListing *listing) {
+    for (size_t i = 0; i < listing->count; i++) {
+        free(listing->entries[i].name);
+        if (listing->entries[i].child != NULL) {
+            dir_listing_free(listing->entries[i].child);
+            free(listing->entries[i].child);
+        }
+    }
+    free(listing->entries);
+    memset(listing, 0, sizeof(DirListing));
+}
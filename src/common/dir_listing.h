@@ -0,0 +1,51 @@
+#ifndef _DIR_LISTING_H
+#define _DIR_LISTING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct DirListing DirListing;
+
+// Entrada de un directorio tal y como se mostrará en el árbol
+typedef struct {
+    char *name;             // Name of the entry (lower case 8.3 name on FAT16), NUL terminated
+    uint32_t key;           // Inode (EXT2) or start cluster (FAT16) of the entry
+    uint32_t size;          // Size in bytes of the entry
+    uint8_t is_directory;
+    uint8_t is_last;        // Last entry of its directory, drawn with └
+    uint8_t printed;        // 0 for entries that are explored but not shown
+    uint8_t explore;        // 1 if the entry is a subdirectory that has to be walked
+    DirListing *child;      // Listing of the subdirectory, filled by the parallel walk
+} DirListingEntry;
+
+/**
+ * @brief Entries of one directory, in the order they are printed.
+ */
+struct DirListing {
+    DirListingEntry *entries;
+    size_t count;
+    size_t capacity;
+};
+
+/**
+ * @brief Appends an entry to a listing.
+ *
+ * @param listing Listing to extend.
+ * @param name Name of the entry, it does not need to be NUL terminated.
+ * @param name_len Length of the name.
+ * @param entry Rest of the fields of the entry; name and child are ignored.
+ *
+ * @return 0 on success, -1 on error (out of memory).
+*/
+int dir_listing_add(DirListing *listing, const char *name, size_t name_len, const DirListingEntry *entry);
+
+/**
+ * @brief Releases a listing and, recursively, the listings of its subdirectories.
+ *
+ * @param listing Listing to release. The structure itself is not freed.
+ *
+ * @return void
+*/
+void dir_listing_free(DirListing *listing);
+
+#endif // !_DIR_LISTING_H
@@ -0,0 +1,218 @@
+#include "extract.h"
+#include "file_scan.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct {
+    int dirfd;              // Destination directory
+    size_t files;
+    size_t directories;
+    size_t skipped;
+    uint64_t bytes;
+} ExtractContext;
+
+// Los nombres de la imagen no pueden sacar un fichero fuera del destino
+static int extract_safe_path(const char *path) {
+    for (const char *c = path; *c != '\0';) {
+        const char *end = strchr(c, '/');
+        size_t length = end != NULL ? (size_t)(end - c) : strlen(c);
+
+        if (length == 0 || (c[0] == '.' && (length == 1 || (length == 2 && c[1] == '.')))) return 0;
+        c += length + (end != NULL);
+    }
+    return 1;
+}
+
+// Crea los directorios de un camino hasta length bytes, como mkdir -p
+static int extract_make_directories(int dirfd, char *path, size_t length) {
+    for (size_t i = 1; i <= length; i++) {
+        if (i < length && path[i] != '/') continue;
+
+        char saved = path[i];
+        path[i] = '\0';
+        int result = mkdirat(dirfd, path, 0777);
+        path[i] = saved;
+        if (result != 0 && errno != EEXIST) return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Creates the directories and the files of the entries.
+ *
+ * The files are created with their final size, so the holes and the bytes past the last
+ * segment need no writes. The entries that cannot be created are marked as failed, so
+ * their segments are not written.
+*/
+static int extract_prepare(ExtractContext *extract, FileScan *scan) {
+    const char *parent = "";    // Last directory known to exist
+    size_t parent_length = 0;
+    int result = 0;
+
+    for (size_t i = 0; i < scan->entry_count; i++) {
+        FileScanEntry *entry = &scan->entries[i];
+        const char *slash = strrchr(entry->path, '/');
+        size_t length = slash != NULL ? (size_t)(slash - entry->path) : 0;
+
+        if (entry->state == FILE_SCAN_FAILED) {
+            result = -1;
+            continue;
+        }
+        if (entry->state == FILE_SCAN_SPECIAL || !extract_safe_path(entry->path)) {
+            if (entry->state == FILE_SCAN_OK) fprintf(stderr, "Skipping unsafe path %s\n", entry->path);
+            entry->state = FILE_SCAN_FAILED;
+            extract->skipped++;
+            continue;
+        }
+
+        if (length > 0 && (length != parent_length || memcmp(entry->path, parent, length) != 0)) {
+            if (extract_make_directories(extract->dirfd, entry->path, length) != 0) {
+                fprintf(stderr, "Error creating the directories of %s: %s\n", entry->path, strerror(errno));
+                entry->state = FILE_SCAN_FAILED;
+                result = -1;
+                continue;
+            }
+            parent = entry->path;
+            parent_length = length;
+        }
+
+        if (entry->is_directory) {
+            if (mkdirat(extract->dirfd, entry->path, 0777) != 0 && errno != EEXIST) {
+                fprintf(stderr, "Error creating %s: %s\n", entry->path, strerror(errno));
+                result = -1;
+                continue;
+            }
+            parent = entry->path;
+            parent_length = strlen(entry->path);
+            extract->directories++;
+            continue;
+        }
+
+        int fd = openat(extract->dirfd, entry->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd < 0 || ftruncate(fd, (off_t)entry->size) != 0) {
+            fprintf(stderr, "Error creating %s: %s\n", entry->path, strerror(errno));
+            if (fd >= 0) close(fd);
+            entry->state = FILE_SCAN_FAILED;
+            result = -1;
+            continue;
+        }
+        close(fd);
+        extract->files++;
+        extract->bytes += entry->size;
+    }
+    return result;
+}
+
+// Escribe un trozo de un fichero, repitiendo las escrituras parciales
+static int extract_pwrite_all(int fd, const uint8_t *data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, (off_t)offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += written;
+        offset += written;
+        length -= written;
+    }
+    return 0;
+}
+
+// Escribe los tramos de una lectura en sus ficheros, abriendo cada fichero una vez por racha
+static int extract_write_run(FileScan *scan, const FileScanRun *run, const uint8_t *data, void *context) {
+    ExtractContext *extract = context;
+    uint32_t open_file = UINT32_MAX;
+    int fd = -1;
+    int result = 0;
+
+    for (size_t i = run->first; i < run->first + run->count; i++) {
+        const FileScanSegment *segment = &scan->segments[i];
+        const FileScanEntry *entry = &scan->entries[segment->file];
+
+        if (entry->state != FILE_SCAN_OK) continue;
+        if (segment->file != open_file) {
+            if (fd >= 0) close(fd);
+            open_file = segment->file;
+            if ((fd = openat(extract->dirfd, entry->path, O_WRONLY | O_CLOEXEC)) < 0) {
+                fprintf(stderr, "Error opening %s: %s\n", entry->path, strerror(errno));
+                result = -1;
+            }
+        }
+        if (fd >= 0 && extract_pwrite_all(fd, data + (segment->physical - run->offset), segment->length, segment->logical) != 0) {
+            fprintf(stderr, "Error writing %s: %s\n", entry->path, strerror(errno));
+            result = -1;
+        }
+    }
+    if (fd >= 0) close(fd);
+    return result;
+}
+
+// Abre el directorio de destino, creándolo si no existe
+static int extract_open_dest(const char *dest) {
+    if (mkdir(dest, 0777) != 0 && errno != EEXIST) return -1;
+    return open(dest, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+/**
+ * @brief Copies files and directories of an image to a directory of the host.
+ *
+ * Every target is resolved with one walk of the volume before reading any data, and
+ * the extents of all the files go to one list sorted by their offset in the image. The
+ * list is read in that order with large reads that merge adjacent ranges, even from
+ * different files, so a whole volume is read in about one pass over the image. With
+ * several threads the reads are written to the output files by a thread pool while the
+ * next ones are read. Holes are left as holes of the output files.
+ *
+ * @param image Image of the file system.
+ * @param dest Directory where the files are written with their full paths; it is created if missing.
+ * @param paths Absolute paths of the files and directories to extract, a directory with all its contents.
+ * @param path_count Number of paths, 0 for the whole volume.
+ * @param threads Number of threads that write the files, 1 to read and write in turns.
+ *
+ * @return 0 on success, -1 if a path was not found or on error.
+*/
+int extract_command(Image *image, const char *dest, const char *const *paths, size_t path_count, int threads) {
+    printf("---- Extract Command ----\n\n");
+
+    ExtractContext extract;
+    FileScan scan;
+    memset(&extract, 0, sizeof(ExtractContext));
+
+    int result = 0;
+    if (file_scan_init(&scan, image, paths, path_count) != 0) {
+        perror("Error extracting");
+        result = -1;
+    } else if ((extract.dirfd = extract_open_dest(dest)) < 0) {
+        fprintf(stderr, "Error opening %s: %s\n", dest, strerror(errno));
+        result = -1;
+    } else {
+        // Todo se resuelve y se crea antes de leer el primer byte de datos
+        if (file_scan_collect(&scan) != 0) {
+            result = -1;
+        } else {
+            if (scan.missing > 0 || extract_prepare(&extract, &scan) != 0) result = -1;
+
+            StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+            size_t reads;
+            if (file_scan_stream(&scan, threads, extract_write_run, &extract, &reads) != 0) result = -1;
+            stats_phase(previous);
+
+            printf("%zu files (%llu bytes) and %zu directories extracted to %s (reads: %zu)\n",
+                   extract.files, (unsigned long long)extract.bytes, extract.directories, dest, reads);
+            if (extract.skipped > 0) {
+                printf("%zu entries skipped: not regular files or directories, or unsafe names\n", extract.skipped);
+            }
+        }
+        close(extract.dirfd);
+    }
+
+    file_scan_free(&scan);
+    return result;
+}
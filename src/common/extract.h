@@ -0,0 +1,28 @@
+#ifndef _EXTRACT_H
+#define _EXTRACT_H
+
+#include <stddef.h>
+
+#include "image.h"
+
+/**
+ * @brief Copies files and directories of an image to a directory of the host.
+ *
+ * Every target is resolved with one walk of the volume before reading any data, and
+ * the extents of all the files go to one list sorted by their offset in the image. The
+ * list is read in that order with large reads that merge adjacent ranges, even from
+ * different files, so a whole volume is read in about one pass over the image. With
+ * several threads the reads are written to the output files by a thread pool while the
+ * next ones are read. Holes are left as holes of the output files.
+ *
+ * @param image Image of the file system.
+ * @param dest Directory where the files are written with their full paths; it is created if missing.
+ * @param paths Absolute paths of the files and directories to extract, a directory with all its contents.
+ * @param path_count Number of paths, 0 for the whole volume.
+ * @param threads Number of threads that write the files, 1 to read and write in turns.
+ *
+ * @return 0 on success, -1 if a path was not found or on error.
+*/
+int extract_command(Image *image, const char *dest, const char *const *paths, size_t path_count, int threads);
+
+#endif // !_EXTRACT_H
@@ -0,0 +1,420 @@
+#include "file_scan.h"
+#include "fs_walk.h"
+#include "thread_pool.h"
+#include "../ext2/ext2_reader.h"
+#include "../fat16/fat16_reader.h"
+#include "report.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct FileScanBuffer {
+    FileScan *scan;
+    FileScanRun run;
+    uint8_t *data;
+    FileScanBuffer *next;
+};
+
+static int file_scan_compare_paths(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Orden de la imagen; los empates, en el orden de los ficheros
+static int file_scan_compare_segments(const void *a, const void *b) {
+    const FileScanSegment *x = a, *y = b;
+
+    if (x->physical != y->physical) return x->physical < y->physical ? -1 : 1;
+    return x->sequence < y->sequence ? -1 : x->sequence > y->sequence;
+}
+
+// Camino con una sola '/' entre componentes y sin '/' final, "" para la raíz
+static const char *file_scan_normalize(Arena *arena, const char *path) {
+    char *normalized = arena_alloc(arena, strlen(path) + 2);
+    size_t length = 0;
+
+    if (normalized == NULL) return NULL;
+    for (const char *c = path; *c != '\0'; c++) {
+        if (*c == '/') continue;
+        if (c == path || c[-1] == '/') normalized[length++] = '/';
+        normalized[length++] = *c;
+    }
+    normalized[length] = '\0';
+    return normalized;
+}
+
+/**
+ * @brief Prepares a scan of some paths of an image.
+ *
+ * @param scan Scan to initialize.
+ * @param image Image of the file system.
+ * @param paths Absolute paths of the files and directories, a directory with all its contents; "/" is the whole volume.
+ * @param path_count Number of paths, 0 for the whole volume.
+ *
+ * @return 0 on success, -1 if out of memory.
+*/
+int file_scan_init(FileScan *scan, Image *image, const char *const *paths, size_t path_count) {
+    int whole_volume = 0;
+
+    memset(scan, 0, sizeof(FileScan));
+    scan->image = image;
+    scan->inside_depth = -1;
+    pthread_mutex_init(&scan->lock, NULL);
+    pthread_cond_init(&scan->buffer_free, NULL);
+
+    scan->targets = malloc((path_count ? path_count : 1) * sizeof(const char *));
+    scan->found = calloc(path_count ? path_count : 1, 1);
+    if (scan->targets == NULL || scan->found == NULL) return -1;
+
+    for (size_t i = 0; i < path_count; i++) {
+        const char *target = file_scan_normalize(&scan->arena, paths[i]);
+        if (target == NULL) return -1;
+        if (target[0] == '\0') {
+            whole_volume = 1;
+        } else {
+            scan->targets[scan->target_count++] = target;
+        }
+    }
+    if (whole_volume) {
+        scan->target_count = 0;
+    }
+
+    qsort(scan->targets, scan->target_count, sizeof(const char *), file_scan_compare_paths);
+    size_t unique = 0;
+    for (size_t i = 0; i < scan->target_count; i++) {
+        if (unique == 0 || strcmp(scan->targets[unique - 1], scan->targets[i]) != 0) {
+            scan->targets[unique++] = scan->targets[i];
+        }
+    }
+    scan->target_count = unique;
+    return 0;
+}
+
+// Guarda las entradas seleccionadas del recorrido
+static int file_scan_select(const FsWalkEntry *entry, void *context) {
+    FileScan *scan = context;
+
+    if (scan->inside_depth >= 0 && entry->depth <= scan->inside_depth) {
+        scan->inside_depth = -1;
+    }
+    int selected = scan->inside_depth >= 0 || scan->target_count == 0;
+    if (scan->target_count > 0) {
+        const char **match = bsearch(&entry->path, scan->targets, scan->target_count, sizeof(const char *), file_scan_compare_paths);
+        if (match != NULL) {
+            scan->found[match - scan->targets] = 1;
+            if (!selected && entry->is_directory) scan->inside_depth = entry->depth;
+            selected = 1;
+        }
+    }
+    if (!selected) return 0;
+
+    if (scan->entry_count == scan->entry_capacity) {
+        size_t capacity = scan->entry_capacity ? scan->entry_capacity * 2 : 256;
+        FileScanEntry *bigger = realloc(scan->entries, capacity * sizeof(FileScanEntry));
+        if (bigger == NULL) return -1;
+        scan->entries = bigger;
+        scan->entry_capacity = capacity;
+    }
+    FileScanEntry *added = &scan->entries[scan->entry_count];
+    size_t length = strlen(entry->path);
+    if ((added->path = arena_alloc(&scan->arena, length)) == NULL) return -1;
+    memcpy(added->path, entry->path + 1, length);
+    added->key = entry->key;
+    added->size = entry->size;
+    added->is_directory = entry->is_directory;
+    added->state = FILE_SCAN_OK;
+    scan->entry_count++;
+    return 0;
+}
+
+// Añade un tramo de un fichero, partido en trozos que caben en una lectura
+static int file_scan_add_range(FileScan *scan, uint32_t file, uint64_t logical, uint64_t physical, uint64_t length) {
+    while (length > 0) {
+        if (scan->segment_count == scan->segment_capacity) {
+            size_t capacity = scan->segment_capacity ? scan->segment_capacity * 2 : 1024;
+            FileScanSegment *bigger = realloc(scan->segments, capacity * sizeof(FileScanSegment));
+            if (bigger == NULL) return -1;
+            scan->segments = bigger;
+            scan->segment_capacity = capacity;
+        }
+        uint32_t part = length < FILE_SCAN_IO_SIZE ? (uint32_t)length : FILE_SCAN_IO_SIZE;
+        scan->segments[scan->segment_count] = (FileScanSegment){ physical, logical, part, file, (uint32_t)scan->segment_count };
+        scan->segment_count++;
+        logical += part;
+        physical += part;
+        length -= part;
+    }
+    return 0;
+}
+
+// Tramos de un fichero EXT2 según su mapa de bloques; los huecos no tienen tramo
+static int file_scan_map_ext2(FileScan *scan, Ext2Volume *volume, uint32_t file) {
+    FileScanEntry *entry = &scan->entries[file];
+    Ext2Inode inode;
+    Ext2Extent *extents;
+    size_t count;
+
+    if (read_ext2_inode(volume, entry->key, &inode) != 0) return -1;
+    if ((inode.mode & 0xF000) != 0x8000) {
+        entry->state = FILE_SCAN_SPECIAL;
+        return 0;
+    }
+    entry->size = ext2_inode_size(&inode);
+    if (ext2_build_extents(volume, &inode, &extents, &count) != 0) return -1;
+
+    int result = 0;
+    for (size_t i = 0; i < count && result == 0; i++) {
+        uint64_t logical = (uint64_t)extents[i].logical * volume->block_size;
+        uint64_t length = (uint64_t)extents[i].length * volume->block_size;
+
+        if (extents[i].physical == 0 || logical >= entry->size) continue;
+        if (length > entry->size - logical) length = entry->size - logical;
+        result = file_scan_add_range(scan, file, logical, (uint64_t)extents[i].physical * volume->block_size, length);
+    }
+    free(extents);
+    return result;
+}
+
+// Tramos de un fichero FAT16 según su cadena de clusters
+static int file_scan_map_fat16(FileScan *scan, Fat16Volume *volume, uint32_t file) {
+    const FileScanEntry *entry = &scan->entries[file];
+    const BootSector *bpb = &volume->boot_sector;
+    uint64_t cluster_size = (uint64_t)bpb->sectors_per_cluster * bpb->sector_size;
+    Fat16Extent *extents;
+    size_t count;
+
+    if (entry->size == 0) return 0;
+    if (fat16_chain_extents(&volume->fat, (uint16_t)entry->key, &extents, &count) != 0) return -1;
+
+    int result = 0;
+    uint64_t logical = 0;
+    for (size_t i = 0; i < count && logical < entry->size && result == 0; i++) {
+        uint64_t length = extents[i].length * cluster_size;
+        uint64_t physical = (uint64_t)calculate_first_sector_of_cluster(extents[i].start_cluster, *bpb) * bpb->sector_size;
+
+        if (length > entry->size - logical) length = entry->size - logical;
+        result = file_scan_add_range(scan, file, logical, physical, length);
+        logical += length;
+    }
+    free(extents);
+    return result;
+}
+
+// Tramos de todos los ficheros; exactamente uno de los volúmenes no es NULL
+static void file_scan_map(FileScan *scan, Ext2Volume *ext2, Fat16Volume *fat16) {
+    for (size_t i = 0; i < scan->entry_count; i++) {
+        FileScanEntry *entry = &scan->entries[i];
+        if (entry->is_directory) continue;
+
+        size_t first_segment = scan->segment_count;
+        int mapped = ext2 != NULL ? file_scan_map_ext2(scan, ext2, (uint32_t)i) : file_scan_map_fat16(scan, fat16, (uint32_t)i);
+        if (mapped != 0) {
+            fprintf(stderr, "Error reading the blocks of /%s\n", entry->path);
+            scan->segment_count = first_segment;
+            entry->state = FILE_SCAN_FAILED;
+        }
+    }
+}
+
+/**
+ * @brief Walks the volume, maps the blocks of the selected files and sorts their segments.
+ *
+ * The targets that do not exist are printed on stderr and counted in missing; the files whose
+ * blocks cannot be mapped are printed and left as FILE_SCAN_FAILED.
+ *
+ * @param scan Scan prepared with file_scan_init.
+ *
+ * @return 0 on success, -1 if the volume cannot be read (the error is printed).
+*/
+int file_scan_collect(FileScan *scan) {
+    int walked;
+
+    if (is_ext2(scan->image)) {
+        Ext2Volume volume;
+        if (ext2_open_volume(scan->image, &volume) != 0) {
+            perror("Error opening EXT2 volume");
+            return -1;
+        }
+        walked = ext2_walk(&volume, file_scan_select, scan);
+        report_walk_error(volume.walk_error);
+        if (walked == 0) file_scan_map(scan, &volume, NULL);
+        ext2_close_volume(&volume);
+    } else if (is_fat16(scan->image)) {
+        Fat16Volume volume;
+        if (fat16_open_volume(scan->image, &volume) != 0) {
+            perror("Error loading FAT");
+            return -1;
+        }
+        report_fat16_copies(&volume);
+        walked = fat16_walk(&volume, file_scan_select, scan);
+        report_walk_error(volume.walk_error);
+        if (walked == 0) file_scan_map(scan, NULL, &volume);
+        fat16_close_volume(&volume);
+    } else {
+        printf("Invalid file system.\n");
+        return -1;
+    }
+
+    if (walked != 0) {
+        perror("Error walking the volume");
+        return -1;
+    }
+    for (size_t i = 0; i < scan->target_count; i++) {
+        if (!scan->found[i]) {
+            fprintf(stderr, "Not found: %s\n", scan->targets[i]);
+            scan->missing++;
+        }
+    }
+
+    // Orden del ascensor: una pasada por la imagen de principio a fin
+    if (scan->segment_count > 0) {
+        qsort(scan->segments, scan->segment_count, sizeof(FileScanSegment), file_scan_compare_segments);
+    }
+    return 0;
+}
+
+// Siguiente lectura: los tramos que empiezan cerca del final de la anterior y caben en FILE_SCAN_IO_SIZE
+static size_t file_scan_next_run(const FileScan *scan, size_t first, FileScanRun *run) {
+    const FileScanSegment *segments = scan->segments;
+    uint64_t start = segments[first].physical;
+    uint64_t end = start + segments[first].length;
+    size_t next = first + 1;
+
+    while (next < scan->segment_count &&
+           segments[next].physical <= end + FILE_SCAN_MAX_GAP &&
+           segments[next].physical + segments[next].length - start <= FILE_SCAN_IO_SIZE) {
+        if (segments[next].physical + segments[next].length > end) end = segments[next].physical + segments[next].length;
+        next++;
+    }
+    run->first = first;
+    run->count = next - first;
+    run->offset = start;
+    run->length = end - start;
+    return next;
+}
+
+static int file_scan_read_run(FileScan *scan, const FileScanRun *run, uint8_t *buffer) {
+    if (image_read(scan->image, run->offset, buffer, run->length) != (ssize_t)run->length) {
+        fprintf(stderr, "Error reading the image at offset %llu\n", (unsigned long long)run->offset);
+        return -1;
+    }
+    return 0;
+}
+
+static void file_scan_release_buffer(FileScan *scan, FileScanBuffer *buffer, int failed) {
+    pthread_mutex_lock(&scan->lock);
+    scan->failed |= failed;
+    buffer->next = scan->free_buffers;
+    scan->free_buffers = buffer;
+    pthread_cond_signal(&scan->buffer_free);
+    pthread_mutex_unlock(&scan->lock);
+}
+
+static void file_scan_run_task(ThreadPool *pool, void *arg) {
+    FileScanBuffer *buffer = arg;
+    FileScan *scan = buffer->scan;
+    (void)pool;
+
+    int failed = scan->function(scan, &buffer->run, buffer->data, scan->context) != 0;
+    file_scan_release_buffer(scan, buffer, failed);
+}
+
+// El hilo principal lee en orden de la imagen y el pool procesa; las lecturas esperan a que haya un buffer libre
+static int file_scan_stream_parallel(FileScan *scan, int threads, size_t *reads) {
+    size_t buffer_count = (size_t)threads * 2 < FILE_SCAN_MAX_BUFFERS ? (size_t)threads * 2 : FILE_SCAN_MAX_BUFFERS;
+    FileScanBuffer *buffers = calloc(buffer_count, sizeof(FileScanBuffer));
+    ThreadPool pool;
+
+    if (buffers == NULL) return -1;
+    for (size_t i = 0; i < buffer_count; i++) {
+        buffers[i].scan = scan;
+        if ((buffers[i].data = malloc(FILE_SCAN_IO_SIZE)) == NULL) break;
+        buffers[i].next = scan->free_buffers;
+        scan->free_buffers = &buffers[i];
+    }
+    if (scan->free_buffers == NULL || thread_pool_init(&pool, threads) != 0) {
+        for (size_t i = 0; i < buffer_count; i++) free(buffers[i].data);
+        free(buffers);
+        return -1;
+    }
+
+    for (size_t next = 0; next < scan->segment_count; (*reads)++) {
+        pthread_mutex_lock(&scan->lock);
+        while (scan->free_buffers == NULL) {
+            pthread_cond_wait(&scan->buffer_free, &scan->lock);
+        }
+        FileScanBuffer *buffer = scan->free_buffers;
+        scan->free_buffers = buffer->next;
+        pthread_mutex_unlock(&scan->lock);
+
+        next = file_scan_next_run(scan, next, &buffer->run);
+        if (file_scan_read_run(scan, &buffer->run, buffer->data) != 0) {
+            file_scan_release_buffer(scan, buffer, 1);
+        } else if (thread_pool_submit(&pool, file_scan_run_task, buffer) != 0) {
+            file_scan_run_task(&pool, buffer);
+        }
+    }
+
+    thread_pool_wait(&pool);
+    thread_pool_destroy(&pool);
+    scan->free_buffers = NULL;
+    for (size_t i = 0; i < buffer_count; i++) free(buffers[i].data);
+    free(buffers);
+    return scan->failed ? -1 : 0;
+}
+
+/**
+ * @brief Reads the segments in the order of the image and passes every read to a function.
+ *
+ * With one thread the reads and the function take turns. With several, the main thread
+ * reads while a thread pool runs the function on the previous reads.
+ *
+ * @param scan Scan after file_scan_collect.
+ * @param threads Number of threads that run the function.
+ * @param function Function that processes each read.
+ * @param context Pointer passed to the function.
+ * @param reads Where the number of reads is stored.
+ *
+ * @return 0 on success, -1 if a read or a call to the function failed.
+*/
+int file_scan_stream(FileScan *scan, int threads, FileScanRunFunction function, void *context, size_t *reads) {
+    scan->function = function;
+    scan->context = context;
+    scan->failed = 0;
+    *reads = 0;
+    if (threads > 1) {
+        return file_scan_stream_parallel(scan, threads, reads);
+    }
+
+    // Lee y procesa cada lectura por turnos
+    uint8_t *buffer = malloc(FILE_SCAN_IO_SIZE);
+    int result = 0;
+
+    if (buffer == NULL) return -1;
+    for (size_t next = 0; next < scan->segment_count; (*reads)++) {
+        FileScanRun run;
+        next = file_scan_next_run(scan, next, &run);
+        if (file_scan_read_run(scan, &run, buffer) != 0 || function(scan, &run, buffer, context) != 0) {
+            result = -1;
+        }
+    }
+    free(buffer);
+    return result;
+}
+
+/**
+ * @brief Releases the memory of a scan.
+ *
+ * @param scan Scan to release.
+ *
+ * @return void
+*/
+void file_scan_free(FileScan *scan) {
+    free(scan->segments);
+    free(scan->entries);
+    free(scan->targets);
+    free(scan->found);
+    arena_free(&scan->arena);
+    pthread_cond_destroy(&scan->buffer_free);
+    pthread_mutex_destroy(&scan->lock);
+}
@@ -0,0 +1,153 @@
+#ifndef _FILE_SCAN_H
+#define _FILE_SCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "arena.h"
+#include "image.h"
+
+// Tamaño máximo de una lectura de la imagen
+#define FILE_SCAN_IO_SIZE (4 * 1024 * 1024)
+
+// Hueco entre dos tramos que se lee de más para no partir la lectura
+#define FILE_SCAN_MAX_GAP (64 * 1024)
+
+// Lecturas que pueden esperar a los hilos que las procesan
+#define FILE_SCAN_MAX_BUFFERS 32
+
+// Estado de una entrada
+typedef enum {
+    FILE_SCAN_OK,
+    FILE_SCAN_SPECIAL,      // Not a regular file or a directory (EXT2 links, devices...); it has no segments
+    FILE_SCAN_FAILED        // Its blocks could not be mapped, or the caller gave up on it
+} FileScanState;
+
+// Fichero o directorio seleccionado
+typedef struct {
+    char *path;             // Full path without the leading '/'
+    uint32_t key;           // Inode (EXT2) or start cluster (FAT16)
+    uint64_t size;
+    uint8_t is_directory;
+    uint8_t state;          // FileScanState
+} FileScanEntry;
+
+// Tramo de un fichero guardado de forma contigua en la imagen, como mucho FILE_SCAN_IO_SIZE bytes
+typedef struct {
+    uint64_t physical;      // Offset in the image
+    uint64_t logical;       // Offset in the file
+    uint32_t length;
+    uint32_t file;          // Index of the entry
+    uint32_t sequence;      // Position of the segment before sorting: files in walk order, each one in file order
+} FileScanSegment;
+
+// Tramos consecutivos de la lista ordenada que se leen con una sola lectura
+typedef struct {
+    size_t first;
+    size_t count;
+    uint64_t offset;
+    size_t length;
+} FileScanRun;
+
+typedef struct FileScan FileScan;
+typedef struct FileScanBuffer FileScanBuffer;
+
+/**
+ * @brief Function that processes the data of a read; with several threads it runs in the workers.
+ *
+ * @param scan Scan being streamed.
+ * @param run Segments of the read.
+ * @param data Bytes of the read, from the offset of the run.
+ * @param context Pointer given to file_scan_stream.
+ *
+ * @return 0 on success, -1 on error (the stream goes on and returns -1).
+*/
+typedef int (*FileScanRunFunction)(FileScan *scan, const FileScanRun *run, const uint8_t *data, void *context);
+
+/**
+ * @brief Files of a volume and their segments, to read them in the order of the image.
+ *
+ * The targets are resolved with one walk of the volume and the block or cluster maps of
+ * the files are turned into one list of segments sorted by offset in the image. The list
+ * is then streamed with large reads that merge adjacent ranges, even from different
+ * files, so the data of a whole volume is read in about one pass over the image.
+ */
+struct FileScan {
+    Image *image;
+
+    // Targets, sorted without repetitions, and which of them the walk found
+    const char **targets;
+    uint8_t *found;
+    size_t target_count;
+    size_t missing;             // Targets the walk did not find
+    int inside_depth;           // Depth of the selected directory being walked, -1 outside of one
+
+    FileScanEntry *entries;     // In walk order, directories before their contents
+    size_t entry_count;
+    size_t entry_capacity;
+    Arena arena;                // Paths of the targets and of the entries
+
+    FileScanSegment *segments;  // Sorted by physical offset after file_scan_collect
+    size_t segment_count;
+    size_t segment_capacity;
+
+    // Buffers of the reads waiting for a worker
+    pthread_mutex_t lock;
+    pthread_cond_t buffer_free;
+    FileScanBuffer *free_buffers;
+    FileScanRunFunction function;
+    void *context;
+    int failed;
+};
+
+/**
+ * @brief Prepares a scan of some paths of an image.
+ *
+ * @param scan Scan to initialize.
+ * @param image Image of the file system.
+ * @param paths Absolute paths of the files and directories, a directory with all its contents; "/" is the whole volume.
+ * @param path_count Number of paths, 0 for the whole volume.
+ *
+ * @return 0 on success, -1 if out of memory.
+*/
+int file_scan_init(FileScan *scan, Image *image, const char *const *paths, size_t path_count);
+
+/**
+ * @brief Walks the volume, maps the blocks of the selected files and sorts their segments.
+ *
+ * The targets that do not exist are printed on stderr and counted in missing; the files whose
+ * blocks cannot be mapped are printed and left as FILE_SCAN_FAILED.
+ *
+ * @param scan Scan prepared with file_scan_init.
+ *
+ * @return 0 on success, -1 if the volume cannot be read (the error is printed).
+*/
+int file_scan_collect(FileScan *scan);
+
+/**
+ * @brief Reads the segments in the order of the image and passes every read to a function.
+ *
+ * With one thread the reads and the function take turns. With several, the main thread
+ * reads while a thread pool runs the function on the previous reads.
+ *
+ * @param scan Scan after file_scan_collect.
+ * @param threads Number of threads that run the function.
+ * @param function Function that processes each read.
+ * @param context Pointer passed to the function.
+ * @param reads Where the number of reads is stored.
+ *
+ * @return 0 on success, -1 if a read or a call to the function failed.
+*/
+int file_scan_stream(FileScan *scan, int threads, FileScanRunFunction function, void *context, size_t *reads);
+
+/**
+ * @brief Releases the memory of a scan.
+ *
+ * @param scan Scan to release.
+ *
+ * @return void
+*/
+void file_scan_free(FileScan *scan);
+
+#endif // !_FILE_SCAN_H
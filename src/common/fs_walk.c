@@ -0,0 +1,239 @@
+#include "fs_walk.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Nivel de la pila del recorrido: el directorio abierto a esa profundidad
+typedef struct {
+    void *cursor;
+    FsWalkWindow windows[2];
+    int current;            // Window being visited, the other one holds the next blocks
+    size_t index;           // Next item of the current window
+    size_t path_len;        // Length of the path of the directory
+    int ended;              // No more blocks to read
+} FsWalkLevel;
+
+typedef struct {
+    const FsWalkOps *ops;
+    void *fs;
+    FsWalkLevel *levels;    // Kept after a directory is closed, reused by the next one at that depth
+    size_t level_capacity;
+    char *path;
+    size_t path_capacity;
+    size_t memory;          // Bytes held by the walk
+} FsWalk;
+
+static size_t fs_walk_window_memory(const FsWalkWindow *window) {
+    return window->capacity * sizeof(FsWalkItem) + window->arena.reserved;
+}
+
+/**
+ * @brief Appends an entry to a window, copying its name to the arena of the window.
+ *
+ * @param window Window to extend.
+ * @param name Name of the entry, it does not need to be NUL terminated.
+ * @param name_len Length of the name.
+ * @param item Rest of the fields of the entry; name and name_len are ignored.
+ *
+ * @return The entry added, NULL if out of memory.
+*/
+FsWalkItem *fs_walk_window_add(FsWalkWindow *window, const char *name, size_t name_len, const FsWalkItem *item) {
+    if (window->count == window->capacity) {
+        size_t capacity = window->capacity ? window->capacity * 2 : 16;
+        FsWalkItem *bigger = realloc(window->items, capacity * sizeof(FsWalkItem));
+        if (bigger == NULL) {
+            return NULL;
+        }
+        window->items = bigger;
+        window->capacity = capacity;
+    }
+
+    char *copy = arena_alloc(&window->arena, name_len + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy, name, name_len);
+    copy[name_len] = '\0';
+
+    FsWalkItem *added = &window->items[window->count++];
+    *added = *item;
+    added->name = copy;
+    added->name_len = name_len;
+    return added;
+}
+
+/**
+ * @brief Empties a window, keeping its memory for the next block.
+ *
+ * @param window Window to empty.
+ *
+ * @return void
+*/
+void fs_walk_window_reset(FsWalkWindow *window) {
+    window->count = 0;
+    arena_reset(&window->arena);
+}
+
+/**
+ * @brief Releases the memory of a window.
+ *
+ * @param window Window to release.
+ *
+ * @return void
+*/
+void fs_walk_window_free(FsWalkWindow *window) {
+    free(window->items);
+    arena_free(&window->arena);
+    memset(window, 0, sizeof(FsWalkWindow));
+}
+
+// Lee bloques del directorio hasta que la ventana tiene alguna entrada o se acaba el directorio
+static void fs_walk_fill(FsWalk *walk, FsWalkLevel *level, FsWalkWindow *window) {
+    walk->memory -= fs_walk_window_memory(window);
+    fs_walk_window_reset(window);
+
+    while (!level->ended && window->count == 0) {
+        if (walk->ops->read_block(walk->fs, level->cursor, window) <= 0) {
+            level->ended = 1; // A directory that cannot be read ends where the error is
+        }
+    }
+
+    walk->memory += fs_walk_window_memory(window);
+    stats_memory(walk->memory);
+}
+
+// Abre un directorio en la profundidad depth, reutilizando la memoria de ese nivel
+static int fs_walk_push(FsWalk *walk, size_t depth, const FsWalkItem *directory, size_t path_len) {
+    if (depth == walk->level_capacity) {
+        size_t capacity = walk->level_capacity ? walk->level_capacity * 2 : 16;
+        FsWalkLevel *bigger = realloc(walk->levels, capacity * sizeof(FsWalkLevel));
+        if (bigger == NULL) {
+            return -1;
+        }
+        memset(bigger + walk->level_capacity, 0, (capacity - walk->level_capacity) * sizeof(FsWalkLevel));
+        walk->memory += (capacity - walk->level_capacity) * sizeof(FsWalkLevel);
+        walk->levels = bigger;
+        walk->level_capacity = capacity;
+    }
+
+    FsWalkLevel *level = &walk->levels[depth];
+    if (level->cursor == NULL) {
+        if ((level->cursor = malloc(walk->ops->cursor_size)) == NULL) {
+            return -1;
+        }
+        walk->memory += walk->ops->cursor_size;
+    }
+
+    level->current = 0;
+    level->index = 0;
+    level->path_len = path_len;
+    level->ended = walk->ops->open(walk->fs, directory, level->cursor) != 0;
+    fs_walk_fill(walk, level, &level->windows[0]);
+    fs_walk_fill(walk, level, &level->windows[1]);
+    return 0;
+}
+
+// Añade /name al camino del directorio, haciendo crecer el buffer si no cabe
+static int fs_walk_path_append(FsWalk *walk, size_t path_len, const FsWalkItem *item) {
+    size_t needed = path_len + 1 + item->name_len + 1;
+
+    if (needed > walk->path_capacity) {
+        size_t capacity = walk->path_capacity ? walk->path_capacity : 256;
+        while (capacity < needed) capacity *= 2;
+        char *bigger = realloc(walk->path, capacity);
+        if (bigger == NULL) {
+            return -1;
+        }
+        walk->memory += capacity - walk->path_capacity;
+        walk->path = bigger;
+        walk->path_capacity = capacity;
+        stats_memory(walk->memory);
+    }
+
+    walk->path[path_len] = '/';
+    memcpy(walk->path + path_len + 1, item->name, item->name_len + 1);
+    return 0;
+}
+
+static void fs_walk_free(FsWalk *walk) {
+    for (size_t i = 0; i < walk->level_capacity; i++) {
+        free(walk->levels[i].cursor);
+        fs_walk_window_free(&walk->levels[i].windows[0]);
+        fs_walk_window_free(&walk->levels[i].windows[1]);
+    }
+    free(walk->levels);
+    free(walk->path);
+}
+
+/**
+ * @brief Walks every directory of a volume depth first, without recursion.
+ *
+ * Each level of the walk keeps the cursor of its directory and two windows: the blocks
+ * being visited and the next ones, read ahead to know which entry is the last. The memory
+ * of a level is reused by every directory opened at that level, so the memory of the walk
+ * only grows with the depth of the tree and FS_WALK_BATCH_SIZE. Its peak goes to --stats.
+ *
+ * @param ops Operations of the file system.
+ * @param fs File system passed to the operations.
+ * @param callback Function called for every entry, a non-zero result stops the walk.
+ * @param context Pointer passed to the callback.
+ *
+ * @return 0 if the whole volume was walked, otherwise the value that stopped the walk, -1 if out of memory (errno is set).
+*/
+int fs_walk_run(const FsWalkOps *ops, void *fs, FsWalkCallback callback, void *context) {
+    FsWalk walk = { ops, fs, NULL, 0, NULL, 0, 0 };
+    size_t depth = 1; // Levels open, the root directory included
+    int result = 0;
+    int failed = fs_walk_push(&walk, 0, NULL, 0) != 0;
+
+    while (depth > 0 && result == 0 && !failed) {
+        FsWalkLevel *level = &walk.levels[depth - 1];
+        FsWalkWindow *window = &level->windows[level->current];
+        FsWalkWindow *next = &level->windows[!level->current];
+
+        // Acabada la ventana se pasa a la siguiente y se lee otra por adelantado
+        if (level->index == window->count) {
+            if (next->count == 0) {
+                depth--;
+                continue;
+            }
+            level->current = !level->current;
+            level->index = 0;
+            fs_walk_fill(&walk, level, window);
+            continue;
+        }
+
+        const FsWalkItem *item = &window->items[level->index++];
+        if (fs_walk_path_append(&walk, level->path_len, item) != 0) {
+            failed = 1;
+            break;
+        }
+
+        FsWalkEntry entry;
+        entry.path = walk.path;
+        entry.name = walk.path + level->path_len + 1;
+        entry.key = item->key;
+        entry.size = item->size;
+        entry.is_directory = item->is_directory;
+        entry.is_last = level->index == window->count && next->count == 0;
+        entry.hidden = item->hidden;
+        entry.depth = (int)depth - 1;
+
+        result = callback(&entry, context);
+        if (result == 0 && item->explore && depth < FS_WALK_MAX_DEPTH) {
+            if (fs_walk_push(&walk, depth, item, level->path_len + 1 + item->name_len) != 0) {
+                failed = 1;
+                break;
+            }
+            depth++;
+        }
+    }
+
+    if (failed) {
+        result = -1;
+    }
+    fs_walk_free(&walk);
+    return result;
+}
@@ -0,0 +1,127 @@
+#ifndef _FS_WALK_H
+#define _FS_WALK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+// Entrada visitada al recorrer todos los directorios de un volumen
+typedef struct {
+    const char *path;       // Full path from the root, e.g. /dir1/file.txt
+    const char *name;       // Last component of the path
+    uint32_t key;           // Inode (EXT2) or start cluster (FAT16) of the entry
+    uint64_t size;          // Size in bytes of the entry
+    uint8_t is_directory;
+    uint8_t is_last;        // Last entry of its directory
+    uint8_t hidden;         // Walked but not shown by the tree (EXT2 lost+found)
+    int depth;              // 0 for the entries of the root directory
+} FsWalkEntry;
+
+/**
+ * @brief Function called for every entry of a volume walk.
+ *
+ * Directories are reported before their contents. The strings are only valid during the call.
+ *
+ * @return 0 to go on, any other value stops the walk and is returned by it.
+*/
+typedef int (*FsWalkCallback)(const FsWalkEntry *entry, void *context);
+
+// Profundidad máxima que se recorre, protege de directorios que se contienen a sí mismos
+#define FS_WALK_MAX_DEPTH 4096
+
+// Bytes de un directorio que un cursor lee con un solo lote de lecturas, al menos un bloque
+#define FS_WALK_BATCH_SIZE (32 * 1024)
+
+// Entrada de un directorio tal y como la lee el sistema de archivos, todavía sin camino
+typedef struct {
+    const char *name;       // NUL terminated, in the arena of its window
+    size_t name_len;
+    uint32_t key;
+    uint64_t size;
+    uint8_t is_directory;
+    uint8_t hidden;
+    uint8_t explore;        // 1 if the walk goes into the entry
+    const void *node;       // File system data that opens the entry (EXT2 inode), NULL if there is none
+} FsWalkItem;
+
+// Entradas leídas de los bloques de un directorio; se vacía antes de leer los siguientes
+typedef struct {
+    FsWalkItem *items;
+    size_t count;
+    size_t capacity;
+    Arena arena;            // Names and nodes of the items
+} FsWalkWindow;
+
+/**
+ * @brief Operations of a file system for fs_walk_run.
+ *
+ * A directory is read through a cursor, a few blocks at a time, so the memory of a
+ * directory does not depend on its size.
+ */
+typedef struct {
+    size_t cursor_size;     // Bytes of the cursor of a directory
+
+    /**
+     * @brief Prepares the cursor of a directory.
+     * @param directory Entry of the directory, NULL for the root directory.
+     * @return 0 on success, -1 if the directory cannot be read.
+     */
+    int (*open)(void *fs, const FsWalkItem *directory, void *cursor);
+
+    /**
+     * @brief Adds to a window the entries of the next blocks of a directory, up to FS_WALK_BATCH_SIZE
+     *        bytes read with one batch.
+     * @return 1 if a block was read (it may have no entries), 0 at the end of the directory, -1 on error.
+     */
+    int (*read_block)(void *fs, void *cursor, FsWalkWindow *window);
+} FsWalkOps;
+
+/**
+ * @brief Appends an entry to a window, copying its name to the arena of the window.
+ *
+ * @param window Window to extend.
+ * @param name Name of the entry, it does not need to be NUL terminated.
+ * @param name_len Length of the name.
+ * @param item Rest of the fields of the entry; name and name_len are ignored.
+ *
+ * @return The entry added, NULL if out of memory.
+*/
+FsWalkItem *fs_walk_window_add(FsWalkWindow *window, const char *name, size_t name_len, const FsWalkItem *item);
+
+/**
+ * @brief Empties a window, keeping its memory for the next block.
+ *
+ * @param window Window to empty.
+ *
+ * @return void
+*/
+void fs_walk_window_reset(FsWalkWindow *window);
+
+/**
+ * @brief Releases the memory of a window.
+ *
+ * @param window Window to release.
+ *
+ * @return void
+*/
+void fs_walk_window_free(FsWalkWindow *window);
+
+/**
+ * @brief Walks every directory of a volume depth first, without recursion.
+ *
+ * Each level of the walk keeps the cursor of its directory and two windows: the blocks
+ * being visited and the next ones, read ahead to know which entry is the last. The memory
+ * of a level is reused by every directory opened at that level, so the memory of the walk
+ * only grows with the depth of the tree and FS_WALK_BATCH_SIZE. Its peak goes to --stats.
+ *
+ * @param ops Operations of the file system.
+ * @param fs File system passed to the operations.
+ * @param callback Function called for every entry, a non-zero result stops the walk.
+ * @param context Pointer passed to the callback.
+ *
+ * @return 0 if the whole volume was walked, otherwise the value that stopped the walk, -1 if out of memory (errno is set).
+*/
+int fs_walk_run(const FsWalkOps *ops, void *fs, FsWalkCallback callback, void *context);
+
+#endif // !_FS_WALK_H
@@ -0,0 +1,276 @@
+#include "grep.h"
+#include "file_scan.h"
+#include "stats.h"
+#include "substring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Ocurrencia del patrón en un fichero
+typedef struct {
+    uint32_t file;
+    uint64_t offset;
+} GrepMatch;
+
+// Bytes a los dos lados del límite entre un tramo y el siguiente del mismo fichero
+typedef struct {
+    uint32_t file;
+    uint64_t boundary;                              // Offset in the file of the first byte of the second segment
+    uint8_t data[2 * (GREP_MAX_PATTERN - 1)];       // pattern_length - 1 bytes of each side
+} GrepJunction;
+
+typedef struct {
+    const uint8_t *pattern;
+    size_t pattern_length;
+
+    // Junction of every segment with the next one, by sequence; -1 if there is none
+    GrepJunction *junctions;
+    int32_t *junction_index;
+
+    pthread_mutex_t lock;       // Protects the list of matches
+    GrepMatch *matches;
+    size_t match_count;
+    size_t match_capacity;
+} GrepContext;
+
+// Ocurrencias encontradas en una lectura, antes de pasarlas a la lista común
+typedef struct {
+    GrepMatch *matches;
+    size_t count;
+    size_t capacity;
+    uint32_t file;
+    uint64_t logical;           // Offset in the file of the buffer being searched
+} GrepFound;
+
+static int grep_compare_matches(const void *a, const void *b) {
+    const GrepMatch *x = a, *y = b;
+
+    if (x->file != y->file) return x->file < y->file ? -1 : 1;
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static int grep_add_match(size_t offset, void *context) {
+    GrepFound *found = context;
+
+    if (found->count == found->capacity) {
+        size_t capacity = found->capacity ? found->capacity * 2 : 64;
+        GrepMatch *bigger = realloc(found->matches, capacity * sizeof(GrepMatch));
+        if (bigger == NULL) return -1;
+        found->matches = bigger;
+        found->capacity = capacity;
+    }
+    found->matches[found->count++] = (GrepMatch){ found->file, found->logical + offset };
+    return 0;
+}
+
+// Pasa las ocurrencias de una lectura a la lista común
+static int grep_merge(GrepContext *grep, GrepFound *found) {
+    int result = 0;
+
+    if (found->count == 0) return 0;
+    pthread_mutex_lock(&grep->lock);
+    if (grep->match_count + found->count > grep->match_capacity) {
+        size_t capacity = grep->match_capacity ? grep->match_capacity : 256;
+        while (capacity < grep->match_count + found->count) capacity *= 2;
+        GrepMatch *bigger = realloc(grep->matches, capacity * sizeof(GrepMatch));
+        if (bigger == NULL) {
+            result = -1;
+        } else {
+            grep->matches = bigger;
+            grep->match_capacity = capacity;
+        }
+    }
+    if (result == 0) {
+        memcpy(grep->matches + grep->match_count, found->matches, found->count * sizeof(GrepMatch));
+        grep->match_count += found->count;
+    }
+    pthread_mutex_unlock(&grep->lock);
+    return result;
+}
+
+// Busca en los tramos de una lectura y guarda sus bordes para las ocurrencias partidas
+static int grep_search_run(FileScan *scan, const FileScanRun *run, const uint8_t *data, void *context) {
+    GrepContext *grep = context;
+    size_t side = grep->pattern_length - 1;
+    GrepFound found = { NULL, 0, 0, 0, 0 };
+    int result = 0;
+
+    for (size_t i = run->first; i < run->first + run->count && result == 0; i++) {
+        const FileScanSegment *segment = &scan->segments[i];
+        const uint8_t *bytes = data + (segment->physical - run->offset);
+
+        if (scan->entries[segment->file].state != FILE_SCAN_OK) continue;
+        found.file = segment->file;
+        found.logical = segment->logical;
+        if (substring_find_all(bytes, segment->length, grep->pattern, grep->pattern_length, grep_add_match, &found) != 0) {
+            result = -1;
+        }
+
+        // Cada mitad de un borde la escribe solo el hilo que tiene su tramo; un tramo corto deja ceros
+        size_t copied = segment->length < side ? segment->length : side;
+        int32_t after = grep->junction_index[segment->sequence];
+        if (after >= 0) {
+            memcpy(grep->junctions[after].data + side - copied, bytes + segment->length - copied, copied);
+        }
+        int32_t before = segment->sequence > 0 ? grep->junction_index[segment->sequence - 1] : -1;
+        if (before >= 0) {
+            memcpy(grep->junctions[before].data + side, bytes, copied);
+        }
+    }
+
+    if (result == 0) result = grep_merge(grep, &found);
+    free(found.matches);
+    return result;
+}
+
+/**
+ * @brief Finds the boundaries between consecutive segments of a file.
+ *
+ * The sequence of a segment is its position before file_scan_collect sorted them, so a
+ * segment and the next one in sequence belong to the same file when their file is the
+ * same. Only the segments that are contiguous in the file get a junction: the bytes of
+ * a hole are zeros, which are not in any pattern given on the command line.
+*/
+static int grep_prepare_junctions(GrepContext *grep, const FileScan *scan) {
+    const FileScanSegment **by_sequence = malloc((scan->segment_count ? scan->segment_count : 1) * sizeof(FileScanSegment *));
+    size_t count = 0;
+
+    grep->junction_index = malloc((scan->segment_count ? scan->segment_count : 1) * sizeof(int32_t));
+    if (by_sequence == NULL || grep->junction_index == NULL) {
+        free(by_sequence);
+        return -1;
+    }
+    for (size_t i = 0; i < scan->segment_count; i++) {
+        by_sequence[scan->segments[i].sequence] = &scan->segments[i];
+    }
+
+    for (size_t i = 0; i < scan->segment_count; i++) {
+        const FileScanSegment *current = by_sequence[i];
+        const FileScanSegment *next = i + 1 < scan->segment_count ? by_sequence[i + 1] : NULL;
+
+        grep->junction_index[i] = -1;
+        if (grep->pattern_length > 1 && next != NULL && next->file == current->file &&
+            current->logical + current->length == next->logical) {
+            grep->junction_index[i] = (int32_t)count++;
+        }
+    }
+
+    grep->junctions = calloc(count ? count : 1, sizeof(GrepJunction));
+    if (grep->junctions == NULL) {
+        free(by_sequence);
+        return -1;
+    }
+    for (size_t i = 0; i < scan->segment_count; i++) {
+        if (grep->junction_index[i] >= 0) {
+            GrepJunction *junction = &grep->junctions[grep->junction_index[i]];
+            junction->file = by_sequence[i]->file;
+            junction->boundary = by_sequence[i + 1]->logical;
+        }
+    }
+    free(by_sequence);
+    return 0;
+}
+
+// Ocurrencias que empiezan antes del borde y terminan después; las demás ya están en la lista
+static int grep_search_junctions(GrepContext *grep, const FileScan *scan) {
+    size_t side = grep->pattern_length - 1;
+    GrepFound found = { NULL, 0, 0, 0, 0 };
+    int result = 0;
+
+    for (size_t i = 0; i < scan->segment_count && result == 0; i++) {
+        if (grep->junction_index[i] < 0) continue;
+
+        const GrepJunction *junction = &grep->junctions[grep->junction_index[i]];
+        if (scan->entries[junction->file].state != FILE_SCAN_OK) continue;
+        found.file = junction->file;
+        found.logical = junction->boundary - side;
+        if (substring_find_all(junction->data, 2 * side, grep->pattern, grep->pattern_length, grep_add_match, &found) != 0) {
+            result = -1;
+        }
+    }
+
+    if (result == 0) result = grep_merge(grep, &found);
+    free(found.matches);
+    return result;
+}
+
+// Escribe las ocurrencias, ordenadas por fichero y offset
+static void grep_print(GrepContext *grep, const FileScan *scan, size_t reads) {
+    size_t files = 0;
+
+    if (grep->match_count > 0) qsort(grep->matches, grep->match_count, sizeof(GrepMatch), grep_compare_matches);
+    for (size_t i = 0; i < grep->match_count; i++) {
+        const GrepMatch *match = &grep->matches[i];
+        if (i == 0 || match->file != grep->matches[i - 1].file) files++;
+        printf("/%s:%llu\n", scan->entries[match->file].path, (unsigned long long)match->offset);
+    }
+    printf("\n%zu matches in %zu files (reads: %zu)\n", grep->match_count, files, reads);
+}
+
+/**
+ * @brief Finds the files of an image that contain a string, with the offsets of every occurrence.
+ *
+ * The files are selected with one walk of the volume and their extents are read in the
+ * order of the image with merged reads, like extract_command. Every read is searched by
+ * a thread pool with a SIMD substring search. The occurrences that straddle two extents
+ * of a file (block or cluster boundaries that are not contiguous in the image, or reads
+ * that split a file) are found in a small buffer with the bytes around each boundary.
+ *
+ * @param image Image of the file system.
+ * @param pattern String to find, up to GREP_MAX_PATTERN bytes.
+ * @param paths Absolute paths of the files and directories to search, a directory with all its contents.
+ * @param path_count Number of paths, 0 for the whole volume.
+ * @param threads Number of threads that search the reads.
+ *
+ * @return 0 on success, -1 if a path was not found or on error.
+*/
+int grep_command(Image *image, const char *pattern, const char *const *paths, size_t path_count, int threads) {
+    printf("---- Grep Command ----\n\n");
+
+    size_t pattern_length = strlen(pattern);
+    if (pattern_length == 0 || pattern_length > GREP_MAX_PATTERN) {
+        printf("The pattern must have between 1 and %d bytes\n", GREP_MAX_PATTERN);
+        return -1;
+    }
+
+    GrepContext grep;
+    FileScan scan;
+    memset(&grep, 0, sizeof(GrepContext));
+    grep.pattern = (const uint8_t *)pattern;
+    grep.pattern_length = pattern_length;
+    pthread_mutex_init(&grep.lock, NULL);
+
+    int result = 0;
+    if (file_scan_init(&scan, image, paths, path_count) != 0) {
+        perror("Error searching");
+        result = -1;
+    } else if (file_scan_collect(&scan) != 0) {
+        result = -1;
+    } else if (grep_prepare_junctions(&grep, &scan) != 0) {
+        perror("Error searching");
+        result = -1;
+    } else {
+        if (scan.missing > 0) result = -1;
+        for (size_t i = 0; i < scan.entry_count; i++) {
+            if (scan.entries[i].state == FILE_SCAN_FAILED) result = -1;
+        }
+
+        StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+        size_t reads;
+        if (file_scan_stream(&scan, threads, grep_search_run, &grep, &reads) != 0 ||
+            grep_search_junctions(&grep, &scan) != 0) {
+            result = -1;
+        }
+        stats_phase(previous);
+        grep_print(&grep, &scan, reads);
+    }
+
+    free(grep.matches);
+    free(grep.junctions);
+    free(grep.junction_index);
+    pthread_mutex_destroy(&grep.lock);
+    file_scan_free(&scan);
+    return result;
+}
@@ -0,0 +1,30 @@
+#ifndef _GREP_H
+#define _GREP_H
+
+#include <stddef.h>
+
+#include "image.h"
+
+// Longitud máxima del patrón; los tramos de un fichero, salvo el último, son más largos
+#define GREP_MAX_PATTERN 256
+
+/**
+ * @brief Finds the files of an image that contain a string, with the offsets of every occurrence.
+ *
+ * The files are selected with one walk of the volume and their extents are read in the
+ * order of the image with merged reads, like extract_command. Every read is searched by
+ * a thread pool with a SIMD substring search. The occurrences that straddle two extents
+ * of a file (block or cluster boundaries that are not contiguous in the image, or reads
+ * that split a file) are found in a small buffer with the bytes around each boundary.
+ *
+ * @param image Image of the file system.
+ * @param pattern String to find, up to GREP_MAX_PATTERN bytes.
+ * @param paths Absolute paths of the files and directories to search, a directory with all its contents.
+ * @param path_count Number of paths, 0 for the whole volume.
+ * @param threads Number of threads that search the reads.
+ *
+ * @return 0 on success, -1 if a path was not found or on error.
+*/
+int grep_command(Image *image, const char *pattern, const char *const *paths, size_t path_count, int threads);
+
+#endif // !_GREP_H
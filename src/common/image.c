@@ -0,0 +1,246 @@
+#include "image.h"
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Loads a non-seekable input (pipe, socket) entirely in memory.
+ *
+ * @param image Image whose descriptor is read until EOF.
+ *
+ * @return 0 on success, -1 on error.
+*/
+static int image_load_stream(Image *image) {
+    size_t capacity = 1 << 20;
+    size_t length = 0;
+    uint8_t *data = malloc(capacity);
+    if (data == NULL) return -1;
+
+    for (;;) {
+        if (length == capacity) {
+            uint8_t *bigger = realloc(data, capacity * 2);
+            if (bigger == NULL) {
+                free(data);
+                return -1;
+            }
+            data = bigger;
+            capacity *= 2;
+        }
+
+        ssize_t n = read(image->fd, data + length, capacity - length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            free(data);
+            return -1;
+        }
+        if (n == 0) break;
+        length += n;
+    }
+
+    image->data = data;
+    image->size = length;
+    image->mapped = 0;
+    return 0;
+}
+
+/**
+ * @brief Opens a file system image in read-only mode.
+ *
+ * @param image Image structure to fill.
+ * @param path Path of the image.
+ *
+ * @return 0 on success, -1 on error (errno is set).
+*/
+int image_open(Image *image, const char *path) {
+    return image_open_flags(image, path, 0);
+}
+
+/**
+ * @brief Opens a file system image in read-only mode, choosing how it is read.
+ *
+ * IMAGE_OPEN_NO_MMAP is for long running processes that read files other programs may
+ * truncate: a read past the new end of a mapping kills the process with SIGBUS, while
+ * pread only returns less data.
+ *
+ * @param image Image structure to fill.
+ * @param path Path of the image.
+ * @param flags 0 or IMAGE_OPEN_NO_MMAP.
+ *
+ * @return 0 on success, -1 on error (errno is set).
+*/
+int image_open_flags(Image *image, const char *path, int flags) {
+    memset(image, 0, sizeof(Image));
+
+    image->path = path;
+    image->fd = open(path, O_RDONLY);
+    if (image->fd == -1) return -1;
+
+    // Block devices report size 0 in st_size, so the size is always taken with lseek
+    off_t end = lseek(image->fd, 0, SEEK_END);
+    if (end == -1) {
+        if (errno != ESPIPE || image_load_stream(image) != 0) {
+            int saved_errno = errno;
+            close(image->fd);
+            errno = saved_errno;
+            return -1;
+        }
+        return 0;
+    }
+    image->size = (uint64_t)end;
+
+    if (image->size > 0 && !(flags & IMAGE_OPEN_NO_MMAP)) {
+        void *map = mmap(NULL, image->size, PROT_READ, MAP_SHARED, image->fd, 0);
+        if (map != MAP_FAILED) {
+            image->data = map;
+            image->mapped = 1;
+            return 0;
+        }
+    }
+
+    // The image cannot (or must not) be mapped: use pread through a read-ahead window
+    image->window = malloc(IMAGE_WINDOW_SIZE);
+    if (image->window == NULL) {
+        close(image->fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    pthread_mutex_init(&image->window_lock, NULL);
+    return 0;
+}
+
+/**
+ * @brief Releases the mapping, the buffers and the descriptor of an image.
+ *
+ * @param image Image to close.
+ *
+ * @return void
+*/
+void image_close(Image *image) {
+    if (image->data != NULL) {
+        if (image->mapped) {
+            munmap(image->data, image->size);
+        } else {
+            free(image->data);
+        }
+    }
+    if (image->window != NULL) {
+        free(image->window);
+        pthread_mutex_destroy(&image->window_lock);
+    }
+    if (image->fd != -1) close(image->fd);
+
+    memset(image, 0, sizeof(Image));
+    image->fd = -1;
+}
+
+/**
+ * @brief Reads with pread until length bytes are read or the image ends.
+ *
+ * @return Number of bytes read, -1 on error.
+*/
+static ssize_t image_pread_full(Image *image, uint64_t offset, void *buffer, size_t length) {
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t n = pread(image->fd, (uint8_t *)buffer + done, length - done, (off_t)(offset + done));
+        stats_syscall(STATS_SYSCALL_PREAD, n > 0 ? n : 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        done += n;
+    }
+
+    return done;
+}
+
+/**
+ * @brief Copies bytes of the image into a buffer.
+ *
+ * @param image Image to read from.
+ * @param offset Absolute offset in the image.
+ * @param buffer Destination buffer.
+ * @param length Number of bytes to read.
+ *
+ * @return Number of bytes copied (less than length at the end of the image), -1 on error.
+*/
+ssize_t image_read(Image *image, uint64_t offset, void *buffer, size_t length) {
+    if (offset >= image->size) return 0;
+    if (length > image->size - offset) length = image->size - offset;
+    stats_read(offset, length);
+
+    if (image->data != NULL) {
+        memcpy(buffer, image->data + offset, length);
+        return length;
+    }
+
+    // Large reads go straight to the device, the window would only add a copy
+    if (length >= IMAGE_WINDOW_SIZE / 2) {
+        return image_pread_full(image, offset, buffer, length);
+    }
+
+    pthread_mutex_lock(&image->window_lock);
+    int hit = offset >= image->window_offset && offset + length <= image->window_offset + image->window_length;
+    stats_cache(STATS_CACHE_IMAGE_WINDOW, hit);
+    if (!hit) {
+        uint64_t window_start = offset - (offset % IMAGE_WINDOW_SIZE);
+        ssize_t n = image_pread_full(image, window_start, image->window, IMAGE_WINDOW_SIZE);
+        if (n < 0) {
+            image->window_length = 0;
+            pthread_mutex_unlock(&image->window_lock);
+            return -1;
+        }
+        image->window_offset = window_start;
+        image->window_length = n;
+
+        // The range may cross the end of the aligned window
+        if (offset + length > window_start + n) {
+            pthread_mutex_unlock(&image->window_lock);
+            return image_pread_full(image, offset, buffer, length);
+        }
+    }
+
+    memcpy(buffer, image->window + (offset - image->window_offset), length);
+    pthread_mutex_unlock(&image->window_lock);
+    return length;
+}
+
+/**
+ * @brief Returns a pointer to a range of the image.
+ *
+ * When the image is in memory the pointer goes straight into it and scratch is not
+ * touched. Otherwise the range is read into scratch, which must hold length bytes.
+ *
+ * @param image Image to read from.
+ * @param offset Absolute offset in the image.
+ * @param length Number of bytes of the range.
+ * @param scratch Buffer used when the range is not in memory.
+ *
+ * @return Pointer to the data, NULL if the range is outside the image or cannot be read
+ *         (errno is EIO for a range past the end of the image).
+*/
+const void *image_view(Image *image, uint64_t offset, size_t length, void *scratch) {
+    if (offset > image->size || length > image->size - offset) {
+        errno = EIO;
+        return NULL;
+    }
+
+    if (image->data != NULL) {
+        stats_read(offset, length);
+        return image->data + offset;
+    }
+
+    ssize_t n = image_read(image, offset, scratch, length);
+    if (n != (ssize_t)length) {
+        if (n >= 0) errno = EIO; // The image was shorter than its size when it was read
+        return NULL;
+    }
+    return scratch;
+}
@@ -0,0 +1,96 @@
+#ifndef _IMAGE_H
+#define _IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+// Tamaño de la ventana de lectura anticipada cuando la imagen no se puede mapear
+#define IMAGE_WINDOW_SIZE (128 * 1024)
+
+// Flags de image_open_flags
+#define IMAGE_OPEN_NO_MMAP 1    // Read with pread even if the image could be mapped
+
+/**
+ * @brief Read-only access to a file system image.
+ *
+ * The image is mapped once with mmap. Inputs that cannot be mapped fall back to
+ * pread through a read-ahead window (block devices) or are loaded entirely in
+ * memory when they cannot be seeked either (pipes).
+ */
+typedef struct {
+    const char *path;       // Path the image was opened with (not copied)
+    int fd;                 // Descriptor of the image file
+    uint64_t size;          // Size of the image in bytes
+    uint8_t *data;          // Whole image in memory (mmap or copy), NULL when using pread
+    int mapped;             // 1 if data comes from mmap, 0 if it was copied into the heap
+    uint8_t *window;        // Read-ahead window for the pread fallback
+    uint64_t window_offset; // Image offset of the first byte of the window
+    size_t window_length;   // Valid bytes in the window
+    pthread_mutex_t window_lock; // The window is shared by every thread reading the image
+} Image;
+
+/**
+ * @brief Opens a file system image in read-only mode.
+ *
+ * @param image Image structure to fill.
+ * @param path Path of the image.
+ *
+ * @return 0 on success, -1 on error (errno is set).
+*/
+int image_open(Image *image, const char *path);
+
+/**
+ * @brief Opens a file system image in read-only mode, choosing how it is read.
+ *
+ * IMAGE_OPEN_NO_MMAP is for long running processes that read files other programs may
+ * truncate: a read past the new end of a mapping kills the process with SIGBUS, while
+ * pread only returns less data.
+ *
+ * @param image Image structure to fill.
+ * @param path Path of the image.
+ * @param flags 0 or IMAGE_OPEN_NO_MMAP.
+ *
+ * @return 0 on success, -1 on error (errno is set).
+*/
+int image_open_flags(Image *image, const char *path, int flags);
+
+/**
+ * @brief Releases the mapping, the buffers and the descriptor of an image.
+ *
+ * @param image Image to close.
+ *
+ * @return void
+*/
+void image_close(Image *image);
+
+/**
+ * @brief Copies bytes of the image into a buffer.
+ *
+ * @param image Image to read from.
+ * @param offset Absolute offset in the image.
+ * @param buffer Destination buffer.
+ * @param length Number of bytes to read.
+ *
+ * @return Number of bytes copied (less than length at the end of the image), -1 on error.
+*/
+ssize_t image_read(Image *image, uint64_t offset, void *buffer, size_t length);
+
+/**
+ * @brief Returns a pointer to a range of the image.
+ *
+ * When the image is in memory the pointer goes straight into it and scratch is not
+ * touched. Otherwise the range is read into scratch, which must hold length bytes.
+ *
+ * @param image Image to read from.
+ * @param offset Absolute offset in the image.
+ * @param length Number of bytes of the range.
+ * @param scratch Buffer used when the range is not in memory.
+ *
+ * @return Pointer to the data, NULL if the range is outside the image or cannot be read
+ *         (errno is EIO for a range past the end of the image).
+*/
+const void *image_view(Image *image, uint64_t offset, size_t length, void *scratch);
+
+#endif // !_IMAGE_H
@@ -0,0 +1,93 @@
+#include "index.h"
+#include "path_index.h"
+#include "stats.h"
+#include "../ext2/ext2_reader.h"
+#include "../fat16/fat16_reader.h"
+#include "report.h"
+
+// Adds every file found by the walk to the index; directories are only walked
+static int index_add_entry(const FsWalkEntry *entry, void *context) {
+    PathIndexBuilder *builder = context;
+
+    if (entry->is_directory) {
+        return 0;
+    }
+    return path_index_builder_add(builder, entry->path, entry->key, entry->size) != 0 ? -1 : 0;
+}
+
+/**
+ * @brief Walks the whole file system and writes the path index sidecar next to the image.
+ * 
+ * Nothing is written if a directory cannot be read, so --cat never trusts a partial index.
+ * 
+ * @param image Image of the file system.
+ * 
+ * @return 0 on success, -1 on error.
+*/
+int build_index_command(Image *image) {
+    printf("---- Build Index Command ----\n\n");
+
+    char path[4096];
+    if (path_index_sidecar_path(image, path, sizeof(path)) != 0) {
+        printf("The index can only be built for image files.\n");
+        return -1;
+    }
+
+    PathIndexBuilder builder = { 0 };
+    uint32_t fs_type, fs_stamp;
+    int walked, walk_error;
+
+    if (is_ext2(image)) {
+        Ext2Volume volume;
+        if (ext2_open_volume(image, &volume) != 0) {
+            perror("Error opening EXT2 volume");
+            return -1;
+        }
+        fs_type = PATH_INDEX_FS_EXT2;
+        fs_stamp = volume.superblock.last_written_time;
+        walked = ext2_walk(&volume, index_add_entry, &builder);
+        walk_error = volume.walk_error;
+        ext2_close_volume(&volume);
+    } else if (is_fat16(image)) {
+        Fat16Volume volume;
+        if (fat16_open_volume(image, &volume) != 0) {
+            perror("Error loading FAT");
+            return -1;
+        }
+        report_fat16_copies(&volume);
+        fs_type = PATH_INDEX_FS_FAT16;
+        fs_stamp = volume.boot_sector.volume_id;
+        walked = fat16_walk(&volume, index_add_entry, &builder);
+        walk_error = volume.walk_error;
+        fat16_close_volume(&volume);
+    } else {
+        printf("Invalid file system.\n");
+        return -1;
+    }
+
+    if (walked != 0) {
+        perror("Error building index");
+        path_index_builder_free(&builder);
+        return -1;
+    }
+
+    // Un índice sin los ficheros de un directorio ilegible haría que --cat no los encontrara
+    if (walk_error != 0) {
+        report_walk_error(walk_error);
+        printf("The index was not written: some directories could not be read.\n");
+        path_index_builder_free(&builder);
+        return -1;
+    }
+    StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+    int written = path_index_write(&builder, image, fs_type, fs_stamp, path);
+    stats_phase(previous);
+    if (written != 0) {
+        perror("Error writing index");
+        path_index_builder_free(&builder);
+        return -1;
+    }
+
+    printf("Indexed %u files in %s\n", builder.record_count, path);
+    path_index_builder_free(&builder);
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef _INDEX_H
+#define _INDEX_H
+
+#include "image.h"
+
+/**
+ * @brief Walks the whole file system and writes the path index sidecar next to the image.
+ * 
+ * Nothing is written if a directory cannot be read, so --cat never trusts a partial index.
+ * 
+ * @param image Image of the file system.
+ * 
+ * @return 0 on success, -1 on error.
+*/
+int build_index_command(Image *image);
+
+#endif // !_INDEX_H
@@ -1,73 +1,75 @@
 #include "info.h"
+#include "stats.h"
 #include "../ext2/ext2_reader.h"
 #include "../fat16/fat16_reader.h"
+#include "report.h"
 
 // Function prototypes
-void print_ext2_superblock(int fd);
+void print_ext2_superblock(Image *image);
 
-void print_fat16_boot_sector(int fd);
+void print_fat16_boot_sector(Image *image);
 
 void print_time(const char *prefix, time_t timestamp);
 
+int verify_ext2_counts(Image *image);
+
+int verify_fat16_counts(Image *image);
+
 /**
  * Checks the file system type and prints the information of the file system
  * 
- * @param fd File descriptor of the file system.
+ * @param image Image of the file system.
+ * @param verify_counts 1 to recount the free blocks and inodes (or clusters) instead of trusting the stored counters.
  * 
- * @return void
+ * @return 0 on success, -1 if the counts could not be verified.
 */
-void info_command(int fd) {
+int info_command(Image *image, int verify_counts) {
     printf("---- Filesystem Information ----\n\n");
 
     //Check if the file system is ext2 or fat16
-    if (is_ext2(fd)) {
+    if (is_ext2(image)) {
         //Print the superblock information
-        print_ext2_superblock(fd);
-    } else if (is_fat16(fd)) {
+        print_ext2_superblock(image);
+        if (verify_counts) {
+            return verify_ext2_counts(image);
+        }
+    } else if (is_fat16(image)) {
         //Print the boot sector information
-        print_fat16_boot_sector(fd);
+        print_fat16_boot_sector(image);
+        if (verify_counts) {
+            return verify_fat16_counts(image);
+        }
     } else {
         printf("Invalid file system.\n");
     }
+    return 0;
 }
 
 /**
  * Prints the superblock information of an ext2 file system
  * 
- * @param fd File descriptor of the file system.
+ * @param image Image of the file system.
  * 
  * @return void
 */
-void print_ext2_superblock(int fd) {
+void print_ext2_superblock(Image *image) {
     Ext2Superblock superblock;
 
-    superblock.volume_name[0] = '\0'; // Asegurar que el nom del volum està finalitzat en NULL
-    if (read_ext2_superblock(fd, &superblock) < 0) {
+    if (read_ext2_superblock(image, &superblock) < 0) {
         perror("Error reading superblock");
-        close(fd);
         return;
     }
 
     char volume_name[17]; // 16 caracteres + 1 para el terminador nulo
+    memcpy(volume_name, superblock.volume_name, 16);
     volume_name[16] = '\0'; // Asegura que la cadena esté terminada en NULL
 
-    if (lseek(fd, 1024 + 120, SEEK_SET) < 0) { // Moverse al offset donde comienza el nombre del volumen dentro del superbloque
-        perror("Error seeking to volume name");
-        close(fd);
-        return;
-    }
-
-    if (read(fd, volume_name, 16) < 0) { // Leer los 16 bytes del nombre del volumen
-        perror("Error reading volume name");
-        close(fd);
-        return;
-    }
-
     /* Com que EXT2 permet diferents mides de blocs hem d'aplicar la formula: 1024 << log_block_size
      * La mida base del bloc és 1024 bytes, per tant, per calcular la mida del bloc
      * hem de fer 1024 << log_block_size, on log_block_size és el camp de la superblock
      * que ens indica la mida del bloc en potències de 2. */
     uint32_t block_size_bytes = 1024 << superblock.log_block_size;
+    StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
 
     printf("Filesystem: EXT2\n\n");
     printf("INODE INFO\n");
@@ -91,6 +93,7 @@ void print_ext2_superblock(int fd) {
     print_time("Last Mounted:", superblock.last_mount_time);
     print_time("Last Written:", superblock.last_written_time);
 
+    stats_phase(previous);
     return; 
 }
 
@@ -111,15 +114,121 @@ void print_time(const char *prefix, time_t timestamp) {
 
     printf("%s: %s\n", prefix, time_buffer);
 }
+/**
+ * Prints the boot sector information.
+ * 
+ * @param bootSector Pointer to the boot sector structure.
+ * 
+ * @return void
+*/
+static void print_boot_sector(const BootSector *bootSector) {
+    printf("Filesystem: FAT16\n\n");
+    printf("System name: %.8s\n", bootSector->oem);
+    printf("Sector size: %u bytes\n", bootSector->sector_size);
+    printf("Sectors per cluster: %u\n", bootSector->sectors_per_cluster);
+    printf("Reserved Sectors: %u\n", bootSector->reserved_sectors);
+    printf("# of FATs: %u\n", bootSector->number_of_fats);
+    printf("Max root entries: %u\n", bootSector->root_dir_entries);
+    printf("Sectors per FAT: %u\n", bootSector->fat_size_16);
+    printf("Label: %.11s\n", bootSector->volume_label);
+}
+
 /**
  * Prints the boot sector information of a FAT16 file system
  * 
- * @param fd File descriptor of the file system.
+ * @param image Image of the file system.
  * 
  * @return void
 */
-void print_fat16_boot_sector(int fd) {
+void print_fat16_boot_sector(Image *image) {
     BootSector bootSector;
-    read_boot_sector(fd, &bootSector);
+    if (read_boot_sector(image, &bootSector) != 0) {
+        perror("Error reading boot sector");
+        return;
+    }
+
+    StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
     print_boot_sector(&bootSector);
+    stats_phase(previous);
+}
+
+/**
+ * Recounts the free blocks and inodes of every group of an ext2 file system from its bitmaps
+ * and prints the groups whose descriptor does not match, and the totals against the superblock
+ * 
+ * @param image Image of the file system.
+ * 
+ * @return 0 on success, -1 on error.
+*/
+int verify_ext2_counts(Image *image) {
+    Ext2Volume volume;
+    if (ext2_open_volume(image, &volume) != 0) {
+        perror("Error opening EXT2 volume");
+        return -1;
+    }
+
+    uint64_t free_blocks = 0;
+    uint64_t free_inodes = 0;
+    uint32_t mismatches = 0;
+
+    printf("\nVERIFY COUNTS\n");
+    for (uint32_t g = 0; g < volume.group_count; g++) {
+        uint32_t group_blocks, group_inodes;
+        if (ext2_count_group_free(&volume, g, &group_blocks, &group_inodes) != 0) {
+            perror("Error reading bitmaps");
+            ext2_close_volume(&volume);
+            return -1;
+        }
+        free_blocks += group_blocks;
+        free_inodes += group_inodes;
+
+        StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+        if (group_blocks != volume.groups[g].free_blocks_count) {
+            printf("Group %u: %u free blocks in the bitmap, %u in the descriptor\n", g, group_blocks, volume.groups[g].free_blocks_count);
+            mismatches++;
+        }
+        if (group_inodes != volume.groups[g].free_inodes_count) {
+            printf("Group %u: %u free inodes in the bitmap, %u in the descriptor\n", g, group_inodes, volume.groups[g].free_inodes_count);
+            mismatches++;
+        }
+        stats_phase(previous);
+    }
+
+    StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+    printf("Free Blocks: %llu (superblock: %u)\n", (unsigned long long)free_blocks, volume.superblock.free_blocks);
+    printf("Free Inodes: %llu (superblock: %u)\n", (unsigned long long)free_inodes, volume.superblock.free_inodes);
+    mismatches += (free_blocks != volume.superblock.free_blocks) + (free_inodes != volume.superblock.free_inodes);
+    printf("Mismatches: %u\n", mismatches);
+    stats_phase(previous);
+
+    ext2_close_volume(&volume);
+    return 0;
+}
+
+/**
+ * Counts the free clusters of a FAT16 file system from its FAT
+ * 
+ * @param image Image of the file system.
+ * 
+ * @return 0 on success, -1 on error.
+*/
+int verify_fat16_counts(Image *image) {
+    Fat16Volume volume;
+    if (fat16_open_volume(image, &volume) != 0) {
+        perror("Error loading FAT");
+        return -1;
+    }
+    report_fat16_copies(&volume);
+
+    uint32_t free_clusters = fat16_count_free_clusters(&volume);
+
+    // FAT16 no guarda el número de clusters libres, no hay nada con que comparar
+    StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+    printf("\nVERIFY COUNTS\n");
+    printf("Free Clusters: %u\n", free_clusters);
+    printf("Free Bytes: %llu\n", (unsigned long long)free_clusters * volume.boot_sector.sectors_per_cluster * volume.boot_sector.sector_size);
+    stats_phase(previous);
+
+    fat16_close_volume(&volume);
+    return 0;
 }
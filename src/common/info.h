@@ -1,10 +1,13 @@
 #include <time.h>
 
+#include "image.h"
+
 /**
  * Checks the file system type and prints the information of the file system
  * 
- * @param fd File descriptor of the file system.
+ * @param image Image of the file system.
+ * @param verify_counts 1 to recount the free blocks and inodes (or clusters) instead of trusting the stored counters.
  * 
- * @return void
+ * @return 0 on success, -1 if the counts could not be verified.
 */
-void info_command(int fd);
+int info_command(Image *image, int verify_counts);
@@ -0,0 +1,475 @@
+#include "io_engine.h"
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// io_uring se usa con las llamadas al sistema directamente, sin liburing
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define IO_ENGINE_HAVE_URING 1
+#endif
+#endif
+
+/**
+ * @brief pread that retries short reads until the range is read or the image ends.
+ *
+ * @return Number of bytes read, -1 on error.
+*/
+static ssize_t io_pread_all(int fd, void *buffer, size_t length, uint64_t offset) {
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t n = pread(fd, (uint8_t *)buffer + done, length - done, offset + done);
+        stats_syscall(STATS_SYSCALL_PREAD, n > 0 ? n : 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        done += n;
+    }
+
+    return done;
+}
+
+#ifdef IO_ENGINE_HAVE_URING
+
+/**
+ * @brief Creates the ring and maps its submission and completion queues.
+ *
+ * @return 0 on success, -1 when io_uring is not available (old kernel, seccomp, limits).
+*/
+static int io_uring_open(IoEngine *engine) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = syscall(__NR_io_uring_setup, IO_ENGINE_DEPTH, &params);
+    if (fd < 0) {
+        return -1;
+    }
+
+    engine->ring_fd = fd;
+    engine->ring_entries = params.sq_entries;
+    engine->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    engine->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    engine->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // Newer kernels map both queues with a single mapping
+    int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && engine->cq_ring_size > engine->sq_ring_size) {
+        engine->sq_ring_size = engine->cq_ring_size;
+    }
+
+    engine->sq_ring = mmap(NULL, engine->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (engine->sq_ring == MAP_FAILED) {
+        engine->sq_ring = NULL;
+        return -1;
+    }
+    if (single_mmap) {
+        engine->cq_ring = engine->sq_ring;
+    } else {
+        engine->cq_ring = mmap(NULL, engine->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (engine->cq_ring == MAP_FAILED) {
+            engine->cq_ring = NULL;
+            return -1;
+        }
+    }
+    engine->sqes = mmap(NULL, engine->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (engine->sqes == MAP_FAILED) {
+        engine->sqes = NULL;
+        return -1;
+    }
+
+    uint8_t *sq = engine->sq_ring;
+    uint8_t *cq = engine->cq_ring;
+    engine->sq_head = (unsigned *)(sq + params.sq_off.head);
+    engine->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    engine->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    engine->sq_array = (unsigned *)(sq + params.sq_off.array);
+    engine->cq_head = (unsigned *)(cq + params.cq_off.head);
+    engine->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    engine->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    engine->cqes = cq + params.cq_off.cqes;
+
+    pthread_mutex_init(&engine->ring_lock, NULL);
+    return 0;
+}
+
+/**
+ * @brief Unmaps the queues and closes the ring.
+*/
+static void io_uring_close(IoEngine *engine) {
+    if (engine->sqes != NULL) munmap(engine->sqes, engine->sqes_size);
+    if (engine->cq_ring != NULL && engine->cq_ring != engine->sq_ring) munmap(engine->cq_ring, engine->cq_ring_size);
+    if (engine->sq_ring != NULL) munmap(engine->sq_ring, engine->sq_ring_size);
+    if (engine->ring_fd >= 0) close(engine->ring_fd);
+    engine->sqes = engine->cq_ring = engine->sq_ring = NULL;
+    engine->ring_fd = -1;
+}
+
+/**
+ * @brief Completes a request from its completion queue entry.
+ *
+ * Short reads are finished with pread, and so are reads the kernel refuses
+ * (IORING_OP_READ needs Linux 5.6).
+*/
+static void io_uring_complete(IoEngine *engine, IoRequest *request, int32_t res) {
+    stats_read(request->offset, request->length);
+    if (res == -EINVAL || res == -EOPNOTSUPP) {
+        request->result = io_pread_all(engine->image->fd, request->buffer, request->length, request->offset);
+    } else if (res < 0) {
+        errno = -res;
+        request->result = -1;
+    } else if ((size_t)res < request->length && res > 0) {
+        ssize_t rest = io_pread_all(engine->image->fd, (uint8_t *)request->buffer + res, request->length - res, request->offset + res);
+        request->result = rest < 0 ? -1 : res + rest;
+    } else {
+        request->result = res;
+    }
+}
+
+/**
+ * @brief Completes every read available in the completion queue.
+ *
+ * @return Number of reads completed.
+*/
+static unsigned io_uring_reap(IoEngine *engine, IoRequest *requests, IoCompletion on_complete, void *context, int *failed) {
+    struct io_uring_cqe *cqes = engine->cqes;
+    unsigned cq_head = *engine->cq_head;
+    unsigned reaped = 0;
+
+    while (cq_head != __atomic_load_n(engine->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &cqes[cq_head & *engine->cq_mask];
+        IoRequest *request = &requests[cqe->user_data];
+
+        io_uring_complete(engine, request, cqe->res);
+        *failed |= request->result != (ssize_t)request->length;
+        cq_head++;
+        reaped++;
+        if (on_complete != NULL) on_complete(request, context);
+    }
+    __atomic_store_n(engine->cq_head, cq_head, __ATOMIC_RELEASE);
+
+    return reaped;
+}
+
+/**
+ * @brief Reads a batch through the ring, keeping up to ring_entries reads in flight.
+ *
+ * @return 0 or -1 as io_engine_read_batch, -2 if the ring cannot be used and the
+ *         requests that were not completed have to be read another way. When the ring
+ *         breaks with reads the kernel never completes, those fail and -1 is returned.
+*/
+static int io_uring_read_batch(IoEngine *engine, IoRequest *requests, size_t count, IoCompletion on_complete, void *context) {
+    struct io_uring_sqe *sqes = engine->sqes;
+    size_t next = 0, done = 0;
+    unsigned in_flight = 0;
+    int failed = 0;
+
+    pthread_mutex_lock(&engine->ring_lock);
+    if (engine->ring_fd < 0) {
+        pthread_mutex_unlock(&engine->ring_lock);
+        return -2;
+    }
+
+    while (done < count) {
+        // Fill the submission queue with as many requests as fit
+        unsigned tail = *engine->sq_tail;
+        unsigned head = __atomic_load_n(engine->sq_head, __ATOMIC_ACQUIRE);
+        while (next < count && in_flight < engine->ring_entries && tail - head < engine->ring_entries) {
+            unsigned index = tail & *engine->sq_mask;
+            struct io_uring_sqe *sqe = &sqes[index];
+
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = engine->image->fd;
+            sqe->off = requests[next].offset;
+            sqe->addr = (uint64_t)(uintptr_t)requests[next].buffer;
+            sqe->len = requests[next].length > UINT32_MAX ? UINT32_MAX : requests[next].length;
+            sqe->user_data = next;
+            engine->sq_array[index] = index;
+
+            tail++;
+            next++;
+            in_flight++;
+        }
+        __atomic_store_n(engine->sq_tail, tail, __ATOMIC_RELEASE);
+
+        // Submit what the kernel has not taken yet and wait for at least one completion
+        unsigned to_submit = tail - __atomic_load_n(engine->sq_head, __ATOMIC_ACQUIRE);
+        int entered = syscall(__NR_io_uring_enter, engine->ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        stats_syscall(STATS_SYSCALL_URING_ENTER, 0);
+        if (entered < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            // The ring is broken, but the reads the kernel already took can still write into
+            // their buffers, even after the ring is closed: wait for them before the caller
+            // reads the rest another way, or reuses or frees the buffers
+            int error = errno;
+            unsigned owned = in_flight - (tail - __atomic_load_n(engine->sq_head, __ATOMIC_ACQUIRE));
+            while (owned > 0) {
+                unsigned reaped = io_uring_reap(engine, requests, on_complete, context, &failed);
+                in_flight -= reaped;
+                owned -= reaped;
+                if (owned > 0 &&
+                    syscall(__NR_io_uring_enter, engine->ring_fd, 0, owned, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+                    errno != EINTR) {
+                    break;
+                }
+            }
+
+            if (owned > 0) {
+                // Some reads may still land in the buffers: fail them instead of reading them again
+                for (size_t i = 0; i < count; i++) {
+                    if (requests[i].result == IO_REQUEST_PENDING) requests[i].result = -1;
+                }
+                pthread_mutex_unlock(&engine->ring_lock);
+                errno = error;
+                return -1;
+            }
+
+            // Nothing is in flight: the requests not taken yet are read synchronously
+            io_uring_close(engine);
+            pthread_mutex_unlock(&engine->ring_lock);
+            return -2;
+        }
+
+        unsigned reaped = io_uring_reap(engine, requests, on_complete, context, &failed);
+        in_flight -= reaped;
+        done += reaped;
+    }
+    pthread_mutex_unlock(&engine->ring_lock);
+
+    return failed ? -1 : 0;
+}
+
+#endif // IO_ENGINE_HAVE_URING
+
+// Lote de lecturas repartido entre los hilos; las terminadas se encolan para el hilo que lo ha enviado
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t completed_ready;
+    IoRequest **completed;
+    size_t completed_count;
+} IoPoolBatch;
+
+typedef struct {
+    IoPoolBatch *batch;
+    IoRequest *request;
+    int fd;
+} IoPoolJob;
+
+static void io_pool_read(ThreadPool *pool, void *arg) {
+    IoPoolJob *job = arg;
+    (void)pool;
+
+    stats_read(job->request->offset, job->request->length);
+    job->request->result = io_pread_all(job->fd, job->request->buffer, job->request->length, job->request->offset);
+
+    pthread_mutex_lock(&job->batch->lock);
+    job->batch->completed[job->batch->completed_count++] = job->request;
+    pthread_cond_signal(&job->batch->completed_ready);
+    pthread_mutex_unlock(&job->batch->lock);
+}
+
+/**
+ * @brief Reads a batch with pread on the threads of the engine.
+*/
+static int io_pool_read_batch(IoEngine *engine, IoRequest *requests, size_t count, IoCompletion on_complete, void *context) {
+    IoPoolBatch batch;
+    IoPoolJob *jobs = malloc(count * sizeof(IoPoolJob));
+    batch.completed = malloc(count * sizeof(IoRequest *));
+    batch.completed_count = 0;
+    if (jobs == NULL || batch.completed == NULL) {
+        free(jobs);
+        free(batch.completed);
+        return -1;
+    }
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.completed_ready, NULL);
+
+    for (size_t i = 0; i < count; i++) {
+        jobs[i].batch = &batch;
+        jobs[i].request = &requests[i];
+        jobs[i].fd = engine->image->fd;
+        if (thread_pool_submit(&engine->pool, io_pool_read, &jobs[i]) != 0) {
+            io_pool_read(&engine->pool, &jobs[i]); // Out of memory: read it here
+        }
+    }
+
+    // Handle the reads in the order they finish
+    int failed = 0;
+    size_t handled = 0;
+    while (handled < count) {
+        pthread_mutex_lock(&batch.lock);
+        while (batch.completed_count == handled) {
+            pthread_cond_wait(&batch.completed_ready, &batch.lock);
+        }
+        size_t available = batch.completed_count;
+        pthread_mutex_unlock(&batch.lock);
+
+        for (; handled < available; handled++) {
+            IoRequest *request = batch.completed[handled];
+            failed |= request->result != (ssize_t)request->length;
+            if (on_complete != NULL) on_complete(request, context);
+        }
+    }
+
+    pthread_mutex_destroy(&batch.lock);
+    pthread_cond_destroy(&batch.completed_ready);
+    free(batch.completed);
+    free(jobs);
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Prepares the engine that reads an image.
+ *
+ * @param engine Engine to initialize.
+ * @param image Image read by the engine.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int io_engine_init(IoEngine *engine, Image *image) {
+    memset(engine, 0, sizeof(IoEngine));
+    engine->image = image;
+    engine->ring_fd = -1;
+
+    if (image->data != NULL) {
+        engine->kind = IO_ENGINE_SYNC;
+        return 0;
+    }
+
+#ifdef IO_ENGINE_HAVE_URING
+    if (io_uring_open(engine) == 0) {
+        engine->kind = IO_ENGINE_URING;
+        return 0;
+    }
+    io_uring_close(engine);
+#endif
+
+    engine->kind = IO_ENGINE_POOL;
+    return thread_pool_init(&engine->pool, IO_ENGINE_THREADS);
+}
+
+/**
+ * @brief Reads a batch of ranges and reports each one as it completes.
+ *
+ * Every request of the batch is submitted before waiting for any of them, so the
+ * device sees the whole batch at once. The function returns when all have completed.
+ *
+ * @param engine Engine to read with.
+ * @param requests Requests of the batch; their result field is filled.
+ * @param count Number of requests.
+ * @param on_complete Function called for every completed request, can be NULL.
+ * @param context Pointer passed to on_complete.
+ *
+ * @return 0 if every request read its whole range, -1 otherwise.
+*/
+int io_engine_read_batch(IoEngine *engine, IoRequest *requests, size_t count, IoCompletion on_complete, void *context) {
+    if (count == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        requests[i].result = IO_REQUEST_PENDING;
+    }
+
+    switch (engine->kind) {
+#ifdef IO_ENGINE_HAVE_URING
+    case IO_ENGINE_URING: {
+        int result = io_uring_read_batch(engine, requests, count, on_complete, context);
+        if (result != -2) {
+            return result;
+        }
+        break; // Read the rest synchronously
+    }
+#endif
+    case IO_ENGINE_POOL:
+        // A single read gains nothing from going through another thread
+        if (count > 1) {
+            return io_pool_read_batch(engine, requests, count, on_complete, context);
+        }
+        break;
+    default:
+        break;
+    }
+
+    Image *image = engine->image;
+    int failed = 0;
+
+    // Ask the kernel to bring every page of the batch in before copying the first one,
+    // with one call for each run of requests that touch or follow each other. A single
+    // request gains nothing over the page fault of its own copy
+    if (image->mapped && count > 1) {
+        long page_size = sysconf(_SC_PAGESIZE);
+        uint64_t run_start = 0, run_end = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (requests[i].offset >= image->size) continue;
+            uint64_t start = requests[i].offset & ~(uint64_t)(page_size - 1);
+            uint64_t end = requests[i].offset + requests[i].length;
+            if (end > image->size) end = image->size;
+            if (run_end > run_start && start >= run_start && start <= run_end) {
+                if (end > run_end) run_end = end;
+                continue;
+            }
+            if (run_end > run_start) madvise(image->data + run_start, run_end - run_start, MADV_WILLNEED);
+            run_start = start;
+            run_end = end;
+        }
+        if (run_end > run_start) madvise(image->data + run_start, run_end - run_start, MADV_WILLNEED);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (requests[i].result == IO_REQUEST_PENDING) {
+            requests[i].result = image_read(image, requests[i].offset, requests[i].buffer, requests[i].length);
+            if (on_complete != NULL) on_complete(&requests[i], context);
+        }
+        failed |= requests[i].result != (ssize_t)requests[i].length;
+    }
+
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Returns the name of the kind of engine, for messages.
+ *
+ * @param engine Engine to describe.
+ *
+ * @return "sync", "io_uring" or "threads".
+*/
+const char *io_engine_name(const IoEngine *engine) {
+    switch (engine->kind) {
+    case IO_ENGINE_URING:
+        return engine->ring_fd >= 0 ? "io_uring" : "sync";
+    case IO_ENGINE_POOL:
+        return "threads";
+    default:
+        return "sync";
+    }
+}
+
+/**
+ * @brief Releases the ring or the threads of an engine.
+ *
+ * @param engine Engine to destroy.
+ *
+ * @return void
+*/
+void io_engine_destroy(IoEngine *engine) {
+#ifdef IO_ENGINE_HAVE_URING
+    if (engine->kind == IO_ENGINE_URING) {
+        io_uring_close(engine);
+        pthread_mutex_destroy(&engine->ring_lock);
+    }
+#endif
+    if (engine->kind == IO_ENGINE_POOL) {
+        thread_pool_destroy(&engine->pool);
+    }
+    memset(engine, 0, sizeof(IoEngine));
+    engine->ring_fd = -1;
+}
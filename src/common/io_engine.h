@@ -0,0 +1,112 @@
+#ifndef _IO_ENGINE_H
+#define _IO_ENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "image.h"
+#include "thread_pool.h"
+
+// Lecturas en vuelo como máximo en el anillo de io_uring
+#define IO_ENGINE_DEPTH 64
+
+// Hilos que hacen pread cuando io_uring no está disponible
+#define IO_ENGINE_THREADS 4
+
+typedef enum {
+    IO_ENGINE_SYNC,     // Reads one after the other; used when the image is in memory, after a read-ahead hint
+    IO_ENGINE_URING,    // io_uring through the raw system calls
+    IO_ENGINE_POOL      // pread on a small pool of threads
+} IoEngineKind;
+
+// Lectura de un rango de la imagen
+typedef struct {
+    uint64_t offset;    // Absolute offset in the image
+    size_t length;      // Number of bytes to read
+    void *buffer;       // Destination, length bytes
+    ssize_t result;     // Bytes read (less than length at the end of the image), -1 on error
+    void *user;         // Free for the caller
+} IoRequest;
+
+// Valor de result mientras la lectura no ha terminado
+#define IO_REQUEST_PENDING (-2)
+
+// Función llamada por cada lectura en cuanto termina, en el hilo que ha enviado el lote
+typedef void (*IoCompletion)(IoRequest *request, void *context);
+
+/**
+ * @brief Reads batches of independent ranges of an image with as many reads in flight as possible.
+ *
+ * The kind is chosen once: images in memory only need copies, preceded by a read-ahead
+ * hint for the whole batch when the image is mapped; otherwise io_uring is used when the
+ * kernel allows it and a pool of pread threads when it does not.
+ */
+typedef struct {
+    IoEngineKind kind;
+    Image *image;
+
+    // io_uring
+    pthread_mutex_t ring_lock;  // Only one batch at a time uses the ring
+    int ring_fd;
+    unsigned ring_entries;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    void *sqes;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    void *cqes;
+
+    // Fallback
+    ThreadPool pool;
+} IoEngine;
+
+/**
+ * @brief Prepares the engine that reads an image.
+ *
+ * @param engine Engine to initialize.
+ * @param image Image read by the engine.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int io_engine_init(IoEngine *engine, Image *image);
+
+/**
+ * @brief Reads a batch of ranges and reports each one as it completes.
+ *
+ * Every request of the batch is submitted before waiting for any of them, so the
+ * device sees the whole batch at once. The function returns when all have completed.
+ *
+ * @param engine Engine to read with.
+ * @param requests Requests of the batch; their result field is filled.
+ * @param count Number of requests.
+ * @param on_complete Function called for every completed request, can be NULL.
+ * @param context Pointer passed to on_complete.
+ *
+ * @return 0 if every request read its whole range, -1 otherwise.
+*/
+int io_engine_read_batch(IoEngine *engine, IoRequest *requests, size_t count, IoCompletion on_complete, void *context);
+
+/**
+ * @brief Returns the name of the kind of engine, for messages.
+ *
+ * @param engine Engine to describe.
+ *
+ * @return "sync", "io_uring" or "threads".
+*/
+const char *io_engine_name(const IoEngine *engine);
+
+/**
+ * @brief Releases the ring or the threads of an engine.
+ *
+ * @param engine Engine to destroy.
+ *
+ * @return void
+*/
+void io_engine_destroy(IoEngine *engine);
+
+#endif // !_IO_ENGINE_H
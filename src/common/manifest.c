@@ -0,0 +1,121 @@
+#include "manifest.h"
+#include "crc32c.h"
+#include "file_scan.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// CRC de cada tramo, en el orden de la lista ordenada; cada hilo escribe solo los de sus lecturas
+static int manifest_hash_run(FileScan *scan, const FileScanRun *run, const uint8_t *data, void *context) {
+    uint32_t *crcs = context;
+
+    for (size_t i = run->first; i < run->first + run->count; i++) {
+        const FileScanSegment *segment = &scan->segments[i];
+        crcs[i] = crc32c_raw(0, data + (segment->physical - run->offset), segment->length);
+    }
+    return 0;
+}
+
+// Escribe un camino como cadena JSON; los bytes que no son de control van tal cual
+static void manifest_print_path(const char *path) {
+    putchar('"');
+    putchar('/');
+    for (const unsigned char *c = (const unsigned char *)path; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            printf("\\%c", *c);
+        } else if (*c < 0x20) {
+            printf("\\u%04x", *c);
+        } else {
+            putchar(*c);
+        }
+    }
+    putchar('"');
+}
+
+/**
+ * @brief Joins the CRCs of the segments of every file and prints its line.
+ *
+ * The sequence of a segment is its position before file_scan_collect sorted them: the
+ * files in the order of the entries and the segments of each one in file order.
+*/
+static int manifest_print(const FileScan *scan, const uint32_t *crcs) {
+    size_t *by_sequence = malloc((scan->segment_count ? scan->segment_count : 1) * sizeof(size_t));
+    size_t next = 0;
+
+    if (by_sequence == NULL) return -1;
+    for (size_t i = 0; i < scan->segment_count; i++) {
+        by_sequence[scan->segments[i].sequence] = i;
+    }
+
+    for (size_t i = 0; i < scan->entry_count; i++) {
+        const FileScanEntry *entry = &scan->entries[i];
+        uint32_t crc = 0;
+        uint64_t position = 0;
+
+        for (; next < scan->segment_count && scan->segments[by_sequence[next]].file == i; next++) {
+            const FileScanSegment *segment = &scan->segments[by_sequence[next]];
+            crc = crc32c_shift(crc, segment->logical + segment->length - position) ^ crcs[by_sequence[next]];
+            position = segment->logical + segment->length;
+        }
+        if (entry->is_directory || entry->state != FILE_SCAN_OK) continue;
+
+        // Los bytes que faltan al final son un hueco
+        crc = crc32c_shift(crc, entry->size - position);
+        printf("{\"path\":");
+        manifest_print_path(entry->path);
+        printf(",\"size\":%llu,\"crc32c\":\"%08x\"}\n", (unsigned long long)entry->size, crc32c_finish(crc, entry->size));
+    }
+    free(by_sequence);
+    return 0;
+}
+
+/**
+ * @brief Prints the path, size and CRC32C of every regular file of an image as NDJSON.
+ *
+ * The files are selected with one walk of the volume and their extents are read in the
+ * order of the image with merged reads, like extract_command, so the reads do not follow
+ * the order of the bytes of a file. Every segment is hashed on its own by a thread pool
+ * and the CRCs of a file are joined in file order at the end, with the holes as zeros.
+ * Only the JSON lines go to stdout; errors go to stderr.
+ *
+ * @param image Image of the file system.
+ * @param paths Absolute paths of the files and directories to hash, a directory with all its contents.
+ * @param path_count Number of paths, 0 for the whole volume.
+ * @param threads Number of threads that hash the reads.
+ *
+ * @return 0 on success, -1 if a path was not found or on error.
+*/
+int manifest_command(Image *image, const char *const *paths, size_t path_count, int threads) {
+    FileScan scan;
+    uint32_t *crcs = NULL;
+    int result = 0;
+
+    if (file_scan_init(&scan, image, paths, path_count) != 0) {
+        perror("Error hashing");
+        result = -1;
+    } else if (file_scan_collect(&scan) != 0) {
+        result = -1;
+    } else if ((crcs = malloc((scan.segment_count ? scan.segment_count : 1) * sizeof(uint32_t))) == NULL) {
+        perror("Error hashing");
+        result = -1;
+    } else {
+        if (scan.missing > 0) result = -1;
+        for (size_t i = 0; i < scan.entry_count; i++) {
+            if (scan.entries[i].state == FILE_SCAN_FAILED) result = -1;
+        }
+
+        StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+        size_t reads;
+        // Sin todas las lecturas los CRC no están completos y no se escribe ninguno
+        if (file_scan_stream(&scan, threads, manifest_hash_run, crcs, &reads) != 0 || manifest_print(&scan, crcs) != 0) {
+            result = -1;
+        }
+        stats_phase(previous);
+    }
+
+    free(crcs);
+    file_scan_free(&scan);
+    return result;
+}
@@ -0,0 +1,26 @@
+#ifndef _MANIFEST_H
+#define _MANIFEST_H
+
+#include <stddef.h>
+
+#include "image.h"
+
+/**
+ * @brief Prints the path, size and CRC32C of every regular file of an image as NDJSON.
+ *
+ * The files are selected with one walk of the volume and their extents are read in the
+ * order of the image with merged reads, like extract_command, so the reads do not follow
+ * the order of the bytes of a file. Every segment is hashed on its own by a thread pool
+ * and the CRCs of a file are joined in file order at the end, with the holes as zeros.
+ * Only the JSON lines go to stdout; errors go to stderr.
+ *
+ * @param image Image of the file system.
+ * @param paths Absolute paths of the files and directories to hash, a directory with all its contents.
+ * @param path_count Number of paths, 0 for the whole volume.
+ * @param threads Number of threads that hash the reads.
+ *
+ * @return 0 on success, -1 if a path was not found or on error.
+*/
+int manifest_command(Image *image, const char *const *paths, size_t path_count, int threads);
+
+#endif // !_MANIFEST_H
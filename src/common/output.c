@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+#include "output.h"
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+/**
+ * @brief Writes a whole buffer to a descriptor, retrying short writes.
+ *
+ * @param fd Destination descriptor.
+ * @param buffer Data to write.
+ * @param length Number of bytes to write.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int output_write_all(int fd, const void *buffer, size_t length) {
+    const uint8_t *data = buffer;
+
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Writes length zero bytes to a descriptor (holes of sparse files).
+ *
+ * @param fd Destination descriptor.
+ * @param length Number of zero bytes.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int output_zeros(int fd, uint64_t length) {
+    static const uint8_t zeros[64 * 1024];
+
+    while (length > 0) {
+        size_t chunk = length < sizeof(zeros) ? length : sizeof(zeros);
+        if (output_write_all(fd, zeros, chunk) != 0) return -1;
+        length -= chunk;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Copies a range inside the kernel with copy_file_range or sendfile.
+ *
+ * @param use_sendfile 1 to use sendfile, 0 to use copy_file_range.
+ * @param copied Number of bytes already copied, updated as the copy goes on.
+ *
+ * @return 0 when the whole range was copied, -1 when the call is not supported for
+ *         these descriptors (the caller falls back with the rest of the range).
+*/
+static int output_kernel_copy(Image *image, uint64_t offset, uint64_t length, int fd, int use_sendfile, uint64_t *copied) {
+    while (*copied < length) {
+        size_t chunk = length - *copied > (1u << 30) ? (1u << 30) : length - *copied;
+        loff_t in_offset = offset + *copied;
+        uint64_t start = in_offset;
+        ssize_t n;
+
+        if (use_sendfile) {
+            off_t sendfile_offset = in_offset;
+            n = sendfile(fd, image->fd, &sendfile_offset, chunk);
+        } else {
+            n = copy_file_range(image->fd, &in_offset, fd, NULL, chunk, 0);
+        }
+        stats_syscall(STATS_SYSCALL_KERNEL_COPY, n > 0 ? n : 0);
+        if (n > 0) stats_read(start, n);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return -1; // The image is shorter than expected, let the fallback report it
+        *copied += n;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Sends a byte range of the image to a descriptor without going through stdio.
+ *
+ * The copy is done inside the kernel with copy_file_range (regular files) or sendfile
+ * (pipes and sockets). Otherwise the range is written from the mapping, or read with
+ * large aligned reads when the image is not mapped.
+ *
+ * @param image Image to copy from.
+ * @param offset Absolute offset of the range in the image.
+ * @param length Number of bytes of the range.
+ * @param fd Destination descriptor.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int output_image_range(Image *image, uint64_t offset, uint64_t length, int fd) {
+    if (offset > image->size || length > image->size - offset) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint64_t copied = 0;
+    struct stat out_stat;
+
+    // Only images backed by a real file can be the source of an in-kernel copy
+    if (length > 0 && (image->mapped || image->window != NULL) && fstat(fd, &out_stat) == 0) {
+        if (S_ISREG(out_stat.st_mode) && output_kernel_copy(image, offset, length, fd, 0, &copied) == 0) {
+            return 0;
+        }
+        if ((S_ISREG(out_stat.st_mode) || S_ISFIFO(out_stat.st_mode) || S_ISSOCK(out_stat.st_mode)) &&
+            output_kernel_copy(image, offset, length, fd, 1, &copied) == 0) {
+            return 0;
+        }
+    }
+
+    // Terminals and other outputs: write straight from the mapping
+    if (image->data != NULL) {
+        return output_write_all(fd, image->data + offset + copied, length - copied);
+    }
+
+    // Without a mapping, large aligned reads followed by writes of the same size
+    void *buffer;
+    if (posix_memalign(&buffer, OUTPUT_ALIGNMENT, OUTPUT_CHUNK_SIZE) != 0) {
+        return -1;
+    }
+
+    while (copied < length) {
+        size_t chunk = length - copied < OUTPUT_CHUNK_SIZE ? length - copied : OUTPUT_CHUNK_SIZE;
+        if (image_read(image, offset + copied, buffer, chunk) != (ssize_t)chunk || output_write_all(fd, buffer, chunk) != 0) {
+            free(buffer);
+            return -1;
+        }
+        copied += chunk;
+    }
+
+    free(buffer);
+    return 0;
+}
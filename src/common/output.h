@@ -0,0 +1,51 @@
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "image.h"
+
+// Tamaño de los bloques de escritura cuando no se puede copiar dentro del kernel
+#define OUTPUT_CHUNK_SIZE (1024 * 1024)
+#define OUTPUT_ALIGNMENT 4096
+
+/**
+ * @brief Writes a whole buffer to a descriptor, retrying short writes.
+ *
+ * @param fd Destination descriptor.
+ * @param buffer Data to write.
+ * @param length Number of bytes to write.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int output_write_all(int fd, const void *buffer, size_t length);
+
+/**
+ * @brief Writes length zero bytes to a descriptor (holes of sparse files).
+ *
+ * @param fd Destination descriptor.
+ * @param length Number of zero bytes.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int output_zeros(int fd, uint64_t length);
+
+/**
+ * @brief Sends a byte range of the image to a descriptor without going through stdio.
+ *
+ * The copy is done inside the kernel with copy_file_range (regular files) or sendfile
+ * (pipes and sockets). Otherwise the range is written from the mapping, or read with
+ * large aligned reads when the image is not mapped.
+ *
+ * @param image Image to copy from.
+ * @param offset Absolute offset of the range in the image.
+ * @param length Number of bytes of the range.
+ * @param fd Destination descriptor.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int output_image_range(Image *image, uint64_t offset, uint64_t length, int fd);
+
+#endif // !_OUTPUT_H
@@ -0,0 +1,97 @@
+#include "owner.h"
+#include "owner_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Offset que se busca y si algún rango lo contiene
+typedef struct {
+    uint64_t offset;
+    int found;
+} OwnerQuery;
+
+static int owner_print(const OwnerMap *map, const OwnerRange *range, void *context) {
+    OwnerQuery *query = context;
+    char name[4352];
+
+    owner_map_describe(map, range, name, sizeof(name));
+    printf("%llu: %s (bytes %llu-%llu)\n", (unsigned long long)query->offset, name,
+           (unsigned long long)range->start, (unsigned long long)range->end - 1);
+    query->found = 1;
+    return 0;
+}
+
+// Carga el mapa del sidecar o lo construye y lo guarda
+static int owner_load(OwnerMap *map, Image *image, int threads) {
+    char path[4096];
+    int has_path = owner_map_sidecar_path(image, path, sizeof(path)) == 0;
+
+    if (owner_map_open(map, image) == 0) {
+        printf("Owner map: %zu ranges read from %s\n\n", map->range_count, path);
+        return 0;
+    }
+    if (owner_map_build(map, image, threads) != 0) return -1;
+
+    printf("Owner map: %zu ranges built", map->range_count);
+    if (has_path && owner_map_write(map, image, path) == 0) {
+        printf(" and saved to %s", path);
+    } else if (has_path) {
+        fprintf(stderr, "Could not save %s: %s\n", path, strerror(errno));
+    }
+    printf("\n\n");
+    return 0;
+}
+
+/**
+ * @brief Shows which file or structure of the volume owns some offsets of an image.
+ *
+ * The owner map is read from the sidecar next to the image when it still matches the
+ * image. Otherwise it is built with one walk and a parallel pass over the block maps or
+ * cluster chains, and saved as the sidecar for the next queries. Every offset is then
+ * found with a binary search over the sorted ranges.
+ *
+ * @param image Image of the file system.
+ * @param offsets Offsets in the image, decimal or hexadecimal with 0x.
+ * @param offset_count Number of offsets.
+ * @param threads Number of threads that read the block maps when the map is built.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int owner_command(Image *image, const char *const *offsets, size_t offset_count, int threads) {
+    printf("---- Owner Command ----\n\n");
+
+    uint64_t values[offset_count ? offset_count : 1];
+    for (size_t i = 0; i < offset_count; i++) {
+        char *end;
+        errno = 0;
+        values[i] = strtoull(offsets[i], &end, 0);
+        if (errno != 0 || end == offsets[i] || *end != '\0' || offsets[i][0] == '-') {
+            printf("Invalid offset: %s\n", offsets[i]);
+            return -1;
+        }
+    }
+
+    OwnerMap map;
+    if (owner_load(&map, image, threads) != 0) {
+        owner_map_free(&map);
+        return -1;
+    }
+
+    for (size_t i = 0; i < offset_count; i++) {
+        OwnerQuery query = { values[i], 0 };
+
+        if (values[i] >= image->size) {
+            printf("%llu: past the end of the image\n", (unsigned long long)values[i]);
+            continue;
+        }
+        owner_map_find(&map, values[i], values[i] + 1, owner_print, &query);
+        if (!query.found) {
+            printf("%llu: free space\n", (unsigned long long)values[i]);
+        }
+    }
+
+    owner_map_free(&map);
+    return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef _OWNER_H
+#define _OWNER_H
+
+#include <stddef.h>
+
+#include "image.h"
+
+/**
+ * @brief Shows which file or structure of the volume owns some offsets of an image.
+ *
+ * The owner map is read from the sidecar next to the image when it still matches the
+ * image. Otherwise it is built with one walk and a parallel pass over the block maps or
+ * cluster chains, and saved as the sidecar for the next queries. Every offset is then
+ * found with a binary search over the sorted ranges.
+ *
+ * @param image Image of the file system.
+ * @param offsets Offsets in the image, decimal or hexadecimal with 0x.
+ * @param offset_count Number of offsets.
+ * @param threads Number of threads that read the block maps when the map is built.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int owner_command(Image *image, const char *const *offsets, size_t offset_count, int threads);
+
+#endif // !_OWNER_H
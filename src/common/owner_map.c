@@ -0,0 +1,703 @@
+#include "owner_map.h"
+#include "fs_walk.h"
+#include "output.h"
+#include "path_index.h"
+#include "thread_pool.h"
+#include "../ext2/ext2_reader.h"
+#include "../fat16/fat16_reader.h"
+#include "report.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Entradas cuyos mapas lee cada tarea del pool
+#define OWNER_MAP_TASK_ENTRIES 64
+
+// Rangos de una tarea, que se pasan al mapa al terminar
+typedef struct {
+    OwnerRange *ranges;
+    size_t count;
+    size_t capacity;
+} OwnerRangeList;
+
+typedef struct {
+    OwnerMap *map;
+    Ext2Volume *ext2;           // Exactly one of the volumes is not NULL
+    Fat16Volume *fat16;
+    uint8_t *kinds;             // OwnerKind of the data of each entry
+    size_t kind_capacity;
+    uint8_t *seen;              // Inodes already listed, one bit each (EXT2 hard links)
+    uint32_t inode_count;
+    pthread_mutex_t lock;       // Protects the ranges of the map while the tasks add theirs
+    int failed;
+} OwnerBuild;
+
+typedef struct {
+    OwnerBuild *build;
+    size_t first;
+    size_t count;
+} OwnerTask;
+
+// Añade un rango, juntándolo con el anterior si lo continúa y tiene el mismo dueño
+static int owner_list_add(OwnerRangeList *list, uint64_t start, uint64_t end, uint32_t kind, uint32_t id) {
+    if (start >= end) return 0;
+    if (list->count > 0) {
+        OwnerRange *last = &list->ranges[list->count - 1];
+        if (last->end == start && last->kind == kind && last->id == id) {
+            last->end = end;
+            return 0;
+        }
+    }
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        OwnerRange *bigger = realloc(list->ranges, capacity * sizeof(OwnerRange));
+        if (bigger == NULL) return -1;
+        list->ranges = bigger;
+        list->capacity = capacity;
+    }
+    list->ranges[list->count++] = (OwnerRange){ start, end, kind, id };
+    return 0;
+}
+
+// Pasa los rangos de una lista al mapa
+static int owner_map_append(OwnerMap *map, const OwnerRangeList *list) {
+    if (map->range_count + list->count > map->range_capacity) {
+        size_t capacity = map->range_capacity ? map->range_capacity : 256;
+        while (capacity < map->range_count + list->count) capacity *= 2;
+        OwnerRange *bigger = realloc(map->ranges, capacity * sizeof(OwnerRange));
+        if (bigger == NULL) return -1;
+        map->ranges = bigger;
+        map->range_capacity = capacity;
+    }
+    if (list->count > 0) memcpy(map->ranges + map->range_count, list->ranges, list->count * sizeof(OwnerRange));
+    map->range_count += list->count;
+    return 0;
+}
+
+// Añade una entrada con su camino; path NULL para un inodo reservado
+static int owner_map_add_entry(OwnerBuild *build, const char *path, uint32_t key, uint8_t kind) {
+    OwnerMap *map = build->map;
+
+    if (map->entry_count == map->entry_capacity) {
+        size_t capacity = map->entry_capacity ? map->entry_capacity * 2 : 256;
+        OwnerEntry *bigger = realloc(map->entries, capacity * sizeof(OwnerEntry));
+        uint8_t *kinds = realloc(build->kinds, capacity);
+        if (bigger != NULL) map->entries = bigger;
+        if (kinds != NULL) build->kinds = kinds;
+        if (bigger == NULL || kinds == NULL) return -1;
+        map->entry_capacity = capacity;
+    }
+
+    uint32_t offset = OWNER_NO_PATH;
+    if (path != NULL) {
+        size_t length = strlen(path) + 1;
+        if (map->names_length + length > map->names_capacity) {
+            size_t capacity = map->names_capacity ? map->names_capacity : 4096;
+            while (capacity < map->names_length + length) capacity *= 2;
+            char *bigger = realloc(map->names, capacity);
+            if (bigger == NULL) return -1;
+            map->names = bigger;
+            map->names_capacity = capacity;
+        }
+        offset = (uint32_t)map->names_length;
+        memcpy(map->names + map->names_length, path, length);
+        map->names_length += length;
+    }
+
+    map->entries[map->entry_count] = (OwnerEntry){ key, offset };
+    build->kinds[map->entry_count] = kind;
+    map->entry_count++;
+    return 0;
+}
+
+// Guarda cada fichero y directorio del recorrido; un inodo con varios enlaces, solo la primera vez
+static int owner_map_select(const FsWalkEntry *entry, void *context) {
+    OwnerBuild *build = context;
+
+    if (build->seen != NULL && entry->key < build->inode_count) {
+        if (build->seen[entry->key / 8] & (1u << (entry->key % 8))) return 0;
+        build->seen[entry->key / 8] |= 1u << (entry->key % 8);
+    }
+    return owner_map_add_entry(build, entry->path, entry->key, entry->is_directory ? OWNER_DIRECTORY : OWNER_FILE);
+}
+
+// Bloques de datos, bloques indirectos y bloque de atributos de un inodo EXT2
+static int owner_map_ext2_entry(OwnerBuild *build, uint32_t index, OwnerRangeList *list) {
+    Ext2Volume *volume = build->ext2;
+    uint64_t block_size = volume->block_size;
+    Ext2Inode inode;
+
+    if (read_ext2_inode(volume, build->map->entries[index].key, &inode) != 0) return -1;
+
+    // Los bloques del resize inode son los descriptores reservados; solo su bloque doble indirecto es suyo
+    if (build->map->entries[index].key == EXT2_RESIZE_INODE) {
+        uint32_t block = inode.block[EXT2_DIND_BLOCK];
+        if (block == 0 || block >= volume->superblock.total_blocks) return 0;
+        return owner_list_add(list, block * block_size, ((uint64_t)block + 1) * block_size, OWNER_BLOCK_MAP, index);
+    }
+
+    // Los enlaces simbólicos cortos y los dispositivos guardan otra cosa en block[]
+    uint16_t type = inode.mode & 0xF000;
+    uint32_t xattr_sectors = inode.file_acl != 0 ? volume->block_size / 512 : 0;
+    int mapped = type == 0x8000 || type == 0x4000 || (type == 0xA000 && inode.blocks > xattr_sectors);
+
+    if (inode.file_acl != 0 && inode.file_acl < volume->superblock.total_blocks &&
+        owner_list_add(list, inode.file_acl * block_size, (inode.file_acl + 1) * block_size, OWNER_XATTR, index) != 0) {
+        return -1;
+    }
+    if (!mapped) return 0;
+
+    Ext2Extent *extents;
+    size_t count;
+    if (ext2_build_extents(volume, &inode, &extents, &count) != 0) return -1;
+    int result = 0;
+    for (size_t i = 0; i < count && result == 0; i++) {
+        if (extents[i].physical == 0) continue;
+        result = owner_list_add(list, extents[i].physical * block_size, ((uint64_t)extents[i].physical + extents[i].length) * block_size,
+                                build->kinds[index], index);
+    }
+    free(extents);
+
+    uint32_t *blocks;
+    if (result != 0 || ext2_indirect_blocks(volume, &inode, &blocks, &count) != 0) return -1;
+    for (size_t i = 0; i < count && result == 0; i++) {
+        result = owner_list_add(list, blocks[i] * block_size, ((uint64_t)blocks[i] + 1) * block_size, OWNER_BLOCK_MAP, index);
+    }
+    free(blocks);
+    return result;
+}
+
+// Cadena de clusters de una entrada FAT16; las entradas vacías no tienen cluster
+static int owner_map_fat16_entry(OwnerBuild *build, uint32_t index, OwnerRangeList *list) {
+    Fat16Volume *volume = build->fat16;
+    const BootSector *bpb = &volume->boot_sector;
+    uint64_t cluster_size = (uint64_t)bpb->sectors_per_cluster * bpb->sector_size;
+    uint32_t key = build->map->entries[index].key;
+    Fat16Extent *extents;
+    size_t count;
+
+    if (key < 2) return 0;
+    if (fat16_chain_extents(&volume->fat, (uint16_t)key, &extents, &count) != 0) return -1;
+
+    int result = 0;
+    for (size_t i = 0; i < count && result == 0; i++) {
+        uint64_t start = (uint64_t)calculate_first_sector_of_cluster(extents[i].start_cluster, *bpb) * bpb->sector_size;
+        result = owner_list_add(list, start, start + extents[i].length * cluster_size, build->kinds[index], index);
+    }
+    free(extents);
+    return result;
+}
+
+// Lee los mapas de un grupo de entradas y pasa sus rangos al mapa
+static void owner_map_task(ThreadPool *pool, void *arg) {
+    OwnerTask *task = arg;
+    OwnerBuild *build = task->build;
+    OwnerRangeList list = { NULL, 0, 0 };
+    (void)pool;
+
+    for (size_t i = task->first; i < task->first + task->count; i++) {
+        size_t before = list.count;
+        int mapped = build->ext2 != NULL ? owner_map_ext2_entry(build, (uint32_t)i, &list) : owner_map_fat16_entry(build, (uint32_t)i, &list);
+        if (mapped != 0) {
+            const OwnerEntry *entry = &build->map->entries[i];
+            if (entry->path != OWNER_NO_PATH) {
+                fprintf(stderr, "Error reading the blocks of %s\n", build->map->names + entry->path);
+            } else {
+                fprintf(stderr, "Error reading the blocks of inode %u\n", entry->key);
+            }
+            list.count = before;
+        }
+    }
+
+    pthread_mutex_lock(&build->lock);
+    if (owner_map_append(build->map, &list) != 0) build->failed = 1;
+    pthread_mutex_unlock(&build->lock);
+    free(list.ranges);
+}
+
+// Reparte las entradas en tareas; con un hilo se hacen una detrás de otra
+static int owner_map_run_tasks(OwnerBuild *build, int threads) {
+    size_t task_count = (build->map->entry_count + OWNER_MAP_TASK_ENTRIES - 1) / OWNER_MAP_TASK_ENTRIES;
+    OwnerTask *tasks = malloc((task_count ? task_count : 1) * sizeof(OwnerTask));
+    ThreadPool pool;
+
+    if (tasks == NULL) return -1;
+    for (size_t i = 0; i < task_count; i++) {
+        size_t first = i * OWNER_MAP_TASK_ENTRIES;
+        size_t left = build->map->entry_count - first;
+        tasks[i] = (OwnerTask){ build, first, left < OWNER_MAP_TASK_ENTRIES ? left : OWNER_MAP_TASK_ENTRIES };
+    }
+
+    if (threads > 1 && thread_pool_init(&pool, threads) == 0) {
+        for (size_t i = 0; i < task_count; i++) {
+            if (thread_pool_submit(&pool, owner_map_task, &tasks[i]) != 0) owner_map_task(&pool, &tasks[i]);
+        }
+        thread_pool_wait(&pool);
+        thread_pool_destroy(&pool);
+    } else {
+        for (size_t i = 0; i < task_count; i++) owner_map_task(NULL, &tasks[i]);
+    }
+    free(tasks);
+    return build->failed ? -1 : 0;
+}
+
+// Superbloques, descriptores, bitmaps y tablas de inodos de cada grupo
+static int owner_map_ext2_metadata(OwnerBuild *build) {
+    Ext2Volume *volume = build->ext2;
+    const Ext2Superblock *superblock = &volume->superblock;
+    uint64_t block_size = volume->block_size;
+    uint64_t gdt_blocks = ((uint64_t)volume->group_count * sizeof(Ext2GroupDesc) + block_size - 1) / block_size;
+    uint64_t table_blocks = ((uint64_t)superblock->inodes_per_group * volume->inode_size + block_size - 1) / block_size;
+    OwnerRangeList list = { NULL, 0, 0 };
+    int result = 0;
+
+    // El superbloque principal está a 1024 bytes del principio, detrás del bloque de arranque
+    result |= owner_list_add(&list, 0, EXT2_SUPERBLOCK_OFFSET, OWNER_BOOT, 0);
+    for (uint32_t group = 0; group < volume->group_count && result == 0; group++) {
+        uint64_t base = ((uint64_t)superblock->first_data_block + (uint64_t)group * superblock->blocks_per_group) * block_size;
+        const Ext2GroupDesc *desc = &volume->groups[group];
+
+        if (ext2_group_has_superblock(volume, group)) {
+            uint64_t start = group == 0 ? EXT2_SUPERBLOCK_OFFSET : base;
+            result |= owner_list_add(&list, start, base + block_size, OWNER_SUPERBLOCK, group);
+            result |= owner_list_add(&list, base + block_size, base + (1 + gdt_blocks) * block_size, OWNER_GROUP_DESCRIPTORS, group);
+            result |= owner_list_add(&list, base + (1 + gdt_blocks) * block_size,
+                                     base + (1 + gdt_blocks + superblock->reserved_gdt_blocks) * block_size, OWNER_RESERVED_GDT, group);
+        }
+        result |= owner_list_add(&list, desc->block_bitmap * block_size, (desc->block_bitmap + 1) * block_size, OWNER_BLOCK_BITMAP, group);
+        result |= owner_list_add(&list, desc->inode_bitmap * block_size, (desc->inode_bitmap + 1) * block_size, OWNER_INODE_BITMAP, group);
+        result |= owner_list_add(&list, desc->inode_table * block_size, (desc->inode_table + table_blocks) * block_size, OWNER_INODE_TABLE, group);
+    }
+
+    if (result == 0) result = owner_map_append(build->map, &list);
+    free(list.ranges);
+    return result;
+}
+
+// Sector de arranque, sectores reservados, copias de la FAT y región del directorio raíz
+static int owner_map_fat16_metadata(OwnerBuild *build) {
+    const BootSector *bpb = &build->fat16->boot_sector;
+    uint64_t sector_size = bpb->sector_size;
+    uint64_t fat_start = (uint64_t)bpb->reserved_sectors * sector_size;
+    uint64_t fat_size = (uint64_t)bpb->fat_size_16 * sector_size;
+    uint64_t root_start = fat_start + bpb->number_of_fats * fat_size;
+    uint64_t root_size = ((uint64_t)bpb->root_dir_entries * sizeof(DirEntry) + sector_size - 1) / sector_size * sector_size;
+    OwnerRangeList list = { NULL, 0, 0 };
+    int result = 0;
+
+    result |= owner_list_add(&list, 0, sector_size, OWNER_BOOT, 0);
+    result |= owner_list_add(&list, sector_size, fat_start, OWNER_RESERVED_SECTORS, 0);
+    for (uint32_t copy = 0; copy < bpb->number_of_fats && result == 0; copy++) {
+        result |= owner_list_add(&list, fat_start + copy * fat_size, fat_start + (copy + 1) * fat_size, OWNER_FAT, copy);
+    }
+    result |= owner_list_add(&list, root_start, root_start + root_size, OWNER_ROOT_DIRECTORY, 0);
+
+    if (result == 0) result = owner_map_append(build->map, &list);
+    free(list.ranges);
+    return result;
+}
+
+static int owner_map_compare_ranges(const void *a, const void *b) {
+    const OwnerRange *x = a, *y = b;
+
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return x->end < y->end ? -1 : x->end > y->end;
+}
+
+// Ordena los rangos y calcula el mayor final de cada prefijo
+static int owner_map_finish(OwnerMap *map) {
+    if (map->range_count > 0) qsort(map->ranges, map->range_count, sizeof(OwnerRange), owner_map_compare_ranges);
+    map->reach = malloc((map->range_count ? map->range_count : 1) * sizeof(uint64_t));
+    if (map->reach == NULL) return -1;
+
+    uint64_t reach = 0;
+    for (size_t i = 0; i < map->range_count; i++) {
+        if (map->ranges[i].end > reach) reach = map->ranges[i].end;
+        map->reach[i] = reach;
+    }
+    return 0;
+}
+
+// Recorrido, metadatos y mapas de un volumen EXT2
+static int owner_map_build_ext2(OwnerBuild *build, int threads) {
+    Ext2Volume *volume = build->ext2;
+    const Ext2Superblock *superblock = &volume->superblock;
+    uint32_t first_inode = superblock->rev_level == 0 ? 11 : superblock->first_non_reserved_inode;
+
+    build->inode_count = superblock->total_inodes + 1;
+    if ((build->seen = calloc(build->inode_count / 8 + 1, 1)) == NULL) return -1;
+
+    // La raíz y los inodos reservados, que pueden tener bloques (el diario, el resize inode)
+    if (owner_map_add_entry(build, "/", EXT2_ROOT_INODE, OWNER_DIRECTORY) != 0) return -1;
+    build->seen[EXT2_ROOT_INODE / 8] |= 1u << (EXT2_ROOT_INODE % 8);
+    for (uint32_t inode = 1; inode < first_inode && inode < build->inode_count; inode++) {
+        if (inode != EXT2_ROOT_INODE && owner_map_add_entry(build, NULL, inode, OWNER_INODE) != 0) return -1;
+    }
+
+    int walked = ext2_walk(volume, owner_map_select, build);
+    report_walk_error(volume->walk_error);
+    if (walked != 0) {
+        perror("Error walking the volume");
+        return -1;
+    }
+    if (owner_map_ext2_metadata(build) != 0) return -1;
+    return owner_map_run_tasks(build, threads);
+}
+
+static int owner_map_build_fat16(OwnerBuild *build, int threads) {
+    int walked = fat16_walk(build->fat16, owner_map_select, build);
+    report_walk_error(build->fat16->walk_error);
+    if (walked != 0) {
+        perror("Error walking the volume");
+        return -1;
+    }
+    if (owner_map_fat16_metadata(build) != 0) return -1;
+    return owner_map_run_tasks(build, threads);
+}
+
+/**
+ * @brief Builds the map of an EXT2 or FAT16 image.
+ *
+ * One walk of the volume lists the files and directories; their block maps or cluster
+ * chains are then read by a thread pool. The metadata of the volume gets its own
+ * ranges: the superblocks, group descriptors, bitmaps and inode tables of EXT2, and the
+ * boot sector, reserved sectors, FAT copies and root directory region of FAT16. A file
+ * with several hard links is listed once, under the first path walked.
+ *
+ * @param map Map to fill.
+ * @param image Image of the file system.
+ * @param threads Number of threads that read the block maps.
+ *
+ * @return 0 on success, -1 on error (the error is printed).
+*/
+int owner_map_build(OwnerMap *map, Image *image, int threads) {
+    OwnerBuild build;
+    int result;
+
+    memset(map, 0, sizeof(OwnerMap));
+    memset(&build, 0, sizeof(OwnerBuild));
+    build.map = map;
+    pthread_mutex_init(&build.lock, NULL);
+
+    if (is_ext2(image)) {
+        Ext2Volume volume;
+        if (ext2_open_volume(image, &volume) != 0) {
+            perror("Error opening EXT2 volume");
+            result = -1;
+        } else {
+            build.ext2 = &volume;
+            map->fs_type = PATH_INDEX_FS_EXT2;
+            map->fs_stamp = volume.superblock.last_written_time;
+            result = owner_map_build_ext2(&build, threads);
+            ext2_close_volume(&volume);
+        }
+    } else if (is_fat16(image)) {
+        Fat16Volume volume;
+        if (fat16_open_volume(image, &volume) != 0) {
+            perror("Error loading FAT");
+            result = -1;
+        } else {
+            report_fat16_copies(&volume);
+            build.fat16 = &volume;
+            map->fs_type = PATH_INDEX_FS_FAT16;
+            map->fs_stamp = volume.boot_sector.volume_id;
+            result = owner_map_build_fat16(&build, threads);
+            fat16_close_volume(&volume);
+        }
+    } else {
+        printf("Invalid file system.\n");
+        result = -1;
+    }
+
+    if (result == 0 && owner_map_finish(map) != 0) {
+        perror("Error building the owner map");
+        result = -1;
+    }
+    free(build.kinds);
+    free(build.seen);
+    pthread_mutex_destroy(&build.lock);
+    return result;
+}
+
+/**
+ * @brief Calls a function for every range that overlaps [start, end), in decreasing order of start.
+ *
+ * @param map Map of the image.
+ * @param start First byte.
+ * @param end First byte after the bytes searched.
+ * @param function Function called with each range.
+ * @param context Pointer passed to the function.
+ *
+ * @return 0, or the value that stopped the search.
+*/
+int owner_map_find(const OwnerMap *map, uint64_t start, uint64_t end, OwnerRangeFunction function, void *context) {
+    // Primer rango que empieza en end o después
+    size_t low = 0, high = map->range_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (map->ranges[middle].start < end) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    // Hacia atrás mientras algún rango anterior pueda llegar a start
+    for (size_t i = low; i > 0 && map->reach[i - 1] > start; i--) {
+        if (map->ranges[i - 1].end > start) {
+            int stop = function(map, &map->ranges[i - 1], context);
+            if (stop != 0) return stop;
+        }
+    }
+    return 0;
+}
+
+// Camino de una entrada, o el número de inodo de un inodo reservado
+static int owner_map_entry_name(const OwnerMap *map, uint32_t index, char *buffer, size_t size) {
+    // Un sidecar dañado puede apuntar fuera de las entradas o de los nombres
+    if (index >= map->entry_count) return snprintf(buffer, size, "unknown");
+    const OwnerEntry *entry = &map->entries[index];
+
+    if (entry->path != OWNER_NO_PATH && entry->path >= map->names_length) return snprintf(buffer, size, "unknown");
+    if (entry->path == OWNER_NO_PATH) return snprintf(buffer, size, "inode %u", entry->key);
+    return snprintf(buffer, size, "%s", map->names + entry->path);
+}
+
+/**
+ * @brief Writes the name of the owner of a range, like "/dir/file", "/dir/file (block map)" or "inode table (group 3)".
+ *
+ * @param map Map of the image.
+ * @param range Range of the map.
+ * @param buffer Where the name is written.
+ * @param size Size of the buffer.
+ *
+ * @return Length of the name, as snprintf.
+*/
+int owner_map_describe(const OwnerMap *map, const OwnerRange *range, char *buffer, size_t size) {
+    int length;
+
+    switch (range->kind) {
+        case OWNER_FILE:
+        case OWNER_DIRECTORY:
+        case OWNER_INODE:
+            return owner_map_entry_name(map, range->id, buffer, size);
+        case OWNER_BLOCK_MAP:
+        case OWNER_XATTR:
+            length = owner_map_entry_name(map, range->id, buffer, size);
+            if (length < 0 || (size_t)length >= size) return length;
+            return length + snprintf(buffer + length, size - length, range->kind == OWNER_BLOCK_MAP ? " (block map)" : " (extended attributes)");
+        case OWNER_BOOT:
+            return snprintf(buffer, size, "boot sector");
+        case OWNER_SUPERBLOCK:
+            return snprintf(buffer, size, "superblock (group %u)", range->id);
+        case OWNER_GROUP_DESCRIPTORS:
+            return snprintf(buffer, size, "group descriptors (group %u)", range->id);
+        case OWNER_RESERVED_GDT:
+            return snprintf(buffer, size, "reserved group descriptors (group %u)", range->id);
+        case OWNER_BLOCK_BITMAP:
+            return snprintf(buffer, size, "block bitmap (group %u)", range->id);
+        case OWNER_INODE_BITMAP:
+            return snprintf(buffer, size, "inode bitmap (group %u)", range->id);
+        case OWNER_INODE_TABLE:
+            return snprintf(buffer, size, "inode table (group %u)", range->id);
+        case OWNER_RESERVED_SECTORS:
+            return snprintf(buffer, size, "reserved sectors");
+        case OWNER_FAT:
+            return snprintf(buffer, size, "FAT %u", range->id + 1);
+        case OWNER_ROOT_DIRECTORY:
+            return snprintf(buffer, size, "root directory");
+        default:
+            return snprintf(buffer, size, "unknown");
+    }
+}
+
+// Tipo y sello del sistema de ficheros de la imagen, los mismos que guarda el índice de caminos
+static int owner_map_stamp(Image *image, uint32_t *fs_type, uint32_t *fs_stamp) {
+    if (is_ext2(image)) {
+        Ext2Superblock superblock;
+        if (read_ext2_superblock(image, &superblock) != 0) return -1;
+        *fs_type = PATH_INDEX_FS_EXT2;
+        *fs_stamp = superblock.last_written_time;
+        return 0;
+    }
+    if (is_fat16(image)) {
+        BootSector boot_sector;
+        if (read_boot_sector(image, &boot_sector) != 0) return -1;
+        *fs_type = PATH_INDEX_FS_FAT16;
+        *fs_stamp = boot_sector.volume_id;
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief Writes the path of the sidecar of an image into a buffer.
+ *
+ * @param image Image the map belongs to.
+ * @param buffer Destination buffer.
+ * @param size Size of the buffer.
+ *
+ * @return 0 on success, -1 if the image has no path (pipes) or the buffer is too small.
+*/
+int owner_map_sidecar_path(const Image *image, char *buffer, size_t size) {
+    if (image->path == NULL || (image->data != NULL && !image->mapped)) {
+        return -1; // Streams loaded in memory have nothing to check the map against
+    }
+
+    int length = snprintf(buffer, size, "%s%s", image->path, OWNER_MAP_SUFFIX);
+    return length < 0 || (size_t)length >= size ? -1 : 0;
+}
+
+/**
+ * @brief Writes a map built with owner_map_build to a sidecar file.
+ *
+ * The file is written under a temporary name and renamed, so a reader never sees half a map.
+ *
+ * @param map Map of the image.
+ * @param image Image the map belongs to.
+ * @param path Path of the sidecar file.
+ *
+ * @return 0 on success, -1 on error (errno is set).
+*/
+int owner_map_write(const OwnerMap *map, Image *image, const char *path) {
+    struct stat image_stat;
+    if (fstat(image->fd, &image_stat) != 0) {
+        return -1;
+    }
+
+    OwnerMapHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, OWNER_MAP_MAGIC, sizeof(header.magic));
+    header.version = OWNER_MAP_VERSION;
+    header.fs_type = map->fs_type;
+    header.fs_stamp = map->fs_stamp;
+    header.entry_count = (uint32_t)map->entry_count;
+    header.range_count = map->range_count;
+    header.names_size = map->names_length;
+    header.image_size = image->size;
+    header.image_mtime_sec = image_stat.st_mtim.tv_sec;
+    header.image_mtime_nsec = image_stat.st_mtim.tv_nsec;
+
+    char temporary[4096];
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int)sizeof(temporary)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+
+    int result = output_write_all(fd, &header, sizeof(header)) != 0 ||
+                 output_write_all(fd, map->ranges, map->range_count * sizeof(OwnerRange)) != 0 ||
+                 output_write_all(fd, map->reach, map->range_count * sizeof(uint64_t)) != 0 ||
+                 output_write_all(fd, map->entries, map->entry_count * sizeof(OwnerEntry)) != 0 ||
+                 output_write_all(fd, map->names, map->names_length) != 0 ? -1 : 0;
+
+    if (close(fd) != 0) result = -1;
+    if (result == 0 && rename(temporary, path) != 0) result = -1;
+    if (result != 0) {
+        int saved_errno = errno;
+        unlink(temporary);
+        errno = saved_errno;
+    }
+    return result;
+}
+
+/**
+ * @brief Maps the sidecar of an image and checks that it still describes the image.
+ *
+ * Only the header is checked, so opening does not depend on the size of the map; the
+ * entries and names of a damaged file are checked when a range is described.
+ *
+ * @param map Map to fill, read-only while it is open.
+ * @param image Image the map belongs to.
+ *
+ * @return 0 if the map can be used, -1 if it is missing, damaged or stale.
+*/
+int owner_map_open(OwnerMap *map, Image *image) {
+    char path[4096];
+    struct stat image_stat, map_stat;
+    uint32_t fs_type, fs_stamp;
+
+    memset(map, 0, sizeof(OwnerMap));
+    if (owner_map_sidecar_path(image, path, sizeof(path)) != 0 || fstat(image->fd, &image_stat) != 0 ||
+        owner_map_stamp(image, &fs_type, &fs_stamp) != 0) {
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    if (fstat(fd, &map_stat) != 0 || (size_t)map_stat.st_size < sizeof(OwnerMapHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    void *data = mmap(NULL, map_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+
+    // Los contadores vienen del fichero: se comprueban antes de multiplicar
+    const OwnerMapHeader *header = data;
+    uint64_t size = (uint64_t)map_stat.st_size;
+    int sound = header->range_count < size && header->names_size < size &&
+                sizeof(OwnerMapHeader) + header->range_count * (sizeof(OwnerRange) + sizeof(uint64_t)) +
+                (uint64_t)header->entry_count * sizeof(OwnerEntry) + header->names_size == size;
+    const char *names = (const char *)data + size - header->names_size;
+
+    // El fichero tiene que estar entero y ser de esta imagen tal como está ahora
+    if (memcmp(header->magic, OWNER_MAP_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != OWNER_MAP_VERSION || !sound ||
+        (header->names_size > 0 && names[header->names_size - 1] != '\0') ||
+        header->fs_type != fs_type || header->fs_stamp != fs_stamp ||
+        header->image_size != image->size ||
+        header->image_mtime_sec != image_stat.st_mtim.tv_sec ||
+        header->image_mtime_nsec != image_stat.st_mtim.tv_nsec) {
+        munmap(data, map_stat.st_size);
+        return -1;
+    }
+
+    map->mapped = data;
+    map->mapped_size = map_stat.st_size;
+    map->fs_type = fs_type;
+    map->fs_stamp = fs_stamp;
+    map->ranges = (OwnerRange *)(header + 1);
+    map->range_count = header->range_count;
+    map->reach = (uint64_t *)(map->ranges + map->range_count);
+    map->entries = (OwnerEntry *)(map->reach + map->range_count);
+    map->entry_count = header->entry_count;
+    map->names = (char *)(map->entries + map->entry_count);
+    map->names_length = header->names_size;
+    return 0;
+}
+
+/**
+ * @brief Releases the memory of a map, or unmaps the sidecar of an opened one.
+ *
+ * @param map Map to release.
+ *
+ * @return void
+*/
+void owner_map_free(OwnerMap *map) {
+    if (map->mapped != NULL) {
+        munmap(map->mapped, map->mapped_size);
+    } else {
+        free(map->ranges);
+        free(map->reach);
+        free(map->entries);
+        free(map->names);
+    }
+    memset(map, 0, sizeof(OwnerMap));
+}
@@ -0,0 +1,190 @@
+#ifndef _OWNER_MAP_H
+#define _OWNER_MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "image.h"
+
+// Lo que guarda un rango de la imagen
+typedef enum {
+    OWNER_FILE,                 // Data of a file (id: entry)
+    OWNER_DIRECTORY,            // Blocks or clusters of a directory (id: entry)
+    OWNER_BLOCK_MAP,            // EXT2 indirect blocks of a file (id: entry)
+    OWNER_XATTR,                // EXT2 extended attribute block of a file (id: entry)
+    OWNER_INODE,                // EXT2 reserved inode without a path, like the journal (id: entry)
+    OWNER_BOOT,                 // EXT2 boot block or FAT16 boot sector
+    OWNER_SUPERBLOCK,           // id: group
+    OWNER_GROUP_DESCRIPTORS,    // id: group
+    OWNER_RESERVED_GDT,         // Blocks kept to grow the descriptor table (id: group)
+    OWNER_BLOCK_BITMAP,         // id: group
+    OWNER_INODE_BITMAP,         // id: group
+    OWNER_INODE_TABLE,          // id: group
+    OWNER_RESERVED_SECTORS,     // FAT16 reserved sectors after the boot sector
+    OWNER_FAT,                  // id: copy, from 0
+    OWNER_ROOT_DIRECTORY        // FAT16 root directory region
+} OwnerKind;
+
+// Rango de bytes de la imagen y su dueño
+typedef struct {
+    uint64_t start;
+    uint64_t end;               // First byte after the range
+    uint32_t kind;              // OwnerKind
+    uint32_t id;                // Entry, group or FAT copy, depending on the kind
+} OwnerRange;
+
+// Fichero, directorio o inodo que tiene rangos
+typedef struct {
+    uint32_t key;               // Inode (EXT2) or start cluster (FAT16)
+    uint32_t path;              // Offset of the path in names, OWNER_NO_PATH for a reserved inode
+} OwnerEntry;
+
+#define OWNER_NO_PATH UINT32_MAX
+
+// Mapa que --owner guarda junto a la imagen: <imagen>.fsown
+#define OWNER_MAP_SUFFIX ".fsown"
+#define OWNER_MAP_MAGIC "FSUOWN1"
+#define OWNER_MAP_VERSION 1
+
+/**
+ * @brief Header of the sidecar file, followed by the ranges, the reach array, the entries and the names.
+ *
+ * Like the path index, the map is only trusted while the file system stamp and the
+ * size and modification time of the image still match.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t fs_type;           // PATH_INDEX_FS_EXT2 or PATH_INDEX_FS_FAT16
+    uint32_t fs_stamp;          // EXT2 last written time or FAT16 volume id
+    uint32_t entry_count;
+    uint64_t range_count;
+    uint64_t names_size;
+    uint64_t image_size;
+    int64_t image_mtime_sec;
+    int64_t image_mtime_nsec;
+} __attribute__((packed)) OwnerMapHeader;
+
+/**
+ * @brief Physical ranges of an image mapped to the files and the structures that own them.
+ *
+ * The ranges are sorted by start. reach[i] is the largest end of the ranges 0..i, so
+ * the ranges that contain an offset are found with a binary search even when a broken
+ * volume gives a block to two owners.
+ */
+typedef struct {
+    OwnerRange *ranges;
+    uint64_t *reach;
+    size_t range_count;
+    size_t range_capacity;
+
+    OwnerEntry *entries;
+    size_t entry_count;
+    size_t entry_capacity;
+
+    char *names;                // Paths of the entries, NUL terminated
+    size_t names_length;
+    size_t names_capacity;
+
+    uint32_t fs_type;           // PATH_INDEX_FS_EXT2 or PATH_INDEX_FS_FAT16
+    uint32_t fs_stamp;
+    void *mapped;               // Sidecar the arrays point into, NULL for a map built in memory
+    size_t mapped_size;
+} OwnerMap;
+
+/**
+ * @brief Function called for every range found by owner_map_find.
+ *
+ * @return 0 to go on, any other value stops the search and is returned.
+*/
+typedef int (*OwnerRangeFunction)(const OwnerMap *map, const OwnerRange *range, void *context);
+
+/**
+ * @brief Builds the map of an EXT2 or FAT16 image.
+ *
+ * One walk of the volume lists the files and directories; their block maps or cluster
+ * chains are then read by a thread pool. The metadata of the volume gets its own
+ * ranges: the superblocks, group descriptors, bitmaps and inode tables of EXT2, and the
+ * boot sector, reserved sectors, FAT copies and root directory region of FAT16. A file
+ * with several hard links is listed once, under the first path walked.
+ *
+ * @param map Map to fill.
+ * @param image Image of the file system.
+ * @param threads Number of threads that read the block maps.
+ *
+ * @return 0 on success, -1 on error (the error is printed).
+*/
+int owner_map_build(OwnerMap *map, Image *image, int threads);
+
+/**
+ * @brief Calls a function for every range that overlaps [start, end), in decreasing order of start.
+ *
+ * @param map Map of the image.
+ * @param start First byte.
+ * @param end First byte after the bytes searched.
+ * @param function Function called with each range.
+ * @param context Pointer passed to the function.
+ *
+ * @return 0, or the value that stopped the search.
+*/
+int owner_map_find(const OwnerMap *map, uint64_t start, uint64_t end, OwnerRangeFunction function, void *context);
+
+/**
+ * @brief Writes the name of the owner of a range, like "/dir/file", "/dir/file (block map)" or "inode table (group 3)".
+ *
+ * @param map Map of the image.
+ * @param range Range of the map.
+ * @param buffer Where the name is written.
+ * @param size Size of the buffer.
+ *
+ * @return Length of the name, as snprintf.
+*/
+int owner_map_describe(const OwnerMap *map, const OwnerRange *range, char *buffer, size_t size);
+
+/**
+ * @brief Writes the path of the sidecar of an image into a buffer.
+ *
+ * @param image Image the map belongs to.
+ * @param buffer Destination buffer.
+ * @param size Size of the buffer.
+ *
+ * @return 0 on success, -1 if the image has no path (pipes) or the buffer is too small.
+*/
+int owner_map_sidecar_path(const Image *image, char *buffer, size_t size);
+
+/**
+ * @brief Writes a map built with owner_map_build to a sidecar file.
+ *
+ * The file is written under a temporary name and renamed, so a reader never sees half a map.
+ *
+ * @param map Map of the image.
+ * @param image Image the map belongs to.
+ * @param path Path of the sidecar file.
+ *
+ * @return 0 on success, -1 on error (errno is set).
+*/
+int owner_map_write(const OwnerMap *map, Image *image, const char *path);
+
+/**
+ * @brief Maps the sidecar of an image and checks that it still describes the image.
+ *
+ * Only the header is checked, so opening does not depend on the size of the map; the
+ * entries and names of a damaged file are checked when a range is described.
+ *
+ * @param map Map to fill, read-only while it is open.
+ * @param image Image the map belongs to.
+ *
+ * @return 0 if the map can be used, -1 if it is missing, damaged or stale.
+*/
+int owner_map_open(OwnerMap *map, Image *image);
+
+/**
+ * @brief Releases the memory of a map, or unmaps the sidecar of an opened one.
+ *
+ * @param map Map to release.
+ *
+ * @return void
+*/
+void owner_map_free(OwnerMap *map);
+
+#endif // !_OWNER_MAP_H
@@ -0,0 +1,313 @@
+#include "path_index.h"
+#include "output.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * @brief FNV-1a hash of a NUL terminated key. 0 is kept to mark free slots.
+*/
+static uint64_t path_index_hash(const char *key) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (; *key != '\0'; key++) {
+        hash ^= (uint8_t)*key;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash != 0 ? hash : 1;
+}
+
+/**
+ * @brief Writes the path of the sidecar of an image into a buffer.
+ *
+ * @param image Image the index belongs to.
+ * @param buffer Destination buffer.
+ * @param size Size of the buffer.
+ *
+ * @return 0 on success, -1 if the image has no path (pipes) or the buffer is too small.
+*/
+int path_index_sidecar_path(const Image *image, char *buffer, size_t size) {
+    if (image->path == NULL || (image->data != NULL && !image->mapped)) {
+        return -1; // Streams loaded in memory have nothing to check the index against
+    }
+
+    int length = snprintf(buffer, size, "%s%s", image->path, PATH_INDEX_SUFFIX);
+    return length < 0 || (size_t)length >= size ? -1 : 0;
+}
+
+/**
+ * @brief Adds a file to an index being built.
+ *
+ * @param builder Index being built, zero initialized before the first call.
+ * @param path Full path of the file, starting with '/'.
+ * @param key Inode (EXT2) or start cluster (FAT16) of the file.
+ * @param size Size in bytes of the file.
+ *
+ * @return 0 on success, -1 on error (out of memory).
+*/
+int path_index_builder_add(PathIndexBuilder *builder, const char *path, uint32_t key, uint64_t size) {
+    size_t length = strlen(path) + 1;
+
+    if (builder->record_count == builder->record_capacity) {
+        uint32_t capacity = builder->record_capacity ? builder->record_capacity * 2 : 256;
+        PathIndexRecord *bigger = realloc(builder->records, (size_t)capacity * sizeof(PathIndexRecord));
+        if (bigger == NULL) return -1;
+        builder->records = bigger;
+        builder->record_capacity = capacity;
+    }
+
+    if (builder->strings_size + length > builder->strings_capacity) {
+        uint64_t capacity = builder->strings_capacity ? builder->strings_capacity : 4096;
+        while (builder->strings_size + length > capacity) capacity *= 2;
+        if (capacity > UINT32_MAX) return -1; // Offsets are stored in 32 bits
+        char *bigger = realloc(builder->strings, capacity);
+        if (bigger == NULL) return -1;
+        builder->strings = bigger;
+        builder->strings_capacity = capacity;
+    }
+
+    PathIndexRecord *record = &builder->records[builder->record_count++];
+    record->key = key;
+    record->path_offset = builder->strings_size;
+    record->size = size;
+
+    memcpy(builder->strings + builder->strings_size, path, length);
+    builder->strings_size += length;
+    return 0;
+}
+
+/**
+ * @brief Inserts a key in the hash table unless it is already there.
+*/
+static void path_index_insert(PathIndexSlot *slots, uint32_t slot_count, const char *strings, uint32_t key_offset, uint32_t record) {
+    const char *key = strings + key_offset;
+    uint64_t hash = path_index_hash(key);
+
+    for (uint32_t i = hash & (slot_count - 1); ; i = (i + 1) & (slot_count - 1)) {
+        if (slots[i].hash == 0) {
+            slots[i].hash = hash;
+            slots[i].record = record;
+            slots[i].key_offset = key_offset;
+            return;
+        }
+        if (slots[i].hash == hash && strcmp(strings + slots[i].key_offset, key) == 0) {
+            return; // The first file with this bare name wins
+        }
+    }
+}
+
+/**
+ * @brief Builds the hash table of full paths and bare names and writes the sidecar.
+ *
+ * The file is written under a temporary name and renamed, so a reader never sees half an index.
+ * When two files share a bare name, the first one added wins, as in the --cat walk.
+ *
+ * @param builder Index built with path_index_builder_add.
+ * @param image Image the index belongs to.
+ * @param fs_type PATH_INDEX_FS_EXT2 or PATH_INDEX_FS_FAT16.
+ * @param fs_stamp EXT2 last written time or FAT16 volume id.
+ * @param path Path of the sidecar file.
+ *
+ * @return 0 on success, -1 on error (errno is set).
+*/
+int path_index_write(const PathIndexBuilder *builder, Image *image, uint32_t fs_type, uint32_t fs_stamp, const char *path) {
+    struct stat image_stat;
+    if (fstat(image->fd, &image_stat) != 0) {
+        return -1;
+    }
+
+    // Two keys per file (full path and bare name) with the table at most half full
+    uint32_t slot_count = 16;
+    while (slot_count < (uint64_t)builder->record_count * 4) {
+        if (slot_count >= (1u << 30)) {
+            errno = EFBIG;
+            return -1;
+        }
+        slot_count *= 2;
+    }
+
+    PathIndexSlot *slots = calloc(slot_count, sizeof(PathIndexSlot));
+    if (slots == NULL) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < builder->record_count; i++) {
+        uint32_t path_offset = builder->records[i].path_offset;
+        const char *name = strrchr(builder->strings + path_offset, '/');
+        uint32_t name_offset = name != NULL ? path_offset + (name + 1 - (builder->strings + path_offset)) : path_offset;
+
+        path_index_insert(slots, slot_count, builder->strings, path_offset, i);
+        path_index_insert(slots, slot_count, builder->strings, name_offset, i);
+    }
+
+    PathIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PATH_INDEX_MAGIC, sizeof(header.magic));
+    header.version = PATH_INDEX_VERSION;
+    header.fs_type = fs_type;
+    header.fs_stamp = fs_stamp;
+    header.slot_count = slot_count;
+    header.record_count = builder->record_count;
+    header.image_size = image->size;
+    header.image_mtime_sec = image_stat.st_mtim.tv_sec;
+    header.image_mtime_nsec = image_stat.st_mtim.tv_nsec;
+    header.strings_size = builder->strings_size;
+
+    char temporary[4096];
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int)sizeof(temporary)) {
+        free(slots);
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        free(slots);
+        return -1;
+    }
+
+    int result = output_write_all(fd, &header, sizeof(header)) != 0 ||
+                 output_write_all(fd, slots, (size_t)slot_count * sizeof(PathIndexSlot)) != 0 ||
+                 output_write_all(fd, builder->records, (size_t)builder->record_count * sizeof(PathIndexRecord)) != 0 ||
+                 output_write_all(fd, builder->strings, builder->strings_size) != 0 ? -1 : 0;
+    free(slots);
+
+    if (close(fd) != 0) result = -1;
+    if (result == 0 && rename(temporary, path) != 0) result = -1;
+    if (result != 0) {
+        int saved_errno = errno;
+        unlink(temporary);
+        errno = saved_errno;
+    }
+    return result;
+}
+
+/**
+ * @brief Releases an index being built.
+ *
+ * @param builder Index to release.
+ *
+ * @return void
+*/
+void path_index_builder_free(PathIndexBuilder *builder) {
+    free(builder->records);
+    free(builder->strings);
+    memset(builder, 0, sizeof(PathIndexBuilder));
+}
+
+/**
+ * @brief Opens the sidecar of an image and checks that it still describes the image.
+ *
+ * @param index Index structure to fill.
+ * @param image Image the index belongs to.
+ * @param fs_type File system of the image.
+ * @param fs_stamp EXT2 last written time or FAT16 volume id of the image.
+ *
+ * @return 0 if the index can be used, -1 if it is missing, damaged or stale.
+*/
+int path_index_open(PathIndex *index, Image *image, uint32_t fs_type, uint32_t fs_stamp) {
+    char path[4096];
+    struct stat image_stat, index_stat;
+
+    memset(index, 0, sizeof(PathIndex));
+    if (path_index_sidecar_path(image, path, sizeof(path)) != 0 || fstat(image->fd, &image_stat) != 0) {
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    if (fstat(fd, &index_stat) != 0 || (size_t)index_stat.st_size < sizeof(PathIndexHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    void *data = mmap(NULL, index_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+
+    const PathIndexHeader *header = data;
+    uint64_t expected = sizeof(PathIndexHeader) + (uint64_t)header->slot_count * sizeof(PathIndexSlot) +
+                        (uint64_t)header->record_count * sizeof(PathIndexRecord) + header->strings_size;
+
+    // The layout has to be sound and the image has to be the one the index was built from
+    if (memcmp(header->magic, PATH_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != PATH_INDEX_VERSION ||
+        header->slot_count == 0 || (header->slot_count & (header->slot_count - 1)) != 0 ||
+        expected != (uint64_t)index_stat.st_size ||
+        header->fs_type != fs_type || header->fs_stamp != fs_stamp ||
+        header->image_size != image->size ||
+        header->image_mtime_sec != image_stat.st_mtim.tv_sec ||
+        header->image_mtime_nsec != image_stat.st_mtim.tv_nsec) {
+        munmap(data, index_stat.st_size);
+        return -1;
+    }
+
+    index->data = data;
+    index->size = index_stat.st_size;
+    index->header = header;
+    index->slots = (const PathIndexSlot *)(header + 1);
+    index->records = (const PathIndexRecord *)(index->slots + header->slot_count);
+    index->strings = (const char *)(index->records + header->record_count);
+    return 0;
+}
+
+/**
+ * @brief Looks up a full path (starting with '/') or a bare file name.
+ *
+ * @param index Index opened with path_index_open.
+ * @param name Path or name to look up.
+ * @param key Pointer where the inode or start cluster of the file is stored.
+ * @param size Pointer where the size of the file is stored.
+ *
+ * @return 1 if the file is in the index, 0 otherwise.
+*/
+int path_index_lookup(const PathIndex *index, const char *name, uint32_t *key, uint64_t *size) {
+    uint32_t slot_count = index->header->slot_count;
+    uint64_t strings_size = index->header->strings_size;
+    uint64_t hash = path_index_hash(name);
+    size_t name_size = strlen(name) + 1;
+
+    // The table is never full, so the probe always reaches a free slot
+    for (uint32_t i = hash & (slot_count - 1), probes = 0; probes < slot_count; i = (i + 1) & (slot_count - 1), probes++) {
+        const PathIndexSlot *slot = &index->slots[i];
+        if (slot->hash == 0) {
+            return 0;
+        }
+        if (slot->hash != hash || slot->record >= index->header->record_count ||
+            slot->key_offset > strings_size || strings_size - slot->key_offset < name_size ||
+            memcmp(index->strings + slot->key_offset, name, name_size) != 0) {
+            continue;
+        }
+
+        *key = index->records[slot->record].key;
+        *size = index->records[slot->record].size;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Unmaps an index opened with path_index_open.
+ *
+ * @param index Index to close.
+ *
+ * @return void
+*/
+void path_index_close(PathIndex *index) {
+    if (index->data != NULL) {
+        munmap(index->data, index->size);
+    }
+    memset(index, 0, sizeof(PathIndex));
+}
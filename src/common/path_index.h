@@ -0,0 +1,157 @@
+#ifndef _PATH_INDEX_H
+#define _PATH_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "image.h"
+
+// Fichero índice que se guarda junto a la imagen: <imagen>.fsidx
+#define PATH_INDEX_SUFFIX ".fsidx"
+#define PATH_INDEX_MAGIC "FSUIDX1"
+#define PATH_INDEX_VERSION 1
+
+// Sistema de ficheros del que se ha construido el índice
+#define PATH_INDEX_FS_EXT2 1
+#define PATH_INDEX_FS_FAT16 2
+
+/**
+ * @brief Header of the sidecar file, followed by the slots, the records and the strings.
+ *
+ * The index is only trusted when the file system stamp (EXT2 last written time or
+ * FAT16 volume id) and the size and modification time of the image still match.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t fs_type;           // PATH_INDEX_FS_EXT2 or PATH_INDEX_FS_FAT16
+    uint32_t fs_stamp;          // EXT2 last written time or FAT16 volume id
+    uint32_t slot_count;        // Size of the hash table, a power of two
+    uint32_t record_count;
+    uint32_t reserved;
+    uint64_t image_size;
+    int64_t image_mtime_sec;
+    int64_t image_mtime_nsec;
+    uint64_t strings_size;
+} __attribute__((packed)) PathIndexHeader;
+
+// Casilla de la tabla hash (direccionamiento abierto); hash 0 marca una casilla libre
+typedef struct {
+    uint64_t hash;
+    uint32_t record;
+    uint32_t key_offset;        // Offset of the NUL terminated key in the strings
+} __attribute__((packed)) PathIndexSlot;
+
+// Fichero indexado
+typedef struct {
+    uint32_t key;               // Inode (EXT2) or start cluster (FAT16)
+    uint32_t path_offset;       // Offset of the full path in the strings
+    uint64_t size;              // Size in bytes of the file
+} __attribute__((packed)) PathIndexRecord;
+
+/**
+ * @brief Index being built in memory before it is written.
+ */
+typedef struct {
+    PathIndexRecord *records;
+    uint32_t record_count;
+    uint32_t record_capacity;
+    char *strings;
+    uint64_t strings_size;
+    uint64_t strings_capacity;
+} PathIndexBuilder;
+
+/**
+ * @brief Sidecar index loaded for lookups.
+ */
+typedef struct {
+    void *data;                 // Whole sidecar file, mapped
+    size_t size;
+    const PathIndexHeader *header;
+    const PathIndexSlot *slots;
+    const PathIndexRecord *records;
+    const char *strings;
+} PathIndex;
+
+/**
+ * @brief Writes the path of the sidecar of an image into a buffer.
+ *
+ * @param image Image the index belongs to.
+ * @param buffer Destination buffer.
+ * @param size Size of the buffer.
+ *
+ * @return 0 on success, -1 if the image has no path (pipes) or the buffer is too small.
+*/
+int path_index_sidecar_path(const Image *image, char *buffer, size_t size);
+
+/**
+ * @brief Adds a file to an index being built.
+ *
+ * @param builder Index being built, zero initialized before the first call.
+ * @param path Full path of the file, starting with '/'.
+ * @param key Inode (EXT2) or start cluster (FAT16) of the file.
+ * @param size Size in bytes of the file.
+ *
+ * @return 0 on success, -1 on error (out of memory).
+*/
+int path_index_builder_add(PathIndexBuilder *builder, const char *path, uint32_t key, uint64_t size);
+
+/**
+ * @brief Builds the hash table of full paths and bare names and writes the sidecar.
+ *
+ * The file is written under a temporary name and renamed, so a reader never sees half an index.
+ * When two files share a bare name, the first one added wins, as in the --cat walk.
+ *
+ * @param builder Index built with path_index_builder_add.
+ * @param image Image the index belongs to.
+ * @param fs_type PATH_INDEX_FS_EXT2 or PATH_INDEX_FS_FAT16.
+ * @param fs_stamp EXT2 last written time or FAT16 volume id.
+ * @param path Path of the sidecar file.
+ *
+ * @return 0 on success, -1 on error (errno is set).
+*/
+int path_index_write(const PathIndexBuilder *builder, Image *image, uint32_t fs_type, uint32_t fs_stamp, const char *path);
+
+/**
+ * @brief Releases an index being built.
+ *
+ * @param builder Index to release.
+ *
+ * @return void
+*/
+void path_index_builder_free(PathIndexBuilder *builder);
+
+/**
+ * @brief Opens the sidecar of an image and checks that it still describes the image.
+ *
+ * @param index Index structure to fill.
+ * @param image Image the index belongs to.
+ * @param fs_type File system of the image.
+ * @param fs_stamp EXT2 last written time or FAT16 volume id of the image.
+ *
+ * @return 0 if the index can be used, -1 if it is missing, damaged or stale.
+*/
+int path_index_open(PathIndex *index, Image *image, uint32_t fs_type, uint32_t fs_stamp);
+
+/**
+ * @brief Looks up a full path (starting with '/') or a bare file name.
+ *
+ * @param index Index opened with path_index_open.
+ * @param name Path or name to look up.
+ * @param key Pointer where the inode or start cluster of the file is stored.
+ * @param size Pointer where the size of the file is stored.
+ *
+ * @return 1 if the file is in the index, 0 otherwise.
+*/
+int path_index_lookup(const PathIndex *index, const char *name, uint32_t *key, uint64_t *size);
+
+/**
+ * @brief Unmaps an index opened with path_index_open.
+ *
+ * @param index Index to close.
+ *
+ * @return void
+*/
+void path_index_close(PathIndex *index);
+
+#endif // !_PATH_INDEX_H
@@ -0,0 +1,35 @@
+#include "report.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Warns on stderr about every FAT copy that differs from the first one.
+ *
+ * The readers only record the copies that differ, so each command reports them
+ * after opening the volume.
+ *
+ * @param volume Volume of the file system, already opened.
+ *
+ * @return void
+*/
+void report_fat16_copies(const Fat16Volume *volume) {
+    for (unsigned i = 1; i < 32; i++) {
+        if (volume->fat.mismatched_copies & (1u << i)) {
+            fprintf(stderr, "Warning: FAT copy %u differs from the first FAT\n", i + 1);
+        }
+    }
+}
+
+/**
+ * @brief Prints on stderr why a walk skipped part of a directory.
+ *
+ * @param error walk_error of the volume, nothing is printed when it is 0.
+ *
+ * @return void
+*/
+void report_walk_error(int error) {
+    if (error != 0) {
+        fprintf(stderr, "Error reading directory: %s\n", strerror(error));
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef _REPORT_H
+#define _REPORT_H
+
+#include "../fat16/fat16_reader.h"
+
+/**
+ * @brief Warns on stderr about every FAT copy that differs from the first one.
+ *
+ * The readers only record the copies that differ, so each command reports them
+ * after opening the volume.
+ *
+ * @param volume Volume of the file system, already opened.
+ *
+ * @return void
+*/
+void report_fat16_copies(const Fat16Volume *volume);
+
+/**
+ * @brief Prints on stderr why a walk skipped part of a directory.
+ *
+ * @param error walk_error of the volume, nothing is printed when it is 0.
+ *
+ * @return void
+*/
+void report_walk_error(int error);
+
+#endif // !_REPORT_H
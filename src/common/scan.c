@@ -0,0 +1,226 @@
+#include "scan.h"
+#include "output.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "../ext2/ext2_reader.h"
+#include "../fat16/fat16_reader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Mayor línea posible: seis números de 20 cifras, el modo en octal y los separadores
+#define SCAN_LINE_MAX 160
+
+// Salida de un grupo, que se escribe cuando le toca
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    uint32_t inodes;
+    int failed;
+    int done;
+} ScanGroup;
+
+typedef struct {
+    Ext2Volume *volume;
+    ScanGroup *groups;
+    pthread_mutex_t lock;       // Protects done of every group
+    pthread_cond_t group_done;
+} ScanContext;
+
+typedef struct {
+    ScanContext *scan;
+    uint32_t group;
+} ScanTask;
+
+// Escribe un número en decimal (o en octal) sin pasar por printf
+static size_t scan_format_number(char *out, uint64_t value, unsigned base) {
+    char digits[24];
+    size_t count = 0;
+
+    do {
+        digits[count++] = (char)('0' + value % base);
+        value /= base;
+    } while (value > 0);
+
+    for (size_t i = 0; i < count; i++) {
+        out[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+// Añade la línea de un inodo a la salida de su grupo
+static int scan_inode_line(uint32_t inode_num, const Ext2Inode *inode, void *context) {
+    ScanGroup *group = context;
+
+    if (group->capacity - group->length < SCAN_LINE_MAX) {
+        size_t capacity = group->capacity ? group->capacity * 2 : 64 * 1024;
+        char *bigger = realloc(group->data, capacity);
+        if (bigger == NULL) {
+            return -1;
+        }
+        group->data = bigger;
+        group->capacity = capacity;
+    }
+
+    const uint64_t fields[] = { ext2_inode_size(inode), inode->links_count, inode->atime, inode->ctime, inode->mtime };
+    char *line = group->data + group->length;
+    size_t length = scan_format_number(line, inode_num, 10);
+    line[length++] = '\t';
+    length += scan_format_number(line + length, inode->mode, 8);
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        line[length++] = '\t';
+        length += scan_format_number(line + length, fields[i], 10);
+    }
+    line[length++] = '\n';
+
+    group->length += length;
+    group->inodes++;
+    return 0;
+}
+
+static void scan_group(ScanContext *scan, uint32_t group) {
+    ScanGroup *output = &scan->groups[group];
+    output->failed = ext2_scan_group(scan->volume, group, scan_inode_line, output) != 0;
+}
+
+static void scan_group_task(ThreadPool *pool, void *arg) {
+    ScanTask *task = arg;
+    ScanContext *scan = task->scan;
+    (void)pool;
+
+    scan_group(scan, task->group);
+
+    pthread_mutex_lock(&scan->lock);
+    scan->groups[task->group].done = 1;
+    pthread_cond_broadcast(&scan->group_done);
+    pthread_mutex_unlock(&scan->lock);
+}
+
+// Escribe la salida de un grupo y libera su memoria
+static int scan_write_group(ScanGroup *group, uint32_t index) {
+    StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+    int result = 0;
+
+    if (group->failed) {
+        fprintf(stderr, "Error reading the inodes of group %u\n", index);
+        result = -1;
+    }
+    if (group->length > 0 && output_write_all(STDOUT_FILENO, group->data, group->length) != 0) {
+        perror("Error writing inodes");
+        result = -1;
+    }
+    free(group->data);
+    group->data = NULL;
+    group->length = group->capacity = 0;
+
+    stats_phase(previous);
+    return result;
+}
+
+// Escanea los grupos con un pool de hilos; el hilo principal los escribe en orden según acaban
+static int scan_parallel(ScanContext *scan, int threads, uint32_t *total) {
+    uint32_t group_count = scan->volume->group_count;
+    ThreadPool pool;
+    ScanTask *tasks = malloc(group_count * sizeof(ScanTask));
+    int result = 0;
+
+    if (tasks == NULL || thread_pool_init(&pool, threads) != 0) {
+        free(tasks);
+        return -1;
+    }
+    pthread_mutex_init(&scan->lock, NULL);
+    pthread_cond_init(&scan->group_done, NULL);
+
+    uint32_t submitted = 0;
+    for (; submitted < group_count; submitted++) {
+        tasks[submitted].scan = scan;
+        tasks[submitted].group = submitted;
+        if (thread_pool_submit(&pool, scan_group_task, &tasks[submitted]) != 0) {
+            result = -1;
+            break;
+        }
+    }
+
+    for (uint32_t g = 0; g < submitted; g++) {
+        pthread_mutex_lock(&scan->lock);
+        while (!scan->groups[g].done) {
+            pthread_cond_wait(&scan->group_done, &scan->lock);
+        }
+        pthread_mutex_unlock(&scan->lock);
+
+        *total += scan->groups[g].inodes;
+        if (scan_write_group(&scan->groups[g], g) != 0) result = -1;
+    }
+
+    thread_pool_wait(&pool);
+    thread_pool_destroy(&pool);
+    pthread_cond_destroy(&scan->group_done);
+    pthread_mutex_destroy(&scan->lock);
+    free(tasks);
+    return result;
+}
+
+/**
+ * @brief Prints every inode in use of an EXT2 image, reading the inode tables in bitmap order.
+ *
+ * With several threads each block group is scanned by a task of a thread pool. The
+ * groups are written in order, so the output is the same as with a single thread.
+ *
+ * @param image Image of the file system.
+ * @param threads Number of threads that scan the groups, 1 for the sequential scan.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int scan_inodes_command(Image *image, int threads) {
+    printf("---- Scan Inodes Command ----\n\n");
+
+    if (!is_ext2(image)) {
+        printf(is_fat16(image) ? "Inode scan is only available for EXT2 images.\n" : "Invalid file system.\n");
+        return -1;
+    }
+
+    Ext2Volume volume;
+    if (ext2_open_volume(image, &volume) != 0) {
+        perror("Error opening EXT2 volume");
+        return -1;
+    }
+
+    ScanContext scan;
+    scan.volume = &volume;
+    scan.groups = calloc(volume.group_count, sizeof(ScanGroup));
+    if (scan.groups == NULL) {
+        perror("Error scanning inodes");
+        ext2_close_volume(&volume);
+        return -1;
+    }
+
+    printf("inode\tmode\tsize\tlinks\tatime\tctime\tmtime\n");
+    fflush(stdout);
+
+    uint32_t total = 0;
+    int result = 0;
+    if (threads > 1 && volume.group_count > 1) {
+        if ((result = scan_parallel(&scan, threads, &total)) != 0) {
+            perror("Error scanning inodes");
+        }
+    } else {
+        for (uint32_t g = 0; g < volume.group_count; g++) {
+            scan_group(&scan, g);
+            total += scan.groups[g].inodes;
+            if (scan_write_group(&scan.groups[g], g) != 0) result = -1;
+        }
+    }
+
+    printf("\n%u inodes in use\n", total);
+
+    for (uint32_t g = 0; g < volume.group_count; g++) {
+        free(scan.groups[g].data);
+    }
+    free(scan.groups);
+    ext2_close_volume(&volume);
+    return result;
+}
@@ -0,0 +1,19 @@
+#ifndef _SCAN_H
+#define _SCAN_H
+
+#include "image.h"
+
+/**
+ * @brief Prints every inode in use of an EXT2 image, reading the inode tables in bitmap order.
+ *
+ * With several threads each block group is scanned by a task of a thread pool. The
+ * groups are written in order, so the output is the same as with a single thread.
+ *
+ * @param image Image of the file system.
+ * @param threads Number of threads that scan the groups, 1 for the sequential scan.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int scan_inodes_command(Image *image, int threads);
+
+#endif // !_SCAN_H
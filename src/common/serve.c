@@ -0,0 +1,727 @@
+#define _GNU_SOURCE
+#include "serve.h"
+#include "output.h"
+#include "thread_pool.h"
+#include "../lib/fsutils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+// Eventos que se esperan en cada vuelta del bucle
+#define SERVE_MAX_EVENTS 64
+
+// Tiempo máximo que un trabajador espera a un cliente que no lee su respuesta
+#define SERVE_SEND_TIMEOUT 30
+
+// Tamaño del buffer del cliente para copiar la respuesta a stdout
+#define SERVE_CLIENT_CHUNK (256 * 1024)
+
+// Imagen abierta del pool
+typedef struct {
+    char *path;             // Absolute path, the key of the pool
+    FsVolume *volume;
+    pthread_mutex_t lock;   // Serializes the use of the volume and the cached tree
+    dev_t device;           // Identity of the file when it was opened
+    ino_t inode;
+    off_t size;
+    struct timespec mtime;
+    int refs;               // Requests using the image, protected by the lock of the pool
+    int pooled;             // 0 once it leaves the pool; the last request closes it
+    uint64_t last_used;
+    int tree_fd;            // memfd with the rendered tree, -1 until the first tree request
+    uint64_t tree_length;
+} ServeImage;
+
+typedef struct {
+    ServeImage *images[SERVE_POOL_SIZE];
+    pthread_mutex_t lock;
+    uint64_t clock;
+} ServePool;
+
+typedef struct ServeClient ServeClient;
+
+typedef struct {
+    int epoll_fd;
+    ServePool pool;
+    ThreadPool workers;
+    pthread_mutex_t lock;       // Protects the list of clients
+    ServeClient *clients;
+} ServeServer;
+
+// Conexión de un cliente; mientras una tarea la atiende no está armada en epoll
+struct ServeClient {
+    ServeServer *server;
+    int fd;
+    int eof;
+    size_t length;
+    uint8_t buffer[4 + SERVE_MAX_REQUEST];
+    ServeClient *prev;
+    ServeClient *next;
+};
+
+static void serve_put_le(uint8_t *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t serve_get_le(const uint8_t *in, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+// Lee exactamente length bytes; 0 si la conexión se cierra antes
+static int serve_read_all(int fd, void *buffer, size_t length) {
+    uint8_t *data = buffer;
+
+    while (length > 0) {
+        ssize_t n = read(fd, data, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+// Envía un rango de un descriptor (el árbol guardado) sin mover su posición
+static int serve_send_range(int out_fd, int in_fd, uint64_t length) {
+    off_t offset = 0;
+
+    while (length > 0) {
+        size_t chunk = length > (1u << 30) ? (1u << 30) : (size_t)length;
+        ssize_t n = sendfile(out_fd, in_fd, &offset, chunk);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        length -= n;
+    }
+    return 0;
+}
+
+static int serve_send_header(int fd, int status, uint64_t length) {
+    uint8_t header[SERVE_RESPONSE_HEADER];
+
+    serve_put_le(header, (uint32_t)status, 4);
+    serve_put_le(header + 4, length, 8);
+    return output_write_all(fd, header, sizeof(header));
+}
+
+// Respuesta completa con un cuerpo de texto: el resultado o el mensaje de error
+static int serve_send_text(int fd, int status, const char *text, size_t length) {
+    if (serve_send_header(fd, status, length) != 0) return -1;
+    return output_write_all(fd, text, length);
+}
+
+static int serve_send_error(int fd, int status) {
+    const char *message = fs_strerror(status);
+    return serve_send_text(fd, status, message, strlen(message));
+}
+
+static void serve_image_free(ServeImage *image) {
+    fs_close(image->volume);
+    if (image->tree_fd >= 0) close(image->tree_fd);
+    pthread_mutex_destroy(&image->lock);
+    free(image->path);
+    free(image);
+}
+
+static int serve_image_same_file(const ServeImage *image, const struct stat *st) {
+    return image->device == st->st_dev && image->inode == st->st_ino && image->size == st->st_size &&
+           image->mtime.tv_sec == st->st_mtim.tv_sec && image->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// Saca una imagen del pool; se cierra ya si nadie la usa, si no al acabar su última petición
+static void serve_pool_drop(ServePool *pool, int slot) {
+    ServeImage *image = pool->images[slot];
+
+    pool->images[slot] = NULL;
+    image->pooled = 0;
+    if (image->refs == 0) serve_image_free(image);
+}
+
+// Guarda una imagen recién abierta en un hueco libre o en el de la menos usada sin peticiones
+static void serve_pool_insert(ServePool *pool, ServeImage *image) {
+    int slot = -1;
+
+    for (int i = 0; i < SERVE_POOL_SIZE; i++) {
+        if (pool->images[i] == NULL) {
+            slot = i;
+            break;
+        }
+        if (pool->images[i]->refs == 0 && (slot < 0 || pool->images[i]->last_used < pool->images[slot]->last_used)) {
+            slot = i;
+        }
+    }
+
+    // With every image busy the new one is used for this request only
+    if (slot < 0) return;
+    if (pool->images[slot] != NULL) serve_pool_drop(pool, slot);
+    pool->images[slot] = image;
+    image->pooled = 1;
+}
+
+/**
+ * @brief Returns the open image of a path, opening it if it is not in the pool or it changed.
+ *
+ * The path is checked with stat on every request, so an image changed on disk is reopened
+ * before it is used. The volume is opened without the lock of the pool, so a slow probe does
+ * not stop the requests of other images; if another request opened the same image meanwhile,
+ * that one is used.
+*/
+static int serve_pool_acquire(ServePool *pool, const char *path, ServeImage **acquired) {
+    char resolved[PATH_MAX];
+    struct stat st;
+
+    if (realpath(path, resolved) == NULL || stat(resolved, &st) != 0) {
+        return fs_error_from_errno(errno);
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        pthread_mutex_lock(&pool->lock);
+        for (int i = 0; i < SERVE_POOL_SIZE; i++) {
+            ServeImage *image = pool->images[i];
+            if (image == NULL || strcmp(image->path, resolved) != 0) continue;
+
+            if (serve_image_same_file(image, &st)) {
+                image->refs++;
+                image->last_used = ++pool->clock;
+                pthread_mutex_unlock(&pool->lock);
+                *acquired = image;
+                return FS_OK;
+            }
+            serve_pool_drop(pool, i);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        if (attempt == 1) break;
+
+        ServeImage *image = calloc(1, sizeof(ServeImage));
+        if (image == NULL || (image->path = strdup(resolved)) == NULL) {
+            free(image);
+            return FS_ERR_NO_MEMORY;
+        }
+
+        // pread instead of a mapping: a client image truncated while it is read must not kill the server with SIGBUS
+        int result = fs_open_flags(resolved, FS_OPEN_NO_MMAP, &image->volume);
+        if (result != FS_OK) {
+            free(image->path);
+            free(image);
+            return result;
+        }
+        pthread_mutex_init(&image->lock, NULL);
+        image->device = st.st_dev;
+        image->inode = st.st_ino;
+        image->size = st.st_size;
+        image->mtime = st.st_mtim;
+        image->tree_fd = -1;
+        image->refs = 1;
+
+        pthread_mutex_lock(&pool->lock);
+        int opened_meanwhile = 0;
+        for (int i = 0; i < SERVE_POOL_SIZE; i++) {
+            if (pool->images[i] != NULL && strcmp(pool->images[i]->path, resolved) == 0 &&
+                serve_image_same_file(pool->images[i], &st)) {
+                opened_meanwhile = 1;
+            }
+        }
+        if (!opened_meanwhile) {
+            image->last_used = ++pool->clock;
+            serve_pool_insert(pool, image);
+            pthread_mutex_unlock(&pool->lock);
+            *acquired = image;
+            return FS_OK;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        serve_image_free(image);
+    }
+    return FS_ERR_IO;
+}
+
+static void serve_pool_release(ServePool *pool, ServeImage *image) {
+    pthread_mutex_lock(&pool->lock);
+    image->refs--;
+    int release = !image->pooled && image->refs == 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (release) serve_image_free(image);
+}
+
+static void serve_pool_destroy(ServePool *pool) {
+    for (int i = 0; i < SERVE_POOL_SIZE; i++) {
+        if (pool->images[i] != NULL) serve_image_free(pool->images[i]);
+    }
+    pthread_mutex_destroy(&pool->lock);
+}
+
+static int serve_info(ServeImage *image, int fd) {
+    FsVolumeInfo info;
+    char text[512];
+
+    pthread_mutex_lock(&image->lock);
+    int result = fs_volume_info(image->volume, &info);
+    pthread_mutex_unlock(&image->lock);
+    if (result != FS_OK) return serve_send_error(fd, result);
+
+    int length = snprintf(text, sizeof(text),
+        "Filesystem: %s\nBlock size: %u\nTotal blocks: %llu\nFree blocks: %llu\nTotal inodes: %llu\nFree inodes: %llu\nLabel: %s\n",
+        info.type == FS_TYPE_EXT2 ? "EXT2" : "FAT16", info.block_size,
+        (unsigned long long)info.total_blocks, (unsigned long long)info.free_blocks,
+        (unsigned long long)info.total_inodes, (unsigned long long)info.free_inodes, info.label);
+    return serve_send_text(fd, FS_OK, text, (size_t)length);
+}
+
+// El árbol se dibuja una vez en un memfd y se envía con sendfile en cada petición
+static int serve_tree(ServeImage *image, int fd) {
+    int result = FS_OK;
+
+    pthread_mutex_lock(&image->lock);
+    if (image->tree_fd < 0) {
+        int tree_fd = memfd_create("fsutils-tree", MFD_CLOEXEC);
+        if (tree_fd < 0) {
+            result = FS_ERR_NO_MEMORY;
+        } else {
+            result = fs_tree(image->volume, tree_fd);
+
+            off_t length = lseek(tree_fd, 0, SEEK_END);
+            if (result != FS_OK || length < 0) {
+                close(tree_fd);
+                if (result == FS_OK) result = FS_ERR_IO;
+            } else {
+                image->tree_fd = tree_fd;
+                image->tree_length = (uint64_t)length;
+            }
+        }
+    }
+    pthread_mutex_unlock(&image->lock);
+    if (result != FS_OK) return serve_send_error(fd, result);
+
+    // The tree is never replaced while the image has requests, so it is sent without the lock
+    if (serve_send_header(fd, FS_OK, image->tree_length) != 0) return -1;
+    return serve_send_range(fd, image->tree_fd, image->tree_length);
+}
+
+static int serve_stat(ServeImage *image, const char *path, int fd) {
+    FsStat st;
+    char text[256];
+
+    pthread_mutex_lock(&image->lock);
+    int result = fs_stat_path(image->volume, path, &st);
+    pthread_mutex_unlock(&image->lock);
+    if (result != FS_OK) return serve_send_error(fd, result);
+
+    int length = snprintf(text, sizeof(text), "Size: %llu\nKey: %u\nMode: %o\nModified: %u\nLinks: %u\nType: %s\n",
+        (unsigned long long)st.size, st.key, st.mode, st.mtime, st.links, st.is_directory ? "directory" : "file");
+    return serve_send_text(fd, FS_OK, text, (size_t)length);
+}
+
+// Solo abrir el fichero usa las caches del volumen; el envío únicamente lee la imagen
+static int serve_cat(ServeImage *image, const char *path, int fd) {
+    FsFile *file;
+
+    pthread_mutex_lock(&image->lock);
+    int result = fs_open_file(image->volume, path, &file);
+    pthread_mutex_unlock(&image->lock);
+    if (result != FS_OK) return serve_send_error(fd, result);
+
+    uint64_t size = fs_file_size(file);
+    if (serve_send_header(fd, FS_OK, size) != 0 || fs_send_file(file, fd, 0, size) != FS_OK) {
+        result = -1;
+    }
+    fs_close_file(file);
+    return result;
+}
+
+/**
+ * @brief Answers one request.
+ *
+ * @return 0 if the connection can go on, -1 if it has to be closed (the answer could not
+ * be written, or was cut in the middle of a body).
+*/
+static int serve_request(ServeServer *server, int fd, const char *body, size_t length) {
+    const char *fields[3] = { NULL, NULL, NULL };
+    size_t count = 0;
+    size_t start = 0;
+
+    // Every field ends with a NUL; a body with a field without it is invalid
+    for (size_t i = 0; i < length; i++) {
+        if (body[i] != '\0') continue;
+        if (count == 3) return serve_send_error(fd, FS_ERR_INVALID);
+        fields[count++] = body + start;
+        start = i + 1;
+    }
+    if (start != length || count < 2) return serve_send_error(fd, FS_ERR_INVALID);
+
+    const char *command = fields[0];
+    int needs_path = !strcmp(command, "stat") || !strcmp(command, "cat");
+    if ((!needs_path && strcmp(command, "info") && strcmp(command, "tree")) || (size_t)(needs_path ? 3 : 2) != count) {
+        return serve_send_error(fd, FS_ERR_INVALID);
+    }
+
+    ServeImage *image;
+    int result = serve_pool_acquire(&server->pool, fields[1], &image);
+    if (result != FS_OK) return serve_send_error(fd, result);
+
+    if (!strcmp(command, "info")) {
+        result = serve_info(image, fd);
+    } else if (!strcmp(command, "tree")) {
+        result = serve_tree(image, fd);
+    } else if (!strcmp(command, "stat")) {
+        result = serve_stat(image, fields[2], fd);
+    } else {
+        result = serve_cat(image, fields[2], fd);
+    }
+
+    serve_pool_release(&server->pool, image);
+    return result == 0 ? 0 : -1;
+}
+
+// Longitud de la primera petición del buffer si ya está completa, 0 si faltan bytes, -1 si es demasiado grande
+static ssize_t serve_client_request(const ServeClient *client) {
+    if (client->length < 4) return 0;
+
+    uint64_t length = serve_get_le(client->buffer, 4);
+    if (length > SERVE_MAX_REQUEST) return -1;
+    return client->length >= 4 + length ? (ssize_t)(4 + length) : 0;
+}
+
+static void serve_client_close(ServeClient *client) {
+    ServeServer *server = client->server;
+
+    pthread_mutex_lock(&server->lock);
+    if (client->prev != NULL) client->prev->next = client->next;
+    else server->clients = client->next;
+    if (client->next != NULL) client->next->prev = client->prev;
+    pthread_mutex_unlock(&server->lock);
+
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    free(client);
+}
+
+static int serve_client_arm(ServeClient *client, int operation) {
+    struct epoll_event event = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = client };
+    return epoll_ctl(client->server->epoll_fd, operation, client->fd, &event);
+}
+
+/**
+ * @brief Task of the thread pool: answers the complete requests of a client.
+ *
+ * The socket is blocking while the answers are written, so sendfile can send a whole
+ * file in one call; it goes back to non blocking before epoll watches it again.
+*/
+static void serve_client_task(ThreadPool *pool, void *arg) {
+    (void)pool;
+    ServeClient *client = arg;
+    int flags = fcntl(client->fd, F_GETFL);
+    int keep = flags >= 0 && fcntl(client->fd, F_SETFL, flags & ~O_NONBLOCK) == 0;
+
+    ssize_t length;
+    while (keep && (length = serve_client_request(client)) != 0) {
+        if (length < 0 || serve_request(client->server, client->fd, (const char *)client->buffer + 4, length - 4) != 0) {
+            keep = 0;
+            break;
+        }
+        client->length -= length;
+        memmove(client->buffer, client->buffer + length, client->length);
+    }
+
+    if (keep && !client->eof && fcntl(client->fd, F_SETFL, flags) == 0 && serve_client_arm(client, EPOLL_CTL_MOD) == 0) {
+        return;
+    }
+    serve_client_close(client);
+}
+
+// Lee lo que haya llegado de un cliente y pasa sus peticiones completas al pool
+static void serve_client_readable(ServeServer *server, ServeClient *client) {
+    while (client->length < sizeof(client->buffer)) {
+        ssize_t n = read(client->fd, client->buffer + client->length, sizeof(client->buffer) - client->length);
+        if (n > 0) {
+            client->length += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        client->eof = 1;
+        break;
+    }
+
+    ssize_t request = serve_client_request(client);
+    if (request > 0) {
+        if (thread_pool_submit(&server->workers, serve_client_task, client) == 0) return;
+    } else if (request == 0 && !client->eof && client->length < sizeof(client->buffer) &&
+               serve_client_arm(client, EPOLL_CTL_MOD) == 0) {
+        return;
+    }
+    serve_client_close(client);
+}
+
+static void serve_accept(ServeServer *server, int listen_fd) {
+    struct timeval timeout = { .tv_sec = SERVE_SEND_TIMEOUT };
+
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("Error accepting connection");
+            return;
+        }
+
+        ServeClient *client = calloc(1, sizeof(ServeClient));
+        if (client == NULL) {
+            close(fd);
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        client->server = server;
+        client->fd = fd;
+
+        pthread_mutex_lock(&server->lock);
+        client->next = server->clients;
+        if (server->clients != NULL) server->clients->prev = client;
+        server->clients = client;
+        pthread_mutex_unlock(&server->lock);
+
+        if (serve_client_arm(client, EPOLL_CTL_ADD) != 0) serve_client_close(client);
+    }
+}
+
+// Crea el socket; uno que ya existe solo se reemplaza si no hay nadie escuchando en él
+static int serve_listen(const char *socket_path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    struct stat st;
+
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long\n");
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Error creating socket");
+        return -1;
+    }
+
+    if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int in_use = probe >= 0 && connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+        if (probe >= 0) close(probe);
+        if (in_use) {
+            fprintf(stderr, "Socket %s is in use\n", socket_path);
+            close(fd);
+            return -1;
+        }
+        unlink(socket_path);
+    }
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror("Error listening on socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Serves info, tree, stat and cat requests on a Unix socket until SIGINT or SIGTERM.
+ *
+ * Protocol, every integer in little endian:
+ *   request:  uint32 length, then the body "command\0image\0[path\0]"
+ *   response: int32 status (0 or a negative FsError), uint64 length, then the body
+ * On success the body is the output of the command (the raw contents for cat), otherwise
+ * the error message. A connection can send any number of requests, one after another.
+ *
+ * The images stay open in a pool with their metadata caches, so only the first request
+ * of an image pays for the probe; an image that changes on disk is opened again. The
+ * tree of an image is rendered once and kept with it. An epoll loop reads the requests
+ * and a thread pool answers them; cat contents go from the image to the socket with
+ * sendfile.
+ *
+ * @param socket_path Path of the socket to create.
+ * @param threads Number of threads that answer requests.
+ *
+ * @return 0 after a clean shutdown, -1 on error.
+*/
+int serve_command(const char *socket_path, int threads) {
+    ServeServer server = { .epoll_fd = -1 };
+    sigset_t signals;
+    int status = -1;
+
+    // The workers inherit the mask, so the signals only reach the signalfd
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    signal(SIGPIPE, SIG_IGN);
+    if (pthread_sigmask(SIG_BLOCK, &signals, NULL) != 0) return -1;
+
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    int listen_fd = serve_listen(socket_path);
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (signal_fd < 0 || listen_fd < 0 || server.epoll_fd < 0) {
+        if (signal_fd < 0 || server.epoll_fd < 0) perror("Error starting server");
+        goto out;
+    }
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = &listen_fd };
+    struct epoll_event signal_event = { .events = EPOLLIN, .data.ptr = &signal_fd };
+    if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) != 0 ||
+        epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, signal_fd, &signal_event) != 0) {
+        perror("Error starting server");
+        goto out;
+    }
+
+    pthread_mutex_init(&server.pool.lock, NULL);
+    pthread_mutex_init(&server.lock, NULL);
+    if (thread_pool_init(&server.workers, threads) != 0) {
+        perror("Error starting worker threads");
+        pthread_mutex_destroy(&server.pool.lock);
+        pthread_mutex_destroy(&server.lock);
+        goto out;
+    }
+
+    printf("Serving on %s\n", socket_path);
+    fflush(stdout);
+
+    int running = 1;
+    struct epoll_event events[SERVE_MAX_EVENTS];
+    while (running) {
+        int count = epoll_wait(server.epoll_fd, events, SERVE_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            perror("Error waiting for events");
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == &signal_fd) {
+                // The signal is consumed, otherwise it would kill the process when unblocked
+                struct signalfd_siginfo info;
+                if (read(signal_fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) running = 0;
+            } else if (events[i].data.ptr == &listen_fd) {
+                serve_accept(&server, listen_fd);
+            } else {
+                serve_client_readable(&server, events[i].data.ptr);
+            }
+        }
+    }
+
+    // The requests in progress end first; then every client is idle and can be closed
+    thread_pool_wait(&server.workers);
+    thread_pool_destroy(&server.workers);
+    while (server.clients != NULL) serve_client_close(server.clients);
+    serve_pool_destroy(&server.pool);
+    pthread_mutex_destroy(&server.lock);
+    status = 0;
+
+out:
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path);
+    }
+    if (server.epoll_fd >= 0) close(server.epoll_fd);
+    if (signal_fd >= 0) close(signal_fd);
+    pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+    return status;
+}
+
+/**
+ * @brief Sends one request to a --serve process and writes the answer to stdout.
+ *
+ * @param socket_path Path of the socket of the server.
+ * @param command info, tree, stat or cat.
+ * @param image Path of the image; a relative path is made absolute first.
+ * @param path Path inside the image for stat and cat, NULL otherwise.
+ *
+ * @return 0 on success, -1 on error (the message goes to stderr).
+*/
+int client_command(const char *socket_path, const char *command, const char *image, const char *path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    uint8_t request[4 + SERVE_MAX_REQUEST];
+    char resolved[PATH_MAX];
+
+    // The server resolves paths from its own directory
+    if (realpath(image, resolved) != NULL) image = resolved;
+
+    const char *fields[3] = { command, image, path };
+    size_t length = 0;
+    for (int i = 0; i < 3 && fields[i] != NULL; i++) {
+        size_t field = strlen(fields[i]) + 1;
+        if (length + field > SERVE_MAX_REQUEST) {
+            fprintf(stderr, "Request too long\n");
+            return -1;
+        }
+        memcpy(request + 4 + length, fields[i], field);
+        length += field;
+    }
+    serve_put_le(request, length, 4);
+
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long\n");
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror("Error connecting to server");
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    uint8_t header[SERVE_RESPONSE_HEADER];
+    if (output_write_all(fd, request, 4 + length) != 0 || serve_read_all(fd, header, sizeof(header)) != 0) {
+        fprintf(stderr, "Error talking to server\n");
+        close(fd);
+        return -1;
+    }
+    int status = (int32_t)serve_get_le(header, 4);
+    uint64_t remaining = serve_get_le(header + 4, 8);
+
+    uint8_t *buffer = malloc(SERVE_CLIENT_CHUNK);
+    int result = buffer != NULL ? 0 : -1;
+    if (status != FS_OK && buffer != NULL) {
+        size_t message = remaining < SERVE_CLIENT_CHUNK - 1 ? remaining : SERVE_CLIENT_CHUNK - 1;
+        if (serve_read_all(fd, buffer, message) == 0) {
+            buffer[message] = '\0';
+            fprintf(stderr, "Error: %s\n", (char *)buffer);
+        } else {
+            fprintf(stderr, "Error talking to server\n");
+        }
+        result = -1;
+    }
+
+    while (status == FS_OK && result == 0 && remaining > 0) {
+        size_t chunk = remaining < SERVE_CLIENT_CHUNK ? remaining : SERVE_CLIENT_CHUNK;
+        ssize_t n = read(fd, buffer, chunk);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            fprintf(stderr, "Error talking to server\n");
+            result = -1;
+        } else if (output_write_all(STDOUT_FILENO, buffer, n) != 0) {
+            perror("Error writing output");
+            result = -1;
+        } else {
+            remaining -= n;
+        }
+    }
+
+    free(buffer);
+    close(fd);
+    return result;
+}
@@ -0,0 +1,50 @@
+#ifndef _SERVE_H
+#define _SERVE_H
+
+// Hilos que atienden peticiones si no se indica --threads
+#define SERVE_DEFAULT_WORKERS 4
+
+// Imágenes abiertas que se mantienen a la vez; la menos usada sin peticiones en curso se cierra
+#define SERVE_POOL_SIZE 64
+
+// Tamaño máximo del cuerpo de una petición
+#define SERVE_MAX_REQUEST 8192
+
+// Cabecera de una respuesta: estado (int32) y longitud del cuerpo (uint64)
+#define SERVE_RESPONSE_HEADER 12
+
+/**
+ * @brief Serves info, tree, stat and cat requests on a Unix socket until SIGINT or SIGTERM.
+ *
+ * Protocol, every integer in little endian:
+ *   request:  uint32 length, then the body "command\0image\0[path\0]"
+ *   response: int32 status (0 or a negative FsError), uint64 length, then the body
+ * On success the body is the output of the command (the raw contents for cat), otherwise
+ * the error message. A connection can send any number of requests, one after another.
+ *
+ * The images stay open in a pool with their metadata caches, so only the first request
+ * of an image pays for the probe; an image that changes on disk is opened again. The
+ * tree of an image is rendered once and kept with it. An epoll loop reads the requests
+ * and a thread pool answers them; cat contents go from the image to the socket with
+ * sendfile.
+ *
+ * @param socket_path Path of the socket to create.
+ * @param threads Number of threads that answer requests.
+ *
+ * @return 0 after a clean shutdown, -1 on error.
+*/
+int serve_command(const char *socket_path, int threads);
+
+/**
+ * @brief Sends one request to a --serve process and writes the answer to stdout.
+ *
+ * @param socket_path Path of the socket of the server.
+ * @param command info, tree, stat or cat.
+ * @param image Path of the image; a relative path is made absolute first.
+ * @param path Path inside the image for stat and cat, NULL otherwise.
+ *
+ * @return 0 on success, -1 on error (the message goes to stderr).
+*/
+int client_command(const char *socket_path, const char *command, const char *image, const char *path);
+
+#endif // !_SERVE_H
@@ -0,0 +1,253 @@
+#include "stats.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Contadores de todo el proceso; los hilos de los recorridos paralelos los suman con atómicos
+typedef struct {
+    int enabled;
+    uint64_t reads;
+    uint64_t bytes_read;
+    uint64_t seeks;
+    uint64_t next_offset;   // Where the last read ended
+    uint64_t histogram[STATS_HISTOGRAM_BUCKETS];
+    uint64_t syscalls[STATS_SYSCALL_COUNT];
+    uint64_t syscall_bytes[STATS_SYSCALL_COUNT];
+    uint64_t hits[STATS_CACHE_COUNT];
+    uint64_t misses[STATS_CACHE_COUNT];
+    uint64_t walk_memory;   // Peak of the memory held by a directory walk
+
+    StatsPhase phase;
+    struct timespec phase_wall;     // When the current phase started
+    struct timespec phase_cpu;
+    double wall_ms[STATS_PHASE_COUNT];
+    double cpu_ms[STATS_PHASE_COUNT];
+} Stats;
+
+static Stats stats;
+
+static const char *const phase_names[STATS_PHASE_COUNT] = { "setup", "probe", "walk", "output" };
+static const char *const cache_names[STATS_CACHE_COUNT] = { "image_window", "ext2_inode", "ext2_indirect", "path_index" };
+static const char *const syscall_names[STATS_SYSCALL_COUNT] = { "pread", "io_uring_enter", "copy_file_range/sendfile" };
+
+static double stats_elapsed_ms(const struct timespec *from, const struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) * 1000.0 + (to->tv_nsec - from->tv_nsec) / 1e6;
+}
+
+/**
+ * @brief Turns the counters on. Until then every stats_* call returns at once.
+ *
+ * @return void
+*/
+void stats_enable(void) {
+    memset(&stats, 0, sizeof(stats));
+    stats.enabled = 1;
+    stats.phase = STATS_PHASE_SETUP;
+    clock_gettime(CLOCK_MONOTONIC, &stats.phase_wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &stats.phase_cpu);
+}
+
+/**
+ * @brief Counts a read of the image: its size, and a seek when it does not start where the last one ended.
+ *
+ * @param offset Absolute offset of the read.
+ * @param length Number of bytes read.
+ *
+ * @return void
+*/
+void stats_read(uint64_t offset, size_t length) {
+    if (!stats.enabled) return;
+
+    int bucket = 0;
+    if (length > (1u << STATS_HISTOGRAM_MIN_SHIFT)) {
+        bucket = 64 - __builtin_clzll((uint64_t)length - 1) - STATS_HISTOGRAM_MIN_SHIFT;
+        if (bucket >= STATS_HISTOGRAM_BUCKETS) bucket = STATS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    __atomic_fetch_add(&stats.reads, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.bytes_read, length, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.histogram[bucket], 1, __ATOMIC_RELAXED);
+    if (__atomic_exchange_n(&stats.next_offset, offset + length, __ATOMIC_RELAXED) != offset) {
+        __atomic_fetch_add(&stats.seeks, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Counts a system call that reads the image.
+ *
+ * @param syscall Kind of call.
+ * @param bytes Bytes it transferred, 0 if it does not apply.
+ *
+ * @return void
+*/
+void stats_syscall(StatsSyscall syscall, uint64_t bytes) {
+    if (!stats.enabled) return;
+
+    __atomic_fetch_add(&stats.syscalls[syscall], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.syscall_bytes[syscall], bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Counts a hit or a miss of a cache.
+ *
+ * @param cache Cache looked up.
+ * @param hit 1 for a hit, 0 for a miss.
+ *
+ * @return void
+*/
+void stats_cache(StatsCache cache, int hit) {
+    if (!stats.enabled) return;
+
+    __atomic_fetch_add(hit ? &stats.hits[cache] : &stats.misses[cache], 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Records the memory a directory walk holds; the report shows the largest value.
+ *
+ * @param bytes Bytes held by the walk now.
+ *
+ * @return void
+*/
+void stats_memory(uint64_t bytes) {
+    if (!stats.enabled) return;
+
+    uint64_t peak = __atomic_load_n(&stats.walk_memory, __ATOMIC_RELAXED);
+    while (bytes > peak && !__atomic_compare_exchange_n(&stats.walk_memory, &peak, bytes, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Suma a la fase actual el tiempo pasado desde que empezó
+static void stats_charge(void) {
+    struct timespec wall, cpu;
+
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    stats.wall_ms[stats.phase] += stats_elapsed_ms(&stats.phase_wall, &wall);
+    stats.cpu_ms[stats.phase] += stats_elapsed_ms(&stats.phase_cpu, &cpu);
+    stats.phase_wall = wall;
+    stats.phase_cpu = cpu;
+}
+
+/**
+ * @brief Charges the time since the last switch to the current phase and starts another one.
+ *
+ * Only the main thread switches phases; the CPU time of the worker threads is charged
+ * to the phase the main thread is in.
+ *
+ * @param phase Phase that starts.
+ *
+ * @return The phase that was running, to go back to it.
+*/
+StatsPhase stats_phase(StatsPhase phase) {
+    if (!stats.enabled) return phase;
+
+    StatsPhase previous = stats.phase;
+    if (previous != phase) {
+        stats_charge();
+        stats.phase = phase;
+    }
+    return previous;
+}
+
+// Límite superior de un cubo del histograma, para las etiquetas
+static void stats_bucket_label(int bucket, char *label, size_t size) {
+    uint64_t limit = 1ull << (bucket + STATS_HISTOGRAM_MIN_SHIFT);
+    const char *prefix = bucket == STATS_HISTOGRAM_BUCKETS - 1 ? ">" : "<=";
+
+    if (bucket == STATS_HISTOGRAM_BUCKETS - 1) limit >>= 1;
+    if (limit >= (1u << 20)) snprintf(label, size, "%s%lluM", prefix, (unsigned long long)(limit >> 20));
+    else if (limit >= 1024) snprintf(label, size, "%s%lluK", prefix, (unsigned long long)(limit >> 10));
+    else snprintf(label, size, "%s%llu", prefix, (unsigned long long)limit);
+}
+
+static void stats_write_text(FILE *out) {
+    char label[16];
+    double wall_total = 0, cpu_total = 0;
+
+    fprintf(out, "\n---- Stats ----\n\n");
+    fprintf(out, "Reads: %llu (%llu bytes)\n", (unsigned long long)stats.reads, (unsigned long long)stats.bytes_read);
+    fprintf(out, "Seeks: %llu\n", (unsigned long long)stats.seeks);
+    fprintf(out, "Walk memory peak: %llu bytes\n", (unsigned long long)stats.walk_memory);
+    for (int i = 0; i < STATS_SYSCALL_COUNT; i++) {
+        fprintf(out, "%s calls: %llu", syscall_names[i], (unsigned long long)stats.syscalls[i]);
+        if (stats.syscall_bytes[i] != 0) fprintf(out, " (%llu bytes)", (unsigned long long)stats.syscall_bytes[i]);
+        fprintf(out, "\n");
+    }
+
+    fprintf(out, "\nRead sizes:\n");
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        if (stats.histogram[i] == 0) continue;
+        stats_bucket_label(i, label, sizeof(label));
+        fprintf(out, "  %-6s %llu\n", label, (unsigned long long)stats.histogram[i]);
+    }
+
+    fprintf(out, "\n%-8s %12s %12s\n", "Phase", "Wall ms", "CPU ms");
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        fprintf(out, "%-8s %12.3f %12.3f\n", phase_names[i], stats.wall_ms[i], stats.cpu_ms[i]);
+        wall_total += stats.wall_ms[i];
+        cpu_total += stats.cpu_ms[i];
+    }
+    fprintf(out, "%-8s %12.3f %12.3f\n", "total", wall_total, cpu_total);
+
+    fprintf(out, "\n%-14s %10s %10s\n", "Cache", "Hits", "Misses");
+    for (int i = 0; i < STATS_CACHE_COUNT; i++) {
+        fprintf(out, "%-14s %10llu %10llu\n", cache_names[i], (unsigned long long)stats.hits[i], (unsigned long long)stats.misses[i]);
+    }
+}
+
+static void stats_write_json(FILE *out) {
+    char label[16];
+
+    fprintf(out, "{\n  \"reads\": %llu,\n  \"bytes_read\": %llu,\n  \"seeks\": %llu,\n  \"walk_memory_peak\": %llu,\n  \"syscalls\": {",
+            (unsigned long long)stats.reads, (unsigned long long)stats.bytes_read, (unsigned long long)stats.seeks,
+            (unsigned long long)stats.walk_memory);
+    for (int i = 0; i < STATS_SYSCALL_COUNT; i++) {
+        fprintf(out, "%s\n    \"%s\": {\"calls\": %llu, \"bytes\": %llu}", i ? "," : "", syscall_names[i],
+                (unsigned long long)stats.syscalls[i], (unsigned long long)stats.syscall_bytes[i]);
+    }
+
+    fprintf(out, "\n  },\n  \"read_sizes\": {");
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        stats_bucket_label(i, label, sizeof(label));
+        fprintf(out, "%s\n    \"%s\": %llu", i ? "," : "", label, (unsigned long long)stats.histogram[i]);
+    }
+
+    fprintf(out, "\n  },\n  \"phases\": {");
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        fprintf(out, "%s\n    \"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", i ? "," : "", phase_names[i], stats.wall_ms[i], stats.cpu_ms[i]);
+    }
+
+    fprintf(out, "\n  },\n  \"caches\": {");
+    for (int i = 0; i < STATS_CACHE_COUNT; i++) {
+        fprintf(out, "%s\n    \"%s\": {\"hits\": %llu, \"misses\": %llu}", i ? "," : "", cache_names[i],
+                (unsigned long long)stats.hits[i], (unsigned long long)stats.misses[i]);
+    }
+    fprintf(out, "\n  }\n}\n");
+}
+
+/**
+ * @brief Closes the current phase and writes the report to stderr, or as JSON to a file.
+ *
+ * @param json_path File for the JSON report, NULL for the text report on stderr.
+ *
+ * @return 0 on success, -1 if the file cannot be written.
+*/
+int stats_report(const char *json_path) {
+    if (!stats.enabled) return 0;
+
+    fflush(stdout); // Part of the output phase
+    stats_charge();
+
+    if (json_path == NULL) {
+        stats_write_text(stderr);
+        return 0;
+    }
+
+    FILE *out = fopen(json_path, "w");
+    if (out == NULL) {
+        return -1;
+    }
+    stats_write_json(out);
+    return fclose(out) == 0 ? 0 : -1;
+}
@@ -0,0 +1,102 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Tamaños de lectura del histograma: <= 512 bytes, <= 1K, ... <= 4M y más de 4M
+#define STATS_HISTOGRAM_MIN_SHIFT 9
+#define STATS_HISTOGRAM_BUCKETS 15
+
+// Fases en las que se reparte el tiempo; setup es todo lo que no es de las otras tres
+typedef enum {
+    STATS_PHASE_SETUP,
+    STATS_PHASE_PROBE,      // is_ext2 / is_fat16
+    STATS_PHASE_WALK,       // Reading the metadata
+    STATS_PHASE_OUTPUT,     // Printing the tree or the file, writing the index
+    STATS_PHASE_COUNT
+} StatsPhase;
+
+typedef enum {
+    STATS_CACHE_IMAGE_WINDOW,   // Read-ahead window of the pread fallback
+    STATS_CACHE_EXT2_INODE,     // EXT2 inode table blocks
+    STATS_CACHE_EXT2_INDIRECT,  // EXT2 indirect blocks
+    STATS_CACHE_PATH_INDEX,     // Sidecar index lookups of --cat
+    STATS_CACHE_COUNT
+} StatsCache;
+
+typedef enum {
+    STATS_SYSCALL_PREAD,
+    STATS_SYSCALL_URING_ENTER,
+    STATS_SYSCALL_KERNEL_COPY,  // copy_file_range and sendfile
+    STATS_SYSCALL_COUNT
+} StatsSyscall;
+
+/**
+ * @brief Turns the counters on. Until then every stats_* call returns at once.
+ *
+ * @return void
+*/
+void stats_enable(void);
+
+/**
+ * @brief Counts a read of the image: its size, and a seek when it does not start where the last one ended.
+ *
+ * @param offset Absolute offset of the read.
+ * @param length Number of bytes read.
+ *
+ * @return void
+*/
+void stats_read(uint64_t offset, size_t length);
+
+/**
+ * @brief Counts a system call that reads the image.
+ *
+ * @param syscall Kind of call.
+ * @param bytes Bytes it transferred, 0 if it does not apply.
+ *
+ * @return void
+*/
+void stats_syscall(StatsSyscall syscall, uint64_t bytes);
+
+/**
+ * @brief Counts a hit or a miss of a cache.
+ *
+ * @param cache Cache looked up.
+ * @param hit 1 for a hit, 0 for a miss.
+ *
+ * @return void
+*/
+void stats_cache(StatsCache cache, int hit);
+
+/**
+ * @brief Records the memory a directory walk holds; the report shows the largest value.
+ *
+ * @param bytes Bytes held by the walk now.
+ *
+ * @return void
+*/
+void stats_memory(uint64_t bytes);
+
+/**
+ * @brief Charges the time since the last switch to the current phase and starts another one.
+ *
+ * Only the main thread switches phases; the CPU time of the worker threads is charged
+ * to the phase the main thread is in.
+ *
+ * @param phase Phase that starts.
+ *
+ * @return The phase that was running, to go back to it.
+*/
+StatsPhase stats_phase(StatsPhase phase);
+
+/**
+ * @brief Closes the current phase and writes the report to stderr, or as JSON to a file.
+ *
+ * @param json_path File for the JSON report, NULL for the text report on stderr.
+ *
+ * @return 0 on success, -1 if the file cannot be written.
+*/
+int stats_report(const char *json_path);
+
+#endif // !_STATS_H
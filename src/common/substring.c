@@ -0,0 +1,126 @@
+#include "substring.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SUBSTRING_X86 1
+#endif
+
+typedef int (*SubstringFind)(const uint8_t *data, size_t length, const uint8_t *pattern, size_t pattern_length,
+                             SubstringMatch match, void *context);
+
+// Salta al siguiente primer byte con memchr y compara el resto, desde la posición start
+static int substring_find_from(const uint8_t *data, size_t length, size_t start, const uint8_t *pattern,
+                               size_t pattern_length, SubstringMatch match, void *context) {
+    const uint8_t *c = data + start;
+    const uint8_t *last = data + length - pattern_length;   // Last position where the pattern fits
+
+    while (c <= last && (c = memchr(c, pattern[0], (size_t)(last - c) + 1)) != NULL) {
+        if (memcmp(c, pattern, pattern_length) == 0) {
+            int stop = match((size_t)(c - data), context);
+            if (stop != 0) return stop;
+        }
+        c++;
+    }
+    return 0;
+}
+
+static int substring_find_scalar(const uint8_t *data, size_t length, const uint8_t *pattern, size_t pattern_length,
+                                 SubstringMatch match, void *context) {
+    return substring_find_from(data, length, 0, pattern, pattern_length, match, context);
+}
+
+#ifdef SUBSTRING_X86
+
+// Compara el primer y el último byte del patrón en 16 posiciones de golpe; solo los candidatos llegan a memcmp
+__attribute__((target("sse2")))
+static int substring_find_sse2(const uint8_t *data, size_t length, const uint8_t *pattern, size_t pattern_length,
+                               SubstringMatch match, void *context) {
+    const __m128i first = _mm_set1_epi8((char)pattern[0]);
+    const __m128i last = _mm_set1_epi8((char)pattern[pattern_length - 1]);
+    size_t i = 0;
+
+    for (; i + pattern_length - 1 + 16 <= length; i += 16) {
+        __m128i head = _mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i *)(data + i)));
+        __m128i tail = _mm_cmpeq_epi8(last, _mm_loadu_si128((const __m128i *)(data + i + pattern_length - 1)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(head, tail));
+
+        while (mask != 0) {
+            size_t position = i + (size_t)__builtin_ctz(mask);
+            if (memcmp(data + position, pattern, pattern_length) == 0) {
+                int stop = match(position, context);
+                if (stop != 0) return stop;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return substring_find_from(data, length, i, pattern, pattern_length, match, context);
+}
+
+// Igual que la versión SSE2 con 32 posiciones por vuelta
+__attribute__((target("avx2")))
+static int substring_find_avx2(const uint8_t *data, size_t length, const uint8_t *pattern, size_t pattern_length,
+                               SubstringMatch match, void *context) {
+    const __m256i first = _mm256_set1_epi8((char)pattern[0]);
+    const __m256i last = _mm256_set1_epi8((char)pattern[pattern_length - 1]);
+    size_t i = 0;
+
+    for (; i + pattern_length - 1 + 32 <= length; i += 32) {
+        __m256i head = _mm256_cmpeq_epi8(first, _mm256_loadu_si256((const __m256i *)(data + i)));
+        __m256i tail = _mm256_cmpeq_epi8(last, _mm256_loadu_si256((const __m256i *)(data + i + pattern_length - 1)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(head, tail));
+
+        while (mask != 0) {
+            size_t position = i + (size_t)__builtin_ctz(mask);
+            if (memcmp(data + position, pattern, pattern_length) == 0) {
+                int stop = match(position, context);
+                if (stop != 0) return stop;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return substring_find_from(data, length, i, pattern, pattern_length, match, context);
+}
+
+#endif // SUBSTRING_X86
+
+static SubstringFind find_function = NULL;
+
+// Elige la versión según las extensiones del procesador; varios hilos eligen lo mismo
+static void substring_select(void) {
+    find_function = substring_find_scalar;
+
+#ifdef SUBSTRING_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        find_function = substring_find_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        find_function = substring_find_sse2;
+    }
+#endif
+}
+
+/**
+ * @brief Finds every occurrence of a pattern in a buffer, overlapping ones included.
+ *
+ * The candidates are the positions where the first and the last byte of the pattern
+ * match, checked 32 (AVX2) or 16 (SSE2) positions at a time when the processor has
+ * them, chosen once at the first call, and with memchr otherwise. Every candidate is
+ * verified with memcmp.
+ *
+ * @param data Buffer to search.
+ * @param length Number of bytes of the buffer.
+ * @param pattern Bytes to find.
+ * @param pattern_length Number of bytes of the pattern; an empty pattern finds nothing.
+ * @param match Function called with the offset of each occurrence, in increasing order.
+ * @param context Pointer passed to the function.
+ *
+ * @return 0 when the whole buffer was searched, or the value that stopped the search.
+*/
+int substring_find_all(const void *data, size_t length, const void *pattern, size_t pattern_length, SubstringMatch match, void *context) {
+    if (pattern_length == 0 || pattern_length > length) return 0;
+    if (find_function == NULL) substring_select();
+    return find_function(data, length, pattern, pattern_length, match, context);
+}
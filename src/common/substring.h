@@ -0,0 +1,35 @@
+#ifndef _SUBSTRING_H
+#define _SUBSTRING_H
+
+#include <stddef.h>
+
+/**
+ * @brief Function called for every occurrence found by substring_find_all.
+ *
+ * @param offset Offset of the occurrence in the buffer.
+ * @param context Pointer given to substring_find_all.
+ *
+ * @return 0 to go on, any other value stops the search and is returned.
+*/
+typedef int (*SubstringMatch)(size_t offset, void *context);
+
+/**
+ * @brief Finds every occurrence of a pattern in a buffer, overlapping ones included.
+ *
+ * The candidates are the positions where the first and the last byte of the pattern
+ * match, checked 32 (AVX2) or 16 (SSE2) positions at a time when the processor has
+ * them, chosen once at the first call, and with memchr otherwise. Every candidate is
+ * verified with memcmp.
+ *
+ * @param data Buffer to search.
+ * @param length Number of bytes of the buffer.
+ * @param pattern Bytes to find.
+ * @param pattern_length Number of bytes of the pattern; an empty pattern finds nothing.
+ * @param match Function called with the offset of each occurrence, in increasing order.
+ * @param context Pointer passed to the function.
+ *
+ * @return 0 when the whole buffer was searched, or the value that stopped the search.
+*/
+int substring_find_all(const void *data, size_t length, const void *pattern, size_t pattern_length, SubstringMatch match, void *context);
+
+#endif // !_SUBSTRING_H
@@ -0,0 +1,253 @@
+#include "thread_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Pool y trabajador del hilo actual, para que las tareas se añadan a su propia cola
+static __thread ThreadPool *current_pool = NULL;
+static __thread int current_worker = -1;
+
+typedef struct {
+    ThreadPool *pool;
+    int index;
+} ThreadPoolWorkerArg;
+
+/**
+ * @brief Pushes a job at the tail of a deque.
+ *
+ * @return 0 on success, -1 on error.
+*/
+static int deque_push(ThreadPoolDeque *deque, ThreadPoolJob job) {
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->tail == deque->capacity) {
+        // Compact the consumed head before growing
+        size_t used = deque->tail - deque->head;
+        if (deque->head > 0 && used < deque->capacity / 2) {
+            memmove(deque->jobs, deque->jobs + deque->head, used * sizeof(ThreadPoolJob));
+        } else {
+            size_t capacity = deque->capacity ? deque->capacity * 2 : 64;
+            ThreadPoolJob *bigger = malloc(capacity * sizeof(ThreadPoolJob));
+            if (bigger == NULL) {
+                pthread_mutex_unlock(&deque->lock);
+                return -1;
+            }
+            if (used > 0) memcpy(bigger, deque->jobs + deque->head, used * sizeof(ThreadPoolJob));
+            free(deque->jobs);
+            deque->jobs = bigger;
+            deque->capacity = capacity;
+        }
+        deque->head = 0;
+        deque->tail = used;
+    }
+
+    deque->jobs[deque->tail++] = job;
+    pthread_mutex_unlock(&deque->lock);
+    return 0;
+}
+
+/**
+ * @brief Takes a job from a deque: the newest one for its owner, the oldest one for a thief.
+ *
+ * @return 1 if a job was taken, 0 if the deque was empty.
+*/
+static int deque_take(ThreadPoolDeque *deque, int steal, ThreadPoolJob *job) {
+    int taken = 0;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        *job = steal ? deque->jobs[deque->head++] : deque->jobs[--deque->tail];
+        taken = 1;
+        if (deque->head == deque->tail) {
+            deque->head = deque->tail = 0;
+        }
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return taken;
+}
+
+/**
+ * @brief Finds work for a worker: its own deque first, then the other workers' deques.
+ *
+ * @return 1 if a job was found, 0 otherwise.
+*/
+static int thread_pool_find_job(ThreadPool *pool, int index, ThreadPoolJob *job) {
+    if (deque_take(&pool->deques[index], 0, job)) {
+        return 1;
+    }
+
+    for (int i = 1; i < pool->worker_count; i++) {
+        if (deque_take(&pool->deques[(index + i) % pool->worker_count], 1, job)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Main loop of a worker thread.
+*/
+static void *thread_pool_worker(void *raw_arg) {
+    ThreadPoolWorkerArg *arg = raw_arg;
+    ThreadPool *pool = arg->pool;
+    int index = arg->index;
+    free(arg);
+
+    current_pool = pool;
+    current_worker = index;
+
+    for (;;) {
+        ThreadPoolJob job;
+
+        if (!thread_pool_find_job(pool, index, &job)) {
+            // Nothing to run or steal: sleep until a new task arrives. The deques are checked
+            // again under the pool lock because submit signals while holding it.
+            pthread_mutex_lock(&pool->lock);
+            int found = 0;
+            while (!pool->stop && !(found = thread_pool_find_job(pool, index, &job))) {
+                pthread_cond_wait(&pool->work_ready, &pool->lock);
+            }
+            pthread_mutex_unlock(&pool->lock);
+
+            if (!found) {
+                break; // The pool is stopping
+            }
+        }
+
+        job.function(pool, job.arg);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_broadcast(&pool->all_done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Starts a pool of workers.
+ *
+ * @param pool Pool to initialize.
+ * @param worker_count Number of worker threads.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int thread_pool_init(ThreadPool *pool, int worker_count) {
+    memset(pool, 0, sizeof(ThreadPool));
+    if (worker_count < 1) worker_count = 1;
+
+    pool->deques = calloc(worker_count, sizeof(ThreadPoolDeque));
+    pool->threads = calloc(worker_count, sizeof(pthread_t));
+    if (pool->deques == NULL || pool->threads == NULL) {
+        free(pool->deques);
+        free(pool->threads);
+        return -1;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+    for (int i = 0; i < worker_count; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    }
+
+    for (int i = 0; i < worker_count; i++) {
+        ThreadPoolWorkerArg *arg = malloc(sizeof(ThreadPoolWorkerArg));
+        if (arg == NULL) break;
+        arg->pool = pool;
+        arg->index = i;
+        if (pthread_create(&pool->threads[i], NULL, thread_pool_worker, arg) != 0) {
+            free(arg);
+            break;
+        }
+        pool->worker_count++;
+    }
+
+    if (pool->worker_count == 0) {
+        thread_pool_destroy(pool);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Adds a task. From a worker it goes to its own deque, otherwise to the first one.
+ *
+ * @param pool Pool that runs the task.
+ * @param function Function of the task.
+ * @param arg Argument passed to the function.
+ *
+ * @return 0 on success, -1 on error (out of memory).
+*/
+int thread_pool_submit(ThreadPool *pool, ThreadPoolTask function, void *arg) {
+    int index = current_pool == pool ? current_worker : 0;
+    ThreadPoolJob job = { function, arg };
+
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (deque_push(&pool->deques[index], job) != 0) {
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_broadcast(&pool->all_done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+/**
+ * @brief Waits until every submitted task, including the ones they submit, has finished.
+ *
+ * @param pool Pool to wait for.
+ *
+ * @return void
+*/
+void thread_pool_wait(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->all_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Stops the workers and releases the pool.
+ *
+ * @param pool Pool to destroy.
+ *
+ * @return void
+*/
+void thread_pool_destroy(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->worker_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    if (pool->deques != NULL) {
+        for (int i = 0; i < pool->worker_count; i++) {
+            free(pool->deques[i].jobs);
+            pthread_mutex_destroy(&pool->deques[i].lock);
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->all_done);
+    free(pool->deques);
+    free(pool->threads);
+    memset(pool, 0, sizeof(ThreadPool));
+}
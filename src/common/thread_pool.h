@@ -0,0 +1,85 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Número máximo de hilos que se aceptan con --threads
+#define THREAD_POOL_MAX_WORKERS 256
+
+typedef struct ThreadPool ThreadPool;
+
+// Función que ejecuta una tarea, puede añadir más tareas al mismo pool
+typedef void (*ThreadPoolTask)(ThreadPool *pool, void *arg);
+
+typedef struct {
+    ThreadPoolTask function;
+    void *arg;
+} ThreadPoolJob;
+
+// Cola doble de un trabajador: el dueño trabaja por el final y los demás roban por el principio
+typedef struct {
+    ThreadPoolJob *jobs;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    pthread_mutex_t lock;
+} ThreadPoolDeque;
+
+/**
+ * @brief Pool of workers with one deque each and work stealing.
+ *
+ * A worker pops its own newest task first (depth-first, good locality) and, when its
+ * deque is empty, steals the oldest task of another worker (the biggest pending subtree).
+ */
+struct ThreadPool {
+    int worker_count;
+    pthread_t *threads;
+    ThreadPoolDeque *deques;
+    pthread_mutex_t lock;       // Protects pending, stop and the sleeping workers
+    pthread_cond_t work_ready;  // Signalled when a task is submitted or the pool stops
+    pthread_cond_t all_done;    // Signalled when pending reaches 0
+    size_t pending;             // Tasks submitted and not finished yet
+    int stop;
+};
+
+/**
+ * @brief Starts a pool of workers.
+ *
+ * @param pool Pool to initialize.
+ * @param worker_count Number of worker threads.
+ *
+ * @return 0 on success, -1 on error.
+*/
+int thread_pool_init(ThreadPool *pool, int worker_count);
+
+/**
+ * @brief Adds a task. From a worker it goes to its own deque, otherwise to the first one.
+ *
+ * @param pool Pool that runs the task.
+ * @param function Function of the task.
+ * @param arg Argument passed to the function.
+ *
+ * @return 0 on success, -1 on error (out of memory).
+*/
+int thread_pool_submit(ThreadPool *pool, ThreadPoolTask function, void *arg);
+
+/**
+ * @brief Waits until every submitted task, including the ones they submit, has finished.
+ *
+ * @param pool Pool to wait for.
+ *
+ * @return void
+*/
+void thread_pool_wait(ThreadPool *pool);
+
+/**
+ * @brief Stops the workers and releases the pool.
+ *
+ * @param pool Pool to destroy.
+ *
+ * @return void
+*/
+void thread_pool_destroy(ThreadPool *pool);
+
+#endif // !_THREAD_POOL_H
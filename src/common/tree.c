@@ -1,22 +1,56 @@
 #include "tree.h"
 #include "../ext2/ext2_reader.h"
+#include "tree_render.h"
+#include "report.h"
+
+#include <unistd.h>
 
 /**
  * @brief Prints the tree representation of the directory structure of the file system.
  * 
- * @param fd File descriptor of the file system.
+ * @param image Image of the file system.
+ * @param threads Number of threads that walk the directories, 1 for the sequential walk.
  * 
  * @return void
 */
-void print_file_tree(int fd) {
-    if (is_ext2(fd)) {
-        Ext2Superblock superblock;
-        read_ext2_superblock(fd, &superblock);
-        dfs_ext2(fd, 2, &superblock, 0, 2, 2);
-    } else if (is_fat16(fd)) {
-        BootSector bootSector;
-        read_boot_sector(fd, &bootSector);
-        fat16_recursion_tree(fd, bootSector, 1, "");
+void print_file_tree(Image *image, int threads) {
+    TreeRender render;
+
+    // El árbol se escribe directamente en el descriptor, después de lo que stdio tenga pendiente
+    fflush(stdout);
+    if (is_ext2(image)) {
+        Ext2Volume volume;
+        if (ext2_open_volume(image, &volume) != 0) {
+            perror("Error opening EXT2 volume");
+            return;
+        }
+        tree_render_begin(&render, STDOUT_FILENO, TREE_STYLE_EXT2);
+        int walked = threads > 1 ? dfs_ext2_parallel(&volume, threads, &render) : dfs_ext2(&volume, &render);
+        if (walked != 0) {
+            perror(threads > 1 ? "Error starting worker threads" : "Error walking directories");
+        }
+        if (tree_render_end(&render) != 0) {
+            perror("Error writing tree");
+        }
+        report_walk_error(volume.walk_error);
+        ext2_close_volume(&volume);
+    } else if (is_fat16(image)) {
+        Fat16Volume volume;
+        if (fat16_open_volume(image, &volume) != 0) {
+            perror("Error loading FAT");
+            return;
+        }
+        report_fat16_copies(&volume);
+        tree_render_begin(&render, STDOUT_FILENO, TREE_STYLE_FAT16);
+        int walked = threads > 1 ? fat16_tree_parallel(&volume, threads, &render) : fat16_recursion_tree(&volume, &render);
+        if (walked != 0) {
+            perror(threads > 1 ? "Error starting worker threads" : "Error walking directories");
+        }
+        if (tree_render_end(&render) != 0) {
+            perror("Error writing tree");
+        }
+        report_walk_error(volume.walk_error);
+        fat16_close_volume(&volume);
     } else {
          printf("Unknown file system\n");
     }
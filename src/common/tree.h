@@ -6,12 +6,13 @@
 /**
  * @brief Prints the tree representation of the directory structure of the file system.
  * 
- * @param fd File descriptor of the file system.
+ * @param image Image of the file system.
+ * @param threads Number of threads that walk the directories, 1 for the sequential walk.
  * 
  * @return void
 */
-void print_file_tree(int fd);
-void fat16_recursion_tree(int fd, const BootSector bootSector, int tree_not_cat, char *filename_to_find);
+void print_file_tree(Image *image, int threads);
+int fat16_recursion_tree(Fat16Volume *volume, TreeRender *render);
 void process_dir_entry(const DirEntry *entry, int level);
 
 #endif // !_TREE_H
\ No newline at end of file
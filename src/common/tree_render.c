@@ -0,0 +1,206 @@
+#include "tree_render.h"
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define TREE_COLOR_RESET  "\x1b[0m"
+#define TREE_COLOR_YELLOW "\x1b[33m"
+#define TREE_COLOR_BLUE   "\x1b[34m"
+#define TREE_COLOR_WHITE  "\x1b[37m"
+
+#define TREE_SEGMENT_OPEN   "│   "
+#define TREE_SEGMENT_CLOSED "    "
+
+static int tree_render_reserve(char **buffer, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) return 0;
+
+    size_t bigger = *capacity ? *capacity : 256;
+    while (bigger < needed) bigger *= 2;
+    char *grown = realloc(*buffer, bigger);
+    if (grown == NULL) return -1;
+    *buffer = grown;
+    *capacity = bigger;
+    return 0;
+}
+
+/**
+ * @brief Writes every iovec entirely, retrying short writes.
+*/
+static int tree_render_writev(TreeRender *render, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(render->fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Prepares a renderer to write a tree to a descriptor.
+ *
+ * Colors are only used when the descriptor is a terminal. The descriptor is written
+ * directly, so a caller writing to stdout flushes stdio first.
+ *
+ * @param render Renderer to prepare.
+ * @param fd Descriptor the tree is written to.
+ * @param style Look of the lines.
+ *
+ * @return void
+*/
+void tree_render_begin(TreeRender *render, int fd, TreeStyle style) {
+    memset(render, 0, sizeof(TreeRender));
+    render->fd = fd;
+    render->style = style;
+    render->color = isatty(fd);
+    render->out = malloc(TREE_RENDER_FLUSH_SIZE);
+    render->failed = render->out == NULL;
+}
+
+// Apila el segmento de un nivel más
+static int tree_render_push(TreeRender *render, const char *segment) {
+    size_t length = strlen(segment);
+
+    if (render->mark_count == render->mark_capacity) {
+        size_t capacity = render->mark_capacity ? render->mark_capacity * 2 : 64;
+        size_t *marks = realloc(render->marks, capacity * sizeof(size_t));
+        if (marks == NULL) return -1;
+        render->marks = marks;
+        render->mark_capacity = capacity;
+    }
+    if (tree_render_reserve(&render->prefix, &render->prefix_capacity, render->prefix_length + length) != 0) {
+        return -1;
+    }
+    render->marks[render->mark_count++] = render->prefix_length;
+    memcpy(render->prefix + render->prefix_length, segment, length);
+    render->prefix_length += length;
+    return 0;
+}
+
+// Deja la pila con los segmentos de los niveles 0..level-1
+static int tree_render_prefix(TreeRender *render, size_t level) {
+    if (render->mark_count > level) {
+        render->prefix_length = render->marks[level];
+        render->mark_count = level;
+    }
+    // A level that never had a line above it is drawn as closed
+    while (render->mark_count < level) {
+        if (tree_render_push(render, TREE_SEGMENT_CLOSED) != 0) return -1;
+    }
+    return 0;
+}
+
+// Añade un trozo de texto a la línea que se está construyendo
+static size_t tree_render_append(TreeRender *render, size_t length, const char *text) {
+    size_t text_length = strlen(text);
+    memcpy(render->line + length, text, text_length);
+    return length + text_length;
+}
+
+/**
+ * @brief Appends a line of the tree.
+ *
+ * The prefix of a line is made of one segment per level above it ("│   " while that
+ * level has more entries, "    " after its last one) and is kept as a stack, so a
+ * line only copies it. There is no depth limit.
+ *
+ * @param render Renderer of the tree.
+ * @param level Level of the entry, 0 for the entries of the root directory.
+ * @param name Name of the entry, as it is shown.
+ * @param is_last 1 if it is the last entry of its directory.
+ * @param is_directory 1 if the entry is a directory.
+ *
+ * @return 0 on success, -1 on error (out of memory or the output failed).
+*/
+int tree_render_line(TreeRender *render, int level, const char *name, int is_last, int is_directory) {
+    if (render->failed || level < 0) return -1;
+
+    StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+    const char *color = NULL;
+    const char *dashes = "── ";
+
+    if (render->color && render->style == TREE_STYLE_EXT2) {
+        color = is_directory ? TREE_COLOR_BLUE : TREE_COLOR_WHITE;
+    } else if (render->style == TREE_STYLE_FAT16 && is_directory) {
+        dashes = "──";
+        color = render->color ? TREE_COLOR_YELLOW : NULL;
+    }
+
+    // Prefix, connector, two colors, name and newline
+    size_t needed = strlen("├") + strlen(dashes) + strlen(name) + 2 * sizeof(TREE_COLOR_RESET) + 1;
+    if (tree_render_prefix(render, level) != 0 ||
+        tree_render_reserve(&render->line, &render->line_capacity, render->prefix_length + needed) != 0) {
+        render->failed = 1;
+        stats_phase(previous);
+        return -1;
+    }
+
+    if (render->prefix_length > 0) memcpy(render->line, render->prefix, render->prefix_length);
+    size_t length = tree_render_append(render, render->prefix_length, is_last ? "└" : "├");
+    if (color != NULL && render->style == TREE_STYLE_EXT2) length = tree_render_append(render, length, color);
+    length = tree_render_append(render, length, dashes);
+    if (color != NULL && render->style == TREE_STYLE_FAT16) length = tree_render_append(render, length, color);
+    length = tree_render_append(render, length, name);
+    if (color != NULL) length = tree_render_append(render, length, TREE_COLOR_RESET);
+    render->line[length++] = '\n';
+
+    // The level of this entry stays open while its directory has more entries
+    if (tree_render_push(render, is_last ? TREE_SEGMENT_CLOSED : TREE_SEGMENT_OPEN) != 0) render->failed = 1;
+
+    // A full buffer is written together with the line that did not fit
+    if (render->out_length + length > TREE_RENDER_FLUSH_SIZE) {
+        struct iovec iov[2] = {
+            { render->out, render->out_length },
+            { render->line, length },
+        };
+        if (tree_render_writev(render, iov, 2) != 0) render->failed = 1;
+        render->out_length = 0;
+    } else {
+        memcpy(render->out + render->out_length, render->line, length);
+        render->out_length += length;
+    }
+
+    stats_phase(previous);
+    return render->failed ? -1 : 0;
+}
+
+/**
+ * @brief Writes the lines still buffered and releases the buffers.
+ *
+ * @param render Renderer of the tree.
+ *
+ * @return 0 on success, -1 if the output failed at any point.
+*/
+int tree_render_end(TreeRender *render) {
+    StatsPhase previous = stats_phase(STATS_PHASE_OUTPUT);
+
+    if (render->out != NULL && render->out_length > 0 && !render->failed) {
+        struct iovec iov = { render->out, render->out_length };
+        if (tree_render_writev(render, &iov, 1) != 0) render->failed = 1;
+    }
+    int result = render->failed ? -1 : 0;
+
+    free(render->out);
+    free(render->line);
+    free(render->prefix);
+    free(render->marks);
+    memset(render, 0, sizeof(TreeRender));
+    render->fd = -1;
+
+    stats_phase(previous);
+    return result;
+}
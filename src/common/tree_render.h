@@ -0,0 +1,73 @@
+#ifndef _TREE_RENDER_H
+#define _TREE_RENDER_H
+
+#include <stddef.h>
+
+// Bytes acumulados antes de escribirlos con una sola llamada a writev
+#define TREE_RENDER_FLUSH_SIZE (1024 * 1024)
+
+// Aspecto de las líneas, el mismo que tenía cada sistema de ficheros
+typedef enum {
+    TREE_STYLE_EXT2,    // "├── name", blue directories and white files
+    TREE_STYLE_FAT16    // "├──[dir]" in yellow and "├── file"
+} TreeStyle;
+
+// Estado de un árbol que se está escribiendo; lo guarda quien lo escribe, así que varios árboles pueden escribirse a la vez
+typedef struct {
+    int fd;
+    int color;
+    int failed;
+    TreeStyle style;
+    char *out;              // Lines waiting to be written, up to TREE_RENDER_FLUSH_SIZE bytes
+    size_t out_length;
+    char *line;             // Line being built, reused
+    size_t line_capacity;
+    char *prefix;           // Segments of every level above the current one
+    size_t prefix_length;
+    size_t prefix_capacity;
+    size_t *marks;          // Offset in prefix where the segment of each level starts
+    size_t mark_count;
+    size_t mark_capacity;
+} TreeRender;
+
+/**
+ * @brief Prepares a renderer to write a tree to a descriptor.
+ *
+ * Colors are only used when the descriptor is a terminal. The descriptor is written
+ * directly, so a caller writing to stdout flushes stdio first.
+ *
+ * @param render Renderer to prepare.
+ * @param fd Descriptor the tree is written to.
+ * @param style Look of the lines.
+ *
+ * @return void
+*/
+void tree_render_begin(TreeRender *render, int fd, TreeStyle style);
+
+/**
+ * @brief Appends a line of the tree.
+ *
+ * The prefix of a line is made of one segment per level above it ("│   " while that
+ * level has more entries, "    " after its last one) and is kept as a stack, so a
+ * line only copies it. There is no depth limit.
+ *
+ * @param render Renderer of the tree.
+ * @param level Level of the entry, 0 for the entries of the root directory.
+ * @param name Name of the entry, as it is shown.
+ * @param is_last 1 if it is the last entry of its directory.
+ * @param is_directory 1 if the entry is a directory.
+ *
+ * @return 0 on success, -1 on error (out of memory or the output failed).
+*/
+int tree_render_line(TreeRender *render, int level, const char *name, int is_last, int is_directory);
+
+/**
+ * @brief Writes the lines still buffered and releases the buffers.
+ *
+ * @param render Renderer of the tree.
+ *
+ * @return 0 on success, -1 if the output failed at any point.
+*/
+int tree_render_end(TreeRender *render);
+
+#endif // !_TREE_RENDER_H
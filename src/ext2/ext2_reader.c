@@ -1,28 +1,24 @@
 #include "ext2_reader.h"
+#include "../common/stats.h"
+#include "../common/tree_render.h"
+#include "../common/bitcount.h"
 
 /**
  * @brief Checks if the file system is an EXT2 file system.
  * 
- * @param fd File descriptor of the file system.
+ * @param image Image of the file system.
  * 
  * @return 1 if the file system is EXT2, 0 otherwise.
 */
-int is_ext2(int fd) {
+int is_ext2(Image *image) {
     uint16_t magic;
+    StatsPhase previous = stats_phase(STATS_PHASE_PROBE);
 
-    // Busquem el magic number de l'ext2
-    if (lseek(fd, EXT2_SUPERBLOCK_OFFSET + EXT2_MAGIC_OFFSET, SEEK_SET) == -1) {
-        perror("Error seeking to superblock");
-        close(fd);
-        exit(1);
-    }
-
-    // Llegim el magic number
-    if (read(fd, &magic, sizeof(magic)) == -1) {
-        perror("Error reading magic number");
-        close(fd);
-        exit(1);
+    // Llegim el magic number de l'ext2 directament de la imatge
+    if (image_read(image, EXT2_SUPERBLOCK_OFFSET + EXT2_MAGIC_OFFSET, &magic, sizeof(magic)) != sizeof(magic)) {
+        magic = 0;  // La imatge és massa petita per ser un EXT2
     }
+    stats_phase(previous);
 
     // Mirem si el magic number és el de l'ext2
     if (magic == EXT2_MAGIC) {
@@ -34,149 +30,607 @@ int is_ext2(int fd) {
 
 /*
  * @brief Reads the superblock of an EXT2 file system.
- * @param fd File descriptor of the EXT2 file system.
+ * @param image Image of the EXT2 file system.
  * @param superblock Pointer to the superblock structure to fill.
  */
-int read_ext2_superblock(int fd, Ext2Superblock *superblock) {
-    /*
-     * Tenim definida la posició del superblock a EXT2_SUPERBLOCK_OFFSET que té el valor 1024 ja que la mida del bloc és de 1024 bytes
-     * Fem servir el SEEK_SET per indicar que volem moure el cursor al principi del fitxer i lsseek per moure el cursor
-     */
-    if (lseek(fd, EXT2_SUPERBLOCK_OFFSET, SEEK_SET) != EXT2_SUPERBLOCK_OFFSET) { // Ens movem al superblock
-        return -1; // Si no podem moure'ns al superblock retornem -1
-    }
-
-    // Llegim un superblock mitjançant el struct Ext2Superblock
-    if (read(fd, superblock, sizeof(Ext2Superblock)) != sizeof(Ext2Superblock)) { // Llegim el superblock
+int read_ext2_superblock(Image *image, Ext2Superblock *superblock) {
+    // Tenim definida la posició del superblock a EXT2_SUPERBLOCK_OFFSET que té el valor 1024 ja que la mida del bloc és de 1024 bytes
+    if (image_read(image, EXT2_SUPERBLOCK_OFFSET, superblock, sizeof(Ext2Superblock)) != sizeof(Ext2Superblock)) { // Llegim el superblock
         return -1; // Si no podem llegir el superblock retornem -1
     }
     return 0;
 }
 
 /*
-    * @brief Reads a group descriptor from the block group descriptor table.
-    * @param fd File descriptor of the EXT2 file system.
-    * @param superblock Superblock of the EXT2 file system.
-    * @param group_num Number of the group descriptor to read.
-    * @param group_desc Pointer to the group descriptor structure to fill.
+    * @brief Prepares a block cache. When the image is in memory no buffers are needed.
+    * @param volume Volume of the EXT2 file system.
+    * @param cache Cache to prepare.
+    * @param slot_count Number of blocks the cache can hold.
+    * @return 0 on success, -1 on error.
+ */
+static int ext2_block_cache_init(Ext2Volume *volume, Ext2BlockCache *cache, uint32_t slot_count) {
+    cache->slot_count = slot_count;
+    pthread_mutex_init(&cache->lock, NULL);
+    if (volume->image->data != NULL) {
+        return 0;
+    }
+
+    cache->data = malloc((size_t)slot_count * volume->block_size);
+    cache->tags = calloc(slot_count, sizeof(uint32_t));
+    return cache->data != NULL && cache->tags != NULL ? 0 : -1;
+}
+
+/*
+    * @brief Copies part of a metadata block, going through a block cache.
+    * @param volume Volume of the EXT2 file system.
+    * @param cache Cache that holds this kind of block.
+    * @param block_num Number of the block.
+    * @param offset Offset of the data inside the block.
+    * @param buffer Destination of the data.
+    * @param length Number of bytes to copy.
+    * @return 0 on success, -1 on error.
+ */
+static int ext2_cached_read(Ext2Volume *volume, Ext2BlockCache *cache, uint32_t block_num, uint32_t offset, void *buffer, size_t length) {
+    uint64_t block_offset = (uint64_t)block_num * volume->block_size;
+
+    // Amb la imatge mapejada el bloc ja és a memòria
+    if (volume->image->data != NULL) {
+        const uint8_t *data = image_view(volume->image, block_offset, volume->block_size, NULL);
+        if (data == NULL) return -1;
+        memcpy(buffer, data + offset, length);
+        return 0;
+    }
+
+    // Cache de correspondència directa: cada bloc només pot anar a un slot.
+    // Copiem les dades amb el lock agafat perquè un altre fil pot reemplaçar el slot
+    uint32_t slot = block_num % cache->slot_count;
+    uint8_t *data = cache->data + (size_t)slot * volume->block_size;
+    int result = 0;
+
+    pthread_mutex_lock(&cache->lock);
+    stats_cache(cache == &volume->inode_cache ? STATS_CACHE_EXT2_INODE : STATS_CACHE_EXT2_INDIRECT, cache->tags[slot] == block_num);
+    if (cache->tags[slot] != block_num) {
+        ssize_t n = image_read(volume->image, block_offset, data, volume->block_size);
+        if (n != volume->block_size) {
+            if (n >= 0) errno = EIO; // Bloc més enllà del final de la imatge
+            cache->tags[slot] = 0;
+            result = -1;
+        } else {
+            cache->tags[slot] = block_num;
+        }
+    }
+    if (result == 0) {
+        memcpy(buffer, data + offset, length);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return result;
+}
+
+/*
+    * @brief Opens an EXT2 volume: reads the superblock and the whole block group descriptor table.
+    * @param image Image of the EXT2 file system.
+    * @param volume Pointer to the volume structure to fill.
+    * @return 0 on success, -1 on error.
  */
-int read_ext2_group_desc(int fd, Ext2Superblock *superblock, uint32_t group_num, Ext2GroupDesc *group_desc) {
-    /*
-     * Calculem el block_size de la seguent manera: 1024 << log_block_size.
-     * Es fa aixi perque en ext2 la mida del bloc donada pel superblock es en potencies de 2
-     */
-    uint32_t block_size = 1024 << superblock->log_block_size;
+int ext2_open_volume(Image *image, Ext2Volume *volume) {
+    memset(volume, 0, sizeof(Ext2Volume));
+    volume->image = image;
+
+    if (read_ext2_superblock(image, &volume->superblock) != 0) {
+        return -1;
+    }
+    Ext2Superblock *superblock = &volume->superblock;
+
+    // Calculem el block_size de la seguent manera: 1024 << log_block_size, ja que en ext2 la mida del bloc donada pel superblock es en potencies de 2
+    volume->block_size = 1024 << superblock->log_block_size;
 
-    // Calculem el bloc on comença la taula de descriptors de grup, sumem 1 perque el superblock ocupa el primer bloc 
-    uint32_t bgdt_block = superblock->first_data_block + 1;
+    // Les imatges de revisió 0 no tenen el camp inode_size i els inodes sempre fan 128 bytes
+    volume->inode_size = superblock->rev_level == 0 ? EXT2_GOOD_OLD_INODE_SIZE : superblock->inode_size;
+    if (superblock->blocks_per_group == 0 || superblock->inodes_per_group == 0 || volume->inode_size == 0) {
+        return -1;
+    }
 
-    /*
-     * Ens movem al descriptor de grup que volem llegir, el descriptor de grup es troba a la posició
-     * fem servir la formula: (bgdt_block * block_size) + (group_num * sizeof(Ext2GroupDesc))
-     * per calcular la posició del descriptor de grup que volem llegir
-     * Ho fem amb aquesta formula ja que el descriptor del grup es troba a la posició 
-     */
-    lseek(fd, (bgdt_block * block_size) + (group_num * sizeof(Ext2GroupDesc)), SEEK_SET);
+    // Nombre de grups de blocs, arrodonint cap amunt l'últim grup que pot estar incomplet
+    volume->group_count = (superblock->total_blocks - superblock->first_data_block + superblock->blocks_per_group - 1) / superblock->blocks_per_group;
 
-    // Llegim el descriptor de grup
-    read(fd, group_desc, sizeof(Ext2GroupDesc));
+    // La taula de descriptors de grup comença al bloc següent al del superblock i la llegim sencera d'un sol cop
+    uint64_t bgdt_offset = (uint64_t)(superblock->first_data_block + 1) * volume->block_size;
+    size_t bgdt_size = (size_t)volume->group_count * sizeof(Ext2GroupDesc);
+    volume->groups = malloc(bgdt_size);
+    if (volume->groups == NULL || image_read(image, bgdt_offset, volume->groups, bgdt_size) != (ssize_t)bgdt_size) {
+        ext2_close_volume(volume);
+        return -1;
+    }
+
+    // Caches dels blocs de la taula d'inodes i dels blocs indirectes
+    if (ext2_block_cache_init(volume, &volume->inode_cache, EXT2_INODE_CACHE_SLOTS) != 0 ||
+        ext2_block_cache_init(volume, &volume->indirect_cache, EXT2_INDIRECT_CACHE_SLOTS) != 0) {
+        ext2_close_volume(volume);
+        return -1;
+    }
+
+    // Motor que envia de cop les lectures independents d'un directori
+    if (io_engine_init(&volume->io, image) != 0) {
+        ext2_close_volume(volume);
+        return -1;
+    }
 
     return 0;
 }
 
+/*
+    * @brief Releases the group descriptor table and the inode table cache of a volume.
+    * @param volume Volume to close.
+ */
+void ext2_close_volume(Ext2Volume *volume) {
+    io_engine_destroy(&volume->io);
+    free(volume->groups);
+    free(volume->inode_cache.data);
+    free(volume->inode_cache.tags);
+    free(volume->indirect_cache.data);
+    free(volume->indirect_cache.tags);
+    if (volume->inode_cache.slot_count) pthread_mutex_destroy(&volume->inode_cache.lock);
+    if (volume->indirect_cache.slot_count) pthread_mutex_destroy(&volume->indirect_cache.lock);
+    volume->groups = NULL;
+    memset(&volume->inode_cache, 0, sizeof(Ext2BlockCache));
+    memset(&volume->indirect_cache, 0, sizeof(Ext2BlockCache));
+}
 
 /*
     * @brief Reads an inode from the inode table.
-    * @param fd File descriptor of the EXT2 file system.
-    * @param superblock Superblock of the EXT2 file system.
+    * @param volume Volume of the EXT2 file system.
     * @param inode_num Number of the inode to read.
     * @param inode Pointer to the inode structure to fill.
  */
-int read_ext2_inode(int fd, Ext2Superblock *superblock, uint32_t inode_num, Ext2Inode *inode) {
+int read_ext2_inode(Ext2Volume *volume, uint32_t inode_num, Ext2Inode *inode) {
+    Ext2Superblock *superblock = &volume->superblock;
+
     // Calculem el número de grup per l'inode donat. Cada grup de blocs conté un nombre fix d'inodes com definit en el superblock
     uint32_t group_num = (inode_num - 1) / superblock->inodes_per_group;
+    if (inode_num == 0 || group_num >= volume->group_count) {
+        errno = EINVAL; // Inode fora de rang
+        return -1;
+    }
 
-    Ext2GroupDesc group_desc;
-    // Llegim el descriptor del grup per obtenir les ubicacions de les taules d'inodes entre d'altres
-    read_ext2_group_desc(fd, superblock, group_num, &group_desc); 
-
-    // La ubicació de la taula d'inodes dins del grup, ens dona el bloc inicial on comencen els inodes del grup
-    uint32_t inode_table_start = group_desc.inode_table;
+    // La ubicació de la taula d'inodes dins del grup ve de la taula de descriptors que ja tenim en memòria
+    uint32_t inode_table_start = volume->groups[group_num].inode_table;
 
     // Calculem l'índex local de l'inode dins del seu grup de blocs, utilitzant mòdul amb el nombre d'inodes per grup
     uint32_t index = (inode_num - 1) % superblock->inodes_per_group;
 
-    // Calculem la mida del bloc utilitzant el valor de desplaçament bit a bit com definit en el superblock ja que la mida del bloc es en potencies de 2    
-    uint32_t block_size = 1024 << superblock->log_block_size; 
+    // Calculem el bloc dins del grup que conté l'inode específic i l'offset dins del bloc, basant-nos en la mida real de l'inode
+    uint64_t inode_offset = (uint64_t)index * volume->inode_size;
+    uint32_t containing_block = inode_offset / volume->block_size;
+    uint32_t offset_within_block = inode_offset % volume->block_size;
+
+    // Copiem només els camps que coneixem, els inodes de 128 bytes no tenen la resta
+    size_t copy_size = volume->inode_size < sizeof(Ext2Inode) ? volume->inode_size : sizeof(Ext2Inode);
+    memset(inode, 0, sizeof(Ext2Inode));
+    if (ext2_cached_read(volume, &volume->inode_cache, inode_table_start + containing_block, offset_within_block, inode, copy_size) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Posició d'un inode del lot dins de la taula d'inodes
+typedef struct {
+    uint32_t block;     // Block of the inode table that holds the inode
+    uint32_t offset;    // Offset of the inode inside the block
+    size_t index;       // Position of the inode in the batch
+} Ext2InodeSlot;
+
+// Tram de blocs consecutius de la taula d'inodes llegit amb una sola petició
+typedef struct {
+    Ext2Volume *volume;
+    const Ext2InodeSlot *slots;
+    size_t slot_count;
+    Ext2Inode *inodes;
+    size_t copy_size;
+} Ext2InodeBatch;
+
+static int ext2_inode_slot_compare(const void *a, const void *b) {
+    const Ext2InodeSlot *x = a, *y = b;
+    if (x->block != y->block) return x->block < y->block ? -1 : 1;
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+/*
+    * @brief Copies the inodes of a completed run of inode table blocks to their place in the batch.
+ */
+static void ext2_inode_run_done(IoRequest *request, void *context) {
+    Ext2InodeBatch *batch = context;
+    size_t first = (size_t)(uintptr_t)request->user;
+    uint32_t first_block = batch->slots[first].block;
+
+    if (request->result != (ssize_t)request->length) {
+        return; // The inodes of the run stay zeroed
+    }
+
+    for (size_t i = first; i < batch->slot_count; i++) {
+        const Ext2InodeSlot *slot = &batch->slots[i];
+        uint64_t position = (uint64_t)(slot->block - first_block) * batch->volume->block_size + slot->offset;
+        if (position >= request->length) break;
+        memcpy(&batch->inodes[slot->index], (uint8_t *)request->buffer + position, batch->copy_size);
+    }
+}
+
+/*
+    * @brief Reads several inodes with one batch of reads, one per run of inode table blocks.
+    * @param volume Volume of the EXT2 file system.
+    * @param inode_nums Numbers of the inodes to read.
+    * @param count Number of inodes.
+    * @param inodes Array of count inodes to fill, in the order of inode_nums.
+    * @return 0 on success, -1 if any inode could not be read (it is left zeroed).
+ */
+int ext2_read_inodes(Ext2Volume *volume, const uint32_t *inode_nums, size_t count, Ext2Inode *inodes) {
+    Ext2Superblock *superblock = &volume->superblock;
+    uint32_t block_size = volume->block_size;
+    int result = 0;
+
+    memset(inodes, 0, count * sizeof(Ext2Inode));
+
+    // Un sol inode no té res a agrupar i passa per la memòria cau
+    if (count < 2) {
+        for (size_t i = 0; i < count; i++) {
+            if (read_ext2_inode(volume, inode_nums[i], &inodes[i]) != 0) result = -1;
+        }
+        return result;
+    }
+
+    // Situem cada inode dins de la taula d'inodes del seu grup i els ordenem per bloc
+    Ext2InodeSlot *slots = malloc(count * sizeof(Ext2InodeSlot));
+    if (slots == NULL) {
+        return -1;
+    }
+    size_t slot_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t group_num = (inode_nums[i] - 1) / superblock->inodes_per_group;
+        if (inode_nums[i] == 0 || group_num >= volume->group_count) {
+            errno = EINVAL;
+            result = -1;
+            continue;
+        }
+        uint64_t inode_offset = (uint64_t)((inode_nums[i] - 1) % superblock->inodes_per_group) * volume->inode_size;
+        slots[slot_count].block = volume->groups[group_num].inode_table + inode_offset / block_size;
+        slots[slot_count].offset = inode_offset % block_size;
+        slots[slot_count].index = i;
+        slot_count++;
+    }
+    qsort(slots, slot_count, sizeof(Ext2InodeSlot), ext2_inode_slot_compare);
+
+    // Una petició per cada tram de blocs consecutius, sense passar de EXT2_INODE_BATCH_RUN blocs
+    IoRequest *requests = malloc((slot_count ? slot_count : 1) * sizeof(IoRequest));
+    uint8_t *buffers = NULL;
+    size_t request_count = 0, block_count = 0;
+    if (requests == NULL) {
+        free(slots);
+        return -1;
+    }
+    for (size_t i = 0; i < slot_count; i++) {
+        if (i > 0 && slots[i].block == slots[i - 1].block) continue;
+
+        IoRequest *last = request_count > 0 ? &requests[request_count - 1] : NULL;
+        if (last != NULL && slots[(size_t)(uintptr_t)last->user].block + last->length / block_size == slots[i].block &&
+            last->length / block_size < EXT2_INODE_BATCH_RUN) {
+            last->length += block_size;
+        } else {
+            requests[request_count].offset = (uint64_t)slots[i].block * block_size;
+            requests[request_count].length = block_size;
+            requests[request_count].user = (void *)(uintptr_t)i;
+            request_count++;
+        }
+        block_count++;
+    }
 
-    // Utilitzem la mida de l'inode com a especificat en el superblock per garantir que el càlcul de la posició sigui correcte
-    uint32_t inode_size = superblock->inode_size;
+    buffers = malloc((block_count ? block_count : 1) * (size_t)block_size);
+    if (buffers == NULL) {
+        free(requests);
+        free(slots);
+        return -1;
+    }
+    size_t used = 0;
+    for (size_t r = 0; r < request_count; r++) {
+        requests[r].buffer = buffers + used;
+        used += requests[r].length;
+    }
 
-    // Calculem el bloc dins del grup que conté l'inode específic, basant-nos en la mida de l'inode
-    uint32_t containing_block = (index * inode_size) / block_size;
+    Ext2InodeBatch batch = { volume, slots, slot_count, inodes, volume->inode_size < sizeof(Ext2Inode) ? volume->inode_size : sizeof(Ext2Inode) };
+    if (io_engine_read_batch(&volume->io, requests, request_count, ext2_inode_run_done, &batch) != 0) {
+        result = -1;
+    }
+
+    free(buffers);
+    free(requests);
+    free(slots);
+    return result;
+}
+
+// Bits a 1 dels primers bit_count bits d'un bitmap; els bits de farciment del final no compten
+static uint32_t ext2_bitmap_used(const uint8_t *bitmap, uint32_t bit_count) {
+    uint32_t used = (uint32_t)bitcount_ones(bitmap, bit_count / 8);
+    if (bit_count % 8 != 0) {
+        used += __builtin_popcount(bitmap[bit_count / 8] & ((1u << (bit_count % 8)) - 1));
+    }
+    return used;
+}
+
+/*
+    * @brief Counts the free blocks and inodes of a block group from its block and inode bitmaps.
+    * @param volume Volume of the EXT2 file system.
+    * @param group Number of the block group.
+    * @param free_blocks Where the number of free blocks is stored.
+    * @param free_inodes Where the number of free inodes is stored.
+    * @return 0 on success, -1 on error.
+ */
+int ext2_count_group_free(Ext2Volume *volume, uint32_t group, uint32_t *free_blocks, uint32_t *free_inodes) {
+    const Ext2Superblock *superblock = &volume->superblock;
+    uint32_t block_size = volume->block_size;
 
-    // Calculem l'offset dins del bloc on comença l'inode específic
-    uint32_t offset_within_block = (index * inode_size) % block_size;
+    if (group >= volume->group_count || superblock->blocks_per_group > block_size * 8 ||
+        superblock->inodes_per_group > block_size * 8) {
+        return -1; // Cada bitmap ocupa un sol bloc
+    }
 
-    // Combinem l'ubicació del bloc inicial, l'offset del bloc contenidor i l'offset dins del bloc per obtenir l'offset complet en el fitxer
-    uint32_t read_offset = (inode_table_start + containing_block) * block_size + offset_within_block;
+    // L'últim grup pot tenir menys blocs que la resta
+    uint32_t first_block = superblock->first_data_block + group * superblock->blocks_per_group;
+    uint32_t block_count = superblock->total_blocks - first_block < superblock->blocks_per_group
+                               ? superblock->total_blocks - first_block : superblock->blocks_per_group;
 
-    // Posicionem el descriptor del fitxer al començament de l'inode que volem llegir
-    if (lseek(fd, read_offset, SEEK_SET) != read_offset) {
-        perror("Error seeking to inode");
+    uint8_t *scratch = NULL;
+    if (volume->image->data == NULL && (scratch = malloc(block_size)) == NULL) {
         return -1;
     }
 
-    // Creem un buffer per llegir l'inode i llegim la quantitat de bytes que ocupa un inode.
-    char inode_buffer[256]; // Utilitzem 256 bytes ja que el superblock indica que la mida de l'inode es de 256 bytes
-    if (read(fd, inode_buffer, sizeof(inode_buffer)) != sizeof(inode_buffer)) {
-        perror("Error reading inode");
+    int result = -1;
+    const uint8_t *bitmap = image_view(volume->image, (uint64_t)volume->groups[group].block_bitmap * block_size, block_size, scratch);
+    if (bitmap != NULL) {
+        *free_blocks = block_count - ext2_bitmap_used(bitmap, block_count);
+        bitmap = image_view(volume->image, (uint64_t)volume->groups[group].inode_bitmap * block_size, block_size, scratch);
+        if (bitmap != NULL) {
+            *free_inodes = superblock->inodes_per_group - ext2_bitmap_used(bitmap, superblock->inodes_per_group);
+            result = 0;
+        }
+    }
+
+    free(scratch);
+    return result;
+}
+
+/*
+    * @brief Reads the inodes in use of a block group: its inode bitmap first, then its inode table in large
+    * sequential reads. The parts of the table that only hold free inodes are not read.
+    * @param volume Volume of the EXT2 file system.
+    * @param group Number of the block group.
+    * @param callback Function called for every inode in use, in inode order.
+    * @param context Pointer passed to the callback.
+    * @return 0 on success, -1 on error.
+ */
+int ext2_scan_group(Ext2Volume *volume, uint32_t group, Ext2InodeCallback callback, void *context) {
+    uint32_t block_size = volume->block_size;
+    uint32_t inodes_per_group = volume->superblock.inodes_per_group;
+    size_t copy_size = volume->inode_size < sizeof(Ext2Inode) ? volume->inode_size : sizeof(Ext2Inode);
+
+    if (group >= volume->group_count || inodes_per_group > block_size * 8) {
+        return -1; // El bitmap d'inodes ocupa un sol bloc
+    }
+
+    // Amb la imatge mapejada el bitmap i la taula es llegeixen directament d'ella
+    uint8_t *scratch = NULL;
+    if (volume->image->data == NULL && (scratch = malloc(EXT2_SCAN_CHUNK_SIZE > block_size ? EXT2_SCAN_CHUNK_SIZE : block_size)) == NULL) {
         return -1;
     }
 
-    // Copiem les dades llegides al buffer de l'estructura d'inode.
-    memcpy(inode, inode_buffer, sizeof(Ext2Inode));
+    // Copiem el bitmap perquè el buffer es reutilitza per llegir la taula
+    uint8_t *bitmap = malloc(block_size);
+    const uint8_t *view = bitmap == NULL ? NULL : image_view(volume->image, (uint64_t)volume->groups[group].inode_bitmap * block_size, block_size, scratch);
+    if (view == NULL) {
+        free(bitmap);
+        free(scratch);
+        return -1;
+    }
+    memcpy(bitmap, view, block_size);
 
+    // Cada lectura cobreix els inodes d'un tros de la taula de EXT2_SCAN_CHUNK_SIZE bytes com a molt
+    uint32_t per_chunk = EXT2_SCAN_CHUNK_SIZE / volume->inode_size;
+    uint64_t table = (uint64_t)volume->groups[group].inode_table * block_size;
+    uint32_t first_inode = group * inodes_per_group + 1;
+    int result = 0;
+    if (per_chunk == 0) per_chunk = 1;
+
+    for (uint32_t start = 0; start < inodes_per_group && result == 0; start += per_chunk) {
+        uint32_t end = start + per_chunk < inodes_per_group ? start + per_chunk : inodes_per_group;
+
+        // Saltem els trossos amb tots els inodes lliures i retallem els inodes lliures del final
+        uint32_t last = end;
+        while (last > start && !(bitmap[(last - 1) / 8] & (1u << ((last - 1) % 8)))) last--;
+        if (last == start) continue;
+        uint32_t first = start;
+        while (!(bitmap[first / 8] & (1u << (first % 8)))) first++;
+
+        const uint8_t *inodes = image_view(volume->image, table + (uint64_t)first * volume->inode_size,
+                                           (size_t)(last - first) * volume->inode_size, scratch);
+        if (inodes == NULL) {
+            result = -1;
+            break;
+        }
+
+        for (uint32_t i = first; i < last && result == 0; i++) {
+            if (!(bitmap[i / 8] & (1u << (i % 8)))) continue;
+
+            Ext2Inode inode;
+            memset(&inode, 0, sizeof(Ext2Inode));
+            memcpy(&inode, inodes + (size_t)(i - first) * volume->inode_size, copy_size);
+            result = callback(first_inode + i, &inode, context);
+        }
+    }
+
+    free(bitmap);
+    free(scratch);
+    return result;
+}
+
+/*
+    * @brief Maps a logical block of an inode to its physical block, walking the indirect blocks.
+    * @param volume Volume of the EXT2 file system.
+    * @param inode Inode of the file.
+    * @param logical Logical block number inside the file.
+    * @param physical Pointer where the physical block is stored, 0 for a hole.
+    * @return 0 on success, -1 on error.
+ */
+int ext2_map_block(Ext2Volume *volume, const Ext2Inode *inode, uint32_t logical, uint32_t *physical) {
+    // Cada bloc indirecte conté block_size / 4 punters de 32 bits
+    uint64_t per_block = volume->block_size / sizeof(uint32_t);
+    uint64_t index = logical;
+    uint32_t block;
+    int depth;
+
+    // Els 12 primers blocs són directes, després venen els arbres indirecte simple, doble i triple
+    if (index < EXT2_NDIR_BLOCKS) {
+        *physical = inode->block[index];
+        return 0;
+    }
+    index -= EXT2_NDIR_BLOCKS;
+
+    if (index < per_block) {
+        block = inode->block[EXT2_IND_BLOCK];
+        depth = 1;
+    } else if ((index -= per_block) < per_block * per_block) {
+        block = inode->block[EXT2_DIND_BLOCK];
+        depth = 2;
+    } else if ((index -= per_block * per_block) < per_block * per_block * per_block) {
+        block = inode->block[EXT2_TIND_BLOCK];
+        depth = 3;
+    } else {
+        errno = EINVAL;
+        return -1; // El bloc lògic és més enllà del que pot adreçar un inode
+    }
+
+    // Baixem per l'arbre indirecte: a cada nivell triem el punter que cobreix l'índex
+    for (; depth > 0; depth--) {
+        if (block == 0) {
+            break; // Tot el subarbre és un forat
+        }
+
+        uint64_t span = 1;
+        for (int i = 1; i < depth; i++) span *= per_block;
+
+        // Només ens cal el punter que cobreix l'índex
+        if (ext2_cached_read(volume, &volume->indirect_cache, block, (index / span) * sizeof(uint32_t), &block, sizeof(uint32_t)) != 0) {
+            return -1;
+        }
+        index %= span;
+    }
+
+    *physical = block;
     return 0;
 }
 
 /*
-    * @brief Reads a directory from the inode.
-    * @param fd File descriptor of the EXT2 file system.
-    * @param superblock Superblock of the EXT2 file system.
-    * @param inode Inode of the directory to read.
-    * @param entries Pointer to the directory entries structure to fill.
+    * @brief Adds a block to an extent list, extending the last extent when it is contiguous.
+    * @return 0 on success, -1 on error.
  */
-int read_ext2_directory(int fd, Ext2Superblock *superblock, Ext2Inode *inode, Ext2DirectoryEntry *entries) {
-    // Calculem la mida del bloc utilitzant el desplaçament bit a bit. 
-    // Ext2 fa servir una base de 1024 bytes, i 'log_block_size' indica quantes vegades aquesta base ha de ser desplaçada a l'esquerra (multiplicada per 2 a la potència de 'log_block_size').
-    uint32_t block_size = 1024 << superblock->log_block_size;
+static int ext2_extent_append(Ext2Extent **extents, size_t *count, size_t *capacity, uint32_t logical, uint32_t physical, uint32_t length) {
+    if (*count > 0) {
+        Ext2Extent *last = &(*extents)[*count - 1];
+        int same_kind = (last->physical == 0) == (physical == 0);
+        if (same_kind && last->logical + last->length == logical && (physical == 0 || last->physical + last->length == physical)) {
+            last->length += length;
+            return 0;
+        }
+    }
+
+    if (*count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 16;
+        Ext2Extent *bigger = realloc(*extents, new_capacity * sizeof(Ext2Extent));
+        if (bigger == NULL) {
+            return -1;
+        }
+        *extents = bigger;
+        *capacity = new_capacity;
+    }
+
+    (*extents)[*count].logical = logical;
+    (*extents)[*count].physical = physical;
+    (*extents)[*count].length = length;
+    (*count)++;
+    return 0;
+}
+
+/*
+    * @brief Walks an indirect tree adding the blocks it maps to the extent list.
+    * @param block Root block of the tree, 0 if the whole tree is a hole.
+    * @param depth 1 for single, 2 for double and 3 for triple indirect.
+    * @param next_logical First logical block covered by the tree, advanced as blocks are added.
+    * @param num_blocks Number of blocks of the file, the walk stops there.
+    * @return 0 on success, -1 on error.
+ */
+static int ext2_walk_indirect(Ext2Volume *volume, uint32_t block, int depth, uint32_t *next_logical, uint32_t num_blocks,
+                              Ext2Extent **extents, size_t *count, size_t *capacity) {
+    uint64_t per_block = volume->block_size / sizeof(uint32_t);
+    uint64_t span = 1;
+    for (int i = 1; i < depth; i++) span *= per_block;
+
+    // Un punter a 0 vol dir que tot el subarbre és un forat
+    if (block == 0) {
+        uint64_t covered = span * per_block;
+        uint32_t hole = covered < num_blocks - *next_logical ? covered : num_blocks - *next_logical;
+        if (ext2_extent_append(extents, count, capacity, *next_logical, 0, hole) != 0) return -1;
+        *next_logical += hole;
+        return 0;
+    }
 
-    // Calculem el nombre total de blocs necessaris per emmagatzemar les dades de l'inode
-    // Això s'aconsegueix sumant 'block_size - 1' a la mida total de l'inode abans de dividir per la mida del bloc.
-    uint32_t num_blocks = (inode->size + block_size - 1) / block_size;
+    // Copiem els punters perquè la recursió pot reutilitzar el slot de la cache
+    uint32_t pointers[per_block];
+    if (ext2_cached_read(volume, &volume->indirect_cache, block, 0, pointers, sizeof(pointers)) != 0) {
+        return -1;
+    }
 
-    uint32_t block_num = 0;
-    uint32_t block_offset = 0;
+    for (uint64_t i = 0; i < per_block && *next_logical < num_blocks; i++) {
+        if (depth == 1) {
+            if (ext2_extent_append(extents, count, capacity, *next_logical, pointers[i], 1) != 0) return -1;
+            (*next_logical)++;
+        } else if (ext2_walk_indirect(volume, pointers[i], depth - 1, next_logical, num_blocks, extents, count, capacity) != 0) {
+            return -1;
+        }
+    }
 
-    // Per cada bloc de dades de l'inode
-    for (uint32_t i = 0; i < num_blocks; i++) {
-        // Obtenim el número del bloc de dades des de l'array de blocs de l'inode
-        // 'block_offset' serveix com un índex a l'array 'block' dins de l'estructura de l'inode, que conté les adreces dels blocs físics on estan emmagatzemades les dades
-        block_num = inode->block[block_offset];
-        block_offset++;
+    return 0;
+}
+
+/*
+    * @brief Builds the extent map of an inode: its blocks coalesced in physically contiguous runs.
+    * @param volume Volume of the EXT2 file system.
+    * @param inode Inode of the file.
+    * @param extents Pointer where the allocated array of extents is stored (the caller frees it).
+    * @param count Pointer where the number of extents is stored.
+    * @return 0 on success, -1 on error.
+ */
+int ext2_build_extents(Ext2Volume *volume, const Ext2Inode *inode, Ext2Extent **extents, size_t *count) {
+    // Nombre de blocs lògics del fitxer, arrodonint cap amunt l'últim bloc; la mida pot passar de 4 GiB
+    uint64_t per_block = volume->block_size / sizeof(uint32_t);
+    uint64_t max_blocks = EXT2_NDIR_BLOCKS + per_block + per_block * per_block + per_block * per_block * per_block;
+    uint64_t size_blocks = (ext2_inode_size(inode) + volume->block_size - 1) / volume->block_size;
+    uint32_t num_blocks = size_blocks < max_blocks ? size_blocks : max_blocks;
+    size_t capacity = 0;
+    uint32_t next_logical = 0;
+
+    *extents = NULL;
+    *count = 0;
 
-        // Ens posicionem al començament del bloc de dades corresponent en el fitxer o dispositiu
-        // Multipliquem 'block_num' per 'block_size' ja que ens dona la posició en bytes des del començament del fitxer
-        // Fem servir 'lseek'per moure el cursor del fitxer a aquesta posició.
-        if (lseek(fd, block_num * block_size, SEEK_SET) != block_num * block_size) {
-            perror("Error seeking to block");
+    // Blocs directes
+    for (; next_logical < EXT2_NDIR_BLOCKS && next_logical < num_blocks; next_logical++) {
+        if (ext2_extent_append(extents, count, &capacity, next_logical, inode->block[next_logical], 1) != 0) {
+            free(*extents);
             return -1;
         }
+    }
 
-        // Llegim un bloc sencer de dades del fitxer, fem serivr entrada + i * block_size per llegir el bloc sencer ja que la mida del bloc es de block_size i li sumem i * block_size per llegir el següent bloc
-        if (read(fd, ((char*)entries) + i * block_size, block_size) != block_size) {
-            perror("Error reading block");
+    // Arbres indirectes simple, doble i triple
+    for (int depth = 1; depth <= 3 && next_logical < num_blocks; depth++) {
+        if (ext2_walk_indirect(volume, inode->block[EXT2_NDIR_BLOCKS + depth - 1], depth, &next_logical, num_blocks, extents, count, &capacity) != 0) {
+            free(*extents);
             return -1;
         }
     }
@@ -184,175 +638,918 @@ int read_ext2_directory(int fd, Ext2Superblock *superblock, Ext2Inode *inode, Ex
     return 0;
 }
 
+/*
+    * @brief Adds the blocks of an indirect tree that hold pointers to a list.
+    * @param block Root block of the tree, 0 if the whole tree is a hole.
+    * @param depth 1 for single, 2 for double and 3 for triple indirect.
+    * @param next_logical First logical block covered by the tree, advanced past the tree.
+    * @param num_blocks Number of blocks of the file, the walk stops there.
+    * @return 0 on success, -1 on error.
+ */
+static int ext2_walk_indirect_blocks(Ext2Volume *volume, uint32_t block, int depth, uint32_t *next_logical, uint32_t num_blocks,
+                                     uint32_t **blocks, size_t *count, size_t *capacity) {
+    uint64_t per_block = volume->block_size / sizeof(uint32_t);
+    uint64_t span = 1;
+    for (int i = 1; i < depth; i++) span *= per_block;
+
+    uint64_t covered = span * per_block;
+    if (block == 0 || depth == 1) {
+        *next_logical += covered < num_blocks - *next_logical ? covered : num_blocks - *next_logical;
+    }
+    if (block == 0) return 0;
+
+    if (*count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 16;
+        uint32_t *bigger = realloc(*blocks, new_capacity * sizeof(uint32_t));
+        if (bigger == NULL) {
+            return -1;
+        }
+        *blocks = bigger;
+        *capacity = new_capacity;
+    }
+    (*blocks)[(*count)++] = block;
+    if (depth == 1) return 0;
+
+    // Copiem els punters perquè la recursió pot reutilitzar el slot de la cache
+    uint32_t pointers[per_block];
+    if (ext2_cached_read(volume, &volume->indirect_cache, block, 0, pointers, sizeof(pointers)) != 0) {
+        return -1;
+    }
+    for (uint64_t i = 0; i < per_block && *next_logical < num_blocks; i++) {
+        if (ext2_walk_indirect_blocks(volume, pointers[i], depth - 1, next_logical, num_blocks, blocks, count, capacity) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+    * @brief Lists the indirect blocks of the block map of an inode, the ones that hold pointers and no data.
+    * @param volume Volume of the EXT2 file system.
+    * @param inode Inode of the file.
+    * @param blocks Pointer where the allocated array of blocks is stored (the caller frees it).
+    * @param count Pointer where the number of blocks is stored.
+    * @return 0 on success, -1 on error.
+ */
+int ext2_indirect_blocks(Ext2Volume *volume, const Ext2Inode *inode, uint32_t **blocks, size_t *count) {
+    // Els mateixos límits que ext2_build_extents: només els arbres que cobreixen la mida del fitxer
+    uint64_t per_block = volume->block_size / sizeof(uint32_t);
+    uint64_t max_blocks = EXT2_NDIR_BLOCKS + per_block + per_block * per_block + per_block * per_block * per_block;
+    uint64_t size_blocks = (ext2_inode_size(inode) + volume->block_size - 1) / volume->block_size;
+    uint32_t num_blocks = size_blocks < max_blocks ? size_blocks : max_blocks;
+    uint32_t next_logical = EXT2_NDIR_BLOCKS;
+    size_t capacity = 0;
+
+    *blocks = NULL;
+    *count = 0;
+    for (int depth = 1; depth <= 3 && next_logical < num_blocks; depth++) {
+        if (ext2_walk_indirect_blocks(volume, inode->block[EXT2_NDIR_BLOCKS + depth - 1], depth, &next_logical, num_blocks, blocks, count, &capacity) != 0) {
+            free(*blocks);
+            *blocks = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Potència de base (3, 5 o 7) o 1
+static int ext2_is_power_of(uint32_t number, uint32_t base) {
+    while (number > 1 && number % base == 0) number /= base;
+    return number == 1;
+}
+
+/*
+    * @brief Checks if a block group starts with a copy of the superblock and of the group descriptor table.
+    * @param volume Volume of the EXT2 file system.
+    * @param group Number of the block group.
+    * @return 1 if the group has the copy, 0 otherwise.
+ */
+int ext2_group_has_superblock(const Ext2Volume *volume, uint32_t group) {
+    if (group <= 1 || !(volume->superblock.feature_ro_compat & EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER)) {
+        return 1;
+    }
+    return ext2_is_power_of(group, 3) || ext2_is_power_of(group, 5) || ext2_is_power_of(group, 7);
+}
+
+/*
+    * @brief Returns the size of an inode, with the high 32 bits that revision 1 keeps in dir_acl for regular files.
+    * @param inode Inode of the file.
+ */
+uint64_t ext2_inode_size(const Ext2Inode *inode) {
+    if ((inode->mode & 0xF000) == 0x8000) {
+        return ((uint64_t)inode->dir_acl << 32) | inode->size;
+    }
+    return inode->size;
+}
+
+/*
+    * @brief Prepares the context of a walk.
+    * @param walk Context to fill.
+    * @param volume Volume of the EXT2 file system.
+    * @param read_inodes 1 to read the inode of every entry, 0 for only the directories.
+    * @return 0 on success, -1 on error.
+ */
+int ext2_walk_init(Ext2WalkContext *walk, Ext2Volume *volume, int read_inodes) {
+    memset(walk, 0, sizeof(Ext2WalkContext));
+    walk->volume = volume;
+    walk->read_inodes = read_inodes;
+    walk->batch_blocks = FS_WALK_BATCH_SIZE / volume->block_size;
+    if (walk->batch_blocks == 0) walk->batch_blocks = 1;
+
+    walk->block = malloc((size_t)walk->batch_blocks * volume->block_size);
+    walk->requests = malloc(walk->batch_blocks * sizeof(IoRequest));
+    if (walk->block == NULL || walk->requests == NULL) {
+        ext2_walk_destroy(walk);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+    * @brief Releases the memory of the context of a walk.
+    * @param walk Context to release.
+ */
+void ext2_walk_destroy(Ext2WalkContext *walk) {
+    free(walk->block);
+    free(walk->requests);
+    free(walk->inode_nums);
+    free(walk->inodes);
+}
+
+/*
+    * @brief Opens a directory for the walk. Implements FsWalkOps.open.
+    * @param fs Ext2WalkContext of the walk.
+    * @param directory Entry of the directory, with its inode as node when it was read with its block; NULL for the root.
+    * @param cursor Ext2DirCursor to fill.
+    * @return 0 on success, -1 on error.
+ */
+static int ext2_dir_open(void *fs, const FsWalkItem *directory, void *cursor) {
+    Ext2WalkContext *walk = fs;
+    Ext2DirCursor *dir = cursor;
+
+    dir->next_block = 0;
+    dir->num_blocks = 0;
+    if (directory != NULL && directory->node != NULL) {
+        memcpy(&dir->inode, directory->node, sizeof(Ext2Inode));
+    } else if (read_ext2_inode(walk->volume, directory != NULL ? directory->key : EXT2_ROOT_INODE, &dir->inode) != 0) {
+        return -1;
+    }
+
+    // Si l'ínode no és un directori no hi ha res a llistar
+    if ((dir->inode.mode & 0xF000) == 0x4000) {
+        dir->num_blocks = (dir->inode.size + walk->volume->block_size - 1) / walk->volume->block_size;
+    }
+    return 0;
+}
+
+/*
+    * @brief Reads with one batch the inodes of the entries of a block and completes them.
+    * @param walk Context of the walk.
+    * @param window Window with the entries of the block from first on.
+    * @param first First entry of the block in the window.
+    * @return 0 on success, -1 on error.
+ */
+static int ext2_dir_read_inodes(Ext2WalkContext *walk, FsWalkWindow *window, size_t first) {
+    size_t count = 0;
+
+    if (window->count - first > walk->batch_capacity) {
+        size_t capacity = window->count - first;
+        uint32_t *inode_nums = realloc(walk->inode_nums, capacity * sizeof(uint32_t));
+        if (inode_nums != NULL) walk->inode_nums = inode_nums;
+        Ext2Inode *inodes = realloc(walk->inodes, capacity * sizeof(Ext2Inode));
+        if (inodes != NULL) walk->inodes = inodes;
+        if (inode_nums == NULL || inodes == NULL) return -1;
+        walk->batch_capacity = capacity;
+    }
+
+    // Sense read_inodes només cal l'inode dels directoris, per obrir-los
+    for (size_t i = first; i < window->count; i++) {
+        if (walk->read_inodes || window->items[i].is_directory) {
+            walk->inode_nums[count++] = window->items[i].key;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+    ext2_read_inodes(walk->volume, walk->inode_nums, count, walk->inodes);
+
+    size_t kept = first;
+    for (size_t i = first, j = 0; i < window->count; i++) {
+        FsWalkItem item = window->items[i];
+
+        if (walk->read_inodes || item.is_directory) {
+            const Ext2Inode *inode = &walk->inodes[j++];
+            if (walk->read_inodes) {
+                if (inode->mode == 0) continue; // Inode que no s'ha pogut llegir
+                item.size = ext2_inode_size(inode);
+                item.is_directory = (inode->mode & 0xF000) == 0x4000;
+                item.explore = item.is_directory;
+            }
+            if (item.explore && inode->mode != 0) {
+                Ext2Inode *node = arena_alloc(&window->arena, sizeof(Ext2Inode));
+                if (node == NULL) return -1;
+                *node = *inode;
+                item.node = node;
+            }
+        }
+        window->items[kept++] = item;
+    }
+    window->count = kept;
+    return 0;
+}
+
+/*
+    * @brief Adds to the window the entries of a directory block; '.' and '..' are skipped.
+    * @param window Window where the entries are added.
+    * @param data Contents of the block.
+    * @param block_size Size of the block.
+    * @return 0 on success, -1 if out of memory.
+ */
+static int ext2_dir_add_block(FsWalkWindow *window, const uint8_t *data, uint32_t block_size) {
+    for (uint32_t offset = 0; offset + 8 <= block_size; ) {
+        const Ext2DirectoryEntry *entry = (const Ext2DirectoryEntry *)(data + offset);
+        if (entry->rec_len < 8 || offset + entry->rec_len > block_size) {
+            break; // Entrada corrupta, no podem saber on comença la següent
+        }
+
+        if (entry->inode != 0 && entry->name_len != 0 && entry->name_len <= entry->rec_len - 8 &&
+            !(entry->name_len == 1 && entry->name[0] == '.') &&
+            !(entry->name_len == 2 && entry->name[0] == '.' && entry->name[1] == '.')) {
+            FsWalkItem item = { 0 };
+            item.key = entry->inode;
+            item.is_directory = entry->file_type == 2;
+            item.explore = item.is_directory;
+            item.hidden = entry->name_len == 10 && memcmp(entry->name, "lost+found", 10) == 0;
+
+            if (fs_walk_window_add(window, entry->name, entry->name_len, &item) == NULL) {
+                return -1;
+            }
+        }
+        offset += entry->rec_len; // Ens movem a la següent entrada
+    }
+    return 0;
+}
+
+/*
+    * @brief Records the errno of a directory block that could not be read, if it is the first one of the volume.
+    * @param walk Context of the walk.
+    * @return -1, to end the directory.
+ */
+static int ext2_dir_failed(Ext2WalkContext *walk) {
+    int none = 0;
+
+    // Els fils de l'arbre paral·lel comparteixen el volum
+    __atomic_compare_exchange_n(&walk->volume->walk_error, &none, errno, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    return -1;
+}
+
+/*
+    * @brief Reads the next blocks of a directory with one batch and adds their entries to the window. Implements FsWalkOps.read_block.
+    * @param fs Ext2WalkContext of the walk.
+    * @param cursor Ext2DirCursor of the directory.
+    * @param window Window where the entries are added; '.' and '..' are skipped.
+    * @return 1 if a block was read, 0 at the end of the directory, -1 on error.
+ */
+static int ext2_dir_read_block(void *fs, void *cursor, FsWalkWindow *window) {
+    Ext2WalkContext *walk = fs;
+    Ext2DirCursor *dir = cursor;
+    uint32_t block_size = walk->volume->block_size;
+
+    if (dir->next_block >= dir->num_blocks) {
+        return 0;
+    }
+    uint32_t count = dir->num_blocks - dir->next_block;
+    if (count > walk->batch_blocks) count = walk->batch_blocks;
+
+    // Els blocs que no es poden mapar queden per a la crida següent, que acaba amb l'error
+    uint32_t physical[count];
+    const uint8_t *views[count];
+    for (uint32_t i = 0; i < count; i++) {
+        if (ext2_map_block(walk->volume, &dir->inode, dir->next_block + i, &physical[i]) != 0) {
+            if (i == 0) return ext2_dir_failed(walk);
+            count = i;
+            break;
+        }
+    }
+
+    // Tots els blocs van junts en un lot del motor d'E/S, que amb la imatge mapejada avisa el nucli abans de copiar-los
+    size_t request_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (physical[i] == 0) continue;
+        IoRequest *request = &walk->requests[request_count++];
+        request->offset = (uint64_t)physical[i] * block_size;
+        request->length = block_size;
+        request->buffer = walk->block + (size_t)i * block_size;
+        request->user = (void *)(uintptr_t)i;
+    }
+    io_engine_read_batch(&walk->volume->io, walk->requests, request_count, NULL, NULL);
+
+    for (uint32_t i = 0; i < count; i++) views[i] = NULL;
+    for (size_t r = 0; r < request_count; r++) {
+        const IoRequest *request = &walk->requests[r];
+        if (request->result == (ssize_t)request->length) views[(uintptr_t)request->user] = request->buffer;
+    }
+
+    // Els blocs s'afegeixen en ordre fins al primer que no s'ha pogut llegir; un forat no té entrades
+    size_t first = window->count;
+    uint32_t added = 0;
+    for (; added < count; added++) {
+        if (physical[added] == 0) continue;
+        if (views[added] == NULL) break;
+        if (ext2_dir_add_block(window, views[added], block_size) != 0) return -1;
+    }
+    dir->next_block += added;
+    if (added == 0) {
+        if (walk->requests[0].result >= 0) errno = EIO; // Bloc més enllà del final de la imatge
+        return ext2_dir_failed(walk);
+    }
+
+    return ext2_dir_read_inodes(walk, window, first) == 0 ? 1 : ext2_dir_failed(walk);
+}
+
+const FsWalkOps ext2_walk_ops = { sizeof(Ext2DirCursor), ext2_dir_open, ext2_dir_read_block };
 
-#define ANSI_COLOR_RESET   "\x1b[0m"
-#define ANSI_COLOR_RED     "\x1b[31m"
-#define ANSI_COLOR_GREEN   "\x1b[32m"
-#define ANSI_COLOR_YELLOW  "\x1b[33m"
-#define ANSI_COLOR_BLUE    "\x1b[34m"
-#define ANSI_COLOR_MAGENTA "\x1b[35m"
-#define ANSI_COLOR_CYAN    "\x1b[36m"
-#define ANSI_COLOR_WHITE   "\x1b[37m"
+/*
+    * @brief Walks the volume with the fs_walk engine.
+    * @param volume Volume of the EXT2 file system.
+    * @param read_inodes 1 to report the sizes of the entries and the type of their inodes.
+    * @param callback Function called for every entry.
+    * @param context Pointer passed to the callback.
+    * @return 0 if the whole volume was walked, otherwise the value that stopped the walk.
+ */
+static int ext2_walk_volume(Ext2Volume *volume, int read_inodes, FsWalkCallback callback, void *context) {
+    Ext2WalkContext walk;
+
+    if (ext2_walk_init(&walk, volume, read_inodes) != 0) {
+        return -1;
+    }
+    int result = fs_walk_run(&ext2_walk_ops, &walk, callback, context);
+    ext2_walk_destroy(&walk);
+    return result;
+}
 
 /*
     * @brief Prints a line of the tree representation of the directory structure.
+    * @param render Renderer of the tree.
     * @param level Level of the tree where the line will be printed.
     * @param name Name of the entry to print.
     * @param is_last_entry Flag indicating if the entry is the last one in the directory.
     * @param is_directory Flag indicating if the entry is a directory.
  */
-void print_tree_line(int level, const char* name, int is_last_entry, int is_directory) {
-    static int levels[100] = {0}; // Array per rastrejar els nivells actius
-    
-    for (int i = 0; i < level; ++i) {
-        printf("%s", levels[i] ? "│   " : "    ");
-    }
+void print_tree_line(TreeRender *render, int level, const char* name, int is_last_entry, int is_directory) {
+    // El prefix de cada nivell el porta el renderitzador, sense límit de profunditat
+    tree_render_line(render, level, name, is_last_entry, is_directory);
+}
 
-    if (is_directory) {
-        printf("%s%s── %s%s\n", is_last_entry ? "└" : "├", ANSI_COLOR_BLUE, name, ANSI_COLOR_RESET);
-    } else {
-        printf("%s%s── %s%s\n", is_last_entry ? "└" : "├", ANSI_COLOR_WHITE, name, ANSI_COLOR_RESET);
+static int ext2_tree_entry(const FsWalkEntry *entry, void *context) {
+    TreeRender *render = context;
+
+    // lost+found es recorre però no es mostra
+    if (!entry->hidden) {
+        print_tree_line(render, entry->depth, entry->name, entry->is_last, entry->is_directory);
     }
+    return 0;
+}
 
-    levels[level] = !is_last_entry; // Establim el nivell actual com a actiu o no
-    
+/*
+    * @brief Shows the tree of the file system walking the directories depth first.
+    * @param volume Volume of the EXT2 file system.
+    * @param render Renderer the lines are written to.
+    * @return 0 on success, -1 if the walk cannot start (errno is set).
+ */
+int dfs_ext2(Ext2Volume *volume, TreeRender *render) {
+    return ext2_walk_volume(volume, 0, ext2_tree_entry, render) == -1 ? -1 : 0;
 }
 
 /*
-    * @brief Performs a depth-first search of the EXT2 file system.
-    * @param fd File descriptor of the EXT2 file system.
-    * @param inode_num Number of the inode to start the search from.
-    * @param superblock Superblock of the EXT2 file system.
-    * @param level Level of the tree where the search is currently at.
+    * @brief Reads a directory one block at a time and lists the entries the tree shows or walks, in disk order.
+    * @param volume Volume of the EXT2 file system.
+    * @param inode Inode of the directory, already read.
+    * @param listing Listing to fill.
+    * @param inodes Pointer where the allocated inodes of the subdirectories are stored, one per listing entry (the caller frees it).
+    * @return 0 on success, -1 on error.
  */
-void dfs_ext2(int fd, uint32_t inode_num, Ext2Superblock *superblock, int level, uint32_t current_inode, uint32_t parent_inode) {
-    Ext2Inode inode; // Ínode actual en el que estem
-    Ext2DirectoryEntry *entries; // Entrades del directori
-    // Mida del bloc, shiftem 1024 a l'esquerra per obtenir la mida del bloc ja que el superblock ens dona la mida del bloc en potencies de 2
-    uint32_t block_size = 1024 << superblock->log_block_size; 
+static int ext2_list_tree_directory(Ext2Volume *volume, const Ext2Inode *inode, DirListing *listing, Ext2Inode **inodes) {
+    Ext2WalkContext walk;
+    Ext2DirCursor dir;
+    FsWalkWindow window = { 0 };
+    FsWalkItem directory = { 0 };
+    size_t capacity = 0;
+    int failed = 0;
 
-    // LLegim l'ínode
-    read_ext2_inode(fd, superblock, inode_num, &inode);
-    uint32_t num_blocks = (inode.size + block_size - 1) / block_size;
-    
-    // Comprovem si l'ínode és un directori
-    if (inode.mode & 0x4000) { 
-        // Llegim les entrades del directori
-        entries = (Ext2DirectoryEntry *) malloc(num_blocks * block_size);
-        read_ext2_directory(fd, superblock, &inode, entries); // Llegim les entrades del directori
-
-        // Per cada entrada del directori
-        for (uint32_t offset = 0; offset < block_size; ) {
-            Ext2DirectoryEntry *entry = (Ext2DirectoryEntry *)((char *)entries + offset);
-            if (entry->inode != 0) { // Si l'entrada no és buida
-                // Mostrem el nom de l'entrada
-
-                uint32_t next_offset = offset + entry->rec_len;
-                uint32_t is_current_last_entry = (next_offset >= block_size) || (((Ext2DirectoryEntry *)((char *)entries + next_offset))->inode == 0);
-
-                if (entry->inode != current_inode && entry->inode != parent_inode && strcmp(entry->name, "lost+found") != 0) {
-                    print_tree_line(level, entry->name, is_current_last_entry, entry->file_type == 2);
-                }
+    *inodes = NULL;
+    directory.node = inode;
+    if (ext2_walk_init(&walk, volume, 0) != 0) {
+        return -1;
+    }
+    ext2_dir_open(&walk, &directory, &dir);
+
+    // Un bloc que no es pot llegir acaba el directori, com al recorregut seqüencial
+    while (!failed && ext2_dir_read_block(&walk, &dir, &window) == 1) {
+        for (size_t i = 0; i < window.count && !failed; i++) {
+            const FsWalkItem *item = &window.items[i];
 
-                // Explorem recursivament si és un directori i no és '.' ni '..'
-                if (entry->file_type == 2 && entry->inode != current_inode && entry->inode != parent_inode) {
-                    dfs_ext2(fd, entry->inode, superblock, level + 1, entry->inode, current_inode);
+            // Els inodes dels subdirectoris ja s'han llegit amb el seu bloc
+            if (listing->count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                Ext2Inode *bigger = realloc(*inodes, capacity * sizeof(Ext2Inode));
+                if (bigger == NULL) {
+                    failed = 1;
+                    break;
                 }
+                *inodes = bigger;
+            }
+
+            DirListingEntry entry = { 0 };
+            entry.key = item->key;
+            entry.is_directory = item->is_directory;
+            entry.printed = !item->hidden;
+            entry.explore = item->node != NULL;
+            if (dir_listing_add(listing, item->name, item->name_len, &entry) != 0) {
+                failed = 1;
+                break;
+            }
+            if (item->node != NULL) {
+                (*inodes)[listing->count - 1] = *(const Ext2Inode *)item->node;
             }
-            offset += entry->rec_len; // Ens movem a la següent entrada
         }
+        fs_walk_window_reset(&window);
+    }
 
-        free(entries); // Alliberem la memòria de les entrades
+    if (listing->count > 0) {
+        listing->entries[listing->count - 1].is_last = 1;
     }
+    fs_walk_window_free(&window);
+    ext2_walk_destroy(&walk);
+    if (failed) {
+        free(*inodes);
+        *inodes = NULL;
+        return -1;
+    }
+    return 0;
 }
 
+// Tasca de l'arbre paral·lel: llista un directori i afegeix una tasca per cada subdirectori
+typedef struct {
+    Ext2Volume *volume;
+    DirListing *listing;
+    Ext2Inode inode;        // Inode of the directory, read by the parent task
+} Ext2TreeTask;
+
 /*
-    * @brief Displays the contents of a file.
-    * @param fd File descriptor of the EXT2 file system.
-    * @param inode Inode of the file to display.
-    * @param block_size Size of the blocks in the file system.
+    * @brief Lists one directory of the parallel walk and submits its subdirectories.
+    * @param pool Pool that runs the walk.
+    * @param arg Ext2TreeTask of the directory, released by the task.
  */
-void cat_ext2_file(int fd, Ext2Inode *inode, uint32_t block_size) {
-    // Calculem el nombre total de blocs de dades necessaris per emmagatzemar el fitxer,
-    // arrodonint cap amunt si la mida total del fitxer no és múltiple de block_size
-    uint32_t num_blocks = (inode->size + block_size - 1) / block_size;
+static void ext2_tree_task(ThreadPool *pool, void *arg) {
+    Ext2TreeTask *task = arg;
+    Ext2Inode *inodes;
 
-    // Per cada bloc de dades del fitxers
-    for (uint32_t i = 0; i < num_blocks; i++) {
-        // Si el bloc de dades està buit saltem
-        if (inode->block[i] == 0) continue;
+    if (ext2_list_tree_directory(task->volume, &task->inode, task->listing, &inodes) == 0) {
+        for (size_t i = 0; i < task->listing->count; i++) {
+            DirListingEntry *entry = &task->listing->entries[i];
+            if (!entry->explore) continue;
 
-        // Posiciona el descriptor del fitxer al començament del bloc de dades actual, ho fem multiplican l'index del bloc per la mida del bloc
-        if (lseek(fd, inode->block[i] * block_size, SEEK_SET) != inode->block[i] * block_size) {
-            perror("Error seeking to block");
-            return;  // Si lseek falla mostrem un missatge d'error i retornem
+            // Cada subdirectori té el seu propi llistat, així els fils no comparteixen res
+            Ext2TreeTask *child = malloc(sizeof(Ext2TreeTask));
+            entry->child = calloc(1, sizeof(DirListing));
+            if (child == NULL || entry->child == NULL) {
+                free(child);
+                continue;
+            }
+            child->volume = task->volume;
+            child->listing = entry->child;
+            child->inode = inodes[i];
+            if (thread_pool_submit(pool, ext2_tree_task, child) != 0) {
+                free(child);
+            }
         }
+        free(inodes);
+    }
 
-        // Creem un buffer per llegir el bloc de dades
-        char buffer[block_size];
-        // Llegim el bloc de dades sencer
-        ssize_t bytes_read = read(fd, buffer, block_size);
-        if (bytes_read == -1) {
-            perror("Error reading block");
-            return;  // Si la lectura falla, mostrem un missatge d'error i retornem
+    free(task);
+}
+
+/*
+    * @brief Prints the listings gathered by the parallel walk, in the same order as dfs_ext2.
+    * @param render Renderer of the tree.
+    * @param listing Listing of the directory.
+    * @param level Level of the directory in the tree.
+ */
+static void ext2_print_listing(TreeRender *render, const DirListing *listing, int level) {
+    for (size_t i = 0; i < listing->count; i++) {
+        const DirListingEntry *entry = &listing->entries[i];
+
+        if (entry->printed) {
+            print_tree_line(render, level, entry->name, entry->is_last, entry->is_directory);
+        }
+        if (entry->child != NULL) {
+            ext2_print_listing(render, entry->child, level + 1);
         }
+    }
+}
+
+/*
+    * @brief Shows the tree of the file system walking the directories with several threads.
+    * @param volume Volume of the EXT2 file system.
+    * @param threads Number of worker threads.
+    * @param render Renderer the lines are written to.
+    * @return 0 on success, -1 if the threads cannot be started (errno is set).
+ */
+int dfs_ext2_parallel(Ext2Volume *volume, int threads, TreeRender *render) {
+    ThreadPool pool;
+    DirListing root = { 0 };
 
-        // Escrivim els bytes llegits
-        printf("%.*s", (int)bytes_read, buffer);
+    Ext2TreeTask *task = malloc(sizeof(Ext2TreeTask));
+    if (task == NULL || thread_pool_init(&pool, threads) != 0) {
+        free(task);
+        return -1;
+    }
+    task->volume = volume;
+    task->listing = &root;
+    if (read_ext2_inode(volume, EXT2_ROOT_INODE, &task->inode) != 0) {
+        memset(&task->inode, 0, sizeof(Ext2Inode));
     }
+
+    // Els fils només llegeixen; la sortida es genera al final i en ordre
+    if (thread_pool_submit(&pool, ext2_tree_task, task) != 0) {
+        free(task);
+    }
+    thread_pool_wait(&pool);
+    thread_pool_destroy(&pool);
+
+    ext2_print_listing(render, &root, 0);
+    dir_listing_free(&root);
+    return 0;
 }
 
+// Funcions bàsiques de l'MD4: selecció, majoria i paritat
+#define EXT2_MD4_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define EXT2_MD4_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define EXT2_MD4_H(x, y, z) ((x) ^ (y) ^ (z))
+#define EXT2_MD4_ROUND(f, a, b, c, d, x, s) ((a) += f((b), (c), (d)) + (x), (a) = ((a) << (s)) | ((a) >> (32 - (s))))
+#define EXT2_MD4_K2 013240474631U
+#define EXT2_MD4_K3 015666365641U
+
+// Offset de l'Ext2DxRootInfo al primer bloc d'un directori indexat
+#define EXT2_DX_ROOT_INFO_OFFSET 24
+
+// ext2_dx_lookup no pot fer servir l'índex i cal llegir tot el directori
+#define EXT2_DX_UNUSABLE 2
 
 /*
-    * @brief Displays the contents of a file.
-    * @param fd File descriptor of the EXT2 file system.
-    * @param inode_num Number of the inode to display.
-    * @param superblock Superblock of the EXT2 file system.
-    * @param filename Name of the file to display.
+    * @brief Half MD4 transform of the htree hash: three rounds of MD4 over 8 words.
+    * @param buf State of the hash, updated.
+    * @param in Words of the name.
  */
-int cat_ext2(int fd, uint32_t inode_num, Ext2Superblock *superblock, char* filename, uint32_t current_inode, uint32_t parent_inode) {
-    Ext2Inode inode; // Ínode actual en el que estem
-    Ext2DirectoryEntry *entries; // Entrades del directori
-    // Mida del bloc, shiftem 1024 a l'esquerra per obtenir la mida del bloc ja que el superblock ens dona la mida del bloc en potencies de 2
-    uint32_t block_size = 1024 << superblock->log_block_size; 
+static void ext2_half_md4(uint32_t buf[4], const uint32_t in[8]) {
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
 
-    // LLegim l'ínode
-    read_ext2_inode(fd, superblock, inode_num, &inode);
-    uint32_t num_blocks = (inode.size + block_size - 1) / block_size;
+    EXT2_MD4_ROUND(EXT2_MD4_F, a, b, c, d, in[0], 3);
+    EXT2_MD4_ROUND(EXT2_MD4_F, d, a, b, c, in[1], 7);
+    EXT2_MD4_ROUND(EXT2_MD4_F, c, d, a, b, in[2], 11);
+    EXT2_MD4_ROUND(EXT2_MD4_F, b, c, d, a, in[3], 19);
+    EXT2_MD4_ROUND(EXT2_MD4_F, a, b, c, d, in[4], 3);
+    EXT2_MD4_ROUND(EXT2_MD4_F, d, a, b, c, in[5], 7);
+    EXT2_MD4_ROUND(EXT2_MD4_F, c, d, a, b, in[6], 11);
+    EXT2_MD4_ROUND(EXT2_MD4_F, b, c, d, a, in[7], 19);
 
-    // Comprovem si l'ínode és un directori
-    if (inode.mode & 0x4000) { 
-        // Llegim les entrades del directori
-        entries = (Ext2DirectoryEntry *) malloc(num_blocks * block_size); // Reservem memòria per les entrades
-        read_ext2_directory(fd, superblock, &inode, entries); // Llegim les entrades del directori
+    EXT2_MD4_ROUND(EXT2_MD4_G, a, b, c, d, in[1] + EXT2_MD4_K2, 3);
+    EXT2_MD4_ROUND(EXT2_MD4_G, d, a, b, c, in[3] + EXT2_MD4_K2, 5);
+    EXT2_MD4_ROUND(EXT2_MD4_G, c, d, a, b, in[5] + EXT2_MD4_K2, 9);
+    EXT2_MD4_ROUND(EXT2_MD4_G, b, c, d, a, in[7] + EXT2_MD4_K2, 13);
+    EXT2_MD4_ROUND(EXT2_MD4_G, a, b, c, d, in[0] + EXT2_MD4_K2, 3);
+    EXT2_MD4_ROUND(EXT2_MD4_G, d, a, b, c, in[2] + EXT2_MD4_K2, 5);
+    EXT2_MD4_ROUND(EXT2_MD4_G, c, d, a, b, in[4] + EXT2_MD4_K2, 9);
+    EXT2_MD4_ROUND(EXT2_MD4_G, b, c, d, a, in[6] + EXT2_MD4_K2, 13);
 
-        // Per cada entrada del directori
-        for (uint32_t offset = 0; offset < block_size; ) {
-            Ext2DirectoryEntry *entry = (Ext2DirectoryEntry *)((char *)entries + offset);
-            if (entry->inode != 0) { // Si l'entrada no és buida
-                char entry_name[entry->name_len + 1];
-                memcpy(entry_name, entry->name, entry->name_len);
-                entry_name[entry->name_len] = '\0';
+    EXT2_MD4_ROUND(EXT2_MD4_H, a, b, c, d, in[3] + EXT2_MD4_K3, 3);
+    EXT2_MD4_ROUND(EXT2_MD4_H, d, a, b, c, in[7] + EXT2_MD4_K3, 9);
+    EXT2_MD4_ROUND(EXT2_MD4_H, c, d, a, b, in[2] + EXT2_MD4_K3, 11);
+    EXT2_MD4_ROUND(EXT2_MD4_H, b, c, d, a, in[6] + EXT2_MD4_K3, 15);
+    EXT2_MD4_ROUND(EXT2_MD4_H, a, b, c, d, in[1] + EXT2_MD4_K3, 3);
+    EXT2_MD4_ROUND(EXT2_MD4_H, d, a, b, c, in[5] + EXT2_MD4_K3, 9);
+    EXT2_MD4_ROUND(EXT2_MD4_H, c, d, a, b, in[0] + EXT2_MD4_K3, 11);
+    EXT2_MD4_ROUND(EXT2_MD4_H, b, c, d, a, in[4] + EXT2_MD4_K3, 15);
 
-                if(strcmp(entry_name, filename) == 0){
-                    Ext2Inode file_inode; // Inode del fitxer
-                    read_ext2_inode(fd, superblock, entry->inode, &file_inode); // Llegim l'ínode del fitxer
-                    cat_ext2_file(fd, &file_inode, block_size); // Mostrem el contingut del fitxer
-                    return 1;
-                }
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
 
-                // Explorem recursivament si és un directori i no és el directori actual ni el directori pare
-                if (entry->file_type == 2 && entry->inode != current_inode && entry->inode != parent_inode) {
-                    if (cat_ext2(fd, entry->inode, superblock, filename, entry->inode, current_inode)) {
-                        return 1;
-                    }
-                }
-            }
-            offset += entry->rec_len; // Ens movem a la següent entrada
+/*
+    * @brief TEA transform of the htree hash: 16 cycles over 4 words.
+    * @param buf State of the hash, updated.
+    * @param in Words of the name.
+ */
+static void ext2_tea(uint32_t buf[4], const uint32_t in[4]) {
+    uint32_t sum = 0;
+    uint32_t b0 = buf[0], b1 = buf[1];
+
+    for (int n = 0; n < 16; n++) {
+        sum += 0x9E3779B9;
+        b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+        b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+    }
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+// Caràcter d'un nom tal com el suma el hash: amb signe o sense segons el volum
+static uint32_t ext2_hash_char(char c, int is_unsigned) {
+    return is_unsigned ? (uint32_t)(unsigned char)c : (uint32_t)(int32_t)(signed char)c;
+}
+
+/*
+    * @brief Packs up to num words of a name for the transforms, padding them with its length.
+    * @param name Rest of the name.
+    * @param length Bytes left of the name, also the ones of the next words.
+    * @param buf Words to fill.
+    * @param num Number of words.
+    * @param is_unsigned 1 if the characters are unsigned.
+ */
+static void ext2_hash_words(const char *name, size_t length, uint32_t *buf, int num, int is_unsigned) {
+    uint32_t pad = (uint32_t)length | ((uint32_t)length << 8);
+    pad |= pad << 16;
+
+    uint32_t value = pad;
+    if (length > (size_t)num * 4) length = (size_t)num * 4;
+    for (size_t i = 0; i < length; i++) {
+        value = ext2_hash_char(name[i], is_unsigned) + (value << 8);
+        if (i % 4 == 3) {
+            *buf++ = value;
+            value = pad;
+            num--;
+        }
+    }
+    if (--num >= 0) *buf++ = value;
+    while (--num >= 0) *buf++ = pad;
+}
+
+/*
+    * @brief Computes the htree hash of a name, as the kernel does to index a directory.
+    * @param volume Volume of the EXT2 file system, for the seed and the signedness of the hash.
+    * @param version Hash version of the index (EXT2_DX_HASH_*).
+    * @param name Name, not NUL terminated.
+    * @param name_len Length of the name.
+    * @return Hash of the name, with the lowest bit clear.
+ */
+uint32_t ext2_dx_hash(const Ext2Volume *volume, uint8_t version, const char *name, size_t name_len) {
+    uint32_t buf[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+    uint32_t in[8];
+    const uint32_t *seed = volume->superblock.hash_seed;
+    int is_unsigned = (volume->superblock.flags & EXT2_FLAGS_UNSIGNED_HASH) != 0;
+    uint32_t hash;
+
+    // Una llavor tota a zeros vol dir la inicial de l'MD4
+    if (seed[0] | seed[1] | seed[2] | seed[3]) {
+        memcpy(buf, seed, sizeof(buf));
+    }
+
+    if (version == EXT2_DX_HASH_HALF_MD4) {
+        for (size_t done = 0; done < name_len; done += 32) {
+            ext2_hash_words(name + done, name_len - done, in, 8, is_unsigned);
+            ext2_half_md4(buf, in);
+        }
+        hash = buf[1];
+    } else if (version == EXT2_DX_HASH_TEA) {
+        for (size_t done = 0; done < name_len; done += 16) {
+            ext2_hash_words(name + done, name_len - done, in, 4, is_unsigned);
+            ext2_tea(buf, in);
+        }
+        hash = buf[0];
+    } else {
+        // Hash original de l'htree
+        uint32_t hash0 = 0x12A3FE2D, hash1 = 0x37ABE8F9;
+        for (size_t i = 0; i < name_len; i++) {
+            hash = hash1 + (hash0 ^ (ext2_hash_char(name[i], is_unsigned) * 7152373));
+            if (hash & 0x80000000) hash -= 0x7FFFFFFF;
+            hash1 = hash0;
+            hash0 = hash;
         }
+        hash = hash0 << 1;
+    }
+    return hash & ~1U;
+}
+
+/*
+    * @brief Reads a logical block of a directory.
+    * @param volume Volume of the EXT2 file system.
+    * @param directory Inode of the directory.
+    * @param logical Logical block.
+    * @param scratch Buffer of a block, used when the image is not mapped.
+    * @param data Pointer where the pointer to the block is stored.
+    * @return 1 if the block was read, 0 if it is a hole, -1 on error.
+ */
+static int ext2_dir_block(Ext2Volume *volume, const Ext2Inode *directory, uint32_t logical, uint8_t *scratch, const uint8_t **data) {
+    uint32_t physical;
+
+    if (ext2_map_block(volume, directory, logical, &physical) != 0) return -1;
+    if (physical == 0) return 0;
+    *data = image_view(volume->image, (uint64_t)physical * volume->block_size, volume->block_size, scratch);
+    return *data != NULL ? 1 : -1;
+}
 
-        free(entries); // Alliberem la memòria de les entrades
+/*
+    * @brief Looks a name up in the entries of one directory block.
+    * @return 1 if found, 0 otherwise.
+ */
+static int ext2_block_find(const uint8_t *data, uint32_t block_size, const char *name, size_t name_len, uint32_t *inode_num) {
+    for (uint32_t offset = 0; offset + 8 <= block_size; ) {
+        const Ext2DirectoryEntry *entry = (const Ext2DirectoryEntry *)(data + offset);
+        if (entry->rec_len < 8 || offset + entry->rec_len > block_size) {
+            break; // Entrada corrupta, no podem saber on comença la següent
+        }
+        if (entry->inode != 0 && entry->name_len == name_len && name_len <= (size_t)entry->rec_len - 8 &&
+            memcmp(entry->name, name, name_len) == 0) {
+            *inode_num = entry->inode;
+            return 1;
+        }
+        offset += entry->rec_len;
     }
+    return 0;
+}
 
+/*
+    * @brief Looks a name up reading every block of a directory.
+    * @return 1 if found, 0 if not, -1 on error.
+ */
+static int ext2_dir_scan(Ext2Volume *volume, const Ext2Inode *directory, const char *name, size_t name_len, uint32_t *inode_num, uint8_t *scratch) {
+    uint32_t num_blocks = (directory->size + volume->block_size - 1) / volume->block_size;
+    const uint8_t *data;
+
+    for (uint32_t block = 0; block < num_blocks; block++) {
+        int read = ext2_dir_block(volume, directory, block, scratch, &data);
+        if (read < 0) return -1;
+        if (read == 1 && ext2_block_find(data, volume->block_size, name, name_len, inode_num)) return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
+
+/*
+    * @brief Looks a name up through the htree of an indexed directory: one block per level and the leaf.
+    *
+    * Each node is searched by bisection for the last entry with a hash not above the one of the name.
+    * When the next leaf starts with the same hash (a collision split between leaves) or the index does
+    * not look right, the directory is read whole instead.
+    * @return 1 if found, 0 if not, -1 on error, EXT2_DX_UNUSABLE to read the directory whole.
+ */
+static int ext2_dx_lookup(Ext2Volume *volume, const Ext2Inode *directory, const char *name, size_t name_len, uint32_t *inode_num, uint8_t *scratch) {
+    uint32_t block_size = volume->block_size;
+    uint32_t num_blocks = (directory->size + block_size - 1) / block_size;
+    const uint8_t *data;
+
+    int read = ext2_dir_block(volume, directory, 0, scratch, &data);
+    if (read != 1) return read < 0 ? -1 : EXT2_DX_UNUSABLE;
+
+    const Ext2DxRootInfo *info = (const Ext2DxRootInfo *)(data + EXT2_DX_ROOT_INFO_OFFSET);
+    if (info->reserved_zero != 0 || info->info_length != sizeof(Ext2DxRootInfo) ||
+        info->indirect_levels >= EXT2_DX_MAX_LEVELS || info->hash_version > EXT2_DX_HASH_TEA) {
+        return EXT2_DX_UNUSABLE;
+    }
+    uint32_t levels = info->indirect_levels;
+    uint32_t hash = ext2_dx_hash(volume, info->hash_version, name, name_len);
+    uint32_t offset = EXT2_DX_ROOT_INFO_OFFSET + sizeof(Ext2DxRootInfo);
+    uint32_t next_hash = 0;     // Hash where the next leaf starts
+    int has_next = 0;
+
+    for (uint32_t level = 0; ; level++) {
+        const Ext2DxEntry *entries = (const Ext2DxEntry *)(data + offset);
+        uint16_t limit = (uint16_t)(entries[0].hash & 0xFFFF);
+        uint16_t count = (uint16_t)(entries[0].hash >> 16);
+        if (count == 0 || count > limit || limit > (block_size - offset) / sizeof(Ext2DxEntry)) {
+            return EXT2_DX_UNUSABLE;
+        }
+
+        // La primera entrada no té hash i cobreix els més petits que el de la segona
+        size_t low = 1, high = count;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (entries[middle].hash > hash) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        if (low < count) {
+            next_hash = entries[low].hash;
+            has_next = 1;
+        }
+        uint32_t block = entries[low - 1].block & 0x0FFFFFFF;
+        if (block >= num_blocks) return EXT2_DX_UNUSABLE;
+
+        if ((read = ext2_dir_block(volume, directory, block, scratch, &data)) != 1) {
+            return read < 0 ? -1 : EXT2_DX_UNUSABLE;
+        }
+        if (level == levels) {
+            if (ext2_block_find(data, block_size, name, name_len, inode_num)) return 1;
+            return has_next && (next_hash & ~1U) == hash ? EXT2_DX_UNUSABLE : 0;
+        }
+        offset = 8; // Un node interior comença amb una entrada buida que ocupa tot el bloc
+    }
+}
+
+/*
+    * @brief Looks a name up in a directory: through its htree when it is indexed, otherwise reading all its blocks.
+    * @param volume Volume of the EXT2 file system.
+    * @param directory Inode of the directory.
+    * @param name Name, not NUL terminated.
+    * @param name_len Length of the name.
+    * @param inode_num Pointer where the inode of the entry is stored.
+    * @return 1 if found, 0 if the directory has no entry with that name, -1 on error.
+ */
+int ext2_dir_lookup(Ext2Volume *volume, const Ext2Inode *directory, const char *name, size_t name_len, uint32_t *inode_num) {
+    uint8_t *scratch = NULL;
+
+    if ((directory->mode & 0xF000) != 0x4000) {
+        return 0;
+    }
+    // Amb la imatge mapejada els blocs es llegeixen directament d'ella
+    if (volume->image->data == NULL && (scratch = malloc(volume->block_size)) == NULL) {
+        return -1;
+    }
+
+    int result = EXT2_DX_UNUSABLE;
+    if ((directory->flags & EXT2_INDEX_FL) && (volume->superblock.feature_optional & EXT2_FEATURE_COMPAT_DIR_INDEX)) {
+        result = ext2_dx_lookup(volume, directory, name, name_len, inode_num, scratch);
+    }
+    if (result == EXT2_DX_UNUSABLE) {
+        result = ext2_dir_scan(volume, directory, name, name_len, inode_num, scratch);
+    }
+    free(scratch);
+    return result;
+}
+
+/*
+    * @brief Resolves an absolute path one component at a time with ext2_dir_lookup.
+    * @param volume Volume of the EXT2 file system.
+    * @param path Absolute path, "/" for the root directory.
+    * @param inode_num Pointer where the inode of the path is stored.
+    * @param inode Pointer where the inode is read.
+    * @return 1 if found, 0 if a component does not exist or is not a directory, -1 on error.
+ */
+int ext2_lookup_path(Ext2Volume *volume, const char *path, uint32_t *inode_num, Ext2Inode *inode) {
+    uint32_t current = EXT2_ROOT_INODE;
+
+    if (read_ext2_inode(volume, current, inode) != 0) {
+        return -1;
+    }
+    for (const char *component = path; *component != '\0'; ) {
+        while (*component == '/') component++;
+        if (*component == '\0') break;
+        size_t length = strcspn(component, "/");
+
+        int found = ext2_dir_lookup(volume, inode, component, length, &current);
+        if (found != 1) return found;
+        if (read_ext2_inode(volume, current, inode) != 0) return -1;
+        component += length;
+    }
+    *inode_num = current;
+    return 1;
+}
+
+// Fitxer buscat pel nom a tot el volum
+typedef struct {
+    const char *filename;
+    uint32_t inode;
+} Ext2CatSearch;
+
+static int ext2_cat_match(const FsWalkEntry *entry, void *context) {
+    Ext2CatSearch *search = context;
+
+    if (entry->is_directory || strcmp(entry->name, search->filename) != 0) {
+        return 0;
+    }
+    search->inode = entry->key;
+    return 1;
+}
+
+/*
+    * @brief Searches every directory for the first file with a name, as --cat does without a full path.
+    * @param volume Volume of the EXT2 file system.
+    * @param filename Name of the file.
+    * @param inode_num Pointer where the inode of the file is stored.
+    * @return 1 if found, 0 if not, -1 on error (errno is set).
+ */
+int ext2_find_file(Ext2Volume *volume, const char *filename, uint32_t *inode_num) {
+    Ext2CatSearch search = { filename, 0 };
+
+    int result = ext2_walk_volume(volume, 0, ext2_cat_match, &search);
+    if (result != 1) {
+        return result == 0 ? 0 : -1;
+    }
+    *inode_num = search.inode;
+    return 1;
+}
+
+/*
+    * @brief Walks every directory of the volume, reporting each entry with its full path.
+    * @param volume Volume of the EXT2 file system.
+    * @param callback Function called for every entry, a non-zero result stops the walk.
+    * @param context Pointer passed to the callback.
+    * @return 0 if the whole volume was walked, otherwise the value that stopped the walk.
+ */
+int ext2_walk(Ext2Volume *volume, FsWalkCallback callback, void *context) {
+    return ext2_walk_volume(volume, 1, callback, context);
+}
@@ -1,6 +1,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -14,11 +15,47 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include "../common/image.h"
+#include "../common/output.h"
+#include "../common/dir_listing.h"
+#include "../common/thread_pool.h"
+#include "../common/fs_walk.h"
+#include "../common/io_engine.h"
+#include "../common/tree_render.h"
+
 #define EXT2_SUPERBLOCK_OFFSET 1024
 #define EXT2_SUPERBLOCK_SIZE 1024
 #define EXT2_MAGIC_OFFSET 56
 #define EXT2_MAGIC 0xEF53
 #define EXT2_ROOT_INODE 2
+#define EXT2_RESIZE_INODE 7
+#define EXT2_GOOD_OLD_INODE_SIZE 128
+#define EXT2_INODE_CACHE_SLOTS 64
+#define EXT2_INDIRECT_CACHE_SLOTS 16
+
+// Blocs consecutius de la taula d'inodes que es llegeixen amb una sola petició
+#define EXT2_INODE_BATCH_RUN 32
+
+// Bytes de la taula d'inodes que --scan-inodes llegeix de cop
+#define EXT2_SCAN_CHUNK_SIZE (1024 * 1024)
+
+// Directoris indexats amb un htree (dir_index)
+#define EXT2_FEATURE_COMPAT_DIR_INDEX 0x0020
+#define EXT2_INDEX_FL 0x00001000
+#define EXT2_FLAGS_UNSIGNED_HASH 0x0002
+#define EXT2_DX_HASH_LEGACY 0
+#define EXT2_DX_HASH_HALF_MD4 1
+#define EXT2_DX_HASH_TEA 2
+#define EXT2_DX_MAX_LEVELS 3
+
+// Còpies del superblock només als grups 0, 1 i potències de 3, 5 i 7 (sparse_super)
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+
+// Índexs de l'array block[] de l'inode
+#define EXT2_NDIR_BLOCKS 12
+#define EXT2_IND_BLOCK 12
+#define EXT2_DIND_BLOCK 13
+#define EXT2_TIND_BLOCK 14
 
 #pragma pack(push, 1)
 typedef struct {
@@ -55,17 +92,35 @@ typedef struct {
     uint32_t feature_optional;
     uint32_t feature_required;
     uint32_t feature_ro_compat;
+    uint8_t uuid[16];
     char volume_name[16];
     char last_mounted_path[64];
     uint32_t compression_algorithms;
     uint8_t prealloc_blocks;
     uint8_t prealloc_dir_blocks;
-    uint16_t unused;
-    char filesystem_id[16];
-    char journal_id[16];
+    uint16_t reserved_gdt_blocks;
+    uint8_t journal_uuid[16];
     uint32_t journal_inode;
     uint32_t journal_device;
     uint32_t orphan_inode_list_head;
+
+    // Directory Indexing Support
+    uint32_t hash_seed[4];
+    uint8_t def_hash_version;
+    uint8_t journal_backup_type;
+    uint16_t group_desc_size;
+
+    // Other Options
+    uint32_t default_mount_options;
+    uint32_t first_meta_bg;
+    uint32_t mkfs_time;
+    uint32_t journal_blocks[17];
+    uint32_t total_blocks_hi;
+    uint32_t reserved_blocks_hi;
+    uint32_t free_blocks_hi;
+    uint16_t min_extra_inode_size;
+    uint16_t want_extra_inode_size;
+    uint32_t flags;
 } Ext2Superblock;
 #pragma pack(pop)
 
@@ -106,6 +161,29 @@ typedef struct
 Ext2DirectoryEntry;
 #pragma pack(pop)
 
+// Capçalera de l'arrel d'un htree, després de les entrades '.' i '..' del primer bloc
+#pragma pack(push, 1)
+typedef struct
+{
+    uint32_t reserved_zero;
+    uint8_t hash_version;
+    uint8_t info_length;
+    uint8_t indirect_levels;
+    uint8_t unused_flags;
+}
+Ext2DxRootInfo;
+#pragma pack(pop)
+
+// Entrada d'un node de l'htree; a la primera, hash guarda limit i count
+#pragma pack(push, 1)
+typedef struct
+{
+    uint32_t hash;
+    uint32_t block;     // Logical block of the directory
+}
+Ext2DxEntry;
+#pragma pack(pop)
+
 #pragma pack(push, 1)
 typedef struct 
 {
@@ -121,64 +199,263 @@ typedef struct
 Ext2GroupDesc;
 #pragma pack(pop)
 
+// Cache de blocs de metadades de correspondència directa (cada bloc només pot anar a un slot)
+typedef struct
+{
+    uint8_t *data;      // slot_count blocks, NULL when the image is in memory
+    uint32_t *tags;     // Block held by each slot, 0 if the slot is empty
+    uint32_t slot_count;
+    pthread_mutex_t lock; // The parallel walks share the cache
+}
+Ext2BlockCache;
+
+// Tram de blocs lògics consecutius d'un fitxer guardats en blocs físics consecutius
+typedef struct
+{
+    uint32_t logical;   // First logical block of the run
+    uint32_t physical;  // First physical block of the run, 0 for a hole
+    uint32_t length;    // Number of blocks of the run
+}
+Ext2Extent;
+
+// Volum EXT2 obert, amb el superblock, la taula de descriptors de grup i la cache de la taula d'inodes
+typedef struct
+{
+    Image *image;
+    Ext2Superblock superblock;
+    uint32_t block_size;
+    uint32_t inode_size;
+    uint32_t group_count;
+    Ext2GroupDesc *groups;          // Whole block group descriptor table
+    Ext2BlockCache inode_cache;     // Inode table blocks
+    Ext2BlockCache indirect_cache;  // Indirect blocks of the block maps
+    IoEngine io;                    // Batched reads of inodes and directory blocks
+    int walk_error;                 // errno of the first directory a walk could not read completely, 0 if none
+}
+Ext2Volume;
+
+// Recorregut d'un volum: el context que reben les operacions del motor de fs_walk
+typedef struct {
+    Ext2Volume *volume;
+    int read_inodes;        // 1 to read the inode of every entry (sizes), 0 for only the directories
+    uint32_t batch_blocks;  // Directory blocks read with one batch
+    uint8_t *block;         // Copy of the directory blocks of a batch
+    IoRequest *requests;    // Reads of a batch
+    uint32_t *inode_nums;   // Inodes of the entries of a block, read in one batch
+    Ext2Inode *inodes;
+    size_t batch_capacity;
+} Ext2WalkContext;
+
+// Directori obert: el seu inode i el següent bloc per llegir
+typedef struct {
+    Ext2Inode inode;
+    uint32_t next_block;
+    uint32_t num_blocks;
+} Ext2DirCursor;
+
 /**
  * @brief Checks if the file system is an EXT2 file system.
  * 
- * @param fd File descriptor of the file system.
+ * @param image Image of the file system.
  * 
  * @return 1 if the file system is EXT2, 0 otherwise.
 */
-int is_ext2(int fd);
+int is_ext2(Image *image);
 
 /*
  * @brief Reads the superblock of an EXT2 file system.
- * @param fd File descriptor of the EXT2 file system.
+ * @param image Image of the EXT2 file system.
  * @param superblock Pointer to the superblock structure to fill.
  */
-int read_ext2_superblock(int fd, Ext2Superblock *superblock);
+int read_ext2_superblock(Image *image, Ext2Superblock *superblock);
 
 /*
-    * @brief Reads a group descriptor from the block group descriptor table.
-    * @param fd File descriptor of the EXT2 file system.
-    * @param superblock Superblock of the EXT2 file system.
-    * @param group_num Number of the group descriptor to read.
-    * @param group_desc Pointer to the group descriptor structure to fill.
+    * @brief Opens an EXT2 volume: reads the superblock and the whole block group descriptor table.
+    * @param image Image of the EXT2 file system.
+    * @param volume Pointer to the volume structure to fill.
+    * @return 0 on success, -1 on error.
  */
-int read_ext2_group_desc(int fd, Ext2Superblock *superblock, uint32_t group_num, Ext2GroupDesc *group_desc);
+int ext2_open_volume(Image *image, Ext2Volume *volume);
+
+/*
+    * @brief Releases the group descriptor table and the inode table cache of a volume.
+    * @param volume Volume to close.
+ */
+void ext2_close_volume(Ext2Volume *volume);
 
 /*
     * @brief Reads an inode from the inode table.
-    * @param fd File descriptor of the EXT2 file system.
-    * @param superblock Superblock of the EXT2 file system.
+    * @param volume Volume of the EXT2 file system.
     * @param inode_num Number of the inode to read.
     * @param inode Pointer to the inode structure to fill.
  */
-int read_ext2_inode(int fd, Ext2Superblock *superblock, uint32_t inode_num, Ext2Inode *inode);
+int read_ext2_inode(Ext2Volume *volume, uint32_t inode_num, Ext2Inode *inode);
+
+/*
+    * @brief Reads several inodes with one batch of reads, one per run of inode table blocks.
+    * @param volume Volume of the EXT2 file system.
+    * @param inode_nums Numbers of the inodes to read.
+    * @param count Number of inodes.
+    * @param inodes Array of count inodes to fill, in the order of inode_nums.
+    * @return 0 on success, -1 if any inode could not be read (it is left zeroed).
+ */
+int ext2_read_inodes(Ext2Volume *volume, const uint32_t *inode_nums, size_t count, Ext2Inode *inodes);
+
+/*
+    * @brief Counts the free blocks and inodes of a block group from its block and inode bitmaps.
+    * @param volume Volume of the EXT2 file system.
+    * @param group Number of the block group.
+    * @param free_blocks Where the number of free blocks is stored.
+    * @param free_inodes Where the number of free inodes is stored.
+    * @return 0 on success, -1 on error.
+ */
+int ext2_count_group_free(Ext2Volume *volume, uint32_t group, uint32_t *free_blocks, uint32_t *free_inodes);
+
+/*
+    * @brief Function called by ext2_scan_group for every inode in use.
+    * @param inode_num Number of the inode.
+    * @param inode The inode, only valid during the call.
+    * @param context Pointer passed to ext2_scan_group.
+    * @return 0 to go on, any other value stops the scan of the group.
+ */
+typedef int (*Ext2InodeCallback)(uint32_t inode_num, const Ext2Inode *inode, void *context);
+
+/*
+    * @brief Reads the inodes in use of a block group: its inode bitmap first, then its inode table in large
+    * sequential reads. The parts of the table that only hold free inodes are not read.
+    * @param volume Volume of the EXT2 file system.
+    * @param group Number of the block group.
+    * @param callback Function called for every inode in use, in inode order.
+    * @param context Pointer passed to the callback.
+    * @return 0 on success, -1 on error.
+ */
+int ext2_scan_group(Ext2Volume *volume, uint32_t group, Ext2InodeCallback callback, void *context);
+
+/*
+    * @brief Maps a logical block of an inode to its physical block, walking the indirect blocks.
+    * @param volume Volume of the EXT2 file system.
+    * @param inode Inode of the file.
+    * @param logical Logical block number inside the file.
+    * @param physical Pointer where the physical block is stored, 0 for a hole.
+    * @return 0 on success, -1 on error.
+ */
+int ext2_map_block(Ext2Volume *volume, const Ext2Inode *inode, uint32_t logical, uint32_t *physical);
+
+/*
+    * @brief Builds the extent map of an inode: its blocks coalesced in physically contiguous runs.
+    * @param volume Volume of the EXT2 file system.
+    * @param inode Inode of the file.
+    * @param extents Pointer where the allocated array of extents is stored (the caller frees it).
+    * @param count Pointer where the number of extents is stored.
+    * @return 0 on success, -1 on error.
+ */
+int ext2_build_extents(Ext2Volume *volume, const Ext2Inode *inode, Ext2Extent **extents, size_t *count);
+
+/*
+    * @brief Returns the size of an inode, with the high 32 bits that revision 1 keeps in dir_acl for regular files.
+    * @param inode Inode of the file.
+ */
+uint64_t ext2_inode_size(const Ext2Inode *inode);
+
+/*
+    * @brief Lists the indirect blocks of the block map of an inode, the ones that hold pointers and no data.
+    * @param volume Volume of the EXT2 file system.
+    * @param inode Inode of the file.
+    * @param blocks Pointer where the allocated array of blocks is stored (the caller frees it).
+    * @param count Pointer where the number of blocks is stored.
+    * @return 0 on success, -1 on error.
+ */
+int ext2_indirect_blocks(Ext2Volume *volume, const Ext2Inode *inode, uint32_t **blocks, size_t *count);
+
+/*
+    * @brief Checks if a block group starts with a copy of the superblock and of the group descriptor table.
+    * @param volume Volume of the EXT2 file system.
+    * @param group Number of the block group.
+    * @return 1 if the group has the copy, 0 otherwise.
+ */
+int ext2_group_has_superblock(const Ext2Volume *volume, uint32_t group);
 
 /*
-    * @brief Reads a directory from the inode.
-    * @param fd File descriptor of the EXT2 file system.
-    * @param superblock Superblock of the EXT2 file system.
-    * @param inode Inode of the directory to read.
-    * @param entries Pointer to the directory entries structure to fill.
+    * @brief Prepares the context of a walk, for the operations in ext2_walk_ops.
+    * @param walk Context to fill.
+    * @param volume Volume of the EXT2 file system.
+    * @param read_inodes 1 to read the inode of every entry, 0 for only the directories.
+    * @return 0 on success, -1 on error.
  */
-int read_ext2_directory(int fd, Ext2Superblock *superblock, Ext2Inode *inode, Ext2DirectoryEntry *entries);
+int ext2_walk_init(Ext2WalkContext *walk, Ext2Volume *volume, int read_inodes);
 
 /*
-    * @brief Displays the contents of a file.
-    * @param fd File descriptor of the EXT2 file system.
-    * @param inode_num Number of the inode to display.
-    * @param superblock Superblock of the EXT2 file system.
-    * @param filename Name of the file to display.
+    * @brief Releases the memory of the context of a walk.
+    * @param walk Context to release.
  */
-int cat_ext2(int fd, uint32_t inode_num, Ext2Superblock *superblock, char* filename, uint32_t current_inode, uint32_t parent_inode);
+void ext2_walk_destroy(Ext2WalkContext *walk);
 
+// Operacions de fs_walk per EXT2; un directori s'obre amb el seu inode (node) o amb el número d'inode (key)
+extern const FsWalkOps ext2_walk_ops;
+
+/*
+    * @brief Walks every directory of the volume, reporting each entry with its full path.
+    * @param volume Volume of the EXT2 file system.
+    * @param callback Function called for every entry, a non-zero result stops the walk.
+    * @param context Pointer passed to the callback.
+    * @return 0 if the whole volume was walked, otherwise the value that stopped the walk.
+ */
+int ext2_walk(Ext2Volume *volume, FsWalkCallback callback, void *context);
+
+/*
+    * @brief Computes the htree hash of a name, as the kernel does to index a directory.
+    * @param volume Volume of the EXT2 file system, for the seed and the signedness of the hash.
+    * @param version Hash version of the index (EXT2_DX_HASH_*).
+    * @param name Name, not NUL terminated.
+    * @param name_len Length of the name.
+    * @return Hash of the name, with the lowest bit clear.
+ */
+uint32_t ext2_dx_hash(const Ext2Volume *volume, uint8_t version, const char *name, size_t name_len);
+
+/*
+    * @brief Looks a name up in a directory: through its htree when it is indexed, otherwise reading all its blocks.
+    * @param volume Volume of the EXT2 file system.
+    * @param directory Inode of the directory.
+    * @param name Name, not NUL terminated.
+    * @param name_len Length of the name.
+    * @param inode_num Pointer where the inode of the entry is stored.
+    * @return 1 if found, 0 if the directory has no entry with that name, -1 on error.
+ */
+int ext2_dir_lookup(Ext2Volume *volume, const Ext2Inode *directory, const char *name, size_t name_len, uint32_t *inode_num);
+
+/*
+    * @brief Resolves an absolute path one component at a time with ext2_dir_lookup.
+    * @param volume Volume of the EXT2 file system.
+    * @param path Absolute path, "/" for the root directory.
+    * @param inode_num Pointer where the inode of the path is stored.
+    * @param inode Pointer where the inode is read.
+    * @return 1 if found, 0 if a component does not exist or is not a directory, -1 on error.
+ */
+int ext2_lookup_path(Ext2Volume *volume, const char *path, uint32_t *inode_num, Ext2Inode *inode);
+
+/*
+    * @brief Searches every directory for the first file with a name, as --cat does without a full path.
+    * @param volume Volume of the EXT2 file system.
+    * @param filename Name of the file.
+    * @param inode_num Pointer where the inode of the file is stored.
+    * @return 1 if found, 0 if not, -1 on error (errno is set).
+ */
+int ext2_find_file(Ext2Volume *volume, const char *filename, uint32_t *inode_num);
+
+
+/*
+    * @brief Shows the tree of the file system walking the directories depth first.
+    * @param volume Volume of the EXT2 file system.
+    * @param render Renderer the lines are written to.
+    * @return 0 on success, -1 if the walk cannot start (errno is set).
+ */
+int dfs_ext2(Ext2Volume *volume, TreeRender *render);
 
 /*
-    * @brief shows the tree representation of the directory structure of the file system.
-    * @param fd File descriptor of the EXT2 file system.
-    * @param inode_num Inode number of the directory to display.
-    * @param superblock Superblock of the EXT2 file system.
-    * @param level Level of the directory in the tree.
+    * @brief Shows the tree of the file system walking the directories with several threads.
+    * @param volume Volume of the EXT2 file system.
+    * @param threads Number of worker threads.
+    * @param render Renderer the lines are written to.
+    * @return 0 on success, -1 if the threads cannot be started (errno is set).
  */
-void dfs_ext2(int fd, uint32_t inode_num, Ext2Superblock *superblock, int level, uint32_t current_inode, uint32_t parent_inode);
\ No newline at end of file
+int dfs_ext2_parallel(Ext2Volume *volume, int threads, TreeRender *render);
@@ -1,21 +1,33 @@
 #include "fat16_reader.h"
+#include "../common/stats.h"
+#include "../common/tree_render.h"
+#include "../common/bitcount.h"
 
-int fat16_recursion_tree_helper(int fd, BootSector bs, int current_sector, int depth, int wasLast, int tree_not_cat, char *file_name);
-void print_directory_tree_entry(unsigned char entry_filename[], int depth, int is_last_entry, int prev_last_entry, int is_directory);
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void print_directory_tree_entry(TreeRender *render, const char *name, int depth, int is_last_entry, int is_directory);
 uint32_t calculate_root_dir_sectors(BootSector bpb);
 void get_filename_processed(unsigned char entry_filename[], char filename[], int is_directory);
-void print_directory_cat_entry(int fd, DirEntry entry, BootSector bs);
 
 /**
  * Checks if the file system is FAT16 by reading the boot sector.
  * 
- * @param fd File descriptor of the file system.
+ * @param image Image of the file system.
  * 
  * @return 1 if the file system is FAT16, 0 otherwise.
 */
-int is_fat16(int fd) {
+int is_fat16(Image *image) {
     BootSector bpb;
-    read_boot_sector(fd, &bpb);
+    StatsPhase previous = stats_phase(STATS_PHASE_PROBE);
+    ssize_t bytes = image_read(image, 0, &bpb, sizeof(BootSector));
+    stats_phase(previous);
+
+    // Too small to hold a boot sector, or values that cannot be a FAT (they would divide by zero)
+    if (bytes != sizeof(BootSector) || bpb.sector_size == 0 || bpb.sectors_per_cluster == 0) {
+        return 0;
+    }
 
     // Determine the count of sectors in the data region of the volume
     uint32_t fat_size = bpb.fat_size_16 != 0 ? bpb.fat_size_16 : bpb.total_sectors_32;
@@ -30,40 +42,18 @@ int is_fat16(int fd) {
 /**
  * Reads the boot sector of the file system. 
  * 
- * @param fd File descriptor of the file system.
+ * @param image Image of the file system.
  * @param bootSector Pointer to the boot sector structure to store the boot sector information.
  * 
- * @return void
+ * @return 0 on success, -1 if the image is too small or cannot be read (errno is set).
 */
-void read_boot_sector(int fd, BootSector *bootSector) {
-    if (lseek(fd, 0, SEEK_SET) < 0) {
-        perror("Error seeking to start of the file");
-        exit(EXIT_FAILURE);
-    }
-
-    if (read(fd, bootSector, sizeof(BootSector)) != sizeof(BootSector)) {
-        perror("Error reading boot sector");
-        exit(EXIT_FAILURE);
+int read_boot_sector(Image *image, BootSector *bootSector) {
+    ssize_t n = image_read(image, 0, bootSector, sizeof(BootSector));
+    if (n != sizeof(BootSector)) {
+        if (n >= 0) errno = EIO; // Image smaller than a boot sector
+        return -1;
     }
-}
-
-/**
- * Prints the boot sector information.
- * 
- * @param bootSector Pointer to the boot sector structure.
- * 
- * @return void
-*/
-void print_boot_sector(const BootSector *bootSector) {
-    printf("Filesystem: FAT16\n\n");
-    printf("System name: %.8s\n", bootSector->oem);
-    printf("Sector size: %u bytes\n", bootSector->sector_size);
-    printf("Sectors per cluster: %u\n", bootSector->sectors_per_cluster);
-    printf("Reserved Sectors: %u\n", bootSector->reserved_sectors);
-    printf("# of FATs: %u\n", bootSector->number_of_fats);
-    printf("Max root entries: %u\n", bootSector->root_dir_entries);
-    printf("Sectors per FAT: %u\n", bootSector->fat_size_16);
-    printf("Label: %.11s\n", bootSector->volume_label);
+    return 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -93,102 +83,560 @@ uint32_t calculate_first_sector_of_cluster(uint16_t cluster, BootSector bs)
     return first_sector_of_cluster;
 }
 
-off_t calculate_dir_entry_offset(uint32_t current_sector, uint16_t idx, const BootSector bs) 
+int fat16_load_table(Image *image, const BootSector *bpb, Fat16Table *table) 
+{
+    size_t fat_bytes = (size_t)bpb->fat_size_16 * bpb->sector_size;
+    uint64_t first_fat_offset = (uint64_t)bpb->reserved_sectors * bpb->sector_size;
+
+    table->entries = malloc(fat_bytes);
+    table->entry_count = fat_bytes / sizeof(uint16_t);
+    table->mismatched_copies = 0;
+    if (table->entries == NULL) {
+        return -1;
+    }
+
+    if (image_read(image, first_fat_offset, table->entries, fat_bytes) != (ssize_t)fat_bytes) {
+        free(table->entries);
+        table->entries = NULL;
+        return -1;
+    }
+
+    // Compare the remaining copies against the first one, one bulk read each
+    void *copy = NULL;
+    for (uint8_t i = 1; i < bpb->number_of_fats; i++) {
+        if (copy == NULL && image->data == NULL && (copy = malloc(fat_bytes)) == NULL) {
+            break;
+        }
+
+        const void *other = image_view(image, first_fat_offset + (uint64_t)i * fat_bytes, fat_bytes, copy);
+        if ((other == NULL || memcmp(other, table->entries, fat_bytes) != 0) && i < 32) {
+            table->mismatched_copies |= 1u << i;
+        }
+    }
+    free(copy);
+
+    return 0;
+}
+
+uint16_t fat16_next_cluster(const Fat16Table *table, uint16_t cluster) 
+{
+    if (cluster >= table->entry_count) {
+        return FAT16_END_OF_CHAIN;
+    }
+    return table->entries[cluster];
+}
+
+uint32_t fat16_data_clusters(const BootSector *bpb) 
 {
-    return current_sector * bs.sector_size + idx * sizeof(DirEntry);
+    uint32_t total_sectors = bpb->total_sectors_16 != 0 ? bpb->total_sectors_16 : bpb->total_sectors_32;
+    uint32_t first_data_sector = calculate_first_data_sector(*bpb, calculate_root_dir_sectors(*bpb));
+    return (total_sectors - first_data_sector) / bpb->sectors_per_cluster;
 }
 
-int is_last_active_entry(int fd, uint32_t current_sector, uint16_t idx, BootSector bs) 
+uint32_t fat16_count_free_clusters(const Fat16Volume *volume) 
 {
-    off_t start_offset = calculate_dir_entry_offset(current_sector, idx + 1, bs);
-    DirEntry next_entry;
+    uint32_t cluster_count = fat16_data_clusters(&volume->boot_sector);
 
-    for (uint16_t i = idx + 1; i < bs.sector_size / sizeof(DirEntry); i++, start_offset += sizeof(DirEntry)) {
-        if (lseek(fd, start_offset, SEEK_SET) == -1 || read(fd, &next_entry, sizeof(DirEntry)) != sizeof(DirEntry)) {
-            perror("Error reading directory entry");
-            exit(EXIT_FAILURE);
-        }
-        
-        // Si se encuentra otra entrada válida, no es la última
-        if (next_entry.filename[0] != DIR_ENTRY_FREE && next_entry.filename[0] != DIR_ENTRY_EMPTY) {
-            return 0; 
+    // Las entradas 0 y 1 están reservadas; una FAT más corta que el volumen solo cuenta sus entradas
+    if (volume->fat.entry_count <= 2) {
+        return 0;
+    }
+    if (cluster_count > volume->fat.entry_count - 2) {
+        cluster_count = volume->fat.entry_count - 2;
+    }
+    return (uint32_t)bitcount_zero_words(volume->fat.entries + 2, cluster_count);
+}
+
+int fat16_chain_extents(const Fat16Table *table, uint16_t start_cluster, Fat16Extent **extents, size_t *count) 
+{
+    size_t capacity = 8;
+    size_t used = 0;
+    Fat16Extent *list = malloc(capacity * sizeof(Fat16Extent));
+    if (list == NULL) {
+        return -1;
+    }
+
+    uint16_t cluster = start_cluster;
+    // A chain cannot be longer than the FAT itself, this also stops on corrupted (cyclic) chains
+    for (uint32_t hops = 0; cluster >= 2 && cluster < FAT16_BAD_CLUSTER && hops < table->entry_count; hops++) {
+        if (used > 0 && list[used - 1].start_cluster + list[used - 1].length == cluster) {
+            list[used - 1].length++;
+        } else {
+            if (used == capacity) {
+                Fat16Extent *bigger = realloc(list, capacity * 2 * sizeof(Fat16Extent));
+                if (bigger == NULL) {
+                    free(list);
+                    return -1;
+                }
+                list = bigger;
+                capacity *= 2;
+            }
+            list[used].start_cluster = cluster;
+            list[used].length = 1;
+            used++;
         }
+        cluster = fat16_next_cluster(table, cluster);
     }
 
-    return 1; 
+    *extents = list;
+    *count = used;
+    return 0;
 }
 
-uint16_t read_fat_entry(int fd, BootSector bpb, uint16_t cluster) 
+int fat16_open_volume(Image *image, Fat16Volume *volume) 
 {
-    off_t fat_offset = bpb.reserved_sectors * bpb.sector_size + cluster * 2;
-    uint16_t next_cluster;
+    volume->image = image;
+    volume->walk_error = 0;
+    if (read_boot_sector(image, &volume->boot_sector) != 0) {
+        return -1;
+    }
+    if (fat16_load_table(image, &volume->boot_sector, &volume->fat) != 0) {
+        return -1;
+    }
+    if (io_engine_init(&volume->io, image) != 0) {
+        fat16_close_volume(volume);
+        return -1;
+    }
+    return 0;
+}
+
+void fat16_close_volume(Fat16Volume *volume) 
+{
+    io_engine_destroy(&volume->io);
+    free(volume->fat.entries);
+    volume->fat.entries = NULL;
+}
+
+// Máscaras de un grupo de hasta 64 entradas de un directorio, el bit i es la entrada i
+typedef struct {
+    uint64_t end;           // Empty entries, the directory ends at the first one
+    uint64_t keep;          // Entries that go to the window
+} Fat16EntryMasks;
 
-    if (lseek(fd, fat_offset, SEEK_SET) == -1 || read(fd, &next_cluster, sizeof(uint16_t)) != sizeof(uint16_t)) {
-        perror("Error reading FAT entry");
-        exit(EXIT_FAILURE);
+int fat16_walk_init(Fat16WalkContext *walk, Fat16Volume *volume, int tree) 
+{
+    const BootSector *bpb = &volume->boot_sector;
+
+    size_t cluster_size = (size_t)bpb->sectors_per_cluster * bpb->sector_size;
+
+    walk->volume = volume;
+    walk->tree = tree;
+    walk->filter = NULL;
+    walk->cluster = NULL;
+    walk->requests = NULL;
+    walk->batch_clusters = cluster_size == 0 || cluster_size >= FS_WALK_BATCH_SIZE ? 1 : FS_WALK_BATCH_SIZE / cluster_size;
+    walk->cluster = malloc(walk->batch_clusters * cluster_size);
+    walk->requests = malloc(walk->batch_clusters * sizeof(IoRequest));
+    if (walk->cluster == NULL || walk->requests == NULL) {
+        fat16_walk_destroy(walk);
+        return -1;
     }
+    return 0;
+}
 
-    return next_cluster;
+void fat16_walk_destroy(Fat16WalkContext *walk) 
+{
+    free(walk->cluster);
+    free(walk->requests);
+    walk->cluster = NULL;
+    walk->requests = NULL;
 }
 
-void fat16_recursion_tree(int fd, const BootSector bpb, int tree_not_cat, char *filename_to_find) 
+// Opens a directory for the walk, the root directory when directory is NULL. Implements FsWalkOps.open
+static int fat16_dir_open(void *fs, const FsWalkItem *directory, void *cursor) 
 {
-    int first_root_dir_sector_number = calculate_first_root_dir_sector_number(bpb);
-    uint32_t root_dir_sectors = calculate_root_dir_sectors(bpb);
-    
-    for (uint32_t i = 0; i < root_dir_sectors; i++) {
-        if (fat16_recursion_tree_helper(fd, bpb, first_root_dir_sector_number + i, 0, 0, tree_not_cat, filename_to_find)) {
-            return;
-        }
+    Fat16WalkContext *walk = fs;
+    Fat16DirCursor *dir = cursor;
+    const BootSector bpb = walk->volume->boot_sector;
+
+    memset(dir, 0, sizeof(Fat16DirCursor));
+    if (directory != NULL) {
+        dir->cluster = directory->key;
+    } else {
+        dir->root_offset = (uint64_t)calculate_first_root_dir_sector_number(bpb) * bpb.sector_size;
+        dir->root_left = (uint64_t)calculate_root_dir_sectors(bpb) * bpb.sector_size;
     }
-    printf("File not found.\n");
+    return 0;
 }
 
-int fat16_recursion_tree_helper(int fd, BootSector bpb, int current_sector, int lvl, int prev_last_entry, int tree_not_cat, char *file_name) 
+// Prepares the name searched by --cat. get_filename_processed turns "FILE    TXT" into "file.txt",
+// so the raw form is the name in upper case split at the dot and padded with spaces
+static void fat16_name_filter_init(Fat16NameFilter *filter, const char *filename) 
 {
-  for (size_t i = 0; i < (bpb.sector_size / sizeof(DirEntry)); i++) 
-  {
-    DirEntry entry;
-    off_t offset = calculate_dir_entry_offset(current_sector, i, bpb);
+    const char *dot = strchr(filename, '.');
+    size_t base_len = dot != NULL ? (size_t)(dot - filename) : strlen(filename);
+    size_t ext_len = dot != NULL ? strlen(dot + 1) : 0;
+
+    memset(filter->raw, SPACE_PAD, sizeof(filter->raw));
+    filter->valid = base_len <= 8 && ext_len <= 3 && (dot == NULL || (ext_len > 0 && strchr(dot + 1, '.') == NULL)) &&
+                    (unsigned char)filename[0] != DIR_ENTRY_FREE;
+    for (const char *c = filename; filter->valid && *c != '\0'; c++) {
+        // Processed names are lower case and never have spaces or '~'
+        if (*c == SPACE_PAD || *c == '~' || isupper((unsigned char)*c)) filter->valid = 0;
+    }
+    if (filter->valid) {
+        for (size_t i = 0; i < base_len; i++) filter->raw[i] = toupper((unsigned char)filename[i]);
+        for (size_t i = 0; i < ext_len; i++) filter->raw[8 + i] = toupper((unsigned char)dot[1 + i]);
+    }
+}
 
-    lseek(fd, offset, SEEK_SET);
-    read(fd, &entry, sizeof(DirEntry));
+// 1 if the spaces of a part of the name, given as a mask of width bits, are all at its end
+static inline int fat16_spaces_trailing(unsigned spaces, unsigned width) 
+{
+    unsigned used = ~spaces & ((1u << width) - 1);
+    return (used & (used + 1)) == 0;
+}
 
-    // skip "." + ".." + "deleted" / "empty" entries
-    if (entry.filename[0] == CURRENT_DIR_ENTRY || entry.filename[0] == DIR_ENTRY_FREE || entry.filename[0] == DIR_ENTRY_EMPTY) {
-        continue;
+// Checks if an entry can be the file searched. Names in canonical form (no '~' or '.', spaces only at the end of
+// the name and of the extension) are compared raw against the name searched, the rest are left to the strcmp of
+// the processed name. Returns 1 if the entry is a candidate
+static inline int fat16_name_candidate(const DirEntry *entry, const Fat16NameFilter *filter) 
+{
+    const uint8_t *raw = (const uint8_t *)entry->filename;
+    unsigned equal = 0, spaces = 0, odd = 0;
+
+#if defined(__SSE2__)
+    // The 11 bytes of the name are compared at once; the entry is 32 bytes so the 16 byte load stays inside it
+    __m128i name = _mm_loadu_si128((const __m128i *)raw);
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(name, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(name, _mm_set1_epi8('z' + 1)));
+    __m128i folded = _mm_sub_epi8(name, _mm_and_si128(lower, _mm_set1_epi8(0x20)));
+    equal = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(folded, _mm_loadu_si128((const __m128i *)filter->raw)));
+    spaces = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(name, _mm_set1_epi8(SPACE_PAD)));
+    odd = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(name, _mm_set1_epi8('~')), _mm_cmpeq_epi8(name, _mm_set1_epi8('.'))));
+#else
+    for (unsigned i = 0; i < 11; i++) {
+        equal |= (unsigned)(toupper(raw[i]) == filter->raw[i]) << i;
+        spaces |= (unsigned)(raw[i] == SPACE_PAD) << i;
+        odd |= (unsigned)(raw[i] == '~' || raw[i] == '.') << i;
     }
-    
-    int is_last_entry = is_last_active_entry(fd, current_sector, i, bpb);
-    if (entry.attributes == ATTR_DIRECTORY) 
-    {
-        if (tree_not_cat) {
-            print_directory_tree_entry(entry.filename, lvl, is_last_entry, prev_last_entry, 1);
-        }
-        
-        uint16_t current_cluster = entry.startCluster;
-        while (current_cluster < 0xFFF8) { // 0xFFF8 is the end-of-cluster-chain marker for FAT16
-            uint32_t first_sector_of_cluster = calculate_first_sector_of_cluster(current_cluster, bpb);
-            fat16_recursion_tree_helper(fd, bpb, first_sector_of_cluster, lvl + 1, is_last_entry, tree_not_cat, file_name);
-            current_cluster = read_fat_entry(fd, bpb, current_cluster);
+#endif
+
+    int canonical = (odd & 0x7FF) == 0 && raw[0] != KANJI_SPECIAL_CASE &&
+                    fat16_spaces_trailing(spaces & 0xFF, 8) && fat16_spaces_trailing((spaces >> 8) & 0x7, 3);
+    return !canonical || (filter->valid && (equal & 0x7FF) == 0x7FF);
+}
+
+// Classifies up to 64 entries with no branches on their contents, so only the entries
+// kept have their name processed
+static void fat16_classify_entries(const Fat16WalkContext *walk, const DirEntry *entries, size_t count, Fat16EntryMasks *masks) 
+{
+    masks->end = 0;
+    masks->keep = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t first = (uint8_t)entries[i].filename[0];
+        uint8_t attributes = entries[i].attributes;
+
+        // "." and ".." and deleted entries are skipped. The tree only shows directories and archives;
+        // the walk skips volume labels and long names
+        uint64_t live = first != DIR_ENTRY_EMPTY && first != CURRENT_DIR_ENTRY && first != DIR_ENTRY_FREE;
+        uint64_t shown = walk->tree ? attributes == ATTR_DIRECTORY || attributes == ATTR_ARCHIVE
+                                    : (attributes & ATTR_VOLUME_ID) == 0;
+        masks->end |= (uint64_t)(first == DIR_ENTRY_EMPTY) << i;
+        masks->keep |= (live & shown) << i;
+    }
+
+    // Searching a file, the directories are kept to go into them and the files only if they can match
+    if (walk->filter != NULL) {
+        uint64_t keep = masks->keep;
+        while (keep != 0) {
+            size_t i = (size_t)__builtin_ctzll(keep);
+            keep &= keep - 1;
+            if (!(entries[i].attributes & ATTR_DIRECTORY) && !fat16_name_candidate(&entries[i], walk->filter)) {
+                masks->keep &= ~(1ull << i);
+            }
         }
-    } 
-    else if (entry.attributes == ATTR_ARCHIVE) 
+    }
+
+    // Nothing after the first empty entry belongs to the directory
+    if (masks->end != 0) {
+        masks->keep &= (masks->end & -masks->end) - 1;
+    }
+}
+
+// Adds to the window the entries of a cluster of a directory, up to the first empty entry
+static int fat16_dir_add_cluster(Fat16WalkContext *walk, Fat16DirCursor *dir, const DirEntry *entries, size_t count, FsWalkWindow *window) 
+{
+    for (size_t base = 0; base < count && !dir->ended; base += 64) 
     {
-        if (tree_not_cat) {
-            print_directory_tree_entry(entry.filename, lvl, is_last_entry, prev_last_entry, 0);
+        Fat16EntryMasks masks;
+        fat16_classify_entries(walk, entries + base, count - base < 64 ? count - base : 64, &masks);
+        dir->ended = masks.end != 0; // No more entries in this directory
+
+        for (uint64_t keep = masks.keep; keep != 0; keep &= keep - 1) {
+            const DirEntry *entry = &entries[base + (size_t)__builtin_ctzll(keep)];
+
+            char name[20];
+            get_filename_processed((unsigned char *)entry->filename, name, 0);
+            if (name[0] == '\0') continue;
+
+            FsWalkItem item = { 0 };
+            item.key = entry->startCluster;
+            item.size = entry->fileSize;
+            item.is_directory = (entry->attributes & ATTR_DIRECTORY) != 0;
+            item.explore = item.is_directory && entry->startCluster >= 2;
+            if (fs_walk_window_add(window, name, strlen(name), &item) == NULL) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Reads the next clusters of a directory (cluster sized pieces of the root region) with one batch and
+// adds their entries to the window. Implements FsWalkOps.read_block
+static int fat16_dir_read_block(void *fs, void *cursor, FsWalkWindow *window) 
+{
+    Fat16WalkContext *walk = fs;
+    Fat16DirCursor *dir = cursor;
+    const BootSector bpb = walk->volume->boot_sector;
+    uint64_t cluster_size = (uint64_t)bpb.sectors_per_cluster * bpb.sector_size;
+    uint64_t offsets[walk->batch_clusters], lengths[walk->batch_clusters];
+    uint16_t next[walk->batch_clusters];
+    const DirEntry *views[walk->batch_clusters];
+    uint32_t count = 0;
+
+    if (dir->ended) {
+        return 0;
+    }
+
+    // The pieces of the batch are chosen without moving the cursor, that only passes the ones read
+    uint64_t root_offset = dir->root_offset, root_left = dir->root_left;
+    uint16_t cluster = dir->cluster;
+    while (count < walk->batch_clusters) {
+        if (dir->cluster == 0) {
+            if (root_left == 0) break;
+            lengths[count] = root_left < cluster_size ? root_left : cluster_size;
+            offsets[count] = root_offset;
+            root_offset += lengths[count];
+            root_left -= lengths[count];
         } else {
-            char filename_processed[20];
-            get_filename_processed(entry.filename, filename_processed, 0);
+            // This also stops on corrupted (cyclic) chains
+            if (cluster < 2 || cluster >= FAT16_BAD_CLUSTER || dir->hops + count >= walk->volume->fat.entry_count) break;
+            lengths[count] = cluster_size;
+            offsets[count] = (uint64_t)calculate_first_sector_of_cluster(cluster, bpb) * bpb.sector_size;
+            cluster = fat16_next_cluster(&walk->volume->fat, cluster);
+        }
+        next[count++] = cluster;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    // Every piece goes in one batch of the I/O engine, which hints the kernel before copying from a mapped image
+    for (uint32_t i = 0; i < count; i++) {
+        walk->requests[i].offset = offsets[i];
+        walk->requests[i].length = lengths[i];
+        walk->requests[i].buffer = walk->cluster + i * cluster_size;
+    }
+    io_engine_read_batch(&walk->volume->io, walk->requests, count, NULL, NULL);
+    for (uint32_t i = 0; i < count; i++) {
+        views[i] = walk->requests[i].result == (ssize_t)lengths[i] ? walk->requests[i].buffer : NULL;
+    }
+
+    // The pieces go to the window in order up to the first one that could not be read
+    uint32_t added = 0;
+    for (; added < count && !dir->ended && views[added] != NULL; added++) {
+        if (fat16_dir_add_cluster(walk, dir, views[added], lengths[added] / sizeof(DirEntry), window) != 0) {
+            return -1;
+        }
+    }
+    if (added == 0) {
+        if (walk->requests[0].result >= 0) errno = EIO; // Cluster past the end of the image
+
+        // The threads of the parallel tree share the volume, the first error is kept
+        int none = 0;
+        __atomic_compare_exchange_n(&walk->volume->walk_error, &none, errno, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        return -1;
+    }
+    if (dir->cluster == 0) {
+        for (uint32_t i = 0; i < added; i++) {
+            dir->root_offset += lengths[i];
+            dir->root_left -= lengths[i];
+        }
+    } else {
+        dir->cluster = next[added - 1];
+        dir->hops += added;
+    }
+    return 1;
+}
+
+const FsWalkOps fat16_walk_ops = { sizeof(Fat16DirCursor), fat16_dir_open, fat16_dir_read_block };
+
+// Walks the volume with the fs_walk engine; tree chooses the entries of the tree or every entry,
+// filter (NULL for none) leaves out the files that cannot be the one searched
+static int fat16_walk_volume(Fat16Volume *volume, int tree, const Fat16NameFilter *filter, FsWalkCallback callback, void *context) 
+{
+    Fat16WalkContext walk;
+
+    if (fat16_walk_init(&walk, volume, tree) != 0) {
+        return -1;
+    }
+    walk.filter = filter;
+    int result = fs_walk_run(&fat16_walk_ops, &walk, callback, context);
+    fat16_walk_destroy(&walk);
+    return result;
+}
+
+static int fat16_tree_entry(const FsWalkEntry *entry, void *context) 
+{
+    TreeRender *render = context;
+    print_directory_tree_entry(render, entry->name, entry->depth, entry->is_last, entry->is_directory);
+    return 0;
+}
+
+// File searched by name by --cat
+typedef struct {
+    const char *filename;
+    uint16_t start_cluster;
+    uint32_t size;
+} Fat16CatSearch;
+
+static int fat16_cat_entry(const FsWalkEntry *entry, void *context) 
+{
+    Fat16CatSearch *search = context;
+
+    if (entry->is_directory || strcmp(entry->name, search->filename) != 0) {
+        return 0;
+    }
+    search->start_cluster = entry->key;
+    search->size = entry->size;
+    return 1;
+}
+
+int fat16_recursion_tree(Fat16Volume *volume, TreeRender *render) 
+{
+    return fat16_walk_volume(volume, 1, NULL, fat16_tree_entry, render);
+}
+
+int fat16_find_file(Fat16Volume *volume, const char *filename, uint16_t *start_cluster, uint32_t *size) 
+{
+    Fat16CatSearch search = { filename, 0, 0 };
+    Fat16NameFilter filter;
+
+    fat16_name_filter_init(&filter, filename);
+    int result = fat16_walk_volume(volume, 1, &filter, fat16_cat_entry, &search);
+    if (result != 1) {
+        return result == 0 ? 0 : -1;
+    }
+    *start_cluster = search.start_cluster;
+    *size = search.size;
+    return 1;
+}
 
-            if (!strcmp(file_name, (char *)filename_processed)) {
-                print_directory_cat_entry(fd, entry, bpb);
-                return 1;
+// Lists the entries of a directory that the tree shows: directories and archives.
+// The directory is read one cluster at a time; the last entry listed is the last one
+// of the directory, whatever cluster it is in
+int fat16_list_directory(Fat16Volume *volume, uint16_t start_cluster, DirListing *listing) 
+{
+    Fat16WalkContext walk;
+    Fat16DirCursor dir;
+    FsWalkWindow window = { 0 };
+    FsWalkItem directory = { 0 };
+    int failed = 0;
+
+    if (fat16_walk_init(&walk, volume, 1) != 0) {
+        return -1;
+    }
+    directory.key = start_cluster;
+    fat16_dir_open(&walk, start_cluster != 0 ? &directory : NULL, &dir);
+
+    while (!failed && fat16_dir_read_block(&walk, &dir, &window) == 1) {
+        for (size_t i = 0; i < window.count; i++) {
+            const FsWalkItem *item = &window.items[i];
+
+            DirListingEntry entry = { 0 };
+            entry.key = item->key;
+            entry.size = item->size;
+            entry.is_directory = item->is_directory;
+            entry.printed = 1;
+            entry.explore = item->explore;
+            if (dir_listing_add(listing, item->name, item->name_len, &entry) != 0) {
+                failed = 1;
+                break;
             }
         }
+        fs_walk_window_reset(&window);
+    }
+
+    if (listing->count > 0) {
+        listing->entries[listing->count - 1].is_last = 1;
+    }
+    fs_walk_window_free(&window);
+    fat16_walk_destroy(&walk);
+    return failed ? -1 : 0;
+}
+
+// Task of the parallel tree: lists one directory and submits a task per subdirectory
+typedef struct {
+    Fat16Volume *volume;
+    DirListing *listing;
+    uint16_t start_cluster;   // 0 for the root directory
+} Fat16TreeTask;
+
+static void fat16_tree_task(ThreadPool *pool, void *arg) 
+{
+    Fat16TreeTask *task = arg;
+    int failed = fat16_list_directory(task->volume, task->start_cluster, task->listing) != 0;
+
+    for (size_t i = 0; i < task->listing->count && !failed; i++) {
+        DirListingEntry *entry = &task->listing->entries[i];
+        if (!entry->explore) continue;
+
+        // Every subdirectory gets its own listing, so the workers share nothing
+        Fat16TreeTask *child = malloc(sizeof(Fat16TreeTask));
+        entry->child = calloc(1, sizeof(DirListing));
+        if (child == NULL || entry->child == NULL) {
+            free(child);
+            continue;
+        }
+        child->volume = task->volume;
+        child->listing = entry->child;
+        child->start_cluster = entry->key;
+        if (thread_pool_submit(pool, fat16_tree_task, child) != 0) {
+            free(child);
+        }
+    }
+
+    free(task);
+}
+
+static void fat16_print_listing(TreeRender *render, const DirListing *listing, int lvl) 
+{
+    for (size_t i = 0; i < listing->count; i++) {
+        const DirListingEntry *entry = &listing->entries[i];
+
+        print_directory_tree_entry(render, entry->name, lvl, entry->is_last, entry->is_directory);
+        if (entry->child != NULL) {
+            fat16_print_listing(render, entry->child, lvl + 1);
+        }
     }
-  }
-  return 0;
+}
+
+int fat16_tree_parallel(Fat16Volume *volume, int threads, TreeRender *render) 
+{
+    ThreadPool pool;
+    DirListing root = { 0 };
+
+    Fat16TreeTask *task = malloc(sizeof(Fat16TreeTask));
+    if (task == NULL || thread_pool_init(&pool, threads) != 0) {
+        free(task);
+        return -1;
+    }
+    task->volume = volume;
+    task->listing = &root;
+    task->start_cluster = 0;
+
+    // The workers only read; the output is printed at the end, in the sequential order
+    if (thread_pool_submit(&pool, fat16_tree_task, task) != 0) {
+        free(task);
+    }
+    thread_pool_wait(&pool);
+    thread_pool_destroy(&pool);
+
+    fat16_print_listing(render, &root, 0);
+    dir_listing_free(&root);
+    return 0;
 }
 
 void get_filename_processed(unsigned char entry_filename[], char filename[], int is_directory)
@@ -218,46 +666,17 @@ void get_filename_processed(unsigned char entry_filename[], char filename[], int
     filename[cont] = '\0';
 }
 
-void print_directory_tree_entry(unsigned char entry_filename[], int depth, int is_last_entry, int prev_last_entry, int is_directory)
+void print_directory_tree_entry(TreeRender *render, const char *name, int depth, int is_last_entry, int is_directory)
 {
-    char filename[20]; // 8 + '.' + 3 + '\0'
+    char filename[20]; // '[' + 8 + '.' + 3 + ']' + '\0'
 
-    get_filename_processed(entry_filename, filename, is_directory);
+    snprintf(filename, sizeof(filename), is_directory ? "[%s]" : "%s", name);
 
-    // Imprimir la indentación basada en la profundidad
-    for (int i = 0; i < depth; i++) {
-        printf(i == 0 && depth > 1 ? "│   " : (prev_last_entry ? "    " : "│   "));
-    }
-    
-    if (is_directory) {
-        printf(is_last_entry ? "└──" ANSI_COLOR_YELLOW "%s" ANSI_COLOR_RESET "\n" : "├──" ANSI_COLOR_YELLOW "%s" ANSI_COLOR_RESET "\n", filename);
-    } else {
-        printf(is_last_entry ? "└── %s\n" : "├── %s\n", filename);
-    }
+    // La indentación de cada nivel la lleva el renderizador
+    tree_render_line(render, depth, filename, is_last_entry, is_directory);
 }
 
-void print_directory_cat_entry(int fd, DirEntry entry, BootSector bpb)
+int fat16_walk(Fat16Volume *volume, FsWalkCallback callback, void *context)
 {
-    uint16_t current_cluster = entry.startCluster;
-    int file_size = entry.fileSize;
-    int bytes_read = 0;
-
-    while (bytes_read < file_size && current_cluster < 0xFFF8) {
-        uint32_t first_sector_of_cluster = calculate_first_sector_of_cluster(current_cluster, bpb);
-        
-        for (int i = 0; i < bpb.sectors_per_cluster && bytes_read < file_size; i++) {
-            int bytes_to_read = bpb.sector_size;
-            bytes_to_read = bytes_read + bytes_to_read > file_size ? file_size - bytes_read : bytes_to_read;
-
-            char buffer[bytes_to_read];
-            lseek(fd, (first_sector_of_cluster + i) * bpb.sector_size, SEEK_SET);
-            read(fd, buffer, bytes_to_read);
-
-            printf("%.*s", bytes_to_read, buffer);
-
-            bytes_read += bytes_to_read;
-        }
-
-        current_cluster = read_fat_entry(fd, bpb, current_cluster);
-    }
-}
\ No newline at end of file
+    return fat16_walk_volume(volume, 0, NULL, callback, context);
+}
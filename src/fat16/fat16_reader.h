@@ -2,6 +2,7 @@
 #define _FAT16_READER_H
 
 #include <stdio.h>
+#include <errno.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -11,6 +12,14 @@
 #include <ctype.h>
 #include <sys/types.h>
 
+#include "../common/image.h"
+#include "../common/output.h"
+#include "../common/dir_listing.h"
+#include "../common/thread_pool.h"
+#include "../common/fs_walk.h"
+#include "../common/io_engine.h"
+#include "../common/tree_render.h"
+
 // Marcadores de inicio y final de nombre de archivo 
 #define DIR_ENTRY_FREE   0xE5
 #define DIR_ENTRY_EMPTY  0x00
@@ -35,10 +44,6 @@
 #define ATTR_DIRECTORY 0x10
 #define ATTR_ARCHIVE 0x20
 
-// Colores
-#define ANSI_COLOR_YELLOW   "\x1b[33m"
-#define ANSI_COLOR_RESET    "\x1b[0m"
-
 
 // Estructura para el sector de arranque
 typedef struct {
@@ -84,32 +89,214 @@ typedef struct {
     unsigned int fileSize;
 } __attribute__((packed)) DirEntry;
 
+// Valores especiales de las entradas de la FAT
+#define FAT16_BAD_CLUSTER 0xFFF7
+#define FAT16_END_OF_CHAIN 0xFFF8
+
+// Tabla FAT cargada en memoria
+typedef struct {
+    uint16_t *entries;      // Entries of the first FAT
+    uint32_t entry_count;   // Number of entries in one FAT copy
+    uint32_t mismatched_copies; // Bit i is set when copy i + 1 (2 to 32) differs from the first one
+} Fat16Table;
+
+// Tramo de clusters consecutivos de una cadena
+typedef struct {
+    uint16_t start_cluster;
+    uint32_t length;        // Number of consecutive clusters
+} Fat16Extent;
+
+// Volumen FAT16 abierto, con el sector de arranque y la FAT ya leídos
+typedef struct {
+    Image *image;
+    BootSector boot_sector;
+    Fat16Table fat;
+    IoEngine io;            // Batched reads of the clusters of a directory
+    int walk_error;         // errno of the first directory a walk could not read completely, 0 if none
+} Fat16Volume;
+
+// Nombre que busca --cat en la forma en que se guarda en una entrada: 8 + 3 caracteres en mayúsculas rellenos con espacios
+typedef struct {
+    uint8_t raw[16];        // Only the first 11 bytes are compared
+    int valid;              // 0 if no name in that form turns into the name searched
+} Fat16NameFilter;
+
+// Recorrido de un volumen: el contexto que reciben las operaciones del motor de fs_walk
+typedef struct {
+    Fat16Volume *volume;
+    int tree;               // 1: only the entries the tree shows, directories and archives
+    const Fat16NameFilter *filter; // Files that can be the one searched, NULL for every file
+    uint32_t batch_clusters; // Clusters of a directory read with one batch
+    uint8_t *cluster;       // Copy of the clusters of a batch
+    IoRequest *requests;    // Reads of a batch
+} Fat16WalkContext;
+
+// Directorio abierto: la parte de la región raíz o el cluster que se lee a continuación
+typedef struct {
+    uint16_t cluster;       // Next cluster of the chain, 0 for the root directory
+    uint32_t hops;          // Clusters read, a chain cannot be longer than the FAT
+    uint64_t root_offset;   // Next byte of the root directory region
+    uint64_t root_left;     // Bytes of the root directory region still to read
+    int ended;              // An empty entry marks the end of the directory
+} Fat16DirCursor;
+
 /**
  * Checks if the file system is FAT16 by reading the boot sector.
  * 
- * @param fd File descriptor of the file system.
+ * @param image Image of the file system.
  * 
  * @return 1 if the file system is FAT16, 0 otherwise.
 */
-int is_fat16(int fd);
+int is_fat16(Image *image);
 
 /**
  * Reads the boot sector of the file system. 
  * 
- * @param fd File descriptor of the file system.
+ * @param image Image of the file system.
  * @param bootSector Pointer to the boot sector structure to store the boot sector information.
  * 
+ * @return 0 on success, -1 if the image is too small or cannot be read (errno is set).
+*/
+int read_boot_sector(Image *image, BootSector *bootSector);
+
+/**
+ * Opens a FAT16 volume: reads the boot sector, loads the FAT in memory and prepares the I/O engine.
+ * 
+ * @param image Image of the file system.
+ * @param volume Volume structure to fill.
+ * 
+ * @return 0 on success, -1 if the FAT cannot be loaded.
+*/
+int fat16_open_volume(Image *image, Fat16Volume *volume);
+
+/**
+ * Releases the memory held by a FAT16 volume.
+ * 
+ * @param volume Volume to close.
+ * 
  * @return void
 */
-void read_boot_sector(int fd, BootSector *bootSector);
+void fat16_close_volume(Fat16Volume *volume);
+
+/**
+ * Loads the FAT in memory with one bulk read per copy and checks the copies against each other.
+ * The copies that differ are kept in mismatched_copies for the caller to report.
+ * 
+ * @param image Image of the file system.
+ * @param bpb Boot sector of the file system.
+ * @param table Table structure to fill.
+ * 
+ * @return 0 on success, -1 on error.
+*/
+int fat16_load_table(Image *image, const BootSector *bpb, Fat16Table *table);
+
+/**
+ * Returns the FAT entry of a cluster, that is the next cluster of its chain.
+ * 
+ * @param table FAT loaded in memory.
+ * @param cluster Cluster to look up.
+ * 
+ * @return Next cluster, or FAT16_END_OF_CHAIN if the cluster is out of the FAT.
+*/
+uint16_t fat16_next_cluster(const Fat16Table *table, uint16_t cluster);
+
+/**
+ * Returns the first sector of a data cluster.
+ * 
+ * @param cluster Cluster number, 2 or more.
+ * @param bs Boot sector of the file system.
+ * 
+ * @return Sector number from the start of the volume.
+*/
+uint32_t calculate_first_sector_of_cluster(uint16_t cluster, BootSector bs);
+
+/**
+ * Returns the number of clusters of the data region.
+ * 
+ * @param bpb Boot sector of the file system.
+ * 
+ * @return Number of data clusters.
+*/
+uint32_t fat16_data_clusters(const BootSector *bpb);
+
+/**
+ * Counts the free clusters of the data region: the entries of the FAT that are zero.
+ * 
+ * @param volume Open FAT16 volume.
+ * 
+ * @return Number of free clusters.
+*/
+uint32_t fat16_count_free_clusters(const Fat16Volume *volume);
+
+/**
+ * Turns a cluster chain into runs of consecutive clusters.
+ * 
+ * @param table FAT loaded in memory.
+ * @param start_cluster First cluster of the chain.
+ * @param extents Pointer where the allocated array of extents is stored (the caller frees it).
+ * @param count Pointer where the number of extents is stored.
+ * 
+ * @return 0 on success, -1 on error (out of memory).
+*/
+int fat16_chain_extents(const Fat16Table *table, uint16_t start_cluster, Fat16Extent **extents, size_t *count);
+
+/**
+ * Prints the tree of the volume walking the directories with several threads.
+ * The output is the same as the one of fat16_recursion_tree.
+ * 
+ * @param volume Volume of the file system.
+ * @param threads Number of worker threads.
+ * @param render Renderer the lines are written to.
+ * 
+ * @return 0 on success, -1 if the threads cannot be started (errno is set).
+*/
+int fat16_tree_parallel(Fat16Volume *volume, int threads, TreeRender *render);
+
+/**
+ * Prepares the context of a walk, for the operations in fat16_walk_ops.
+ * 
+ * @param walk Context to fill; its filter starts as NULL.
+ * @param volume Open FAT16 volume.
+ * @param tree 1 for only the entries the tree shows (directories and archives), 0 for every entry.
+ * 
+ * @return 0 on success, -1 on error (out of memory).
+*/
+int fat16_walk_init(Fat16WalkContext *walk, Fat16Volume *volume, int tree);
 
 /**
- * Prints the boot sector information.
+ * Releases the memory of the context of a walk.
  * 
- * @param bootSector Pointer to the boot sector structure.
+ * @param walk Context to release.
  * 
  * @return void
 */
-void print_boot_sector(const BootSector *bootSector);
+void fat16_walk_destroy(Fat16WalkContext *walk);
+
+// Operaciones de fs_walk para FAT16; el directorio se abre con la clave (cluster inicial) de su entrada
+extern const FsWalkOps fat16_walk_ops;
+
+/**
+ * Walks every directory of the volume, reporting each entry with its full path.
+ * Names are reported the way --cat expects them: lower case 8.3 names.
+ * 
+ * @param volume Volume of the file system.
+ * @param callback Function called for every entry, a non-zero result stops the walk.
+ * @param context Pointer passed to the callback.
+ * 
+ * @return 0 if the whole volume was walked, otherwise the value that stopped the walk.
+*/
+int fat16_walk(Fat16Volume *volume, FsWalkCallback callback, void *context);
+
+/**
+ * Searches every directory for the first file with a name, as --cat does without a full path.
+ * 
+ * @param volume Volume of the file system.
+ * @param filename Lower case 8.3 name of the file.
+ * @param start_cluster Pointer where the first cluster of the file is stored.
+ * @param size Pointer where the size of the file is stored.
+ * 
+ * @return 1 if found, 0 if not, -1 on error (errno is set).
+*/
+int fat16_find_file(Fat16Volume *volume, const char *filename, uint16_t *start_cluster, uint32_t *size);
 
 #endif // !_FAT16_READER_H
\ No newline at end of file
@@ -0,0 +1,727 @@
+#include "fsutils.h"
+#include "../common/image.h"
+#include "../common/output.h"
+#include "../common/tree.h"
+#include "../common/tree_render.h"
+#include "../ext2/ext2_reader.h"
+#include "../fat16/fat16_reader.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+struct FsVolume {
+    Image image;
+    char *path;             // Copy of the path, the image keeps a pointer to it
+    FsType type;
+    union {
+        Ext2Volume ext2;
+        Fat16Volume fat16;
+    } fs;
+};
+
+// Error de una función de los lectores que ha fallado, según el errno que ha dejado
+static int fs_reader_error(void) {
+    return errno == ENOMEM ? FS_ERR_NO_MEMORY : FS_ERR_IO;
+}
+
+// Contexto de las operaciones de fs_walk del sistema de archivos del volumen
+typedef union {
+    Ext2WalkContext ext2;
+    Fat16WalkContext fat16;
+} FsWalkContext;
+
+struct FsDir {
+    FsVolume *volume;
+    FsWalkContext walk;
+    const FsWalkOps *ops;
+    void *cursor;
+    FsWalkWindow window;    // Entries of the last block read
+    size_t index;           // Next entry of the window
+    int ended;
+};
+
+// Tramo de un fichero en bytes; physical 0 es un agujero
+typedef struct {
+    uint64_t logical;
+    uint64_t physical;
+    uint64_t length;
+} FsFileExtent;
+
+struct FsFile {
+    FsVolume *volume;
+    uint64_t size;
+    FsFileExtent *extents;  // Sorted by logical offset
+    size_t extent_count;
+};
+
+// Entrada encontrada al resolver un camino, con una copia de lo que vive en la ventana del directorio
+typedef struct {
+    FsWalkItem item;        // name and node are not valid; node is restored from inode
+    Ext2Inode inode;        // Inode of an EXT2 directory, to open it without reading it again
+    int has_inode;
+    int is_root;
+} FsLookup;
+
+/**
+ * @brief Opens an image and parses its file system.
+ *
+ * @param path Path of the image.
+ * @param volume Where the handle is stored.
+ *
+ * @return FS_OK, FS_ERR_UNKNOWN_FS, or the error of fs_error_from_errno if the image cannot be opened.
+*/
+int fs_open(const char *path, FsVolume **volume) {
+    return fs_open_flags(path, 0, volume);
+}
+
+/**
+ * @brief Opens an image like fs_open, choosing how it is read.
+ *
+ * Processes that keep volumes open for a long time should pass FS_OPEN_NO_MMAP: if
+ * another program truncates a mapped image, the next read of the lost part raises
+ * SIGBUS, while with pread it only fails with FS_ERR_IO.
+ *
+ * @param path Path of the image.
+ * @param flags 0 or FS_OPEN_NO_MMAP.
+ * @param volume Where the handle is stored.
+ *
+ * @return FS_OK, FS_ERR_UNKNOWN_FS, or the error of fs_error_from_errno if the image cannot be opened.
+*/
+int fs_open_flags(const char *path, int flags, FsVolume **volume) {
+    if (path == NULL || volume == NULL) return FS_ERR_INVALID;
+
+    FsVolume *opened = calloc(1, sizeof(FsVolume));
+    if (opened == NULL || (opened->path = strdup(path)) == NULL) {
+        free(opened);
+        return FS_ERR_NO_MEMORY;
+    }
+
+    if (image_open_flags(&opened->image, opened->path, flags & FS_OPEN_NO_MMAP ? IMAGE_OPEN_NO_MMAP : 0) != 0) {
+        int result = fs_error_from_errno(errno);
+        free(opened->path);
+        free(opened);
+        return result;
+    }
+
+    int result = FS_OK;
+    if (is_ext2(&opened->image)) {
+        opened->type = FS_TYPE_EXT2;
+        if (ext2_open_volume(&opened->image, &opened->fs.ext2) != 0) result = fs_reader_error();
+    } else if (is_fat16(&opened->image)) {
+        opened->type = FS_TYPE_FAT16;
+        if (fat16_open_volume(&opened->image, &opened->fs.fat16) != 0) result = fs_reader_error();
+    } else {
+        result = FS_ERR_UNKNOWN_FS;
+    }
+
+    if (result != FS_OK) {
+        image_close(&opened->image);
+        free(opened->path);
+        free(opened);
+        return result;
+    }
+    *volume = opened;
+    return FS_OK;
+}
+
+/**
+ * @brief Releases a volume. The directories and files opened from it must be closed first.
+ *
+ * @param volume Volume to close, NULL is ignored.
+ *
+ * @return void
+*/
+void fs_close(FsVolume *volume) {
+    if (volume == NULL) return;
+
+    if (volume->type == FS_TYPE_EXT2) {
+        ext2_close_volume(&volume->fs.ext2);
+    } else {
+        fat16_close_volume(&volume->fs.fat16);
+    }
+    image_close(&volume->image);
+    free(volume->path);
+    free(volume);
+}
+
+/**
+ * @brief Returns the file system of a volume.
+ *
+ * @param volume Open volume.
+ *
+ * @return FS_TYPE_EXT2 or FS_TYPE_FAT16.
+*/
+FsType fs_volume_type(const FsVolume *volume) {
+    return volume->type;
+}
+
+// Copia un nombre de longitud fija quitando los espacios y NUL del final
+static void fs_copy_label(char *label, const char *raw, size_t length) {
+    while (length > 0 && (raw[length - 1] == ' ' || raw[length - 1] == '\0')) length--;
+    memcpy(label, raw, length);
+    label[length] = '\0';
+}
+
+/**
+ * @brief Returns the general information of a volume.
+ *
+ * @param volume Open volume.
+ * @param info Where the information is stored.
+ *
+ * @return FS_OK, FS_ERR_IO or FS_ERR_INVALID.
+*/
+int fs_volume_info(FsVolume *volume, FsVolumeInfo *info) {
+    if (volume == NULL || info == NULL) return FS_ERR_INVALID;
+
+    memset(info, 0, sizeof(FsVolumeInfo));
+    info->type = volume->type;
+    if (volume->type == FS_TYPE_EXT2) {
+        const Ext2Superblock *sb = &volume->fs.ext2.superblock;
+        info->block_size = volume->fs.ext2.block_size;
+        info->total_blocks = sb->total_blocks;
+        info->free_blocks = sb->free_blocks;
+        info->total_inodes = sb->total_inodes;
+        info->free_inodes = sb->free_inodes;
+        fs_copy_label(info->label, sb->volume_name, sizeof(sb->volume_name));
+    } else {
+        const BootSector *bpb = &volume->fs.fat16.boot_sector;
+        info->block_size = (uint32_t)bpb->sectors_per_cluster * bpb->sector_size;
+        info->total_blocks = fat16_data_clusters(bpb);
+        info->free_blocks = fat16_count_free_clusters(&volume->fs.fat16);
+        fs_copy_label(info->label, bpb->volume_label, sizeof(bpb->volume_label));
+    }
+    return FS_OK;
+}
+
+/**
+ * @brief Writes the directory tree of a volume to a descriptor, as --tree prints it.
+ *
+ * Colors are only used if the descriptor is a terminal. Trees of different volumes can
+ * be written at the same time from different threads. A directory that cannot be read is
+ * left out of the tree and the call returns FS_ERR_IO after writing the rest.
+ *
+ * @param volume Open volume.
+ * @param fd Destination descriptor.
+ *
+ * @return FS_OK, FS_ERR_IO or FS_ERR_NO_MEMORY.
+*/
+int fs_tree(FsVolume *volume, int fd) {
+    TreeRender render;
+    int walked, walk_error;
+
+    if (volume == NULL || fd < 0) return FS_ERR_INVALID;
+
+    if (volume->type == FS_TYPE_EXT2) {
+        volume->fs.ext2.walk_error = 0;
+        tree_render_begin(&render, fd, TREE_STYLE_EXT2);
+        walked = dfs_ext2(&volume->fs.ext2, &render) == 0 ? FS_OK : fs_reader_error();
+        walk_error = volume->fs.ext2.walk_error;
+    } else {
+        volume->fs.fat16.walk_error = 0;
+        tree_render_begin(&render, fd, TREE_STYLE_FAT16);
+        walked = fat16_recursion_tree(&volume->fs.fat16, &render) == 0 ? FS_OK : fs_reader_error();
+        walk_error = volume->fs.fat16.walk_error;
+    }
+    if (tree_render_end(&render) != 0) return FS_ERR_IO;
+    if (walked != FS_OK) return walked;
+    return walk_error == 0 ? FS_OK : FS_ERR_IO;
+}
+
+// Prepara un iterador sobre un directorio, el raíz si lookup es el de la raíz
+static int fs_dir_start(FsVolume *volume, FsDir *dir, const FsLookup *lookup) {
+    memset(dir, 0, sizeof(FsDir));
+    dir->volume = volume;
+
+    int failed;
+    if (volume->type == FS_TYPE_EXT2) {
+        dir->ops = &ext2_walk_ops;
+        failed = ext2_walk_init(&dir->walk.ext2, &volume->fs.ext2, 1) != 0;
+    } else {
+        dir->ops = &fat16_walk_ops;
+        failed = fat16_walk_init(&dir->walk.fat16, &volume->fs.fat16, 0) != 0;
+    }
+    if (failed || (dir->cursor = malloc(dir->ops->cursor_size)) == NULL) {
+        // The context is released here; without a cursor the iterator is never stopped
+        if (volume->type == FS_TYPE_EXT2) {
+            ext2_walk_destroy(&dir->walk.ext2);
+        } else {
+            fat16_walk_destroy(&dir->walk.fat16);
+        }
+        return FS_ERR_NO_MEMORY;
+    }
+
+    FsWalkItem directory = lookup->item;
+    directory.node = lookup->has_inode ? &lookup->inode : NULL;
+    if (dir->ops->open(&dir->walk, lookup->is_root ? NULL : &directory, dir->cursor) != 0) {
+        dir->ended = 1;
+        return FS_ERR_IO;
+    }
+    return FS_OK;
+}
+
+static void fs_dir_stop(FsDir *dir) {
+    if (dir->volume->type == FS_TYPE_EXT2) {
+        ext2_walk_destroy(&dir->walk.ext2);
+    } else {
+        fat16_walk_destroy(&dir->walk.fat16);
+    }
+    fs_walk_window_free(&dir->window);
+    free(dir->cursor);
+}
+
+// Devuelve la siguiente entrada del directorio, leyendo otro bloque cuando la ventana se acaba
+static int fs_dir_next(FsDir *dir, const FsWalkItem **item) {
+    while (dir->index == dir->window.count) {
+        if (dir->ended) return 0;
+
+        fs_walk_window_reset(&dir->window);
+        dir->index = 0;
+        int result = dir->ops->read_block(&dir->walk, dir->cursor, &dir->window);
+        if (result < 0) {
+            dir->ended = 1;
+            return FS_ERR_IO;
+        }
+        if (result == 0) dir->ended = 1;
+    }
+    *item = &dir->window.items[dir->index++];
+    return 1;
+}
+
+// Paso de fs_lookup en EXT2: el nombre se busca con el htree del directorio si lo tiene
+static int fs_lookup_ext2(FsVolume *volume, FsLookup *lookup, const char *name, size_t length) {
+    Ext2Volume *ext2 = &volume->fs.ext2;
+    Ext2Inode directory;
+    uint32_t inode_num;
+
+    if (lookup->has_inode) {
+        directory = lookup->inode;
+    } else if (read_ext2_inode(ext2, lookup->item.key, &directory) != 0) {
+        return FS_ERR_IO;
+    }
+
+    int found = ext2_dir_lookup(ext2, &directory, name, length, &inode_num);
+    if (found != 1) return found == 0 ? FS_ERR_NOT_FOUND : FS_ERR_IO;
+    if (read_ext2_inode(ext2, inode_num, &lookup->inode) != 0) return FS_ERR_IO;
+
+    memset(&lookup->item, 0, sizeof(FsWalkItem));
+    lookup->item.key = inode_num;
+    lookup->item.size = ext2_inode_size(&lookup->inode);
+    lookup->item.is_directory = (lookup->inode.mode & 0xF000) == 0x4000;
+    lookup->item.explore = lookup->item.is_directory;
+    lookup->has_inode = 1;
+    lookup->is_root = 0;
+    return FS_OK;
+}
+
+// Resuelve un camino absoluto, componente a componente
+static int fs_lookup(FsVolume *volume, const char *path, FsLookup *lookup) {
+    if (path == NULL || path[0] != '/') return FS_ERR_INVALID;
+
+    memset(lookup, 0, sizeof(FsLookup));
+    lookup->is_root = 1;
+    lookup->item.is_directory = 1;
+    lookup->item.key = volume->type == FS_TYPE_EXT2 ? EXT2_ROOT_INODE : 0;
+
+    const char *component = path;
+    while (*component != '\0') {
+        while (*component == '/') component++;
+        if (*component == '\0') break;
+        size_t length = strcspn(component, "/");
+
+        if (!lookup->item.is_directory) return FS_ERR_NOT_DIRECTORY;
+
+        if (volume->type == FS_TYPE_EXT2) {
+            int result = fs_lookup_ext2(volume, lookup, component, length);
+            if (result != FS_OK) return result;
+            component += length;
+            continue;
+        }
+
+        FsDir dir;
+        int result = fs_dir_start(volume, &dir, lookup);
+        const FsWalkItem *item = NULL;
+        while (result == FS_OK) {
+            int next = fs_dir_next(&dir, &item);
+            if (next <= 0) {
+                result = next == 0 ? FS_ERR_NOT_FOUND : next;
+            } else if (item->name_len == length && memcmp(item->name, component, length) == 0) {
+                break;
+            }
+        }
+
+        if (result == FS_OK) {
+            lookup->item = *item;
+            lookup->item.name = NULL;
+            lookup->item.node = NULL;
+            lookup->is_root = 0;
+            lookup->has_inode = item->node != NULL && volume->type == FS_TYPE_EXT2;
+            if (lookup->has_inode) memcpy(&lookup->inode, item->node, sizeof(Ext2Inode));
+        }
+        if (dir.cursor != NULL) fs_dir_stop(&dir);
+        if (result != FS_OK) return result;
+
+        component += length;
+    }
+    return FS_OK;
+}
+
+/**
+ * @brief Looks up a path and returns its metadata.
+ *
+ * @param volume Open volume.
+ * @param path Absolute path, "/" for the root directory.
+ * @param stat Where the metadata is stored.
+ *
+ * @return FS_OK or a negative FsError.
+*/
+int fs_stat_path(FsVolume *volume, const char *path, FsStat *stat) {
+    if (volume == NULL || stat == NULL) return FS_ERR_INVALID;
+
+    FsLookup lookup;
+    int result = fs_lookup(volume, path, &lookup);
+    if (result != FS_OK) return result;
+
+    memset(stat, 0, sizeof(FsStat));
+    stat->key = lookup.item.key;
+    stat->is_directory = lookup.item.is_directory;
+
+    if (volume->type == FS_TYPE_EXT2) {
+        Ext2Inode inode;
+        if (read_ext2_inode(&volume->fs.ext2, lookup.item.key, &inode) != 0) return FS_ERR_IO;
+        stat->size = ext2_inode_size(&inode);
+        stat->mode = inode.mode;
+        stat->mtime = inode.mtime;
+        stat->links = inode.links_count;
+    } else {
+        stat->size = lookup.item.size;
+        stat->mode = lookup.item.is_directory ? 040755 : 0100644;
+        stat->links = 1;
+    }
+    return FS_OK;
+}
+
+/**
+ * @brief Opens a directory to iterate its entries with fs_readdir.
+ *
+ * The directory is read one block at a time, so the memory of the iterator does not
+ * depend on the size of the directory.
+ *
+ * @param volume Open volume.
+ * @param path Absolute path of the directory.
+ * @param dir Where the iterator is stored.
+ *
+ * @return FS_OK or a negative FsError.
+*/
+int fs_opendir(FsVolume *volume, const char *path, FsDir **dir) {
+    if (volume == NULL || dir == NULL) return FS_ERR_INVALID;
+
+    FsLookup lookup;
+    int result = fs_lookup(volume, path, &lookup);
+    if (result != FS_OK) return result;
+    if (!lookup.item.is_directory) return FS_ERR_NOT_DIRECTORY;
+
+    FsDir *opened = malloc(sizeof(FsDir));
+    if (opened == NULL) return FS_ERR_NO_MEMORY;
+    if ((result = fs_dir_start(volume, opened, &lookup)) != FS_OK) {
+        if (opened->cursor != NULL) fs_dir_stop(opened);
+        free(opened);
+        return result;
+    }
+    *dir = opened;
+    return FS_OK;
+}
+
+/**
+ * @brief Reads the next entry of a directory. "." and ".." are not returned.
+ *
+ * @param dir Iterator of fs_opendir.
+ * @param entry Where the entry is stored.
+ *
+ * @return 1 if an entry was read, 0 at the end of the directory, or a negative FsError.
+*/
+int fs_readdir(FsDir *dir, FsDirEntry *entry) {
+    if (dir == NULL || entry == NULL) return FS_ERR_INVALID;
+
+    const FsWalkItem *item;
+    int result = fs_dir_next(dir, &item);
+    if (result <= 0) return result;
+
+    entry->name = item->name;
+    entry->name_len = item->name_len;
+    entry->size = item->size;
+    entry->key = item->key;
+    entry->is_directory = item->is_directory;
+    return 1;
+}
+
+/**
+ * @brief Releases a directory iterator.
+ *
+ * @param dir Iterator to close, NULL is ignored.
+ *
+ * @return void
+*/
+void fs_closedir(FsDir *dir) {
+    if (dir == NULL) return;
+    fs_dir_stop(dir);
+    free(dir);
+}
+
+// Mapa de bloques de un fichero EXT2 pasado a bytes
+static int fs_file_map_ext2(FsFile *file, uint32_t inode_num) {
+    Ext2Volume *ext2 = &file->volume->fs.ext2;
+    Ext2Inode inode;
+    Ext2Extent *extents;
+    size_t count;
+
+    if (read_ext2_inode(ext2, inode_num, &inode) != 0) return FS_ERR_IO;
+    if (ext2_build_extents(ext2, &inode, &extents, &count) != 0) return FS_ERR_IO;
+
+    file->size = ext2_inode_size(&inode);
+    file->extents = malloc((count ? count : 1) * sizeof(FsFileExtent));
+    if (file->extents == NULL) {
+        free(extents);
+        return FS_ERR_NO_MEMORY;
+    }
+    for (size_t i = 0; i < count; i++) {
+        file->extents[i].logical = (uint64_t)extents[i].logical * ext2->block_size;
+        file->extents[i].physical = (uint64_t)extents[i].physical * ext2->block_size;
+        file->extents[i].length = (uint64_t)extents[i].length * ext2->block_size;
+    }
+    file->extent_count = count;
+    free(extents);
+    return FS_OK;
+}
+
+// Cadena de clusters de un fichero FAT16 pasada a bytes
+static int fs_file_map_fat16(FsFile *file, uint16_t start_cluster, uint64_t size) {
+    Fat16Volume *fat16 = &file->volume->fs.fat16;
+    const BootSector *bpb = &fat16->boot_sector;
+    uint64_t cluster_size = (uint64_t)bpb->sectors_per_cluster * bpb->sector_size;
+    Fat16Extent *extents;
+    size_t count;
+
+    if (fat16_chain_extents(&fat16->fat, start_cluster, &extents, &count) != 0) return FS_ERR_NO_MEMORY;
+
+    file->size = size;
+    file->extents = malloc((count ? count : 1) * sizeof(FsFileExtent));
+    if (file->extents == NULL) {
+        free(extents);
+        return FS_ERR_NO_MEMORY;
+    }
+    uint64_t logical = 0;
+    for (size_t i = 0; i < count; i++) {
+        file->extents[i].logical = logical;
+        file->extents[i].physical = (uint64_t)calculate_first_sector_of_cluster(extents[i].start_cluster, *bpb) * bpb->sector_size;
+        file->extents[i].length = extents[i].length * cluster_size;
+        logical += file->extents[i].length;
+    }
+    file->extent_count = count;
+    free(extents);
+    return FS_OK;
+}
+
+/**
+ * @brief Opens a file for fs_pread. Its block or cluster map is built once here.
+ *
+ * @param volume Open volume.
+ * @param path Absolute path of the file.
+ * @param file Where the handle is stored.
+ *
+ * @return FS_OK or a negative FsError.
+*/
+int fs_open_file(FsVolume *volume, const char *path, FsFile **file) {
+    if (volume == NULL || file == NULL) return FS_ERR_INVALID;
+
+    FsLookup lookup;
+    int result = fs_lookup(volume, path, &lookup);
+    if (result != FS_OK) return result;
+    if (lookup.item.is_directory) return FS_ERR_IS_DIRECTORY;
+
+    FsFile *opened = calloc(1, sizeof(FsFile));
+    if (opened == NULL) return FS_ERR_NO_MEMORY;
+    opened->volume = volume;
+
+    result = volume->type == FS_TYPE_EXT2
+        ? fs_file_map_ext2(opened, lookup.item.key)
+        : fs_file_map_fat16(opened, (uint16_t)lookup.item.key, lookup.item.size);
+    if (result != FS_OK) {
+        free(opened);
+        return result;
+    }
+    *file = opened;
+    return FS_OK;
+}
+
+/**
+ * @brief Returns the size in bytes of an open file.
+ *
+ * @param file Open file.
+ *
+ * @return Size of the file.
+*/
+uint64_t fs_file_size(const FsFile *file) {
+    return file->size;
+}
+
+// Primer tramo que acaba después de offset, extent_count si no hay ninguno
+static size_t fs_file_find_extent(const FsFile *file, uint64_t offset) {
+    size_t low = 0, high = file->extent_count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (file->extents[middle].logical + file->extents[middle].length <= offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Destino de fs_file_copy: un buffer si no es NULL, si no un descriptor
+typedef struct {
+    uint8_t *buffer;
+    int fd;
+} FsFileCopy;
+
+// Copia un rango ya recortado al tamaño del fichero, tramo a tramo; los agujeros son ceros
+static int fs_file_copy(FsFile *file, uint64_t offset, uint64_t length, FsFileCopy *copy) {
+    uint64_t done = 0;
+    size_t e = fs_file_find_extent(file, offset);
+
+    while (done < length) {
+        uint64_t position = offset + done;
+        const FsFileExtent *extent = e < file->extent_count ? &file->extents[e] : NULL;
+        uint64_t chunk = length - done;
+        int failed;
+
+        // Antes del siguiente tramo, o después del último, el fichero es un agujero
+        if (extent == NULL || position < extent->logical || extent->physical == 0) {
+            uint64_t hole_end = extent == NULL ? file->size
+                              : position < extent->logical ? extent->logical : extent->logical + extent->length;
+            if (hole_end - position < chunk) chunk = hole_end - position;
+            if (copy->buffer != NULL) {
+                memset(copy->buffer + done, 0, chunk);
+                failed = 0;
+            } else {
+                failed = output_zeros(copy->fd, chunk) != 0;
+            }
+        } else {
+            uint64_t inside = position - extent->logical;
+            if (extent->length - inside < chunk) chunk = extent->length - inside;
+            if (copy->buffer != NULL) {
+                failed = image_read(&file->volume->image, extent->physical + inside, copy->buffer + done, chunk) != (ssize_t)chunk;
+            } else {
+                failed = output_image_range(&file->volume->image, extent->physical + inside, chunk, copy->fd) != 0;
+            }
+        }
+        if (failed) return FS_ERR_IO;
+
+        done += chunk;
+        if (extent != NULL && position + chunk >= extent->logical + extent->length) e++;
+    }
+    return FS_OK;
+}
+
+/**
+ * @brief Reads a range of a file. Holes read as zeros.
+ *
+ * @param file Open file.
+ * @param buffer Destination, at least length bytes.
+ * @param length Number of bytes to read.
+ * @param offset Offset in the file.
+ *
+ * @return Bytes read (less than length at the end of the file, 0 past it) or a negative FsError.
+*/
+ssize_t fs_pread(FsFile *file, void *buffer, size_t length, uint64_t offset) {
+    if (file == NULL || (buffer == NULL && length > 0)) return FS_ERR_INVALID;
+    if (offset >= file->size) return 0;
+    if (length > file->size - offset) length = file->size - offset;
+    if (length > SSIZE_MAX) length = SSIZE_MAX;
+
+    FsFileCopy copy = { .buffer = buffer };
+    int result = fs_file_copy(file, offset, length, &copy);
+    return result == FS_OK ? (ssize_t)length : result;
+}
+
+/**
+ * @brief Sends a range of a file to a descriptor without copying it through user space.
+ *
+ * The data goes from the image to the descriptor with copy_file_range or sendfile when
+ * the kernel allows it (files, pipes and sockets); holes are written as zeros. It only
+ * reads the image, so several files of a volume can be sent at the same time.
+ *
+ * @param file Open file.
+ * @param fd Destination descriptor.
+ * @param offset Offset in the file.
+ * @param length Number of bytes, cut at the end of the file.
+ *
+ * @return FS_OK or FS_ERR_IO.
+*/
+int fs_send_file(FsFile *file, int fd, uint64_t offset, uint64_t length) {
+    if (file == NULL || fd < 0) return FS_ERR_INVALID;
+    if (offset >= file->size) return FS_OK;
+    if (length > file->size - offset) length = file->size - offset;
+
+    FsFileCopy copy = { .fd = fd };
+    return fs_file_copy(file, offset, length, &copy);
+}
+
+/**
+ * @brief Releases a file handle.
+ *
+ * @param file File to close, NULL is ignored.
+ *
+ * @return void
+*/
+void fs_close_file(FsFile *file) {
+    if (file == NULL) return;
+    free(file->extents);
+    free(file);
+}
+
+/**
+ * @brief Converts the errno of a failed system call on a path to an error code.
+ *
+ * @param error errno value.
+ *
+ * @return FS_ERR_NOT_FOUND, FS_ERR_PERMISSION, FS_ERR_INVALID, FS_ERR_NO_MEMORY or FS_ERR_IO.
+*/
+int fs_error_from_errno(int error) {
+    switch (error) {
+        case ENOENT:
+        case ENOTDIR: return FS_ERR_NOT_FOUND;
+        case EACCES:
+        case EPERM: return FS_ERR_PERMISSION;
+        case ELOOP:
+        case ENAMETOOLONG:
+        case EINVAL: return FS_ERR_INVALID;
+        case ENOMEM: return FS_ERR_NO_MEMORY;
+        default: return FS_ERR_IO;
+    }
+}
+
+/**
+ * @brief Describes an error code.
+ *
+ * @param error FsError value.
+ *
+ * @return Static string.
+*/
+const char *fs_strerror(int error) {
+    switch (error) {
+        case FS_OK: return "Success";
+        case FS_ERR_IO: return "Error reading the image";
+        case FS_ERR_NO_MEMORY: return "Out of memory";
+        case FS_ERR_UNKNOWN_FS: return "Unknown file system";
+        case FS_ERR_NOT_FOUND: return "No such file or directory";
+        case FS_ERR_NOT_DIRECTORY: return "Not a directory";
+        case FS_ERR_IS_DIRECTORY: return "Is a directory";
+        case FS_ERR_INVALID: return "Invalid argument";
+        case FS_ERR_PERMISSION: return "Permission denied";
+        default: return "Unknown error";
+    }
+}
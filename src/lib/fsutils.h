@@ -0,0 +1,264 @@
+#ifndef _FSUTILS_H
+#define _FSUTILS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * libfsutils: read-only access to EXT2 and FAT16 images through a volume handle.
+ *
+ * A volume is probed and parsed once by fs_open; the superblock or boot sector, the group
+ * descriptors or the FAT and the metadata caches stay in the handle until fs_close. No
+ * function declared here prints or exits: every error is returned as a negative FsError.
+ * A volume and the handles opened from it must not be used by several threads at the same
+ * time, except fs_pread and fs_send_file on files already open.
+ *
+ * Paths are absolute, with '/' between components. FAT16 names are the lower case 8.3
+ * names that --tree shows.
+ */
+
+// Códigos de error, siempre negativos
+typedef enum {
+    FS_OK = 0,
+    FS_ERR_IO = -1,             // The image could not be opened or read
+    FS_ERR_NO_MEMORY = -2,
+    FS_ERR_UNKNOWN_FS = -3,     // The image is neither EXT2 nor FAT16
+    FS_ERR_NOT_FOUND = -4,
+    FS_ERR_NOT_DIRECTORY = -5,  // A component of the path is not a directory
+    FS_ERR_IS_DIRECTORY = -6,   // fs_open_file on a directory
+    FS_ERR_INVALID = -7,        // Invalid argument
+    FS_ERR_PERMISSION = -8      // The image cannot be accessed by this process
+} FsError;
+
+// Flags de fs_open_flags
+typedef enum {
+    FS_OPEN_NO_MMAP = 1         // Read the image with pread, never through a mapping
+} FsOpenFlag;
+
+typedef enum {
+    FS_TYPE_EXT2,
+    FS_TYPE_FAT16
+} FsType;
+
+typedef struct FsVolume FsVolume;
+typedef struct FsDir FsDir;
+typedef struct FsFile FsFile;
+
+// Metadatos de una entrada
+typedef struct {
+    uint64_t size;          // Size in bytes
+    uint32_t key;           // Inode (EXT2) or first cluster (FAT16)
+    uint32_t mode;          // Type and permissions; on FAT16 040755 for directories, 0100644 for files
+    uint32_t mtime;         // Modification time, 0 on FAT16
+    uint16_t links;         // Hard links, 1 on FAT16
+    int is_directory;
+} FsStat;
+
+// Datos generales de un volumen
+typedef struct {
+    FsType type;
+    uint32_t block_size;    // Block (EXT2) or cluster (FAT16) size in bytes
+    uint64_t total_blocks;  // Blocks, or clusters of the data region
+    uint64_t free_blocks;   // From the superblock on EXT2, counted in the FAT on FAT16
+    uint64_t total_inodes;  // 0 on FAT16
+    uint64_t free_inodes;
+    char label[17];         // Volume name, NUL terminated
+} FsVolumeInfo;
+
+// Entrada leída con fs_readdir
+typedef struct {
+    const char *name;       // NUL terminated, valid until the next fs_readdir or fs_closedir
+    size_t name_len;
+    uint64_t size;
+    uint32_t key;
+    int is_directory;
+} FsDirEntry;
+
+/**
+ * @brief Opens an image and parses its file system.
+ *
+ * @param path Path of the image.
+ * @param volume Where the handle is stored.
+ *
+ * @return FS_OK, FS_ERR_UNKNOWN_FS, or the error of fs_error_from_errno if the image cannot be opened.
+*/
+int fs_open(const char *path, FsVolume **volume);
+
+/**
+ * @brief Opens an image like fs_open, choosing how it is read.
+ *
+ * Processes that keep volumes open for a long time should pass FS_OPEN_NO_MMAP: if
+ * another program truncates a mapped image, the next read of the lost part raises
+ * SIGBUS, while with pread it only fails with FS_ERR_IO.
+ *
+ * @param path Path of the image.
+ * @param flags 0 or FS_OPEN_NO_MMAP.
+ * @param volume Where the handle is stored.
+ *
+ * @return FS_OK, FS_ERR_UNKNOWN_FS, or the error of fs_error_from_errno if the image cannot be opened.
+*/
+int fs_open_flags(const char *path, int flags, FsVolume **volume);
+
+/**
+ * @brief Releases a volume. The directories and files opened from it must be closed first.
+ *
+ * @param volume Volume to close, NULL is ignored.
+ *
+ * @return void
+*/
+void fs_close(FsVolume *volume);
+
+/**
+ * @brief Returns the file system of a volume.
+ *
+ * @param volume Open volume.
+ *
+ * @return FS_TYPE_EXT2 or FS_TYPE_FAT16.
+*/
+FsType fs_volume_type(const FsVolume *volume);
+
+/**
+ * @brief Returns the general information of a volume.
+ *
+ * @param volume Open volume.
+ * @param info Where the information is stored.
+ *
+ * @return FS_OK, FS_ERR_IO or FS_ERR_INVALID.
+*/
+int fs_volume_info(FsVolume *volume, FsVolumeInfo *info);
+
+/**
+ * @brief Writes the directory tree of a volume to a descriptor, as --tree prints it.
+ *
+ * Colors are only used if the descriptor is a terminal. Trees of different volumes can
+ * be written at the same time from different threads. A directory that cannot be read is
+ * left out of the tree and the call returns FS_ERR_IO after writing the rest.
+ *
+ * @param volume Open volume.
+ * @param fd Destination descriptor.
+ *
+ * @return FS_OK, FS_ERR_IO or FS_ERR_NO_MEMORY.
+*/
+int fs_tree(FsVolume *volume, int fd);
+
+/**
+ * @brief Looks up a path and returns its metadata.
+ *
+ * @param volume Open volume.
+ * @param path Absolute path, "/" for the root directory.
+ * @param stat Where the metadata is stored.
+ *
+ * @return FS_OK or a negative FsError.
+*/
+int fs_stat_path(FsVolume *volume, const char *path, FsStat *stat);
+
+/**
+ * @brief Opens a directory to iterate its entries with fs_readdir.
+ *
+ * The directory is read one block at a time, so the memory of the iterator does not
+ * depend on the size of the directory.
+ *
+ * @param volume Open volume.
+ * @param path Absolute path of the directory.
+ * @param dir Where the iterator is stored.
+ *
+ * @return FS_OK or a negative FsError.
+*/
+int fs_opendir(FsVolume *volume, const char *path, FsDir **dir);
+
+/**
+ * @brief Reads the next entry of a directory. "." and ".." are not returned.
+ *
+ * @param dir Iterator of fs_opendir.
+ * @param entry Where the entry is stored.
+ *
+ * @return 1 if an entry was read, 0 at the end of the directory, or a negative FsError.
+*/
+int fs_readdir(FsDir *dir, FsDirEntry *entry);
+
+/**
+ * @brief Releases a directory iterator.
+ *
+ * @param dir Iterator to close, NULL is ignored.
+ *
+ * @return void
+*/
+void fs_closedir(FsDir *dir);
+
+/**
+ * @brief Opens a file for fs_pread. Its block or cluster map is built once here.
+ *
+ * @param volume Open volume.
+ * @param path Absolute path of the file.
+ * @param file Where the handle is stored.
+ *
+ * @return FS_OK or a negative FsError.
+*/
+int fs_open_file(FsVolume *volume, const char *path, FsFile **file);
+
+/**
+ * @brief Returns the size in bytes of an open file.
+ *
+ * @param file Open file.
+ *
+ * @return Size of the file.
+*/
+uint64_t fs_file_size(const FsFile *file);
+
+/**
+ * @brief Reads a range of a file. Holes read as zeros.
+ *
+ * @param file Open file.
+ * @param buffer Destination, at least length bytes.
+ * @param length Number of bytes to read.
+ * @param offset Offset in the file.
+ *
+ * @return Bytes read (less than length at the end of the file, 0 past it) or a negative FsError.
+*/
+ssize_t fs_pread(FsFile *file, void *buffer, size_t length, uint64_t offset);
+
+/**
+ * @brief Sends a range of a file to a descriptor without copying it through user space.
+ *
+ * The data goes from the image to the descriptor with copy_file_range or sendfile when
+ * the kernel allows it (files, pipes and sockets); holes are written as zeros. It only
+ * reads the image, so several files of a volume can be sent at the same time.
+ *
+ * @param file Open file.
+ * @param fd Destination descriptor.
+ * @param offset Offset in the file.
+ * @param length Number of bytes, cut at the end of the file.
+ *
+ * @return FS_OK or FS_ERR_IO.
+*/
+int fs_send_file(FsFile *file, int fd, uint64_t offset, uint64_t length);
+
+/**
+ * @brief Releases a file handle.
+ *
+ * @param file File to close, NULL is ignored.
+ *
+ * @return void
+*/
+void fs_close_file(FsFile *file);
+
+/**
+ * @brief Converts the errno of a failed system call on a path to an error code.
+ *
+ * @param error errno value.
+ *
+ * @return FS_ERR_NOT_FOUND, FS_ERR_PERMISSION, FS_ERR_INVALID, FS_ERR_NO_MEMORY or FS_ERR_IO.
+*/
+int fs_error_from_errno(int error);
+
+/**
+ * @brief Describes an error code.
+ *
+ * @param error FsError value.
+ *
+ * @return Static string.
+*/
+const char *fs_strerror(int error);
+
+#endif // !_FSUTILS_H
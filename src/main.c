@@ -4,50 +4,205 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include "common/image.h"
+#include "common/thread_pool.h"
 #include "common/tree.h"
 #include "common/info.h"
 #include "common/cat.h"
 #include "common/cat.h"
+#include "common/index.h"
+#include "common/stats.h"
+#include "common/scan.h"
+#include "common/serve.h"
+#include "common/extract.h"
+#include "common/grep.h"
+#include "common/manifest.h"
+#include "common/diff.h"
+#include "common/owner.h"
 
 int main(int argc, char *argv[]) {
-    if ((argc != 3 && (!strcmp(argv[1], "--info") || (!strcmp(argv[1], "--tree")))) || // If the command is info or tree it must have 3 arguments
-        (argc != 4 && !strcmp(argv[1], "--cat")))                                      // Else if the command is cat it must have 4 arguments
+    if (argc < 3) 
     {
         printf("Invalid number of arguments\n");
         return EXIT_FAILURE;
     }
 
-    // Open the file system image file
-    int fd = open(argv[2], O_RDONLY);
-    if (fd == -1) 
+    // The client only talks to a server: --client <socket> <command> <image> [path]
+    if (strcmp(argv[1], "--client") == 0) 
+    {
+        if (argc != 5 && argc != 6) 
+        {
+            printf("Invalid number of arguments\n");
+            return EXIT_FAILURE;
+        }
+        return client_command(argv[2], argv[3], argv[4], argc == 6 ? argv[5] : NULL) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Options go after the positional arguments: --tree <image> --threads N --stats
+    int extract = !strcmp(argv[1], "--extract");
+    int grep = !strcmp(argv[1], "--grep");
+    int manifest = !strcmp(argv[1], "--manifest");
+    int diff = !strcmp(argv[1], "--diff");
+    int owner = !strcmp(argv[1], "--owner");
+    int positional = !strcmp(argv[1], "--cat") || extract || grep || diff || owner ? 4 : 3;
+    const char *paths[argc];            // --extract <image> <dest> [path...], --grep <image> <pattern> [path...], --manifest <image> [path...], --owner <image> <offset> [offset...]
+    size_t path_count = 0;
+    if (owner && argc > 3) 
+    {
+        paths[path_count++] = argv[3];
+    }
+    int threads = 1;
+    int threads_given = 0;
+    int stats = 0;
+    int verify_counts = 0;
+    const char *stats_json = NULL;
+    for (int i = positional; i < argc; i++) 
+    {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) 
+        {
+            threads = atoi(argv[++i]);
+            threads_given = 1;
+            if (threads < 1 || threads > THREAD_POOL_MAX_WORKERS) 
+            {
+                printf("Invalid number of threads\n");
+                return EXIT_FAILURE;
+            }
+        } 
+        else if (!strcmp(argv[i], "--verify-counts")) 
+        {
+            verify_counts = 1;
+        } 
+        else if (!strcmp(argv[i], "--stats")) 
+        {
+            stats = 1;
+        } 
+        else if (!strcmp(argv[i], "--stats-json") && i + 1 < argc) 
+        {
+            stats = 1;
+            stats_json = argv[++i];
+        } 
+        else if ((extract || grep || manifest || owner) && strncmp(argv[i], "--", 2) != 0) 
+        {
+            paths[path_count++] = argv[i];
+        } 
+        else 
+        {
+            positional = -1;
+            break;
+        }
+    }
+
+    if (positional == -1 || argc < positional || // Info and tree need 3 arguments, cat, extract, grep, diff and owner need 4
+        (threads > 1 && strcmp(argv[1], "--tree") && strcmp(argv[1], "--scan-inodes") && strcmp(argv[1], "--serve") && !extract && !grep && !manifest && !diff && !owner) ||  // Only the tree walk, the inode scan, the server and the commands that read file contents run in parallel
+        (verify_counts && strcmp(argv[1], "--info")) ||
+        (stats && !strcmp(argv[1], "--serve")))
+    {
+        printf("Invalid number of arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    // The server opens the images of its requests, argv[2] is the socket
+    if (strcmp(argv[1], "--serve") == 0) 
+    {
+        return serve_command(argv[2], threads_given ? threads : SERVE_DEFAULT_WORKERS) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (stats) 
+    {
+        stats_enable();
+    }
+
+    // Open the file system image once, the readers take pointers into its mapping
+    Image image;
+    if (image_open(&image, argv[2]) == -1) 
     {
         perror("Error opening file");
         return EXIT_FAILURE;
     }
 
+    // Everything the commands do outside the probe and the output is the metadata walk
+    stats_phase(STATS_PHASE_WALK);
+
+    int status = EXIT_SUCCESS;
     if (strcmp(argv[1], "--info") == 0) 
     {
-        info_command(fd);
+        if (info_command(&image, verify_counts) != 0) 
+        {
+            status = EXIT_FAILURE;
+        }
     } 
     else if (strcmp(argv[1], "--tree") == 0) 
     {
-        print_file_tree(fd);
+        print_file_tree(&image, threads);
 
     } 
     else if (strcmp(argv[1], "--cat") == 0) 
     {
         char* fileName = argv[3];
         fileName = strcat(fileName, "\0");
-        cat_command(fd, fileName);
+        cat_command(&image, fileName);
+    } 
+    else if (extract) 
+    {
+        if (extract_command(&image, argv[3], paths, path_count, threads) != 0) 
+        {
+            status = EXIT_FAILURE;
+        }
+    } 
+    else if (grep) 
+    {
+        if (grep_command(&image, argv[3], paths, path_count, threads) != 0) 
+        {
+            status = EXIT_FAILURE;
+        }
+    } 
+    else if (manifest) 
+    {
+        if (manifest_command(&image, paths, path_count, threads) != 0) 
+        {
+            status = EXIT_FAILURE;
+        }
+    } 
+    else if (diff) 
+    {
+        if (diff_command(&image, argv[3], threads) != 0) 
+        {
+            status = EXIT_FAILURE;
+        }
+    } 
+    else if (owner) 
+    {
+        if (owner_command(&image, paths, path_count, threads) != 0) 
+        {
+            status = EXIT_FAILURE;
+        }
+    } 
+    else if (strcmp(argv[1], "--build-index") == 0) 
+    {
+        if (build_index_command(&image) != 0) 
+        {
+            status = EXIT_FAILURE;
+        }
+    } 
+    else if (strcmp(argv[1], "--scan-inodes") == 0) 
+    {
+        if (scan_inodes_command(&image, threads) != 0) 
+        {
+            status = EXIT_FAILURE;
+        }
     } 
     else 
     {
         printf("Invalid command.\n");
-        close(fd);
-        return 1;
-
+        status = 1;
     }
 
-    close(fd);
-    return EXIT_SUCCESS;
+    stats_phase(STATS_PHASE_SETUP);
+    image_close(&image);
+    if (stats_report(stats_json) != 0) 
+    {
+        perror("Error writing stats");
+        status = EXIT_FAILURE;
+    }
+    return status;
 }
\ No newline at end of file